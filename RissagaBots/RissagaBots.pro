@@ -0,0 +1,41 @@
+#-------------------------------------------------
+#
+# Load generator: thousands of headless clients against a server.
+#
+#-------------------------------------------------
+
+QT       -= core gui
+
+CONFIG += c++11
+
+TARGET = RissagaBots
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+
+INCLUDEPATH += D:\Projects\Rissaga
+INCLUDEPATH += D:\Projects\Rissaga\GW_SDL2\include
+
+LIBS += -LD:\Projects\Rissaga\GW_SDL2\i686-w64-mingw32\lib -lmingw32 -lSDL2Main -lSDL2 -lSDL2_net
+
+SOURCES += \
+    source/main.cpp \
+    source/bot.cpp \
+    source/swarm.cpp \
+    ../common/snapshot_delta.cpp
+
+HEADERS += \
+    source/bot.h \
+    source/swarm.h \
+    ../common/game_obj.h \
+    ../common/histogram.h \
+    ../common/net_protocol.h \
+    ../common/bitstream.h \
+    ../common/snapshot_delta.h \
+    ../common/state_machine.h \
+    ../common/string.h \
+    ../common/logging.h \
+    ../utils/math.h \
+    ../utils/point.h
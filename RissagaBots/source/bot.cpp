@@ -0,0 +1,174 @@
+#include "bot.h"
+
+#include "SDL_timer.h"
+
+#include "common/snapshot_delta.h"
+
+using namespace Ris;
+
+BotScript::BotScript(Uint32 seed) :
+	m_seed(seed),
+	m_nextEvent(0),
+	m_heldCount(0)
+{
+	m_nextEvent = random() % 20;
+}
+
+void BotScript::keyEvent(SDL_KeyboardEvent &key, SDL_Keycode code, bool pressed)
+{
+	SDL_memset(&key, 0, sizeof(key));
+	key.type = pressed ? SDL_KEYDOWN : SDL_KEYUP;
+	key.state = pressed ? SDL_PRESSED : SDL_RELEASED;
+	key.keysym.sym = code;
+}
+
+bool BotScript::next(Uint32 tick, SDL_KeyboardEvent &key)
+{
+	static const SDL_Keycode arrows[4] = { SDLK_UP, SDLK_RIGHT, SDLK_DOWN, SDLK_LEFT };
+	if ((Sint32)(tick - m_nextEvent) < 0)
+		return false;
+	Uint32 r = random();
+	if (m_heldCount == 0)
+	{
+		// Walk somewhere for half a second to two seconds.
+		m_held[m_heldCount++] = arrows[r & 3];
+		keyEvent(key, m_held[0], true);
+		m_nextEvent = tick + 10 + (r >> 2) % 30;
+	}
+	else if ((m_heldCount == 1) && ((r & 3) == 0))
+	{
+		// Turns diagonal: an arrow next to the held one.
+		int held = 0;
+		while (arrows[held] != m_held[0])
+			held++;
+		m_held[m_heldCount++] = arrows[(held + ((r & 4) ? 1 : 3)) & 3];
+		keyEvent(key, m_held[1], true);
+		m_nextEvent = tick + 5 + (r >> 3) % 15;
+	}
+	else
+	{
+		// Any release stops walking, as it does for players.
+		keyEvent(key, m_held[--m_heldCount], false);
+		m_nextEvent = m_heldCount ? tick : tick + 5 + (r >> 2) % 20;
+	}
+	return true;
+}
+
+Bot::Bot(Uint32 seed) :
+	m_script(seed),
+	m_welcomed(false),
+	m_entity(0),
+	m_lastHello(0),
+	m_outSequence(0),
+	m_tick(0),
+	m_nextInput(0),
+	m_lastApplied(0),
+	m_hasApplied(false)
+{ }
+
+int Bot::hello(Uint8 *data, Uint32 now)
+{
+	if (m_welcomed || (m_lastHello && (now - m_lastHello < HelloInterval)))
+		return 0;
+	m_lastHello = now ? now : 1;
+	Net::ByteWriter w(data, Net::MaxPacketSize);
+	Net::writeHeader(w, Net::MsgHello, m_outSequence++);
+	return w.size();
+}
+
+int Bot::input(Uint8 *data, Uint64 counter)
+{
+	if (!m_welcomed)
+		return 0;
+	SDL_KeyboardEvent key;
+	while (m_script.next(m_tick, key))
+		m_player.checkKeyboard(key);
+	m_tick++;
+
+	Uint16 newest = m_nextInput++;
+	m_dirs[newest % InputHistory] = (Uint8)m_player.walkDirection();
+	m_sentAt[newest % InputHistory] = counter;
+	int count = (m_nextInput < RedundantInputs) ? (int)m_nextInput : (int)RedundantInputs;
+	Uint8 dirs[RedundantInputs];
+	for (int i = 0; i < count; ++i)
+		dirs[i] = m_dirs[(Uint16)(newest - i) % InputHistory];
+	Net::ByteWriter w(data, Net::MaxPacketSize);
+	Net::writeHeader(w, Net::MsgInput, m_outSequence++);
+	Net::writeInputs(w, newest, dirs, count);
+	return w.size();
+}
+
+int Bot::statusRequest(Uint8 *data)
+{
+	Net::ByteWriter w(data, Net::MaxPacketSize);
+	Net::writeHeader(w, Net::MsgStatusRequest, m_outSequence++);
+	return w.size();
+}
+
+int Bot::bye(Uint8 *data)
+{
+	if (!m_welcomed)
+		return 0;
+	m_welcomed = false;
+	Net::ByteWriter w(data, Net::MaxPacketSize);
+	Net::writeHeader(w, Net::MsgBye, m_outSequence++);
+	return w.size();
+}
+
+int Bot::handle(const Uint8 *data, int size, Uint64 counter, BotStats &stats, Uint8 *reply)
+{
+	Net::ByteReader r(data, size);
+	Uint8 type = r.read8();
+	r.read16();
+	if (r.overflow())
+		return 0;
+	switch (type)
+	{
+	case Net::MsgWelcome:
+		m_entity = r.read32();
+		m_welcomed = !r.overflow();
+		break;
+	case Net::MsgPlayerState:
+		{
+			Net::PlayerState state;
+			Net::readPlayerState(r, state);
+			if (r.overflow())
+				break;
+			stats.playerStates++;
+			// Every input applied since last state: one latency sample each.
+			Uint16 first = m_hasApplied ? (Uint16)(m_lastApplied + 1) : state.inputSequence;
+			if (m_hasApplied && !Net::sequenceNewer(state.inputSequence, m_lastApplied))
+				break;
+			Uint64 frequency = SDL_GetPerformanceFrequency();
+			for (Uint16 s = first; (Sint16)(state.inputSequence - s) >= 0; ++s)
+			{
+				if ((Uint16)(m_nextInput - s) > InputHistory)
+					continue;
+				stats.latency.record((Uint32)((counter - m_sentAt[s % InputHistory]) * 1000000 / frequency));
+			}
+			m_lastApplied = state.inputSequence;
+			m_hasApplied = true;
+		}
+		break;
+	case Net::MsgDeltaSnapshot:
+		{
+			Uint16 sequence;
+			Uint32 tick;
+			if (!Net::peekSnapshot(r.current(), r.left(), sequence, tick))
+				break;
+			stats.snapshots++;
+			Net::ByteWriter w(reply, Net::MaxPacketSize);
+			Net::writeHeader(w, Net::MsgSnapshotAck, m_outSequence++);
+			w.write16(sequence);
+			return w.size();
+		}
+	case Net::MsgStatus:
+		Net::readServerStatus(r, stats.status);
+		stats.newStatus = !r.overflow();
+		break;
+	case Net::MsgBye:
+		m_welcomed = false;
+		break;
+	}
+	return 0;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "SDL_events.h"
+
+#include "common/game_obj.h"
+#include "common/histogram.h"
+#include "common/net_protocol.h"
+
+namespace Ris
+{
+	// Keyboard of a bot: presses and releases arrow keys like a player wandering around,
+	// sometimes holding two of them. Same seed, same key events.
+	class BotScript
+	{
+		Uint32 m_seed;
+		Uint32 m_nextEvent;
+		SDL_Keycode m_held[2];
+		int m_heldCount;
+
+		inline Uint32 random() { return (m_seed = m_seed * 1103515245 + 12345) >> 8; }
+		static void keyEvent(SDL_KeyboardEvent &key, SDL_Keycode code, bool pressed);
+
+	public:
+		BotScript(Uint32 seed);
+		// Next key event due on or before tick. Returns false if there is none.
+		bool next(Uint32 tick, SDL_KeyboardEvent &key);
+	};
+
+	// What bots saw. Shared by all of them, as they all run on one thread.
+	struct BotStats
+	{
+		Uint32 packetsIn;
+		Uint32 packetsOut;
+		Uint32 bytesIn;
+		Uint32 bytesOut;
+		Uint32 snapshots;
+		Uint32 playerStates;
+		// From an input being sent to server state telling it was applied.
+		Histogram latency;
+		Net::ServerStatus status;
+		bool newStatus;
+
+		BotStats() : packetsIn(0), packetsOut(0), bytesIn(0), bytesOut(0), snapshots(0), playerStates(0), newStatus(false)
+		{ }
+	};
+
+	// Headless client. Key events go to an AliveObj, exactly as client keyboard does,
+	// and its walking direction is sent as input on every input tick.
+	// Snapshots are acknowledged without decoding them: server does the same work for a bot
+	// than for a player, bot does not keep any world.
+	class Bot
+	{
+	public:
+		enum
+		{
+			InputHistory = 64,
+			// Last inputs repeated on every packet.
+			RedundantInputs = 4,
+			HelloInterval = 500
+		};
+
+	private:
+		AliveObj m_player;
+		BotScript m_script;
+		bool m_welcomed;
+		Uint32 m_entity;
+		Uint32 m_lastHello;
+		Uint16 m_outSequence;
+		Uint32 m_tick;
+		// Inputs by sequence, with performance counter when first sent.
+		Uint16 m_nextInput;
+		Uint8 m_dirs[InputHistory];
+		Uint64 m_sentAt[InputHistory];
+		Uint16 m_lastApplied;
+		bool m_hasApplied;
+
+	public:
+		Bot(Uint32 seed);
+
+		// Packets to send are written on data (Net::MaxPacketSize). They return its size, 0 for none.
+		// Hello while not welcomed, every HelloInterval ms.
+		int hello(Uint8 *data, Uint32 now);
+		// Runs script for one input tick and writes inputs.
+		int input(Uint8 *data, Uint64 counter);
+		int statusRequest(Uint8 *data);
+		int bye(Uint8 *data);
+		// Packet from server. An answer (snapshot ack) may be written on reply.
+		int handle(const Uint8 *data, int size, Uint64 counter, BotStats &stats, Uint8 *reply);
+
+		inline bool welcomed() const { return m_welcomed; }
+		inline Uint32 entity() const { return m_entity; }
+	};
+}
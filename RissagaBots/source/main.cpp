@@ -0,0 +1,73 @@
+#include "SDL.h"
+#include "SDL_net.h"
+
+#include "common/string.h"
+#include "common/logging.h"
+#include "swarm.h"
+
+#include <stdlib.h>
+
+using namespace Ris;
+
+#define TICKS_PER_SECOND(t) (1000/t)
+
+int main(int argc, char *argv[])
+{
+	String host = "127.0.0.1";
+	Uint16 port = Net::DefaultPort;
+	SwarmConfig config;
+	for (int i = 1; i < argc - 1; ++i)
+	{
+		String arg(argv[i]);
+		if (arg == "--connect")
+		{
+			// host[:port]
+			host = argv[++i];
+			size_t colon = host.find(':');
+			if (colon != String::npos)
+			{
+				port = (Uint16)atoi(host.c_str() + colon + 1);
+				host = host.substr(0, colon);
+			}
+		}
+		else if (arg == "--bots")
+			config.bots = atoi(argv[++i]);
+		else if (arg == "--seed")
+			config.seed = (Uint32)atoi(argv[++i]);
+		else if (arg == "--tick-rate")
+		{
+			int rate = atoi(argv[++i]);
+			config.inputInterval = (rate > 0) ? TICKS_PER_SECOND(rate) : config.inputInterval;
+		}
+		else if (arg == "--ramp")
+			config.ramp = (Uint32)atoi(argv[++i]);
+		else if (arg == "--seconds")
+			config.seconds = (Uint32)atoi(argv[++i]);
+		else if (arg == "--report")
+			config.reportInterval = (Uint32)atoi(argv[++i]) * 1000;
+	}
+
+	if (SDL_Init(SDL_INIT_TIMER | SDL_INIT_EVENTS) < 0)
+	{
+		g_log.logErr("SDL could not initialize! SDL_Error: " + String(SDL_GetError()));
+		return EXIT_FAILURE;
+	}
+	if (SDLNet_Init() < 0)
+	{
+		g_log.logErr("SDL_net could not initialize! SDL_net Error: " + String(SDLNet_GetError()));
+		SDL_Quit();
+		return EXIT_FAILURE;
+	}
+	int result = EXIT_SUCCESS;
+	{
+		BotSwarm swarm(config);
+		if (swarm.start(host, port))
+			swarm.run();
+		else
+			result = EXIT_FAILURE;
+		swarm.stop();
+	}
+	SDLNet_Quit();
+	SDL_Quit();
+	return result;
+}
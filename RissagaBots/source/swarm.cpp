@@ -0,0 +1,307 @@
+#include "swarm.h"
+
+#include "SDL_events.h"
+#include "SDL_timer.h"
+
+#include "common/logging.h"
+
+#ifdef RIS_BOTS_EPOLL
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#endif
+
+using namespace Ris;
+
+BotSwarm::BotSwarm(const SwarmConfig &config) :
+	m_config(config),
+	m_joined(0),
+	m_lastStatusTick(0),
+	m_lastStatusTime(0)
+#ifdef RIS_BOTS_EPOLL
+	, m_epoll(-1)
+#endif
+{
+	if (m_config.inputInterval == 0)
+		m_config.inputInterval = 1;
+	m_server.host = INADDR_NONE;
+	m_server.port = 0;
+}
+
+BotSwarm::~BotSwarm()
+{
+	stop();
+#ifdef RIS_BOTS_EPOLL
+	if (m_epoll >= 0)
+		::close(m_epoll);
+#endif
+}
+
+bool BotSwarm::start(const String &host, Uint16 port)
+{
+	if (SDLNet_ResolveHost(&m_server, host.c_str(), port) < 0)
+	{
+		g_log.logErr("Cannot resolve " + host + ": " + String(SDLNet_GetError()));
+		return false;
+	}
+#ifdef RIS_BOTS_EPOLL
+	// A socket per bot: default limit is usually 1024 files.
+	rlimit limit;
+	if (getrlimit(RLIMIT_NOFILE, &limit) == 0)
+	{
+		limit.rlim_cur = limit.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &limit);
+	}
+	m_epoll = epoll_create1(EPOLL_CLOEXEC);
+	if (m_epoll < 0)
+	{
+		g_log.logErr("Cannot create epoll: " + String(strerror(errno)));
+		return false;
+	}
+	m_sockets.assign(m_config.bots, -1);
+#else
+	m_sockets.assign(m_config.bots, nullptr);
+#endif
+	m_bots.clear();
+	for (int i = 0; i < m_config.bots; ++i)
+		m_bots.push_back(BotPtr(new Bot(m_config.seed * 7919 + i)));
+	g_log.logLog("Starting " + String(m_config.bots) + " bots on " + host + ":" + String(port) + ".");
+	return true;
+}
+
+void BotSwarm::run()
+{
+	Uint32 interval = m_config.inputInterval;
+	Uint32 start = SDL_GetTicks();
+	Uint32 processed = start;
+	Uint32 lastReport = start;
+	while (!SDL_QuitRequested())
+	{
+		Uint32 now = SDL_GetTicks();
+		Uint32 elapsed = now - start;
+		if (m_config.seconds && (elapsed >= m_config.seconds * 1000))
+			break;
+
+		Uint64 joining = (Uint64)elapsed * m_config.ramp / 1000 + 1;
+		while ((m_joined < m_config.bots) && ((Uint64)m_joined < joining))
+		{
+			if (!open(m_joined))
+			{
+				g_log.logWar("Stopped joining at " + String(m_joined) + " bots.");
+				m_config.bots = m_joined;
+				break;
+			}
+			m_joined++;
+		}
+
+		// Every bot has its own ms along the input interval, as players are not in sync.
+		if (now - processed > interval)
+			processed = now - interval;
+		while ((Sint32)(now - processed) > 0)
+		{
+			processed++;
+			Uint64 counter = SDL_GetPerformanceCounter();
+			for (int i = processed % interval; i < m_joined; i += interval)
+			{
+				Bot &bot = *m_bots[i];
+				int size = bot.welcomed() ? bot.input(m_buffer, counter) : bot.hello(m_buffer, now);
+				if (size)
+					send(i, m_buffer, size);
+			}
+		}
+
+		if (now - lastReport >= m_config.reportInterval)
+		{
+			report(now - lastReport);
+			lastReport = now;
+			// Answer comes on time for next report.
+			for (int i = 0; i < m_joined; ++i)
+			{
+				if (m_bots[i]->welcomed())
+				{
+					send(i, m_buffer, m_bots[i]->statusRequest(m_buffer));
+					break;
+				}
+			}
+		}
+		wait(1);
+	}
+}
+
+void BotSwarm::stop()
+{
+	if (m_joined == 0)
+		return;
+	for (int i = 0; i < m_joined; ++i)
+	{
+		int size = m_bots[i]->bye(m_buffer);
+		if (size)
+			send(i, m_buffer, size);
+		close(i);
+	}
+	m_joined = 0;
+	m_latency.merge(m_stats.latency);
+	g_log.logLog(m_latency.report("Run input latency"));
+}
+
+void BotSwarm::receive(int bot, const Uint8 *data, int size)
+{
+	m_stats.packetsIn++;
+	m_stats.bytesIn += size;
+	int reply = m_bots[bot]->handle(data, size, SDL_GetPerformanceCounter(), m_stats, m_reply);
+	if (reply)
+		send(bot, m_reply, reply);
+}
+
+int BotSwarm::welcomed() const
+{
+	int count = 0;
+	for (int i = 0; i < m_joined; ++i)
+		count += m_bots[i]->welcomed();
+	return count;
+}
+
+void BotSwarm::report(Uint32 elapsed)
+{
+	float seconds = elapsed ? elapsed / 1000.0f : 1.0f;
+	int in = welcomed();
+	char buf[320];
+	SDL_snprintf(buf, sizeof(buf), "%d/%d bots in. In %.1f KB/s (%.2f per bot), out %.1f KB/s, %.0f/%.0f packets/s, "
+		"%.0f snapshots/s.", in, m_config.bots, m_stats.bytesIn / seconds / 1024.0f,
+		in ? m_stats.bytesIn / seconds / 1024.0f / in : 0.0f, m_stats.bytesOut / seconds / 1024.0f,
+		m_stats.packetsIn / seconds, m_stats.packetsOut / seconds, m_stats.snapshots / seconds);
+	g_log.logLog(buf);
+	g_log.logLog(m_stats.latency.report("Input latency"));
+	if (m_stats.newStatus)
+	{
+		const Net::ServerStatus &s = m_stats.status;
+		SDL_snprintf(buf, sizeof(buf), "Server: %u clients, tick %.2f avg, %.2f p50, %.2f p99, %.2f max ms over %u ticks.",
+			s.clients, s.averageUs / 1000.0f, s.p50Us / 1000.0f, s.p99Us / 1000.0f, s.maxUs / 1000.0f, s.ticks);
+		g_log.logLog(buf);
+		m_stats.newStatus = false;
+	}
+	m_latency.merge(m_stats.latency);
+	m_stats.latency.reset();
+	m_stats.packetsIn = m_stats.packetsOut = 0;
+	m_stats.bytesIn = m_stats.bytesOut = 0;
+	m_stats.snapshots = m_stats.playerStates = 0;
+}
+
+#ifdef RIS_BOTS_EPOLL
+
+bool BotSwarm::open(int bot)
+{
+	int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+	{
+		g_log.logErr("Cannot create socket: " + String(strerror(errno)));
+		return false;
+	}
+	// Connected: only server packets come in, and send() needs no address.
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = m_server.host;
+	address.sin_port = m_server.port;
+	epoll_event e;
+	e.events = EPOLLIN;
+	e.data.u32 = (Uint32)bot;
+	if ((connect(fd, (sockaddr*)&address, sizeof(address)) < 0) || (epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &e) < 0))
+	{
+		g_log.logErr("Cannot set bot socket up: " + String(strerror(errno)));
+		::close(fd);
+		return false;
+	}
+	m_sockets[bot] = fd;
+	return true;
+}
+
+void BotSwarm::close(int bot)
+{
+	if (m_sockets[bot] >= 0)
+		::close(m_sockets[bot]);
+	m_sockets[bot] = -1;
+}
+
+void BotSwarm::send(int bot, const Uint8 *data, int size)
+{
+	if (::send(m_sockets[bot], data, size, 0) < 0)
+		return;
+	m_stats.packetsOut++;
+	m_stats.bytesOut += size;
+}
+
+void BotSwarm::wait(Uint32 timeout)
+{
+	epoll_event events[256];
+	int count = epoll_wait(m_epoll, events, 256, (int)timeout);
+	for (int i = 0; i < count; ++i)
+	{
+		int bot = (int)events[i].data.u32;
+		for (;;)
+		{
+			ssize_t size = recv(m_sockets[bot], m_buffer, sizeof(m_buffer), 0);
+			if (size < 0)
+				break;
+			receive(bot, m_buffer, (int)size);
+		}
+	}
+}
+
+#else
+
+bool BotSwarm::open(int bot)
+{
+	m_sockets[bot] = SDLNet_UDP_Open(0);
+	if (m_sockets[bot] == nullptr)
+	{
+		g_log.logErr("Cannot open socket: " + String(SDLNet_GetError()));
+		return false;
+	}
+	return true;
+}
+
+void BotSwarm::close(int bot)
+{
+	if (m_sockets[bot] != nullptr)
+		SDLNet_UDP_Close(m_sockets[bot]);
+	m_sockets[bot] = nullptr;
+}
+
+void BotSwarm::send(int bot, const Uint8 *data, int size)
+{
+	UDPpacket p;
+	p.channel = -1;
+	p.data = const_cast<Uint8*>(data);
+	p.len = size;
+	p.maxlen = size;
+	p.address = m_server;
+	if (SDLNet_UDP_Send(m_sockets[bot], -1, &p) == 0)
+		return;
+	m_stats.packetsOut++;
+	m_stats.bytesOut += size;
+}
+
+void BotSwarm::wait(Uint32 timeout)
+{
+	UDPpacket p;
+	p.data = m_buffer;
+	p.maxlen = sizeof(m_buffer);
+	bool received = false;
+	for (int i = 0; i < m_joined; ++i)
+	{
+		while (SDLNet_UDP_Recv(m_sockets[i], &p) > 0)
+		{
+			received = true;
+			receive(i, m_buffer, p.len);
+		}
+	}
+	if (!received)
+		SDL_Delay(timeout);
+}
+
+#endif
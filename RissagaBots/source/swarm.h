@@ -0,0 +1,77 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "SDL_net.h"
+
+#include "common/string.h"
+#include "bot.h"
+
+// Linux waits on every bot socket at once with epoll. Elsewhere sockets are swept in turn.
+#if defined(__linux__)
+#define RIS_BOTS_EPOLL
+#endif
+
+namespace Ris
+{
+	typedef std::unique_ptr<Bot> BotPtr;
+
+	struct SwarmConfig
+	{
+		int bots;
+		Uint32 seed;
+		// Input ticks, in ms. Bots are spread along it, not all sent at once.
+		Uint32 inputInterval;
+		// Bots joining per second.
+		Uint32 ramp;
+		// 0 runs until quit is requested.
+		Uint32 seconds;
+		Uint32 reportInterval;
+
+		SwarmConfig() : bots(1000), seed(1), inputInterval(50), ramp(500), seconds(0), reportInterval(5000)
+		{ }
+	};
+
+	// Lots of bots, one socket each (server tells clients apart by address), all on the
+	// calling thread: one event loop waits for any socket or for next bot input.
+	class BotSwarm
+	{
+		SwarmConfig m_config;
+		std::vector<BotPtr> m_bots;
+		IPaddress m_server;
+		int m_joined;
+		BotStats m_stats;
+		// Latency over the whole run.
+		Histogram m_latency;
+		Uint32 m_lastStatusTick;
+		Uint32 m_lastStatusTime;
+		Uint8 m_buffer[Net::MaxPacketSize];
+		Uint8 m_reply[Net::MaxPacketSize];
+
+#ifdef RIS_BOTS_EPOLL
+		std::vector<int> m_sockets;
+		int m_epoll;
+#else
+		std::vector<UDPsocket> m_sockets;
+#endif
+
+		bool open(int bot);
+		void close(int bot);
+		void send(int bot, const Uint8 *data, int size);
+		// Waits up to timeout ms, handling whatever bots receive meanwhile.
+		void wait(Uint32 timeout);
+		void receive(int bot, const Uint8 *data, int size);
+		int welcomed() const;
+		void report(Uint32 elapsed);
+
+	public:
+		BotSwarm(const SwarmConfig &config);
+		~BotSwarm();
+
+		bool start(const String &host, Uint16 port);
+		void run();
+		// Says bye to server and closes every socket.
+		void stop();
+	};
+}
@@ -20,12 +20,26 @@ TEMPLATE = app
 INCLUDEPATH += D:\Projects\Rissaga
 INCLUDEPATH += D:\Projects\Rissaga\GW_SDL2\include
 
-LIBS += -LD:\Projects\Rissaga\GW_SDL2\i686-w64-mingw32\lib -lmingw32 -lSDL2Main -mwindows -lSDL2 -lSDL2_image -lSDL2_ttf
+LIBS += -LD:\Projects\Rissaga\GW_SDL2\i686-w64-mingw32\lib -lmingw32 -lSDL2Main -mwindows -lSDL2 -lSDL2_image -lSDL2_ttf -lSDL2_net
 
 SOURCES += \
     source/resources/fonts.cpp \
     source/resources/textures.cpp \
-    source/main.cpp
+    source/main.cpp \
+    source/resources/texture_pool.cpp \
+    source/resources/pixels.cpp \
+    source/resources/palettes.cpp \
+    source/animations.cpp \
+    source/simulation.cpp \
+    ../common/jobs.cpp \
+    source/net/interpolation.cpp \
+    source/net/net_client.cpp \
+    source/net/prediction.cpp \
+    ../common/snapshot_delta.cpp \
+    ../common/net_channel.cpp \
+    ../common/net_sim.cpp \
+    ../common/clock_sync.cpp \
+    ../common/input_record.cpp
 
 HEADERS += \
     source/resources/fonts.h \
@@ -41,4 +55,27 @@ HEADERS += \
     ../utils/math.h \
     ../utils/point.h \
     ../utils/rect.h \
-    ../utils/Size.h
+    ../utils/Size.h \
+    source/resources/texture_pool.h \
+    source/resources/pixels.h \
+    source/resources/palettes.h \
+    source/animations.h \
+    ../common/movement_fsm.h \
+    source/simulation.h \
+    ../common/triple_buffer.h \
+    ../common/profiler.h \
+    ../common/jobs.h \
+    source/net/interpolation.h \
+    source/net/net_client.h \
+    ../common/net_protocol.h \
+    source/net/prediction.h \
+    ../common/bitstream.h \
+    ../common/snapshot_delta.h \
+    ../common/net_channel.h \
+    ../common/game_obj.h \
+    ../common/histogram.h \
+    ../common/net_sim.h \
+    ../common/clock_sync.h \
+    ../common/input_record.h \
+    ../utils/fixed.h \
+    ../common/simd.h
@@ -0,0 +1,237 @@
+#include "animations.h"
+
+#include <fstream>
+#include <sstream>
+
+#include "common/jobs.h"
+
+using namespace Ris;
+
+static const char *facingNames[Animations::FacingCount] = { "south", "west", "east", "north" };
+
+Animations::SheetID Animations::loadSheet(const String &fname)
+{
+	auto found = m_sheetIDs.find(fname);
+	if (found != m_sheetIDs.end())
+		return found->second;
+
+	std::ifstream file(fname.c_str());
+	if (!file.is_open())
+	{
+		g_log.logErr("Unable to open animation sheet " + fname);
+		return InvalidSheet;
+	}
+	SheetID sheet = InvalidSheet;
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(file, line))
+	{
+		lineNumber++;
+		std::istringstream in(line);
+		std::string cmd;
+		if (!(in >> cmd) || (cmd[0] == '#'))
+			continue;
+		if (cmd == "frame")
+		{
+			int w = 0, h = 0;
+			in >> w >> h;
+			if ((w <= 0) || (h <= 0) || (sheet != InvalidSheet))
+			{
+				g_log.logErr(fname + ":" + String(lineNumber) + ": invalid frame size.");
+				return InvalidSheet;
+			}
+			sheet = addSheet(fname, w, h);
+		}
+		else
+		if (cmd == "clip")
+		{
+			std::string name, loop;
+			int row = -1, column = -1, frames = 0, frameTime = 0;
+			in >> name >> row >> column >> frames >> frameTime >> loop;
+			if ((sheet == InvalidSheet) || (row < 0) || (column < 0) || (frames <= 0) || (frameTime < 0))
+			{
+				g_log.logErr(fname + ":" + String(lineNumber) + ": invalid clip.");
+				continue;
+			}
+			addClip(sheet, name, row, column, frames, frameTime, loop == "loop");
+		}
+		else
+			g_log.logWar(fname + ":" + String(lineNumber) + ": unknown command " + cmd);
+	}
+	if (sheet != InvalidSheet)
+		fillMovementClips(m_sheets[sheet]);
+	return sheet;
+}
+
+Animations::SheetID Animations::addSheet(const String &name, int frameWidth, int frameHeight)
+{
+	SheetID id = (SheetID)m_sheets.size();
+	m_sheets.push_back(Sheet());
+	Sheet &s = m_sheets.back();
+	s.frameWidth = frameWidth;
+	s.frameHeight = frameHeight;
+	for (int f = 0; f < FacingCount; ++f)
+		s.standClips[f] = s.walkClips[f] = InvalidClip;
+	m_sheetIDs[name] = id;
+	return id;
+}
+
+Animations::ClipID Animations::addClip(SheetID sheet, const String &name, int row, int column, int frames, int frameTime, bool loop)
+{
+	Sheet &s = m_sheets[sheet];
+	AnimationClip clip;
+	clip.firstFrame = (Uint32)m_rects.size();
+	clip.frames = (Uint16)frames;
+	clip.frameTime = (Uint16)frameTime;
+	clip.loop = loop;
+	for (int i = 0; i < frames; ++i)
+	{
+		SDL_Rect r = { (column + i) * s.frameWidth, row * s.frameHeight, s.frameWidth, s.frameHeight };
+		m_rects.push_back(r);
+	}
+	ClipID id = (ClipID)m_clips.size();
+	m_clips.push_back(clip);
+	s.clips[name] = id;
+	return id;
+}
+
+Animations::ClipID Animations::findClip(SheetID sheet, const String &name) const
+{
+	const Sheet &s = m_sheets[sheet];
+	auto it = s.clips.find(name);
+	return (it != s.clips.end()) ? it->second : InvalidClip;
+}
+
+void Animations::fillMovementClips(Sheet &sheet)
+{
+	// Clips are found by name: stand_south, walk_west...
+	for (int f = 0; f < FacingCount; ++f)
+	{
+		auto stand = sheet.clips.find(std::string("stand_") + facingNames[f]);
+		auto walk = sheet.clips.find(std::string("walk_") + facingNames[f]);
+		if (stand != sheet.clips.end())
+			sheet.standClips[f] = stand->second;
+		if (walk != sheet.clips.end())
+			sheet.walkClips[f] = walk->second;
+	}
+}
+
+Animations::ClipID Animations::movementClip(SheetID sheet, State::StateID state, Facing facing) const
+{
+	const Sheet &s = m_sheets[sheet];
+	ClipID clip = (state == State::Walking) ? s.walkClips[facing] : s.standClips[facing];
+	return (clip != InvalidClip) ? clip : s.standClips[facing];
+}
+
+Animations::Facing Animations::facing(StateWalking::Direction dir, Facing current)
+{
+	// On diagonals, sprite faces the horizontal direction.
+	if (dir & StateWalking::East)
+		return FaceEast;
+	if (dir & StateWalking::West)
+		return FaceWest;
+	if (dir & StateWalking::North)
+		return FaceNorth;
+	if (dir & StateWalking::South)
+		return FaceSouth;
+	return current;
+}
+
+Animations::Handle Animations::create(ClipID clip)
+{
+	Handle h;
+	if (!m_freeHandles.empty())
+	{
+		h = m_freeHandles.back();
+		m_freeHandles.pop_back();
+	}
+	else
+	{
+		h = (Handle)m_indexOf.size();
+		m_indexOf.push_back(0);
+	}
+	m_indexOf[h] = (Uint32)m_clip.size();
+	m_clip.push_back(clip);
+	m_frame.push_back(0);
+	m_elapsed.push_back(0);
+	m_rect.push_back(m_clips[clip].firstFrame);
+	m_handleOf.push_back(h);
+	return h;
+}
+
+void Animations::destroy(Handle h)
+{
+	// Last animation is moved into the hole, so arrays keep packed.
+	Uint32 i = m_indexOf[h];
+	Uint32 last = (Uint32)m_clip.size() - 1;
+	if (i != last)
+	{
+		m_clip[i] = m_clip[last];
+		m_frame[i] = m_frame[last];
+		m_elapsed[i] = m_elapsed[last];
+		m_rect[i] = m_rect[last];
+		m_handleOf[i] = m_handleOf[last];
+		m_indexOf[m_handleOf[i]] = i;
+	}
+	m_clip.pop_back();
+	m_frame.pop_back();
+	m_elapsed.pop_back();
+	m_rect.pop_back();
+	m_handleOf.pop_back();
+	m_freeHandles.push_back(h);
+}
+
+void Animations::play(Handle h, ClipID clip)
+{
+	Uint32 i = m_indexOf[h];
+	if ((clip == InvalidClip) || (m_clip[i] == clip))
+		return;
+	m_clip[i] = clip;
+	m_frame[i] = 0;
+	m_elapsed[i] = 0;
+	m_rect[i] = m_clips[clip].firstFrame;
+}
+
+struct AnimationsUpdate
+{
+	Animations *animations;
+	Uint32 ms;
+};
+
+static void updateRange(void *context, Uint32 begin, Uint32 end)
+{
+	AnimationsUpdate *u = static_cast<AnimationsUpdate*>(context);
+	u->animations->update(u->ms, begin, end);
+}
+
+void Animations::update(Uint32 ms)
+{
+	AnimationsUpdate u = { this, ms };
+	JobSystem::instance().parallelForWait((Uint32)m_clip.size(), 2048, updateRange, &u);
+}
+
+void Animations::update(Uint32 ms, Uint32 begin, Uint32 end)
+{
+	for (Uint32 i = begin; i < end; ++i)
+	{
+		const AnimationClip &clip = m_clips[m_clip[i]];
+		if ((clip.frames <= 1) || (clip.frameTime == 0))
+			continue;
+		Uint32 elapsed = m_elapsed[i] + ms;
+		Uint32 frame = m_frame[i] + elapsed / clip.frameTime;
+		elapsed %= clip.frameTime;
+		if (frame >= clip.frames)
+		{
+			if (clip.loop)
+				frame %= clip.frames;
+			else
+			{
+				frame = clip.frames - 1;
+				elapsed = 0;
+			}
+		}
+		m_elapsed[i] = elapsed;
+		m_frame[i] = (Uint16)frame;
+		m_rect[i] = clip.firstFrame + frame;
+	}
+}
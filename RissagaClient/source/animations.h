@@ -0,0 +1,101 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include "SDL_rect.h"
+
+#include "common/string.h"
+#include "common/logging.h"
+#include "common/state_machine.h"
+
+namespace Ris
+{
+	// Frames of a clip are consecutive on Animations source rects table.
+	struct AnimationClip
+	{
+		Uint32 firstFrame;	// Index on source rects table.
+		Uint16 frames;
+		Uint16 frameTime;	// Milliseconds per frame. 0 for still clips.
+		bool loop;
+	};
+
+	// Sprite sheet animations.
+	// Clips are defined per sheet on a text file (see resources/Hero.anim) and all their
+	// source rects are precomputed on one flat table.
+	// Playback state of every animated sprite is kept on contiguous arrays and
+	// advanced by just one update() call per frame.
+	// ToDo: Must be singleton!
+	class Animations
+	{
+	public:
+		typedef Uint32 Handle;
+		typedef Uint16 ClipID;
+		typedef Uint16 SheetID;
+		static const Handle InvalidHandle = 0xFFFFFFFF;
+		static const ClipID InvalidClip = 0xFFFF;
+		static const SheetID InvalidSheet = 0xFFFF;
+
+		// Same order than rows on RPG like character sheets.
+		enum Facing
+		{
+			FaceSouth = 0,
+			FaceWest,
+			FaceEast,
+			FaceNorth,
+			FacingCount
+		};
+
+	private:
+		struct Sheet
+		{
+			int frameWidth;
+			int frameHeight;
+			std::unordered_map<std::string, ClipID> clips;
+			// Clips used for movement states, by facing.
+			ClipID standClips[FacingCount];
+			ClipID walkClips[FacingCount];
+		};
+		std::vector<Sheet> m_sheets;
+		std::unordered_map<std::string, SheetID> m_sheetIDs;
+		std::vector<SDL_Rect> m_rects;
+		std::vector<AnimationClip> m_clips;
+
+		// Playback state. One entry per animation, no holes.
+		std::vector<ClipID> m_clip;
+		std::vector<Uint16> m_frame;
+		std::vector<Uint32> m_elapsed;
+		std::vector<Uint32> m_rect;		// Current index on source rects table.
+		std::vector<Handle> m_handleOf;
+		// Handles are stable while animations are moved around to keep arrays packed.
+		std::vector<Uint32> m_indexOf;
+		std::vector<Handle> m_freeHandles;
+
+		void fillMovementClips(Sheet &sheet);
+
+	public:
+		// Loads sheet clips definitions. Sheets are cached by filename.
+		SheetID loadSheet(const String &fname);
+		SheetID addSheet(const String &name, int frameWidth, int frameHeight);
+		// Adds a clip of frames consecutive on a sheet row.
+		ClipID addClip(SheetID sheet, const String &name, int row, int column, int frames, int frameTime, bool loop);
+		ClipID findClip(SheetID sheet, const String &name) const;
+		// Clip to be played for a movement state and facing.
+		ClipID movementClip(SheetID sheet, State::StateID state, Facing facing) const;
+		// Facing for a walking direction. current is kept if there is no direction.
+		static Facing facing(StateWalking::Direction dir, Facing current);
+
+		Handle create(ClipID clip);
+		void destroy(Handle h);
+		// Changes clip. Nothing is done if clip is already being played.
+		void play(Handle h, ClipID clip);
+		// Advances all animations. Big sets are split among job system workers.
+		void update(Uint32 ms);
+		// Advances animations in [begin, end) only.
+		void update(Uint32 ms, Uint32 begin, Uint32 end);
+
+		inline const SDL_Rect &sourceRect(Handle h) const { return m_rects[m_rect[m_indexOf[h]]]; }
+		inline size_t count() const { return m_clip.size(); }
+	};
+	static Animations g_Animations;
+}
@@ -6,13 +6,24 @@
 #include "utils/color.h"
 
 #include "common/state_machine.h"
+#include "common/movement_fsm.h"
+#include "common/profiler.h"
+#include "common/jobs.h"
 #include "common/string.h"
 #include "common/logging.h"
+#include "common/game_obj.h"
 
 #include "resources/fonts.h"
 #include "resources/textures.h"
+#include "resources/texture_pool.h"
+#include "resources/palettes.h"
+#include "animations.h"
+#include "simulation.h"
+#include "net/net_client.h"
+#include "net/prediction.h"
 
 #include <list>
+#include <map>
 #include <time.h>
 
 #define GAME_NAME "Rissaga"
@@ -136,51 +147,63 @@ namespace Ris
 		String m_text;
 		Color m_clr;
 		SDL_Texture *m_texture;
+		// Text is rendered on top-left corner of a pooled texture.
+		SDL_Rect m_textureRect;
 
 	public:
 		Text() : m_texture(nullptr)
 		{ }
 		Text(RendererShared r, const Color &c = ColorWhite) : Entity(r), m_clr(c), m_texture(nullptr), m_font(g_Fonts.getFont("resources/Cella.ttf", 12))
 		{ }
+		~Text()
+		{
+			g_TexturePool.release(m_texture);
+		}
 		void render(CameraShared cam)
 		{
 			if (m_texture)
 			{
-				SDL_RenderCopy(getSDLRenderer(), m_texture, NULL, getSDLRect());
+				SDL_RenderCopy(getSDLRenderer(), m_texture, &m_textureRect, getSDLRect());
 			}
 		}
 		bool setText(const String &text)
 		{
 			m_text = text;
-			if (m_texture)
-			{
-				SDL_DestroyTexture(m_texture);
-				m_texture = nullptr;
-			}
 			//Render text surface
 			SDL_Surface* textSurface = TTF_RenderText_Solid(m_font->getTTFFont(), m_text.c_str(), m_clr.getSDLColor());
 			if (textSurface == NULL)
 			{
 				g_log.logErr("Unable to render text surface: " + String(TTF_GetError()));
+				return false;
 			}
-			else
+			// Pooled textures are ARGB streaming ones.
+			SDL_Surface *argbSurface = SDL_ConvertSurfaceFormat(textSurface, SDL_PIXELFORMAT_ARGB8888, 0);
+			SDL_FreeSurface(textSurface);
+			if (argbSurface == NULL)
+			{
+				g_log.logErr("Unable to convert text surface: " + String(SDL_GetError()));
+				return false;
+			}
+			// Current texture is reused while new text fits inside.
+			if (!TexturePool::fits(m_texture, argbSurface->w, argbSurface->h))
+			{
+				g_TexturePool.release(m_texture);
+				m_texture = g_TexturePool.acquire(getSDLRenderer(), argbSurface->w, argbSurface->h);
+			}
+			if (m_texture != nullptr)
 			{
-				//Create texture from surface pixels
-				m_texture = SDL_CreateTextureFromSurface(getSDLRenderer(), textSurface);
-				if (m_texture == nullptr)
+				m_textureRect.x = 0;
+				m_textureRect.y = 0;
+				m_textureRect.w = argbSurface->w;
+				m_textureRect.h = argbSurface->h;
+				if (!g_TexturePool.update(m_texture, argbSurface))
 				{
-					g_log.logErr("Unable to create texture from rendered text: " + String(SDL_GetError()));
+					g_TexturePool.release(m_texture);
+					m_texture = nullptr;
 				}
-///				else
-//				{
-					//Get image dimensions
-//					mWidth = textSurface->w;
-//					mHeight = textSurface->h;
-//				}
-
-				//Get rid of old surface
-				SDL_FreeSurface(textSurface);
 			}
+			//Get rid of old surface
+			SDL_FreeSurface(argbSurface);
 
 			//Return success
 			return m_texture != NULL;
@@ -192,12 +215,16 @@ namespace Ris
 	{
 		TextureShared m_texture;
 		Rect m_sourceRect;
+		// Texture color modulation. Lets many sprites share one texture with different tints.
+		Color m_tint;
 
 	public:
 		inline Rect &sourceRect() { return m_sourceRect; }
 		inline const Rect &sourceRect() const { return m_sourceRect; }
 		inline Rect &destRect() { return Entity::rect(); }
 		inline const Rect &destRect() const { Entity::rect(); }
+		inline const Color &tint() const { return m_tint; }
+		inline void setTint(const Color &c) { m_tint = c; }
 
 		bool loadTexture(const String &fname)
 		{
@@ -206,13 +233,30 @@ namespace Ris
 				return false;
 			return true;
 		}
-		Sprite(RendererShared r) : Entity(r)
+		// Loads fname indexed image recolored with paletteTable colors.
+		bool loadTexture(const String &fname, const String &paletteTable)
+		{
+			m_texture = g_PaletteSwaps.getVariant(fname, paletteTable, getSDLRenderer());
+			if (!m_texture.get())
+				return false;
+			return true;
+		}
+		Sprite(RendererShared r) : Entity(r), m_tint(255, 255, 255)
 		{
 
 		}
 		void render(CameraShared cam)
 		{
-			SDL_RenderCopy(getSDLRenderer(), m_texture->getSDLTexture(), &sourceRect().getSDLRect(), &destRect().getSDLRect());
+			render(&sourceRect().getSDLRect());
+		}
+
+	protected:
+		void render(const SDL_Rect *source)
+		{
+			// Texture is shared, so modulation must be set on every render.
+			const SDL_Color &c = m_tint.getSDLColor();
+			SDL_SetTextureColorMod(m_texture->getSDLTexture(), c.r, c.g, c.b);
+			SDL_RenderCopy(getSDLRenderer(), m_texture->getSDLTexture(), source, &destRect().getSDLRect());
 		}
 	};
 	typedef std::shared_ptr<Sprite> SpriteShared;
@@ -238,14 +282,52 @@ namespace Ris
 		};
 	private:
 		MoveFlags moving;
+		Animations::SheetID m_sheet;
+		Animations::Handle m_animation;
+		Animations::Facing m_facing;
 	public:
 		inline void setMoveFlag(MoveFlags f) { moving |= f; }
 		inline void resetMoveFlag(MoveFlags f) { moving |= f; }
 
 		float subAnimation;
 		Point2D interSpeed;
-		AnimedSprite(RendererShared &r) : Sprite(r), subAnimation(0)
+		AnimedSprite(RendererShared &r) : Sprite(r), m_sheet(Animations::InvalidSheet), m_animation(Animations::InvalidHandle), m_facing(Animations::FaceSouth), subAnimation(0)
 		{}
+		~AnimedSprite()
+		{
+			if (m_animation != Animations::InvalidHandle)
+				g_Animations.destroy(m_animation);
+		}
+		// Loads sheet clips and starts standing.
+		bool loadAnimations(const String &fname)
+		{
+			m_sheet = g_Animations.loadSheet(fname);
+			if (m_sheet == Animations::InvalidSheet)
+				return false;
+			Animations::ClipID clip = g_Animations.movementClip(m_sheet, State::Standing, m_facing);
+			if (clip == Animations::InvalidClip)
+				return false;
+			if (m_animation == Animations::InvalidHandle)
+				m_animation = g_Animations.create(clip);
+			else
+				g_Animations.play(m_animation, clip);
+			return true;
+		}
+		// Picks the clip for this movement state.
+		void setMovement(State::StateID state, StateWalking::Direction dir)
+		{
+			if (m_animation == Animations::InvalidHandle)
+				return;
+			m_facing = Animations::facing(dir, m_facing);
+			g_Animations.play(m_animation, g_Animations.movementClip(m_sheet, state, m_facing));
+		}
+		void render(CameraShared cam)
+		{
+			if (m_animation != Animations::InvalidHandle)
+				Sprite::render(&g_Animations.sourceRect(m_animation));
+			else
+				Sprite::render(cam);
+		}
 	};
 	typedef std::shared_ptr<AnimedSprite> AnimedSpriteShared;
 
@@ -290,55 +372,6 @@ namespace Ris
 			return true;
 		}
 	};
-	class GameObj
-	{
-		Point2D m_position;
-		String m_name;
-
-	public:
-		Point2D &position() { return m_position; }
-		const Point2D &position() const { return m_position; }
-		String &name() { return m_name; }
-		const String &name() const { return m_name; }
-	};
-
-	class AliveObj : public GameObj
-	{
-		int m_health;
-		int m_mana;
-
-		// Valid States;
-		struct MovementStates
-		{
-			StateStand stateStanding;
-			StateWalking stateWalking;
-		}movementStates;
-
-		State *moveState;
-		inline void newMovementState(State *state, const SDL_KeyboardEvent &key)
-		{
-			moveState->onExit();
-			moveState = state;
-			moveState->onEnter(key);
-		}
-	public:
-		AliveObj() : moveState(&movementStates.stateStanding)
-		{ }
-		void checkKeyboard(const SDL_KeyboardEvent &key)
-		{
-			switch (moveState->checkKeyboard(key))
-			{
-			case State::NoState:
-				break;
-			case State::Walking:
-				newMovementState(&movementStates.stateWalking, key);
-				break;
-			case State::Standing:
-				newMovementState(&movementStates.stateStanding, key);
-				break;
-			}
-		}
-	};
 }
 
 using namespace Ris;
@@ -348,15 +381,107 @@ using namespace Ris;
 const int tickInterval = TICKS_PER_SECOND(20);
 const int frameInterval = TICKS_PER_SECOND(60);
 const float interInterval = ceil((float)tickInterval / (float)frameInterval);
+// Inputs sent at most on one frame to catch up after a stall. Server would queue them all, and
+// apply everything that late from then on.
+const int maxInputCatchUp = 2;
+
+// Runs a recording runs times, headless. Every run must end up with the same hashes as recording.
+static int replayMain(const String &path, int runs)
+{
+	if (SDL_Init(SDL_INIT_TIMER) < 0)
+	{
+		g_log.logErr(String("SDL could not initialize: ") + SDL_GetError());
+		return EXIT_FAILURE;
+	}
+	InputReplay replay;
+	if (!replay.load(path))
+		return EXIT_FAILURE;
+	g_log.logLog("Replaying " + path + ": " + String((Uint32)replay.header().entities.size()) + " entities, " +
+		String(replay.endTick()) + " ticks, " + String((Uint32)replay.inputCount()) + " recorded inputs.");
+	JobSystem::instance().start();
+	bool same = true;
+	Uint32 firstHash = 0;
+	for (int run = 0; run < runs; ++run)
+	{
+		Simulation sim(tickInterval, 4.0f);
+		ReplayResult result;
+		if (!sim.replay(replay, result))
+		{
+			same = false;
+			break;
+		}
+		if (run == 0)
+			firstHash = result.hash;
+		char buf[200];
+		SDL_snprintf(buf, sizeof(buf), "Run %d: %u ticks in %.1f ms (%.0f ticks/s), %u inputs, hash %08x, %u mismatches.",
+			run + 1, result.ticks, result.ms, (result.ms > 0.0) ? result.ticks * 1000.0 / result.ms : 0.0, result.inputs,
+			result.hash, result.mismatches);
+		g_log.logLog(buf);
+		if (result.mismatches > 0)
+		{
+			g_log.logErr("State differs from recording since tick " + String(result.firstMismatch) + ".");
+			same = false;
+		}
+		if (result.hash != firstHash)
+		{
+			g_log.logErr("Run " + String(run + 1) + " differs from run 1.");
+			same = false;
+		}
+	}
+	JobSystem::instance().stop();
+	SDL_Quit();
+	return same ? EXIT_SUCCESS : EXIT_FAILURE;
+}
 
 int main(int argc, char *argv[])
 {
-	argc = argc;
-	argv = argv;
+	// --connect host[:port] shows entities of a server too.
+	// --netsim conditions (see net_sim.h) puts a bad network in between, --netsim-seed picks its luck.
+	// --record file records local simulation inputs. --replay file runs such a recording again
+	// headless, --replay-runs times, and fails if any tick ends differently.
+	String server;
+	String recordPath;
+	String replayPath;
+	int replayRuns = 2;
+	Uint16 serverPort = Net::DefaultPort;
+	Net::NetConditions conditions;
+	bool simulated = false;
+	Uint32 simSeed = 1;
+	for (int i = 1; i < argc - 1; ++i)
+	{
+		String arg(argv[i]);
+		if (arg == "--netsim")
+		{
+			if (!conditions.parse(argv[i + 1]))
+				return EXIT_FAILURE;
+			simulated = true;
+		}
+		else if (arg == "--netsim-seed")
+			simSeed = (Uint32)atoi(argv[i + 1]);
+		else if (arg == "--record")
+			recordPath = argv[i + 1];
+		else if (arg == "--replay")
+			replayPath = argv[i + 1];
+		else if (arg == "--replay-runs")
+			replayRuns = atoi(argv[i + 1]);
+		else if (arg == "--connect")
+		{
+			server = argv[i + 1];
+			size_t colon = server.find(':');
+			if (colon != String::npos)
+			{
+				serverPort = (Uint16)atoi(server.c_str() + colon + 1);
+				server = server.substr(0, colon);
+			}
+		}
+	}
+	if (!replayPath.empty())
+		return replayMain(replayPath, replayRuns);
 	//The window we'll be rendering to
 	MainWindow mainWin;
 	if (!mainWin.initWindow(GAME_NAME, 800, 600))
 		return EXIT_FAILURE;
+	JobSystem::instance().start();
 	CameraShared cam = std::make_shared<Camera>();
 	RectangleShared r = std::make_shared<Rectangle>(mainWin.getRenderer(), Color(1.0f, 1.0f, 1.0f, 0.5f));
 	r->moveTo(10, 10);
@@ -369,92 +494,192 @@ int main(int argc, char *argv[])
 	tickText->setText("Ticks: Calc...");
 	tickText->moveTo(0, 21);
 	tickText->resizeTo(100, 20);
+	TextShared profText = std::make_shared<Text>(mainWin.getRenderer(), Color(1.0f, 1.0f, 1.0f, 0.5f));
+	profText->setText("Profile: Calc...");
+	profText->moveTo(0, 42);
+	profText->resizeTo(300, 20);
 	AnimedSpriteShared sprite = std::make_shared<AnimedSprite>(mainWin.getRenderer());
 	sprite->loadTexture("resources/Hero.png");
-	sprite->resize(32, 32);
-	sprite->sourceRect().set(0, 0, 32, 32);
-	AliveObj alive1;
-	alive1.position() = sprite->rect().origin();
+	sprite->loadAnimations("resources/Hero.anim");
+	sprite->resizeTo(32, 48);
 	AnimedSpriteShared sprite2 = std::make_shared<AnimedSprite>(mainWin.getRenderer());
 	sprite2->loadTexture("resources/Hero.png");
-	sprite2->destRect().set(32, 0, 32, 32);
-	sprite2->sourceRect().set(0, 0, 32, 32);
+	sprite2->loadAnimations("resources/Hero.anim");
+	sprite2->resizeTo(32, 48);
+
+	// World runs on its own thread. This one handles events and rendering only.
+	Simulation sim(tickInterval, 4.0f);
+	Uint32 player = sim.addEntity(0.0f, 0.0f, false);
+	Uint32 npc = sim.addEntity(32.0f, 0.0f, true);
+	if (!recordPath.empty() && !sim.record(recordPath))
+		return EXIT_FAILURE;
+	if (!sim.start())
+		return EXIT_FAILURE;
+	SnapshotView world;
+	NetClient net(tickInterval);
+	if (!server.empty() && net.connect(server, serverPort) && simulated)
+		net.simulate(conditions, conditions, simSeed);
+	std::map<Uint32, AnimedSpriteShared> remoteSprites;
+	std::vector<RemoteEntities::State> remoteStates;
+	TextShared netText = std::make_shared<Text>(mainWin.getRenderer(), Color(1.0f, 1.0f, 1.0f, 0.5f));
+	netText->setText("Net: Offline.");
+	netText->moveTo(0, 63);
+	netText->resizeTo(400, 20);
+	TextShared predText = std::make_shared<Text>(mainWin.getRenderer(), Color(1.0f, 1.0f, 1.0f, 0.5f));
+	predText->setText("Prediction: Offline.");
+	predText->moveTo(0, 84);
+	predText->resizeTo(400, 20);
+	// Online, our player moves at once from local inputs and server corrects it later.
+	Prediction prediction(4.0f);
+	MovementFSM keys;
+	keys.add();
+	Net::PlayerState playerState;
+	Uint8 recentInputs[Net::MaxRedundantInputs];
+	Uint32 nextInputTick = SDL_GetTicks();
+	ProfileCounter *renderProfile = Profiler::instance().counter("Render");
 	//Event handler
 	SDL_Event e;
 	bool quit = false;
 	//While application is running
 	int curTime;
 	int counterTimer = SDL_GetTicks();
-	int nextTick = counterTimer;
 	int nextFrame = counterTimer;
+	int lastFrame = counterTimer;
 	int frames = 0;
-	int ticks = 0;
+	Uint32 lastTick = 0;
 	while (!quit)
 	{
 		curTime = SDL_GetTicks();
-		if (nextTick < curTime)
+		while (SDL_PollEvent(&e) != 0)
 		{
-			int delta = curTime - nextTick;
-				// Tick skip!!!! :((
-			while (nextTick < curTime)
-				nextTick += tickInterval;
-#ifdef _DEBUG
-			if (sprite->subAnimation)
-				g_log.logWar("At new logic tick, sprite has "+String(sprite->subAnimation) +"animations not done");
-#endif
-			while (SDL_PollEvent(&e) != 0)
+			switch (e.type)
 			{
-				switch (e.type)
+			case SDL_QUIT:
+				quit = true;
+				break;
+			case SDL_KEYDOWN:
+			case SDL_KEYUP:
 				{
-				case SDL_QUIT:
-					quit = true;
-					break;
-				case SDL_KEYDOWN:
-				case SDL_KEYUP:
-					alive1.checkKeyboard(e.key);
+					MoveEvent ev = MovementFSM::fromKeyboard(e.key);
+					if (ev == MoveNoEvent)
+						break;
+					if (net.connected())
+						keys.apply(0, ev);
+					else
+						sim.pushInput(player, ev);
+				}
+				break;
+			}
+		}
+		net.poll(curTime);
+		if (net.connected())
+		{
+			if (net.takePlayerState(playerState))
+				prediction.reconcile(playerState);
+			int catchUp = 0;
+			while ((Sint32)(nextInputTick - curTime) <= 0)
+			{
+				// Rest of missed inputs are dropped: server repeats last one instead.
+				if (++catchUp > maxInputCatchUp)
+				{
+					nextInputTick = curTime + net.clock().inputStep();
 					break;
 				}
+				// A bit faster or slower than server ticks, so inputs arrive just in time.
+				nextInputTick += net.clock().inputStep();
+				if (net.playerID() == NetClient::NoPlayer)
+					continue;
+				prediction.record(keys.direction(0));
+				int count = prediction.recentInputs(recentInputs, Net::MaxRedundantInputs);
+				net.sendInputs(prediction.newestSequence(), recentInputs, count);
 			}
-			ticks++;
 		}
 
 		if (nextFrame < curTime)
 		{
+			ProfileScope prof(renderProfile);
 			frames++;
 			// Frame skip...
 			while (nextFrame < curTime)
 				nextFrame += frameInterval;
+			world.update(sim.snapshots());
 			if (counterTimer < curTime)
 			{
 				counterTimer += 1000;
 				fpsText->setText("FPS: " + String(frames) + ".");
-				tickText->setText("Ticks: " + String(ticks) + ".");
+				tickText->setText("Ticks: " + String(world.tick() - lastTick) + ".");
+				profText->setText(Profiler::instance().report());
+				if (net.connected())
+				{
+					netText->setText(net.report(curTime));
+					predText->setText(prediction.report());
+				}
 				frames = 0;
-				ticks = 0;
+				lastTick = world.tick();
+			}
+			if (net.connected() && (net.playerID() != NetClient::NoPlayer))
+			{
+				float alpha = 1.0f - (float)(Sint32)(nextInputTick - curTime) / (float)tickInterval;
+				sprite->rect().origin() = prediction.position(Math::limit(0.0f, 1.0f, alpha));
+				sprite->setMovement(prediction.state(), prediction.direction());
+			}
+			else
+			{
+				sprite->rect().origin() = world.position(player, curTime);
+				sprite->setMovement(world.state(player), world.direction(player));
 			}
-			if (sprite->subAnimation)
+			sprite2->rect().origin() = world.position(npc, curTime);
+			sprite2->setMovement(world.state(npc), world.direction(npc));
+			if (net.connected())
 			{
-				if (sprite->subAnimation)
+				// Remote entities are shown as they were a bit ago, interpolated between snapshots.
+				net.remotes().sampleAll(curTime, remoteStates);
+				// Sprites of entities gone are dropped.
+				std::map<Uint32, AnimedSpriteShared> seen;
+				for (const RemoteEntities::State &st : remoteStates)
 				{
-					if (sprite->rect().origin() != alive1.position())
-						sprite->rect().origin() += sprite->interSpeed;
+					if (st.id == net.playerID())
+						continue;
+					AnimedSpriteShared &rs = seen[st.id];
+					auto old = remoteSprites.find(st.id);
+					if (old != remoteSprites.end())
+						rs = old->second;
+					else
+					{
+						rs = std::make_shared<AnimedSprite>(mainWin.getRenderer());
+						rs->loadTexture("resources/Hero.png");
+						rs->loadAnimations("resources/Hero.anim");
+						rs->resizeTo(32, 48);
+					}
+					rs->rect().origin() = Point2D(st.sample.x, st.sample.y);
+					rs->setMovement((State::StateID)st.sample.state, (StateWalking::Direction)st.sample.dirs);
 				}
-				else
-					sprite->rect().origin() = alive1.position();
-				sprite->subAnimation--;
+				remoteSprites.swap(seen);
 			}
+			g_Animations.update(curTime - lastFrame);
+			lastFrame = curTime;
 			SDL_SetRenderDrawColor(mainWin.getRenderer()->getSDLRenderer(), 0, 0, 0, 0x0);
 			SDL_RenderClear(mainWin.getRenderer()->getSDLRenderer());
 			r->render(cam);
 			sprite->render(cam);
 			sprite2->render(cam);
+			for (auto &it : remoteSprites)
+				it.second->render(cam);
 			//		r->resize(0.01, 0.01);
 			fpsText->render(cam);
 			tickText->render(cam);
+			profText->render(cam);
+			netText->render(cam);
+			predText->render(cam);
 			//Update screen
 			SDL_RenderPresent(mainWin.getRenderer()->getSDLRenderer());
 		}
+		else
+			SDL_Delay(1);
 	}
+	net.disconnect();
+	sim.stop();
+	JobSystem::instance().stop();
 	return EXIT_SUCCESS;
 	/*	Pointf2D punto(-1.0f, 0.0f);
 	float rad = punto.getRadians();
@@ -0,0 +1,151 @@
+#include "interpolation.h"
+
+using namespace Ris;
+
+void JitterBuffer::insert(const RemoteSample &s)
+{
+	// Samples come mostly in order, so place is searched from the end.
+	int i = m_count;
+	while ((i > 0) && ((Sint32)(m_samples[i - 1].time - s.time) > 0))
+		--i;
+	if ((i > 0) && (m_samples[i - 1].time == s.time))
+		return;	// Duplicate.
+	if (m_count == Capacity)
+	{
+		if (i == 0)
+			return;	// Older than anything kept.
+		memmove(m_samples, m_samples + 1, (i - 1) * sizeof(RemoteSample));
+		m_samples[i - 1] = s;
+		return;
+	}
+	memmove(m_samples + i + 1, m_samples + i, (m_count - i) * sizeof(RemoteSample));
+	m_samples[i] = s;
+	m_count++;
+}
+
+JitterBuffer::Result JitterBuffer::sample(Uint32 time, Uint32 maxExtrapolation, RemoteSample &out) const
+{
+	if (m_count == 0)
+		return Empty;
+	const RemoteSample &last = m_samples[m_count - 1];
+	if ((Sint32)(time - last.time) >= 0)
+	{
+		out = last;
+		out.time = time;
+		if (m_count < 2)
+			return Underrun;
+		// Dead reckoning with last known velocity, up to maxExtrapolation.
+		const RemoteSample &prev = m_samples[m_count - 2];
+		Uint32 ahead = time - last.time;
+		Result result = Extrapolated;
+		if (ahead > maxExtrapolation)
+		{
+			ahead = maxExtrapolation;
+			result = Underrun;
+		}
+		// Entity stopped or turned: moving it along old velocity would be wrong.
+		if ((last.dirs == 0) || (last.dirs != prev.dirs))
+			return result;
+		float t = (float)ahead / (float)(last.time - prev.time);
+		out.x = last.x + (last.x - prev.x) * t;
+		out.y = last.y + (last.y - prev.y) * t;
+		return result;
+	}
+	if ((Sint32)(time - m_samples[0].time) <= 0)
+	{
+		out = m_samples[0];
+		return Interpolated;
+	}
+	int i = m_count - 1;
+	while ((Sint32)(m_samples[i - 1].time - time) > 0)
+		--i;
+	const RemoteSample &a = m_samples[i - 1];
+	const RemoteSample &b = m_samples[i];
+	float t = (float)(time - a.time) / (float)(b.time - a.time);
+	out.time = time;
+	out.x = a.x + (b.x - a.x) * t;
+	out.y = a.y + (b.y - a.y) * t;
+	out.state = a.state;
+	out.dirs = a.dirs;
+	return Interpolated;
+}
+
+void JitterBuffer::discardBefore(Uint32 time)
+{
+	// Sample just before time is kept, it is needed to interpolate.
+	int drop = 0;
+	while ((drop + 1 < m_count) && ((Sint32)(m_samples[drop + 1].time - time) <= 0))
+		++drop;
+	if (drop == 0)
+		return;
+	m_count -= drop;
+	memmove(m_samples, m_samples + drop, m_count * sizeof(RemoteSample));
+}
+
+void RemoteEntities::addSnapshot(Uint32 serverTime, Uint32 localTime, const Net::SnapshotEntity *entities, int count)
+{
+	// Smallest offset seen is the one of the fastest packet. Later, slower packets
+	// only drift the estimate a bit, so jitter does not shake the render time.
+	// A synced clock does better, when there is one.
+	if (!m_syncedClock)
+	{
+		Sint32 offset = (Sint32)(localTime - serverTime);
+		if (!m_hasClockOffset || (offset < m_clockOffset))
+		{
+			m_clockOffset = offset;
+			m_hasClockOffset = true;
+		}
+		else
+			// Never negative here: rounded to nearest, not up, or it would creep by a ms a packet.
+			m_clockOffset += (offset - m_clockOffset + 32) / 64;
+	}
+
+	for (int i = 0; i < count; ++i)
+	{
+		const Net::SnapshotEntity &e = entities[i];
+		Entity &entity = m_entities[e.id];
+		RemoteSample s = { serverTime, e.x, e.y, e.state, e.dirs };
+		entity.buffer.insert(s);
+		entity.lastSeen = localTime;
+	}
+}
+
+Uint32 RemoteEntities::renderTime(Uint32 now) const
+{
+	return now - m_clockOffset - m_delay;
+}
+
+void RemoteEntities::sampleAll(Uint32 now, std::vector<State> &out, Uint32 timeout)
+{
+	out.clear();
+	Uint32 time = renderTime(now);
+	for (auto it = m_entities.begin(); it != m_entities.end();)
+	{
+		Entity &entity = it->second;
+		if (now - entity.lastSeen > timeout)
+		{
+			it = m_entities.erase(it);
+			continue;
+		}
+		State st;
+		st.id = it->first;
+		switch (entity.buffer.sample(time, m_maxExtrapolation, st.sample))
+		{
+		case JitterBuffer::Empty:
+			++it;
+			continue;
+		case JitterBuffer::Interpolated:
+			m_stats.interpolated++;
+			break;
+		case JitterBuffer::Extrapolated:
+			m_stats.extrapolated++;
+			break;
+		case JitterBuffer::Underrun:
+			m_stats.underruns++;
+			break;
+		}
+		entity.buffer.discardBefore(time);
+		out.push_back(st);
+		++it;
+	}
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include "common/net_protocol.h"
+
+namespace Ris
+{
+	// Remote entity state at a server time.
+	struct RemoteSample
+	{
+		Uint32 time;
+		float x;
+		float y;
+		Uint8 state;
+		Uint8 dirs;
+	};
+
+	// Last samples of one remote entity, sorted by time.
+	class JitterBuffer
+	{
+		enum
+		{
+			Capacity = 32
+		};
+		RemoteSample m_samples[Capacity];
+		int m_count;
+
+	public:
+		enum Result
+		{
+			Empty = 0,
+			Interpolated,
+			Extrapolated,
+			// Render time is past newest sample plus extrapolation cap. Newest one is held.
+			Underrun
+		};
+		JitterBuffer() : m_count(0)
+		{ }
+		inline int count() const { return m_count; }
+		inline Uint32 newest() const { return m_count ? m_samples[m_count - 1].time : 0; }
+
+		// Late samples are put in place. Oldest one is dropped when full.
+		void insert(const RemoteSample &s);
+		// State at time. Extrapolation is limited to maxExtrapolation ms past newest sample.
+		Result sample(Uint32 time, Uint32 maxExtrapolation, RemoteSample &out) const;
+		// Drops samples not needed anymore to render at time.
+		void discardBefore(Uint32 time);
+	};
+
+	// Remote entities rendered a bit in the past, so there is always a pair of
+	// snapshots to interpolate between even with network jitter.
+	class RemoteEntities
+	{
+	public:
+		struct Stats
+		{
+			Uint32 interpolated;
+			Uint32 extrapolated;
+			Uint32 underruns;
+			Stats() : interpolated(0), extrapolated(0), underruns(0)
+			{ }
+		};
+		struct State
+		{
+			Uint32 id;
+			RemoteSample sample;
+		};
+
+	private:
+		struct Entity
+		{
+			JitterBuffer buffer;
+			Uint32 lastSeen;	// Local time.
+		};
+		std::unordered_map<Uint32, Entity> m_entities;
+		Uint32 m_delay;
+		Uint32 m_maxExtrapolation;
+		// Local time minus server time, when snapshots arrive.
+		Sint32 m_clockOffset;
+		bool m_hasClockOffset;
+		// Set from a clock sync: not estimated from snapshots anymore.
+		bool m_syncedClock;
+		Stats m_stats;
+
+	public:
+		RemoteEntities(Uint32 delay = 100, Uint32 maxExtrapolation = 250) :
+			m_delay(delay), m_maxExtrapolation(maxExtrapolation), m_clockOffset(0), m_hasClockOffset(false),
+			m_syncedClock(false)
+		{ }
+		inline Uint32 delay() const { return m_delay; }
+		inline void setDelay(Uint32 ms) { m_delay = ms; }
+		inline void setMaxExtrapolation(Uint32 ms) { m_maxExtrapolation = ms; }
+		inline const Stats &stats() const { return m_stats; }
+		inline size_t count() const { return m_entities.size(); }
+		// Local time minus server time a snapshot arrives, from a clock sync (one way trip included).
+		inline void setClockOffset(Sint32 offset)
+		{
+			m_clockOffset = offset;
+			m_hasClockOffset = true;
+			m_syncedClock = true;
+		}
+
+		// Adds entities of a snapshot taken on server at serverTime and received at localTime.
+		void addSnapshot(Uint32 serverTime, Uint32 localTime, const Net::SnapshotEntity *entities, int count);
+		// Server time being rendered at local time now.
+		Uint32 renderTime(Uint32 now) const;
+		// States of all entities at render time. Entities not seen for timeout ms are dropped.
+		void sampleAll(Uint32 now, std::vector<State> &out, Uint32 timeout = 3000);
+	};
+}
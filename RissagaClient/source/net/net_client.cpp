@@ -0,0 +1,398 @@
+#include "net_client.h"
+
+#include "SDL_timer.h"
+
+#include "common/logging.h"
+
+#include <math.h>
+
+using namespace Ris;
+
+NetClient::NetClient(Uint32 tickInterval) :
+	m_socket(nullptr),
+	m_packet(nullptr),
+	m_connected(false),
+	m_playerID(NoPlayer),
+	m_lastHello(0),
+	m_outSequence(0),
+	m_inSequence(0),
+	m_inReceived(0),
+	m_hasInSequence(false),
+	m_lastTick(0),
+	m_newPlayerState(false),
+	m_clock(tickInterval),
+	m_reportTime(0),
+	m_simulated(false)
+{
+	m_server.host = INADDR_NONE;
+	m_server.port = 0;
+}
+
+NetClient::~NetClient()
+{
+	disconnect();
+}
+
+bool NetClient::connect(const String &host, Uint16 port)
+{
+	disconnect();
+	if (SDLNet_Init() < 0)
+	{
+		g_log.logErr("SDL_net could not initialize! SDL_net Error: " + String(SDLNet_GetError()));
+		return false;
+	}
+	if (SDLNet_ResolveHost(&m_server, host.c_str(), port) < 0)
+	{
+		g_log.logErr("Cannot resolve " + host + ": " + String(SDLNet_GetError()));
+		SDLNet_Quit();
+		return false;
+	}
+	// Any local port.
+	m_socket = SDLNet_UDP_Open(0);
+	m_packet = SDLNet_AllocPacket(Net::MaxPacketSize);
+	if ((m_socket == nullptr) || (m_packet == nullptr))
+	{
+		g_log.logErr("Cannot open UDP socket: " + String(SDLNet_GetError()));
+		if (m_packet != nullptr)
+			SDLNet_FreePacket(m_packet);
+		if (m_socket != nullptr)
+			SDLNet_UDP_Close(m_socket);
+		m_packet = nullptr;
+		m_socket = nullptr;
+		SDLNet_Quit();
+		return false;
+	}
+	m_connected = true;
+	m_playerID = NoPlayer;
+	m_hasInSequence = false;
+	m_newPlayerState = false;
+	m_clock.reset();
+	m_lastHello = SDL_GetTicks();
+	sendHello(m_lastHello);
+	return true;
+}
+
+void NetClient::disconnect()
+{
+	if (!m_connected)
+		return;
+	Uint8 data[Net::HeaderSize];
+	Net::ByteWriter w(data, sizeof(data));
+	Net::writeHeader(w, Net::MsgBye, m_outSequence++);
+	// Simulated link is gone with the socket.
+	transmit(data, w.size());
+	m_simulated = false;
+	SDLNet_FreePacket(m_packet);
+	SDLNet_UDP_Close(m_socket);
+	SDLNet_Quit();
+	m_packet = nullptr;
+	m_socket = nullptr;
+	m_connected = false;
+}
+
+void NetClient::simulate(const Net::NetConditions &up, const Net::NetConditions &down, Uint32 seed)
+{
+	m_upLink.setConditions(up);
+	m_upLink.reset(seed);
+	m_downLink.setConditions(down);
+	m_downLink.reset(seed * 7919 + 1);
+	m_simulated = true;
+	g_log.logLog("Simulating up link: " + up.describe() + ".");
+	g_log.logLog("Simulating down link: " + down.describe() + ".");
+}
+
+bool NetClient::send(const Uint8 *data, int size)
+{
+	if (!m_simulated)
+		return transmit(data, size);
+	m_upLink.send(data, size, m_server, SDL_GetTicks());
+	m_stats.bytesOut += size;
+	m_stats.packetsOut++;
+	return true;
+}
+
+bool NetClient::transmit(const Uint8 *data, int size)
+{
+	UDPpacket p;
+	p.channel = -1;
+	p.data = const_cast<Uint8*>(data);
+	p.len = size;
+	p.maxlen = size;
+	p.address = m_server;
+	if (SDLNet_UDP_Send(m_socket, -1, &p) == 0)
+	{
+		g_log.logErr("Cannot send packet: " + String(SDLNet_GetError()));
+		return false;
+	}
+	if (!m_simulated)
+	{
+		m_stats.bytesOut += size;
+		m_stats.packetsOut++;
+	}
+	return true;
+}
+
+void NetClient::sendHello(Uint32 now)
+{
+	Uint8 data[Net::HeaderSize];
+	Net::ByteWriter w(data, sizeof(data));
+	Net::writeHeader(w, Net::MsgHello, m_outSequence++);
+	send(data, w.size());
+	m_lastHello = now;
+}
+
+void NetClient::sendTimeRequest()
+{
+	Uint8 data[Net::HeaderSize + 4];
+	Net::ByteWriter w(data, sizeof(data));
+	Net::writeHeader(w, Net::MsgTimeRequest, m_outSequence++);
+	// Exact time it leaves, not the one of this frame.
+	m_clock.writeRequest(w, SDL_GetTicks());
+	send(data, w.size());
+}
+
+void NetClient::poll(Uint32 now)
+{
+	if (!m_connected)
+		return;
+	// Hello or welcome may have been lost.
+	if ((m_playerID == NoPlayer) && (now - m_lastHello >= 500))
+		sendHello(now);
+	if ((m_playerID != NoPlayer) && m_clock.wantsRequest(now))
+		sendTimeRequest();
+
+	if (m_simulated)
+	{
+		Uint8 data[Net::MaxPacketSize];
+		int size;
+		IPaddress address;
+		while (m_upLink.receive(now, data, size, address))
+			transmit(data, size);
+	}
+
+	int got = 0;
+	// Server may say bye while handling a packet.
+	while (m_connected && ((got = SDLNet_UDP_Recv(m_socket, m_packet)) > 0))
+	{
+		// Anything not coming from server is ignored.
+		if ((m_packet->address.host != m_server.host) || (m_packet->address.port != m_server.port))
+			continue;
+		if (m_simulated)
+		{
+			m_downLink.send(m_packet->data, m_packet->len, m_packet->address, now);
+			continue;
+		}
+		m_stats.bytesIn += m_packet->len;
+		m_stats.packetsIn++;
+		handle(*m_packet, now);
+	}
+	if (got < 0)
+		g_log.logErr("Cannot receive packet: " + String(SDLNet_GetError()));
+	while (m_connected && m_simulated && m_downLink.receive(now, m_packet->data, m_packet->len, m_packet->address))
+	{
+		m_stats.bytesIn += m_packet->len;
+		m_stats.packetsIn++;
+		handle(*m_packet, now);
+	}
+	m_clock.update(now);
+	// Snapshots arrive half a round trip after they were taken.
+	if (m_clock.synced())
+		m_remotes.setClockOffset((Sint32)floor(m_clock.rtt() * 0.5 - m_clock.offset() + 0.5));
+}
+
+void NetClient::handle(const UDPpacket &packet, Uint32 now)
+{
+	Net::ByteReader r(packet.data, packet.len);
+	Uint8 type = r.read8();
+	Uint16 sequence = r.read16();
+	if (r.overflow())
+	{
+		m_stats.malformed++;
+		return;
+	}
+	if (!m_hasInSequence || Net::sequenceNewer(sequence, m_inSequence))
+	{
+		if (m_hasInSequence)
+		{
+			Uint16 gap = (Uint16)(sequence - m_inSequence);
+			m_stats.lost += gap - 1;
+			// Two shifts, each below 32: a gap of exactly 32 keeps the bit of last sequence.
+			m_inReceived = (gap <= 32) ? ((m_inReceived << 1) | 1) << (gap - 1) : 0;
+		}
+		else
+			m_inReceived = 0;
+		m_inSequence = sequence;
+		m_hasInSequence = true;
+	}
+	else
+	{
+		Uint16 age = (Uint16)(m_inSequence - sequence);
+		Uint32 bit = ((age > 0) && (age <= 32)) ? (Uint32)1 << (age - 1) : 0;
+		if ((age == 0) || (m_inReceived & bit))
+			m_stats.duplicated++;
+		else
+		{
+			// Reordered: was counted as lost when the gap was seen.
+			m_inReceived |= bit;
+			m_stats.late++;
+			if (m_stats.lost > 0)
+				m_stats.lost--;
+		}
+	}
+
+	switch (type)
+	{
+	case Net::MsgWelcome:
+		m_playerID = r.read32();
+		if (r.overflow())
+		{
+			m_stats.malformed++;
+			m_playerID = NoPlayer;
+		}
+		break;
+	case Net::MsgSnapshot:
+		handleSnapshot(r, now);
+		break;
+	case Net::MsgDeltaSnapshot:
+		handleDeltaSnapshot(packet.data + Net::HeaderSize, packet.len - Net::HeaderSize, now);
+		break;
+	case Net::MsgPlayerState:
+		handlePlayerState(r);
+		break;
+	case Net::MsgTime:
+		{
+			Net::TimeReply reply;
+			Net::readTimeReply(r, reply);
+			if (r.overflow())
+				m_stats.malformed++;
+			else
+				m_clock.addSample(reply, SDL_GetTicks());
+		}
+		break;
+	case Net::MsgBye:
+		g_log.logLog("Server closed connection.");
+		disconnect();
+		break;
+	default:
+		m_stats.malformed++;
+		break;
+	}
+}
+
+void NetClient::handleSnapshot(Net::ByteReader &r, Uint32 now)
+{
+	Uint32 tick = r.read32();
+	Uint32 serverTime = r.read32();
+	Uint16 count = r.read16();
+	if (r.overflow() || (r.left() < count * Net::SnapshotEntitySize))
+	{
+		m_stats.malformed++;
+		return;
+	}
+	m_snapshot.resize(count);
+	for (Uint16 i = 0; i < count; ++i)
+		Net::readSnapshotEntity(r, m_snapshot[i]);
+	// Late snapshots are still inserted on jitter buffers, they may be needed to interpolate.
+	if ((Sint32)(tick - m_lastTick) > 0)
+		m_lastTick = tick;
+	m_remotes.addSnapshot(serverTime, now, m_snapshot.data(), count);
+}
+
+void NetClient::handleDeltaSnapshot(const Uint8 *data, int size, Uint32 now)
+{
+	Uint16 sequence;
+	Net::SnapshotDecoder::Result result = m_deltas.decode(data, size, sequence);
+	if (result != Net::SnapshotDecoder::Decoded)
+	{
+		if (result == Net::SnapshotDecoder::Malformed)
+			m_stats.malformed++;
+		else if (result == Net::SnapshotDecoder::NoBaseline)
+			m_stats.baselineMissing++;
+		return;
+	}
+	Uint8 ack[Net::HeaderSize + 2];
+	Net::ByteWriter w(ack, sizeof(ack));
+	Net::writeHeader(w, Net::MsgSnapshotAck, m_outSequence++);
+	w.write16(sequence);
+	send(ack, w.size());
+
+	const Net::ClientView *view = m_deltas.latest();
+	if (view->sequence != sequence)
+		return;	// Late, a newer one was already used.
+	m_snapshot.resize(view->entities.size());
+	for (size_t i = 0; i < view->entities.size(); ++i)
+	{
+		const Net::EntityState &e = view->entities[i];
+		Net::SnapshotEntity &se = m_snapshot[i];
+		se.id = e.id;
+		se.x = e.position.x;
+		se.y = e.position.y;
+		se.state = e.state;
+		se.dirs = e.dirs;
+	}
+	if ((Sint32)(view->tick - m_lastTick) > 0)
+		m_lastTick = view->tick;
+	m_remotes.addSnapshot(view->time, now, m_snapshot.data(), (int)m_snapshot.size());
+}
+
+void NetClient::handlePlayerState(Net::ByteReader &r)
+{
+	Net::PlayerState state;
+	Net::readPlayerState(r, state);
+	if (r.overflow())
+	{
+		m_stats.malformed++;
+		return;
+	}
+	// Only newest one matters, prediction replays from it.
+	if (m_newPlayerState && !Net::sequenceNewer(state.inputSequence, m_playerState.inputSequence))
+		return;
+	m_playerState = state;
+	m_newPlayerState = true;
+}
+
+void NetClient::sendInputs(Uint16 newest, const Uint8 *dirs, int count)
+{
+	if (!m_connected || (m_playerID == NoPlayer))
+		return;
+	if (count > Net::MaxRedundantInputs)
+		count = Net::MaxRedundantInputs;
+	Uint8 data[Net::HeaderSize + 3 + Net::MaxRedundantInputs];
+	Net::ByteWriter w(data, sizeof(data));
+	Net::writeHeader(w, Net::MsgInput, m_outSequence++);
+	Net::writeInputs(w, newest, dirs, count);
+	send(data, w.size());
+}
+
+bool NetClient::takePlayerState(Net::PlayerState &state)
+{
+	if (!m_newPlayerState)
+		return false;
+	state = m_playerState;
+	m_newPlayerState = false;
+	return true;
+}
+
+String NetClient::report(Uint32 now)
+{
+	Uint32 elapsed = now - m_reportTime;
+	if (elapsed == 0)
+		elapsed = 1;
+	const RemoteEntities::Stats &rs = m_remotes.stats();
+	Uint32 packets = m_stats.packetsIn - m_reported.packetsIn;
+	Uint32 lost = m_stats.lost - m_reported.lost;
+	Uint32 samples = (rs.interpolated - m_reportedRemotes.interpolated) +
+		(rs.extrapolated - m_reportedRemotes.extrapolated) + (rs.underruns - m_reportedRemotes.underruns);
+	int lossPermille = (packets + lost) ? (int)(lost * 1000 / (packets + lost)) : 0;
+	int extraPermille = samples ? (int)((rs.extrapolated - m_reportedRemotes.extrapolated) * 1000 / samples) : 0;
+	String s = "Net: in " + String((m_stats.bytesIn - m_reported.bytesIn) * 1000 / elapsed) +
+		" B/s, out " + String((m_stats.bytesOut - m_reported.bytesOut) * 1000 / elapsed) +
+		" B/s, loss " + String(lossPermille / 10) + "." + String(lossPermille % 10) +
+		"%, extrap " + String(extraPermille / 10) + "." + String(extraPermille % 10) +
+		"%, underruns " + String(rs.underruns - m_reportedRemotes.underruns) + ", rtt " +
+		String((int)m_clock.rtt()) + " ms.";
+	m_reported = m_stats;
+	m_reportedRemotes = rs;
+	m_reportTime = now;
+	return s;
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <vector>
+
+#include "SDL_net.h"
+
+#include "common/string.h"
+#include "common/net_protocol.h"
+#include "common/snapshot_delta.h"
+#include "common/net_sim.h"
+#include "common/clock_sync.h"
+#include "interpolation.h"
+
+namespace Ris
+{
+	// Running totals. Rates are computed by NetClient::report().
+	struct NetStats
+	{
+		Uint32 bytesIn;
+		Uint32 bytesOut;
+		Uint32 packetsIn;
+		Uint32 packetsOut;
+		Uint32 lost;		// Sequence gaps.
+		Uint32 late;		// Older than last received, used anyway if still useful.
+		Uint32 duplicated;	// Received already. Neither late nor lost.
+		Uint32 malformed;
+		Uint32 baselineMissing;	// Delta snapshots against a baseline dropped from history.
+		NetStats() : bytesIn(0), bytesOut(0), packetsIn(0), packetsOut(0), lost(0), late(0), duplicated(0), malformed(0),
+			baselineMissing(0)
+		{ }
+	};
+
+	// UDP client: joins a server and feeds received snapshots to a RemoteEntities.
+	// Everything is done on the calling thread by poll(). Sockets are never blocking.
+	class NetClient
+	{
+		UDPsocket m_socket;
+		UDPpacket *m_packet;
+		IPaddress m_server;
+		bool m_connected;
+		Uint32 m_playerID;
+		Uint32 m_lastHello;
+		Uint16 m_outSequence;
+		Uint16 m_inSequence;
+		// Bit i set if sequence m_inSequence - 1 - i was received.
+		Uint32 m_inReceived;
+		bool m_hasInSequence;
+		Uint32 m_lastTick;
+
+		Net::PlayerState m_playerState;
+		bool m_newPlayerState;
+
+		ClockSync m_clock;
+		RemoteEntities m_remotes;
+		std::vector<Net::SnapshotEntity> m_snapshot;
+		Net::SnapshotDecoder m_deltas;
+		NetStats m_stats;
+		NetStats m_reported;
+		RemoteEntities::Stats m_reportedRemotes;
+		Uint32 m_reportTime;
+
+		// Optional bad network between us and server, both ways.
+		bool m_simulated;
+		Net::NetSimulator m_upLink;
+		Net::NetSimulator m_downLink;
+
+		// Through simulated link, if any.
+		bool send(const Uint8 *data, int size);
+		// Straight to socket.
+		bool transmit(const Uint8 *data, int size);
+		void sendHello(Uint32 now);
+		void sendTimeRequest();
+		void handle(const UDPpacket &packet, Uint32 now);
+		void handleSnapshot(Net::ByteReader &r, Uint32 now);
+		void handlePlayerState(Net::ByteReader &r);
+		void handleDeltaSnapshot(const Uint8 *data, int size, Uint32 now);
+
+	public:
+		static const Uint32 NoPlayer = 0xFFFFFFFF;
+
+		// tickInterval of server, until it tells its own.
+		NetClient(Uint32 tickInterval = 50);
+		~NetClient();
+
+		// Opens socket and starts joining. Welcome is waited for on poll().
+		bool connect(const String &host, Uint16 port = Net::DefaultPort);
+		void disconnect();
+		// Packets to and from server go through simulated links from now on, until
+		// disconnect(). Both are seeded from seed. Outgoing ones leave on poll().
+		void simulate(const Net::NetConditions &up, const Net::NetConditions &down, Uint32 seed);
+		// Receives every pending packet. Hello is resent while not welcomed.
+		void poll(Uint32 now);
+
+		// Sends last inputs, newest first. Nothing is sent until welcomed.
+		void sendInputs(Uint16 newest, const Uint8 *dirs, int count);
+		// Newest authoritative state of our player, once.
+		bool takePlayerState(Net::PlayerState &state);
+
+		inline bool connected() const { return m_connected; }
+		// Entity ID of our player on server. NoPlayer until welcomed.
+		inline Uint32 playerID() const { return m_playerID; }
+		inline RemoteEntities &remotes() { return m_remotes; }
+		// Server clock and ticks, and pace of input ticks.
+		inline ClockSync &clock() { return m_clock; }
+		inline const NetStats &stats() const { return m_stats; }
+		// One line summary of last period rates: bandwidth, loss and interpolation underruns.
+		String report(Uint32 now);
+	};
+}
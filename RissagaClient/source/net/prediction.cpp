@@ -0,0 +1,153 @@
+#include "prediction.h"
+
+#include <math.h>
+
+using namespace Ris;
+
+Prediction::Prediction(float speed) :
+	m_first(0),
+	m_count(0),
+	m_nextSequence(0),
+	m_lastAck(0),
+	m_hasAck(false),
+	m_prevX(0.0f),
+	m_prevY(0.0f),
+	m_speed(Fixed::fromFloat(speed)),
+	m_offsetX(0.0f),
+	m_offsetY(0.0f),
+	m_smoothing(0.8f),
+	m_snapDistance(64.0f),
+	m_tolerance(0.01f)
+{
+	m_fsm.add();
+}
+
+void Prediction::reset(float x, float y, State::StateID state, Uint8 dirs)
+{
+	m_first = 0;
+	m_count = 0;
+	m_hasAck = false;
+	m_fsm.set(0, state, dirs);
+	m_x = Fixed::fromFloat(x);
+	m_y = Fixed::fromFloat(y);
+	m_prevX = m_x.toFloat();
+	m_prevY = m_y.toFloat();
+	m_offsetX = m_offsetY = 0.0f;
+}
+
+void Prediction::step(Uint8 dirs)
+{
+	// Same steps than a server tick: inputs first, then movement.
+	m_fsm.setDirection(0, dirs);
+	m_fsm.integrate(&m_x, &m_y, m_speed);
+}
+
+const Prediction::Input &Prediction::record(Uint8 dirs)
+{
+	// Server is too far behind: oldest input is forgotten. Its correction will not be smoothed.
+	if (m_count == Capacity)
+	{
+		m_first = (m_first + 1) % Capacity;
+		m_count--;
+	}
+	m_prevX = m_x.toFloat();
+	m_prevY = m_y.toFloat();
+	step(dirs);
+	Input &in = input(m_count++);
+	in.sequence = m_nextSequence++;
+	in.dirs = dirs;
+	in.x = m_x.toFloat();
+	in.y = m_y.toFloat();
+
+	m_offsetX *= m_smoothing;
+	m_offsetY *= m_smoothing;
+	m_stats.ticks++;
+	m_stats.lastError = 0.0f;
+	m_stats.lastReplayed = 0;
+	return in;
+}
+
+void Prediction::reconcile(const Net::PlayerState &server)
+{
+	// States are unreliable: older than one already used is useless.
+	if (m_hasAck && !Net::sequenceNewer(server.inputSequence, m_lastAck))
+		return;
+	m_lastAck = server.inputSequence;
+	m_hasAck = true;
+
+	// Predicted position for the same input, if still known.
+	float predictedX = server.x;
+	float predictedY = server.y;
+	bool known = false;
+	while ((m_count > 0) && !Net::sequenceNewer(input(0).sequence, server.inputSequence))
+	{
+		if (input(0).sequence == server.inputSequence)
+		{
+			predictedX = input(0).x;
+			predictedY = input(0).y;
+			known = true;
+		}
+		m_first = (m_first + 1) % Capacity;
+		m_count--;
+	}
+	float dx = server.x - predictedX;
+	float dy = server.y - predictedY;
+	float error = sqrtf(dx * dx + dy * dy);
+	m_stats.lastError = error;
+	if (error > m_stats.maxError)
+		m_stats.maxError = error;
+	if (known && (error <= m_tolerance))
+		return;
+
+	// Rewind to server state and replay what it has not seen yet.
+	float oldX = m_x.toFloat();
+	float oldY = m_y.toFloat();
+	m_fsm.set(0, (State::StateID)server.state, server.dirs);
+	m_x = Fixed::fromFloat(server.x);
+	m_y = Fixed::fromFloat(server.y);
+	for (int i = 0; i < m_count; ++i)
+	{
+		Input &in = input(i);
+		step(in.dirs);
+		in.x = m_x.toFloat();
+		in.y = m_y.toFloat();
+	}
+	m_stats.corrections++;
+	m_stats.replayed += m_count;
+	m_stats.lastReplayed = m_count;
+
+	// Render position does not jump: difference is shown as an offset fading out.
+	float x = m_x.toFloat();
+	float y = m_y.toFloat();
+	m_prevX += x - oldX;
+	m_prevY += y - oldY;
+	m_offsetX += oldX - x;
+	m_offsetY += oldY - y;
+	if (m_offsetX * m_offsetX + m_offsetY * m_offsetY > m_snapDistance * m_snapDistance)
+		m_offsetX = m_offsetY = 0.0f;
+}
+
+int Prediction::recentInputs(Uint8 *dirs, int max) const
+{
+	int count = (m_count < max) ? m_count : max;
+	for (int i = 0; i < count; ++i)
+		dirs[i] = m_inputs[(m_first + m_count - 1 - i) % Capacity].dirs;
+	return count;
+}
+
+Point2D Prediction::position(float alpha) const
+{
+	float x = m_x.toFloat();
+	float y = m_y.toFloat();
+	return Point2D(m_prevX + (x - m_prevX) * alpha + m_offsetX, m_prevY + (y - m_prevY) * alpha + m_offsetY);
+}
+
+String Prediction::report()
+{
+	int avgReplay = m_stats.corrections ? (int)(m_stats.replayed * 10 / m_stats.corrections) : 0;
+	String s = "Prediction: " + String(m_stats.corrections) + "/" + String(m_stats.ticks) +
+		" ticks corrected, max error " + String((int)(m_stats.maxError * 10.0f) / 10) + "." + String((int)(m_stats.maxError * 10.0f) % 10) +
+		" px, replay " + String(avgReplay / 10) + "." + String(avgReplay % 10) + " inputs, pending " + String(m_count) + ".";
+	m_stats = Stats();
+	return s;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "utils/fixed.h"
+#include "utils/point.h"
+#include "common/string.h"
+#include "common/movement_fsm.h"
+#include "common/net_protocol.h"
+
+namespace Ris
+{
+	// Client side prediction of the local player.
+	// Every tick, held directions are recorded as an input with a sequence number and applied
+	// right away. When server state arrives, inputs it already applied are dropped and the rest
+	// are replayed over it. Any difference left is not snapped but faded out over a few ticks.
+	class Prediction
+	{
+	public:
+		struct Input
+		{
+			Uint16 sequence;
+			Uint8 dirs;
+			// Predicted position right after this input was applied.
+			float x;
+			float y;
+		};
+		struct Stats
+		{
+			Uint32 ticks;
+			Uint32 corrections;
+			Uint32 replayed;
+			float maxError;
+			float lastError;
+			Uint32 lastReplayed;
+			Stats() : ticks(0), corrections(0), replayed(0), maxError(0.0f), lastError(0.0f), lastReplayed(0)
+			{ }
+		};
+
+	private:
+		enum
+		{
+			// Inputs not acknowledged yet. More than a second at 20 ticks per second.
+			Capacity = 64
+		};
+		Input m_inputs[Capacity];
+		int m_first;
+		int m_count;
+		Uint16 m_nextSequence;
+		Uint16 m_lastAck;
+		bool m_hasAck;
+
+		// Same state machine and fixed point positions than the server. Just one entity: the player.
+		MovementFSM m_fsm;
+		Fixed m_x;
+		Fixed m_y;
+		float m_prevX;
+		float m_prevY;
+		Fixed m_speed;
+
+		// Visual offset left by last corrections. Decays every tick.
+		float m_offsetX;
+		float m_offsetY;
+		float m_smoothing;
+		float m_snapDistance;
+		float m_tolerance;
+
+		Stats m_stats;
+
+		inline Input &input(int i) { return m_inputs[(m_first + i) % Capacity]; }
+		void step(Uint8 dirs);
+
+	public:
+		// speed in pixels per tick, as on server.
+		Prediction(float speed);
+
+		// Starts from a known state, forgetting any input.
+		void reset(float x, float y, State::StateID state = State::Standing, Uint8 dirs = StateWalking::NoDir);
+		// Applies held directions for a new tick. Returns the input, to be sent to server.
+		const Input &record(Uint8 dirs);
+		// Rewinds to server state and replays inputs it has not applied yet.
+		void reconcile(const Net::PlayerState &server);
+
+		// Last inputs, newest first, as sent on each input packet.
+		int recentInputs(Uint8 *dirs, int max) const;
+		inline Uint16 newestSequence() const { return (Uint16)(m_nextSequence - 1); }
+		inline int pending() const { return m_count; }
+
+		// Position between last two ticks, alpha in [0, 1], smoothed.
+		Point2D position(float alpha) const;
+		inline State::StateID state() const { return m_fsm.state(0); }
+		inline StateWalking::Direction direction() const { return m_fsm.direction(0); }
+
+		// Corrections smaller than tolerance pixels are ignored. Bigger than snapDistance are not smoothed.
+		// smoothing is the part of the correction still shown after one tick.
+		inline void setSmoothing(float smoothing, float tolerance, float snapDistance)
+		{
+			m_smoothing = smoothing;
+			m_tolerance = tolerance;
+			m_snapDistance = snapDistance;
+		}
+		inline const Stats &stats() const { return m_stats; }
+		// Prediction error and replays since last report.
+		String report();
+	};
+}
@@ -0,0 +1,146 @@
+#include "palettes.h"
+
+using namespace Ris;
+
+bool IndexedImage::load(const String &fname)
+{
+	SDL_Surface *surface = IMG_Load(fname.c_str());
+	if (surface == NULL)
+	{
+		g_log.logErr("Unable to load image " + fname + " : " + IMG_GetError());
+		return false;
+	}
+	if ((surface->format->BitsPerPixel != 8) || (surface->format->palette == NULL))
+	{
+		g_log.logErr("Image " + fname + " is not an 8 bits indexed one.");
+		SDL_FreeSurface(surface);
+		return false;
+	}
+	if (m_surface != nullptr)
+		SDL_FreeSurface(m_surface);
+	m_surface = surface;
+	return true;
+}
+
+bool IndexedImage::createVariant(Texture &texture, const PaletteTable &table, SDL_Renderer *renderer) const
+{
+	if (m_surface == nullptr)
+		return false;
+	// A surface over source pixels but with its own palette.
+	SDL_Surface *view = SDL_CreateRGBSurfaceFrom(m_surface->pixels, m_surface->w, m_surface->h, 8, m_surface->pitch, 0, 0, 0, 0);
+	if (view == NULL)
+	{
+		g_log.logErr("Unable to create palette variant: " + String(SDL_GetError()));
+		return false;
+	}
+	const SDL_Palette *source = m_surface->format->palette;
+	SDL_SetPaletteColors(view->format->palette, source->colors, 0, source->ncolors);
+	for (const PaletteSwap &swap : table)
+		SDL_SetPaletteColors(view->format->palette, &swap.color, swap.index, 1);
+	Uint32 key;
+	if (SDL_GetColorKey(m_surface, &key) == 0)
+		SDL_SetColorKey(view, SDL_TRUE, key);
+
+	bool ok = texture.create(view, renderer);
+	// Pixels are not freed as they were given to SDL_CreateRGBSurfaceFrom.
+	SDL_FreeSurface(view);
+	return ok;
+}
+
+int IndexedImage::memorySize() const
+{
+	if (m_surface == nullptr)
+		return 0;
+	return m_surface->pitch * m_surface->h + m_surface->format->palette->ncolors * (int)sizeof(SDL_Color);
+}
+
+IndexedImageShared PaletteSwaps::getImage(const String &fname)
+{
+	IndexedImageShared img = m_images[fname];
+	if (!img.get())
+	{
+		img = std::make_shared<IndexedImage>();
+		if (!img->load(fname))
+		{
+			m_images.erase(fname);
+			return IndexedImageShared();
+		}
+		m_images[fname] = img;
+	}
+	return img;
+}
+
+void PaletteSwaps::addTable(const String &tableName, const PaletteTable &table)
+{
+	m_tables[tableName] = table;
+	for (auto it = m_variants.begin(); it != m_variants.end(); )
+	{
+		if (it->first.second == tableName)
+			it = m_variants.erase(it);
+		else
+			++it;
+	}
+}
+
+TextureShared PaletteSwaps::getVariant(const String &fname, const String &tableName, SDL_Renderer *renderer)
+{
+	VariantKey key(fname, tableName);
+	auto found = m_variants.find(key);
+	if (found != m_variants.end())
+		return found->second;
+
+	auto table = m_tables.find(tableName);
+	if (table == m_tables.end())
+	{
+		g_log.logErr("Unknown palette table " + tableName);
+		return TextureShared();
+	}
+	IndexedImageShared img = getImage(fname);
+	if (!img.get())
+		return TextureShared();
+
+	TextureShared t = std::make_shared<Texture>();
+	if (!img->createVariant(*t, table->second, renderer))
+	{
+		g_log.logErr("Cannot create palette variant " + fname + " with " + tableName);
+		return TextureShared();
+	}
+	m_variants[key] = t;
+	return t;
+}
+
+void PaletteSwaps::purgeUnused()
+{
+	for (auto it = m_variants.begin(); it != m_variants.end(); )
+	{
+		if (it->second.use_count() == 1)
+			it = m_variants.erase(it);
+		else
+			++it;
+	}
+}
+
+int PaletteSwaps::variantMemory(const String &fname, const String &tableName) const
+{
+	auto it = m_variants.find(VariantKey(fname, tableName));
+	return (it != m_variants.end()) ? it->second->memorySize() : 0;
+}
+
+int PaletteSwaps::totalMemory() const
+{
+	int total = 0;
+	for (const auto &it : m_variants)
+		total += it.second->memorySize();
+	for (const auto &it : m_images)
+		total += it.second->memorySize();
+	return total;
+}
+
+void PaletteSwaps::logMemory() const
+{
+	for (const auto &it : m_variants)
+		g_log.logLog("Palette variant " + String(it.first.first) + " with " + String(it.first.second) + ": " + String(it.second->memorySize()) + " bytes, " + String((int)it.second.use_count() - 1) + " users.");
+	for (const auto &it : m_images)
+		g_log.logLog("Indexed source " + String(it.first) + ": " + String(it.second->memorySize()) + " bytes.");
+	g_log.logLog("Palette swaps total: " + String(totalMemory()) + " bytes.");
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include <memory>
+
+#include "common/string.h"
+#include "common/logging.h"
+#include "textures.h"
+
+namespace Ris
+{
+	// Source palette index and the color it's replaced with.
+	struct PaletteSwap
+	{
+		Uint8 index;
+		SDL_Color color;
+	};
+	typedef std::vector<PaletteSwap> PaletteTable;
+
+	// 8 bits indexed image kept in memory so recolored variants can be created from it.
+	class IndexedImage
+	{
+		SDL_Surface *m_surface;
+
+	public:
+		IndexedImage() : m_surface(nullptr)
+		{ }
+		~IndexedImage()
+		{
+			if (m_surface != nullptr)
+				SDL_FreeSurface(m_surface);
+		}
+		inline bool isValid() const { return m_surface != nullptr; }
+		bool load(const String &fname);
+		// Creates a texture with source palette colors replaced by table ones.
+		// Source pixels are shared, not copied.
+		bool createVariant(Texture &texture, const PaletteTable &table, SDL_Renderer *renderer) const;
+		// System memory used by indexed pixels and palette, in bytes.
+		int memorySize() const;
+	};
+	typedef std::shared_ptr<IndexedImage> IndexedImageShared;
+
+	// Recolored sprite variants (armor tints, team colors...) from just one indexed image.
+	// Variants are created on demand and shared by all sprites using the same image and table.
+	// For uniform tints, use Sprite::setTint, that modulates one shared texture instead.
+	// ToDo: Must be singleton!
+	class PaletteSwaps
+	{
+		// Image and table names. Kept apart, so no two pairs can give the same key.
+		typedef std::pair<std::string, std::string> VariantKey;
+		std::unordered_map<std::string, PaletteTable> m_tables;
+		std::unordered_map<std::string, IndexedImageShared> m_images;
+		std::map<VariantKey, TextureShared> m_variants;
+
+		IndexedImageShared getImage(const String &fname);
+
+	public:
+		// Adds or replaces a palette table. Cached variants using old table are dropped.
+		void addTable(const String &tableName, const PaletteTable &table);
+		// Gets fname image recolored with tableName palette table.
+		TextureShared getVariant(const String &fname, const String &tableName, SDL_Renderer *renderer);
+		// Drops variants not used by anyone.
+		void purgeUnused();
+
+		// Video memory used by a variant, in bytes. 0 if not created.
+		int variantMemory(const String &fname, const String &tableName) const;
+		// Video memory used by all variants plus system memory used by indexed sources.
+		int totalMemory() const;
+		// Logs memory used by every variant.
+		void logMemory() const;
+	};
+	static PaletteSwaps g_PaletteSwaps;
+}
@@ -0,0 +1,130 @@
+#include "pixels.h"
+
+#ifdef RIS_SSE2
+#include <emmintrin.h>
+#endif
+
+using namespace Ris;
+
+// c*a/255 rounded, without division.
+static inline Uint32 mul255(Uint32 c, Uint32 a)
+{
+	Uint32 t = c * a + 128;
+	return (t + (t >> 8)) >> 8;
+}
+
+static void premultiplyScalar(Uint32 *pixels, int count, Uint8 alphaShift)
+{
+	for (int i = 0; i < count; ++i)
+	{
+		Uint32 p = pixels[i];
+		Uint32 a = (p >> alphaShift) & 0xFF;
+		Uint32 r = a << alphaShift;
+		for (Uint8 shift = 0; shift < 32; shift += 8)
+		{
+			if (shift != alphaShift)
+				r |= mul255((p >> shift) & 0xFF, a) << shift;
+		}
+		pixels[i] = r;
+	}
+}
+
+#ifdef RIS_SSE2
+// A is the alpha byte index inside the pixel. Works on 4 pixels per iteration.
+template <int A>
+static int premultiplySSE2(Uint32 *pixels, int count)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i round = _mm_set1_epi16(128);
+	const __m128i alphaMask = _mm_set1_epi32(0xFF << (A * 8));
+	int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128i px = _mm_loadu_si128((const __m128i*)(pixels + i));
+		// Two pixels per register with 16 bits per channel.
+		__m128i lo = _mm_unpacklo_epi8(px, zero);
+		__m128i hi = _mm_unpackhi_epi8(px, zero);
+		__m128i alo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, _MM_SHUFFLE(A, A, A, A)), _MM_SHUFFLE(A, A, A, A));
+		__m128i ahi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, _MM_SHUFFLE(A, A, A, A)), _MM_SHUFFLE(A, A, A, A));
+		lo = _mm_add_epi16(_mm_mullo_epi16(lo, alo), round);
+		hi = _mm_add_epi16(_mm_mullo_epi16(hi, ahi), round);
+		lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+		hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+		__m128i res = _mm_packus_epi16(lo, hi);
+		// Alpha channel was multiplied by itself. Take it back from source.
+		res = _mm_or_si128(_mm_andnot_si128(alphaMask, res), _mm_and_si128(px, alphaMask));
+		_mm_storeu_si128((__m128i*)(pixels + i), res);
+	}
+	return i;
+}
+#endif
+
+void Pixels::premultiplyAlpha(Uint32 *pixels, int count, Uint8 alphaShift)
+{
+	int done = 0;
+#ifdef RIS_SSE2
+	if (alphaShift == 24)
+		done = premultiplySSE2<3>(pixels, count);
+	else
+	if (alphaShift == 0)
+		done = premultiplySSE2<0>(pixels, count);
+#endif
+	premultiplyScalar(pixels + done, count - done, alphaShift);
+}
+
+bool Pixels::isOpaque(const Uint32 *pixels, int count, Uint32 alphaMask)
+{
+	int i = 0;
+#ifdef RIS_SSE2
+	const __m128i mask = _mm_set1_epi32((int)alphaMask);
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128i px = _mm_loadu_si128((const __m128i*)(pixels + i));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(px, mask), mask)) != 0xFFFF)
+			return false;
+	}
+#endif
+	for (; i < count; ++i)
+	{
+		if ((pixels[i] & alphaMask) != alphaMask)
+			return false;
+	}
+	return true;
+}
+
+bool Pixels::premultiplyAlpha(SDL_Surface *surface)
+{
+	if ((surface->format->BytesPerPixel != 4) || (surface->format->Amask == 0))
+		return false;
+	if (SDL_MUSTLOCK(surface))
+		SDL_LockSurface(surface);
+	Uint8 *row = (Uint8*)surface->pixels;
+	if (surface->pitch == surface->w * 4)
+		premultiplyAlpha((Uint32*)row, surface->w * surface->h, surface->format->Ashift);
+	else
+	{
+		for (int y = 0; y < surface->h; ++y, row += surface->pitch)
+			premultiplyAlpha((Uint32*)row, surface->w, surface->format->Ashift);
+	}
+	if (SDL_MUSTLOCK(surface))
+		SDL_UnlockSurface(surface);
+	return true;
+}
+
+bool Pixels::isOpaque(SDL_Surface *surface)
+{
+	// Without alpha channel or colorkey nothing can be transparent.
+	if (surface->format->Amask == 0)
+		return SDL_GetColorKey(surface, NULL) != 0;
+	if (surface->format->BytesPerPixel != 4)
+		return false;
+	if (SDL_MUSTLOCK(surface))
+		SDL_LockSurface(surface);
+	bool opaque = true;
+	const Uint8 *row = (const Uint8*)surface->pixels;
+	for (int y = 0; opaque && (y < surface->h); ++y, row += surface->pitch)
+		opaque = isOpaque((const Uint32*)row, surface->w, surface->format->Amask);
+	if (SDL_MUSTLOCK(surface))
+		SDL_UnlockSurface(surface);
+	return opaque;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "SDL_surface.h"
+
+#include "common/simd.h"
+
+namespace Ris
+{
+	// CPU pixel kernels for 32 bits surfaces.
+	// Surfaces must be 32 bits per pixel with an alpha byte (ARGB8888, ABGR8888, RGBA8888...)
+	class Pixels
+	{
+	public:
+		// Multiplies color channels by alpha. Alpha is kept as is.
+		static void premultiplyAlpha(Uint32 *pixels, int count, Uint8 alphaShift);
+		// Returns true if every pixel alpha is fully opaque.
+		static bool isOpaque(const Uint32 *pixels, int count, Uint32 alphaMask);
+
+		// Surface versions. They handle locking and pitch.
+		static bool premultiplyAlpha(SDL_Surface *surface);
+		static bool isOpaque(SDL_Surface *surface);
+	};
+}
@@ -0,0 +1,135 @@
+#include "texture_pool.h"
+
+#include <string.h>
+
+using namespace Ris;
+
+int TexturePool::sizeClass(int v)
+{
+	int c = MinSizeClass;
+	while (c < v)
+		c <<= 1;
+	return c;
+}
+
+Uint64 TexturePool::createPoolID(Uint32 format, int access, int w, int h)
+{
+	// Size classes are powers of two: 14 bits for each one hold every class up to 8192.
+	return ((Uint64)format << 32) | ((Uint64)(access & 0xF) << 28) | ((Uint64)(w & 0x3FFF) << 14) | (Uint64)(h & 0x3FFF);
+}
+
+SDL_Texture *TexturePool::acquire(SDL_Renderer *renderer, int w, int h, Uint32 format, int access)
+{
+	// Textures belongs to its renderer. A new one invalidates all pooled ones.
+	if (m_renderer != renderer)
+	{
+		clear();
+		m_renderer = renderer;
+	}
+	w = sizeClass(w);
+	h = sizeClass(h);
+	TextureList &list = m_free[createPoolID(format, access, w, h)];
+	SDL_Texture *texture;
+	if (!list.empty())
+	{
+		texture = list.back();
+		list.pop_back();
+		m_stats.hits++;
+		m_stats.pooled--;
+	}
+	else
+	{
+		texture = SDL_CreateTexture(renderer, format, access, w, h);
+		if (texture == nullptr)
+		{
+			g_log.logErr("Cannot create pooled texture: " + String(SDL_GetError()));
+			return nullptr;
+		}
+		if (SDL_ISPIXELFORMAT_ALPHA(format))
+			SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+		m_stats.misses++;
+	}
+	m_stats.live++;
+	return texture;
+}
+
+void TexturePool::release(SDL_Texture *texture)
+{
+	if (texture == nullptr)
+		return;
+	Uint32 format;
+	int access, w, h;
+	if (SDL_QueryTexture(texture, &format, &access, &w, &h) != 0)
+	{
+		g_log.logErr("Releasing an invalid texture to the pool: " + String(SDL_GetError()));
+		return;
+	}
+	// Modulations are texture state. Restore them so next user gets a clean one.
+	SDL_SetTextureColorMod(texture, 255, 255, 255);
+	SDL_SetTextureAlphaMod(texture, 255);
+	m_free[createPoolID(format, access, w, h)].push_back(texture);
+	m_stats.released++;
+	m_stats.live--;
+	m_stats.pooled++;
+}
+
+bool TexturePool::fits(SDL_Texture *texture, int w, int h)
+{
+	int tw, th;
+	if (texture == nullptr || SDL_QueryTexture(texture, NULL, NULL, &tw, &th) != 0)
+		return false;
+	return (w <= tw) && (h <= th);
+}
+
+bool TexturePool::update(SDL_Texture *texture, SDL_Surface *surface)
+{
+	int access;
+	SDL_Rect rect = { 0, 0, surface->w, surface->h };
+
+	m_stats.uploads++;
+	if (SDL_QueryTexture(texture, NULL, &access, NULL, NULL) != 0)
+		return false;
+	if (access != SDL_TEXTUREACCESS_STREAMING)
+	{
+		if (SDL_UpdateTexture(texture, &rect, surface->pixels, surface->pitch) != 0)
+		{
+			g_log.logErr("Cannot update pooled texture: " + String(SDL_GetError()));
+			return false;
+		}
+		return true;
+	}
+	void *pixels;
+	int pitch;
+	if (SDL_LockTexture(texture, &rect, &pixels, &pitch) != 0)
+	{
+		g_log.logErr("Cannot lock pooled texture: " + String(SDL_GetError()));
+		return false;
+	}
+	if (SDL_MUSTLOCK(surface))
+		SDL_LockSurface(surface);
+	const Uint8 *src = (const Uint8*)surface->pixels;
+	Uint8 *dst = (Uint8*)pixels;
+	int rowBytes = surface->w * surface->format->BytesPerPixel;
+	if (pitch == surface->pitch)
+		memcpy(dst, src, surface->pitch * surface->h);
+	else
+	{
+		for (int y = 0; y < surface->h; ++y, src += surface->pitch, dst += pitch)
+			memcpy(dst, src, rowBytes);
+	}
+	if (SDL_MUSTLOCK(surface))
+		SDL_UnlockSurface(surface);
+	SDL_UnlockTexture(texture);
+	return true;
+}
+
+void TexturePool::clear()
+{
+	for (auto &it : m_free)
+	{
+		for (SDL_Texture *t : it.second)
+			SDL_DestroyTexture(t);
+	}
+	m_free.clear();
+	m_stats.pooled = 0;
+}
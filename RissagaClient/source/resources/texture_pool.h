@@ -0,0 +1,71 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include "SDL_render.h"
+
+#include "common/string.h"
+#include "common/logging.h"
+
+namespace Ris
+{
+	// Recycles streaming and target textures for dynamic content (texts, minimaps, name tags...)
+	// Textures are grouped by (format, access, size class). Size classes are powers of two,
+	// so a texture can be reused for any content that fits inside it.
+	// ToDo: Must be singleton!
+	class TexturePool
+	{
+	public:
+		struct Stats
+		{
+			Uint32 hits;		// acquire() served from the pool.
+			Uint32 misses;		// acquire() had to create a new texture.
+			Uint32 released;	// Textures given back to the pool.
+			Uint32 uploads;		// update() calls.
+			Uint32 live;		// Textures currently handed out.
+			Uint32 pooled;		// Textures waiting in the pool.
+
+			Stats() : hits(0), misses(0), released(0), uploads(0), live(0), pooled(0)
+			{ }
+			inline float hitRate() const { return (hits + misses) ? (float)hits / (float)(hits + misses) : 0.0f; }
+		};
+
+	private:
+		typedef std::vector<SDL_Texture*> TextureList;
+		std::unordered_map<Uint64, TextureList> m_free;
+		SDL_Renderer *m_renderer;
+		Stats m_stats;
+
+		static int sizeClass(int v);
+		static Uint64 createPoolID(Uint32 format, int access, int w, int h);
+
+	public:
+		enum
+		{
+			MinSizeClass = 16
+		};
+		TexturePool() : m_renderer(nullptr)
+		{ }
+		~TexturePool()
+		{
+			clear();
+		}
+
+		// Gets a texture at least w*h big. Texture real size is rounded up to its size class.
+		SDL_Texture *acquire(SDL_Renderer *renderer, int w, int h, Uint32 format = SDL_PIXELFORMAT_ARGB8888, int access = SDL_TEXTUREACCESS_STREAMING);
+		// Gives texture back to the pool. Texture must be acquired from this pool.
+		void release(SDL_Texture *texture);
+		// Returns true if texture is big enough to hold a w*h content.
+		static bool fits(SDL_Texture *texture, int w, int h);
+		// Uploads surface pixels into the top-left corner of texture.
+		// Surface must have the same pixel format than texture.
+		bool update(SDL_Texture *texture, SDL_Surface *surface);
+		// Destroys all pooled textures. Textures handed out are not affected.
+		void clear();
+
+		inline const Stats &stats() const { return m_stats; }
+		inline void resetStats() { m_stats.hits = m_stats.misses = m_stats.released = m_stats.uploads = 0; }
+	};
+	static TexturePool g_TexturePool;
+}
@@ -1,12 +1,28 @@
 #include "textures.h"
+#include "pixels.h"
 
 using namespace Ris;
 
-bool Texture::load(const String &fname, SDL_Renderer *renderer)
+Uint32 Texture::preferredFormat(SDL_Renderer *renderer, bool alpha)
 {
-	//The final texture
-	SDL_Texture *newTexture = NULL;
+	SDL_RendererInfo info;
+	if (SDL_GetRendererInfo(renderer, &info) == 0)
+	{
+		// Renderer lists its formats from the best one.
+		for (Uint32 i = 0; i < info.num_texture_formats; ++i)
+		{
+			Uint32 f = info.texture_formats[i];
+			if (SDL_ISPIXELFORMAT_FOURCC(f) || (SDL_BYTESPERPIXEL(f) != 4))
+				continue;
+			if (!alpha || SDL_ISPIXELFORMAT_ALPHA(f))
+				return f;
+		}
+	}
+	return SDL_PIXELFORMAT_ARGB8888;
+}
 
+bool Texture::load(const String &fname, SDL_Renderer *renderer, bool premultiply)
+{
 	//Load image at specified path
 	SDL_Surface* loadedSurface = IMG_Load(fname.c_str());
 	if (loadedSurface == NULL)
@@ -14,31 +30,75 @@ bool Texture::load(const String &fname, SDL_Renderer *renderer)
 		g_log.logErr("Unable to load image " + fname + " : " + IMG_GetError());
 		return false;
 	}
-	//Create texture from surface pixels
-	m_texture = SDL_CreateTextureFromSurface(renderer, loadedSurface);
-	if (m_texture == NULL)
-		g_log.logErr("Unable to create texture from " + fname + " : " + SDL_GetError());
+	bool ok = create(loadedSurface, renderer, premultiply);
+	if (!ok)
+		g_log.logErr("Unable to create texture from " + fname);
 
 	//Get rid of old loaded surface
 	SDL_FreeSurface(loadedSurface);
 
-	return true;
+	return ok;
+}
+
+bool Texture::create(SDL_Surface *source, SDL_Renderer *renderer, bool premultiply)
+{
+	// Convert once here, so renderer doesn't need to do it on upload.
+	// Colorkeyed and alpha images are converted to a format with alpha channel.
+	bool alpha = (source->format->Amask != 0) || (SDL_GetColorKey(source, NULL) == 0);
+	SDL_Surface *surface = SDL_ConvertSurfaceFormat(source, preferredFormat(renderer, alpha), 0);
+	if (surface == NULL)
+	{
+		g_log.logErr("Unable to convert surface: " + String(SDL_GetError()));
+		return false;
+	}
+	m_width = surface->w;
+	m_height = surface->h;
+	m_opaque = Pixels::isOpaque(surface);
+	m_premultiplied = premultiply && !m_opaque && Pixels::premultiplyAlpha(surface);
+
+	//Create texture from surface pixels
+	if (m_texture != NULL)
+		SDL_DestroyTexture(m_texture);
+	m_texture = SDL_CreateTextureFromSurface(renderer, surface);
+	if (m_texture == NULL)
+		g_log.logErr("Unable to create texture: " + String(SDL_GetError()));
+	else
+		SDL_SetTextureBlendMode(m_texture, blendMode());
+
+	//Get rid of converted surface
+	SDL_FreeSurface(surface);
+
+	return m_texture != NULL;
+}
+
+int Texture::memorySize() const
+{
+	Uint32 format;
+	if ((m_texture == NULL) || (SDL_QueryTexture(m_texture, &format, NULL, NULL, NULL) != 0))
+		return 0;
+	return m_width * m_height * SDL_BYTESPERPIXEL(format);
+}
+
+String Textures::createTextureID(const String &fname, bool premultiplied)
+{
+	return premultiplied ? String(fname + "#pm") : fname;
 }
 
-TextureShared Textures::getTexture(const String &fname, SDL_Renderer *renderer)
+TextureShared Textures::getTexture(const String &fname, SDL_Renderer *renderer, bool premultiplied)
 {
-	TextureShared f = operator[](fname);
+	String textureID = createTextureID(fname, premultiplied);
+	TextureShared f = operator[](textureID);
 	if (!f.get())
 	{
 		f = std::make_shared<Texture>();
-		if (!f->load(fname, renderer))
+		if (!f->load(fname, renderer, premultiplied))
 		{
 			// Error, cannot be loaded :/
-			g_log.logErr("Cannot load font file " + fname);
-			erase(fname);
+			g_log.logErr("Cannot load texture file " + fname);
+			erase(textureID);
 		}
 		else
-			operator[](fname) = f;
+			operator[](textureID) = f;
 	}
 	return f;
 }
@@ -12,16 +12,38 @@ namespace Ris
 	class Texture
 	{
 		SDL_Texture *m_texture;
+		int m_width;
+		int m_height;
+		// No transparent pixel at all. Can be rendered without blending.
+		bool m_opaque;
+		// Color channels are already multiplied by alpha.
+		bool m_premultiplied;
+
+		static Uint32 preferredFormat(SDL_Renderer *renderer, bool alpha);
 
 	public:
 		SDL_Texture *getSDLTexture() const { return m_texture; }
-		Texture() : m_texture(nullptr)
+		Texture() : m_texture(nullptr), m_width(0), m_height(0), m_opaque(false), m_premultiplied(false)
 		{ }
 		~Texture()
 		{
 			SDL_DestroyTexture(m_texture);
 		}
-		bool load(const String &fname, SDL_Renderer *renderer);
+		inline int width() const { return m_width; }
+		inline int height() const { return m_height; }
+		inline bool isOpaque() const { return m_opaque; }
+		inline bool isPremultiplied() const { return m_premultiplied; }
+		inline SDL_BlendMode blendMode() const { return m_opaque ? SDL_BLENDMODE_NONE : SDL_BLENDMODE_BLEND; }
+		// Video memory used by texture pixels, in bytes.
+		int memorySize() const;
+
+		// Loads image converting it once to the renderer preferred pixel format.
+		// Opaque images are set to be rendered without blending.
+		// premultiply multiplies color by alpha. Such textures need a (ONE, ONE_MINUS_SRC_ALPHA)
+		// blending to be drawn; SDL2 default blend modes are for straight alpha.
+		bool load(const String &fname, SDL_Renderer *renderer, bool premultiply = false);
+		// Same as load() but from an already loaded surface. Surface is not freed.
+		bool create(SDL_Surface *surface, SDL_Renderer *renderer, bool premultiply = false);
 	};
 	typedef std::shared_ptr<Texture> TextureShared;
 
@@ -41,8 +63,9 @@ namespace Ris
 			IMG_Quit();
 		}
 
+		static String createTextureID(const String &fname, bool premultiplied);
 		// Gets texture from filename.
-		TextureShared getTexture(const String &fname, SDL_Renderer *renderer);
+		TextureShared getTexture(const String &fname, SDL_Renderer *renderer, bool premultiplied = false);
 	};
 	static Textures g_Textures;
 }
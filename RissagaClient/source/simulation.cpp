@@ -0,0 +1,268 @@
+#include "simulation.h"
+
+#include "SDL_timer.h"
+
+#include "common/logging.h"
+#include "common/jobs.h"
+
+using namespace Ris;
+
+Simulation::Simulation(int tickInterval, float speed) :
+	m_seed(0x5EED),
+	m_tick(0),
+	m_tickInterval(tickInterval),
+	m_speed(Fixed::fromFloat(speed)),
+	m_inputLock(SDL_CreateMutex()),
+	m_thread(nullptr),
+	m_profile(Profiler::instance().counter("Sim")),
+	m_replay(nullptr)
+{
+	SDL_AtomicSet(&m_quit, 0);
+}
+
+Simulation::~Simulation()
+{
+	stop();
+	SDL_DestroyMutex(m_inputLock);
+}
+
+Uint32 Simulation::addEntity(Fixed x, Fixed y, bool ai)
+{
+	m_x.push_back(x);
+	m_y.push_back(y);
+	m_aiThink.push_back(ai ? 1 : 0);
+	return m_movement.add();
+}
+
+bool Simulation::start()
+{
+	// First snapshot is there before any tick, so renderer always has something to show.
+	publish();
+	SDL_AtomicSet(&m_quit, 0);
+	m_thread = SDL_CreateThread(threadMain, "Simulation", this);
+	if (m_thread == nullptr)
+	{
+		g_log.logErr("Cannot create simulation thread: " + String(SDL_GetError()));
+		return false;
+	}
+	return true;
+}
+
+void Simulation::stop()
+{
+	if (m_thread == nullptr)
+		return;
+	SDL_AtomicSet(&m_quit, 1);
+	SDL_WaitThread(m_thread, NULL);
+	m_thread = nullptr;
+	if (m_recorder.isOpen())
+	{
+		m_recorder.close(m_tick);
+		g_log.logLog("Recorded " + String(m_tick) + " ticks on " + String(m_recorder.bytes()) + " bytes.");
+	}
+}
+
+void Simulation::pushInput(Uint32 entity, Uint8 event)
+{
+	MoveInput in = { entity, event };
+	SDL_LockMutex(m_inputLock);
+	m_pendingInputs.push_back(in);
+	SDL_UnlockMutex(m_inputLock);
+}
+
+bool Simulation::record(const String &path)
+{
+	ReplayHeader header;
+	header.tickInterval = (Uint16)m_tickInterval;
+	header.speed = m_speed;
+	header.seed = m_seed;
+	header.entities.resize(m_x.size());
+	for (size_t i = 0; i < m_x.size(); ++i)
+	{
+		header.entities[i].x = m_x[i];
+		header.entities[i].y = m_y[i];
+		header.entities[i].ai = (m_aiThink[i] != 0);
+	}
+	return m_recorder.open(path, header);
+}
+
+bool Simulation::replay(InputReplay &replay, ReplayResult &result)
+{
+	if (m_movement.count() > 0)
+	{
+		g_log.logErr("Cannot replay on a simulation with entities.");
+		return false;
+	}
+	const ReplayHeader &header = replay.header();
+	m_tickInterval = header.tickInterval;
+	m_speed = header.speed;
+	m_seed = header.seed;
+	m_tick = 0;
+	for (const ReplayEntity &e : header.entities)
+		addEntity(e.x, e.y, e.ai);
+	replay.rewind();
+	m_replay = &replay;
+
+	result.ticks = 0;
+	result.inputs = 0;
+	result.mismatches = 0;
+	result.firstMismatch = 0;
+	result.hash = hashBytes(&header.seed, sizeof(header.seed));
+	Uint64 start = SDL_GetPerformanceCounter();
+	while (m_tick < replay.endTick())
+	{
+		tick();
+		result.inputs += (Uint32)m_tickInputs.size();
+		Uint32 hash = stateHash();
+		result.hash = hashBytes(&hash, sizeof(hash), result.hash);
+		Uint32 recorded;
+		if (replay.hash(m_tick, recorded) && (recorded != hash))
+		{
+			if (result.mismatches == 0)
+				result.firstMismatch = m_tick;
+			result.mismatches++;
+		}
+	}
+	result.ms = (double)(SDL_GetPerformanceCounter() - start) * 1000.0 / (double)SDL_GetPerformanceFrequency();
+	result.ticks = m_tick;
+	m_replay = nullptr;
+	return true;
+}
+
+Uint32 Simulation::stateHash() const
+{
+	size_t count = m_movement.count();
+	Uint32 hash = hashBytes(&m_tick, sizeof(m_tick));
+	hash = hashBytes(&m_seed, sizeof(m_seed), hash);
+	hash = hashBytes(m_x.data(), count * sizeof(Fixed), hash);
+	hash = hashBytes(m_y.data(), count * sizeof(Fixed), hash);
+	hash = hashBytes(m_movement.states(), count, hash);
+	return hashBytes(m_movement.directions(), count, hash);
+}
+
+int Simulation::threadMain(void *data)
+{
+	static_cast<Simulation*>(data)->run();
+	return 0;
+}
+
+void Simulation::run()
+{
+	JobSystem::instance().attachThread();
+	Uint32 nextTick = SDL_GetTicks();
+	while (!SDL_AtomicGet(&m_quit))
+	{
+		Uint32 now = SDL_GetTicks();
+		if ((Sint32)(nextTick - now) > 0)
+		{
+			SDL_Delay(nextTick - now);
+			continue;
+		}
+		// Tick skip!!!! :((
+		while ((Sint32)(nextTick - now) <= 0)
+			nextTick += m_tickInterval;
+		tick();
+	}
+}
+
+void Simulation::tick()
+{
+	ProfileScope prof(m_profile);
+
+	m_tickInputs.clear();
+	m_tick++;
+	if (m_replay != nullptr)
+		m_replay->inputs(m_tick, m_tickInputs);
+	else
+	{
+		SDL_LockMutex(m_inputLock);
+		m_tickInputs.swap(m_pendingInputs);
+		SDL_UnlockMutex(m_inputLock);
+	}
+	// AI inputs are not recorded: they come again from the same seed.
+	m_recorder.inputs(m_tick, m_tickInputs.data(), m_tickInputs.size());
+
+	think();
+	m_movement.updateAll(m_tickInputs);
+	JobSystem::instance().parallelForWait(m_movement.count(), 4096, integrateRange, this);
+	if (m_recorder.isOpen())
+		m_recorder.hash(m_tick, stateHash());
+	publish();
+}
+
+void Simulation::integrateRange(void *context, Uint32 begin, Uint32 end)
+{
+	Simulation *sim = static_cast<Simulation*>(context);
+	sim->m_movement.integrate(sim->m_x.data(), sim->m_y.data(), sim->m_speed, begin, end);
+}
+
+void Simulation::think()
+{
+	// Wanderers: every second or so, stop or take a random direction.
+	static const Uint8 presses[4] = { MovePressNorth, MovePressSouth, MovePressEast, MovePressWest };
+	for (Uint32 i = 0; i < m_aiThink.size(); ++i)
+	{
+		if ((m_aiThink[i] == 0) || (m_aiThink[i] > m_tick))
+			continue;
+		m_aiThink[i] = m_tick + 10 + random() % 20;
+		Uint8 dirs = m_movement.direction(i);
+		for (int d = 0; d < 4; ++d)
+		{
+			if (dirs & (1 << d))
+			{
+				MoveInput in = { i, (Uint8)(MoveReleaseNorth + d) };
+				m_tickInputs.push_back(in);
+			}
+		}
+		if (random() & 0x100)
+		{
+			MoveInput in = { i, presses[(random() >> 8) & 3] };
+			m_tickInputs.push_back(in);
+		}
+	}
+}
+
+void Simulation::publish()
+{
+	WorldSnapshot &snap = m_snapshots.writeBuffer();
+	snap.tick = m_tick;
+	snap.time = SDL_GetTicks();
+	snap.entities.resize(m_movement.count());
+	const Uint8 *states = m_movement.states();
+	const Uint8 *dirs = m_movement.directions();
+	for (size_t i = 0; i < snap.entities.size(); ++i)
+	{
+		EntitySnapshot &e = snap.entities[i];
+		e.x = m_x[i].toFloat();
+		e.y = m_y[i].toFloat();
+		e.state = states[i];
+		e.dirs = dirs[i];
+	}
+	m_snapshots.publish();
+}
+
+bool SnapshotView::update(TripleBuffer<WorldSnapshot> &snapshots)
+{
+	if (!snapshots.update())
+		return false;
+	// Assignment reuses vectors memory, so nothing is allocated once warmed up.
+	m_prev.tick = m_cur.tick;
+	m_prev.time = m_cur.time;
+	m_prev.entities.swap(m_cur.entities);
+	const WorldSnapshot &snap = snapshots.readBuffer();
+	m_cur.tick = snap.tick;
+	m_cur.time = snap.time;
+	m_cur.entities.assign(snap.entities.begin(), snap.entities.end());
+	return true;
+}
+
+Point2D SnapshotView::position(Uint32 entity, Uint32 now) const
+{
+	const EntitySnapshot &cur = m_cur.entities[entity];
+	if ((entity >= m_prev.entities.size()) || (m_cur.time == m_prev.time))
+		return Point2D(cur.x, cur.y);
+	const EntitySnapshot &prev = m_prev.entities[entity];
+	float alpha = (float)(Sint32)(now - m_cur.time) / (float)(m_cur.time - m_prev.time);
+	alpha = Math::limit(0.0f, 1.0f, alpha);
+	return Point2D(prev.x + (cur.x - prev.x) * alpha, prev.y + (cur.y - prev.y) * alpha);
+}
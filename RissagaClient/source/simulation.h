@@ -0,0 +1,131 @@
+#pragma once
+
+#include <vector>
+
+#include "SDL_thread.h"
+#include "SDL_mutex.h"
+
+#include "utils/point.h"
+#include "common/movement_fsm.h"
+#include "common/triple_buffer.h"
+#include "common/profiler.h"
+#include "common/input_record.h"
+
+namespace Ris
+{
+	struct EntitySnapshot
+	{
+		float x;
+		float y;
+		Uint8 state;
+		Uint8 dirs;
+	};
+
+	// Immutable world state as it was at the end of a tick.
+	struct WorldSnapshot
+	{
+		Uint32 tick;
+		Uint32 time;
+		std::vector<EntitySnapshot> entities;
+
+		WorldSnapshot() : tick(0), time(0)
+		{ }
+	};
+
+	struct ReplayResult
+	{
+		Uint32 ticks;
+		// Inputs applied, AI ones too.
+		Uint32 inputs;
+		Uint32 mismatches;
+		// First tick whose state differs from recording. 0 if none.
+		Uint32 firstMismatch;
+		// Hash of all tick hashes: two runs of a recording must have the same.
+		Uint32 hash;
+		double ms;
+	};
+
+	// World simulation running on its own thread at a fixed tick rate.
+	// No SDL video call is done here. World is published as snapshots through a triple buffer.
+	class Simulation
+	{
+		MovementFSM m_movement;
+		// Fixed point, so the same inputs give the same world on any machine.
+		// Snapshots carry floats: rendering never sees Fixed.
+		std::vector<Fixed> m_x;
+		std::vector<Fixed> m_y;
+		// Tick of next AI decision. 0 for non AI entities.
+		std::vector<Uint32> m_aiThink;
+		Uint32 m_seed;
+
+		Uint32 m_tick;
+		int m_tickInterval;
+		Fixed m_speed;
+
+		// Inputs are pushed by main thread and taken by simulation one at tick start.
+		SDL_mutex *m_inputLock;
+		std::vector<MoveInput> m_pendingInputs;
+		std::vector<MoveInput> m_tickInputs;
+
+		TripleBuffer<WorldSnapshot> m_snapshots;
+		SDL_Thread *m_thread;
+		SDL_atomic_t m_quit;
+		ProfileCounter *m_profile;
+
+		InputRecorder m_recorder;
+		// Recording being replayed: inputs come from it instead of pushInput().
+		InputReplay *m_replay;
+
+		static int threadMain(void *data);
+		void run();
+		void tick();
+		static void integrateRange(void *context, Uint32 begin, Uint32 end);
+		void think();
+		void publish();
+		inline Uint32 random() { return m_seed = m_seed * 1103515245 + 12345; }
+
+	public:
+		// tickInterval in milliseconds. speed in pixels per tick.
+		Simulation(int tickInterval, float speed);
+		~Simulation();
+
+		// Entities must be added before start().
+		Uint32 addEntity(Fixed x, Fixed y, bool ai);
+		inline Uint32 addEntity(float x, float y, bool ai) { return addEntity(Fixed::fromFloat(x), Fixed::fromFloat(y), ai); }
+		bool start();
+		void stop();
+
+		// Can be called from any thread.
+		void pushInput(Uint32 entity, Uint8 event);
+
+		// Before start(): inputs pushed are recorded on path with the tick they are applied on,
+		// and so is a state hash at the end of every tick. File is closed on stop().
+		bool record(const String &path);
+		// Runs a recording again on the calling thread, headless and as fast as it goes,
+		// checking state hash of every tick. No entity must be added: they come from the recording.
+		bool replay(InputReplay &replay, ReplayResult &result);
+		// Hash of tick number and whole entity state.
+		Uint32 stateHash() const;
+
+		inline int tickInterval() const { return m_tickInterval; }
+		inline TripleBuffer<WorldSnapshot> &snapshots() { return m_snapshots; }
+	};
+
+	// Render side view of the simulation: last two snapshots and interpolation between them.
+	class SnapshotView
+	{
+		WorldSnapshot m_prev;
+		WorldSnapshot m_cur;
+
+	public:
+		// Takes last published snapshot, if any. Returns true if there was a new one.
+		bool update(TripleBuffer<WorldSnapshot> &snapshots);
+		inline Uint32 tick() const { return m_cur.tick; }
+		inline size_t count() const { return m_cur.entities.size(); }
+		inline State::StateID state(Uint32 entity) const { return (State::StateID)m_cur.entities[entity].state; }
+		inline StateWalking::Direction direction(Uint32 entity) const { return (StateWalking::Direction)m_cur.entities[entity].dirs; }
+		// Entity position interpolated from previous to current snapshot.
+		// Rendering is a tick behind simulation, so movement is smooth at any frame rate.
+		Point2D position(Uint32 entity, Uint32 now) const;
+	};
+}
@@ -0,0 +1,39 @@
+#-------------------------------------------------
+#
+# UDP proxy simulating latency, jitter and loss between clients and a server.
+#
+#-------------------------------------------------
+
+QT       -= core gui
+
+CONFIG += c++11
+
+TARGET = RissagaProxy
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+
+INCLUDEPATH += D:\Projects\Rissaga
+INCLUDEPATH += D:\Projects\Rissaga\GW_SDL2\include
+
+LIBS += -LD:\Projects\Rissaga\GW_SDL2\i686-w64-mingw32\lib -lmingw32 -lSDL2Main -lSDL2 -lSDL2_net
+
+SOURCES += \
+    source/main.cpp \
+    source/proxy.cpp \
+    source/link_check.cpp \
+    ../common/net_sim.cpp
+
+HEADERS += \
+    source/proxy.h \
+    source/link_check.h \
+    ../common/net_sim.h \
+    ../common/net_protocol.h \
+    ../common/bitstream.h \
+    ../common/state_machine.h \
+    ../common/string.h \
+    ../common/logging.h \
+    ../utils/point.h \
+    ../utils/math.h
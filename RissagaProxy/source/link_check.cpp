@@ -0,0 +1,235 @@
+#include "link_check.h"
+
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+#include "common/logging.h"
+
+using namespace Ris;
+using namespace Ris::Net;
+
+namespace
+{
+	enum
+	{
+		PacketSize = 100,
+		// Packets on their way at once: a second of latency at a packet per ms, with room to spare.
+		Capacity = 8192
+	};
+
+	// What came out of a link.
+	struct LinkRun
+	{
+		Uint32 sent;
+		// Packets that got through at least once, and every copy that did.
+		Uint32 unique;
+		Uint32 copies;
+		// First copies coming after a later packet.
+		Uint32 outOfOrder;
+		Uint32 dropped;
+		Uint64 bytes;
+		Uint32 firstArrival;
+		Uint32 lastArrival;
+		// Of every packet and when it came, to compare runs.
+		Uint32 hash;
+		// Of first copies, in ms.
+		std::vector<Uint32> delays;
+	};
+}
+
+// Sends packets, perTick of them every spacing ms from 0, and takes them out every ms until
+// the link is empty.
+static void runLink(const NetConditions &conditions, Uint32 seed, Uint32 packets, Uint32 spacing, Uint32 perTick,
+	LinkRun &run)
+{
+	NetSimulator link(conditions, seed, Capacity);
+	std::vector<Uint8> seen(packets, 0);
+	IPaddress address = { 0, 0 };
+	Uint8 data[MaxPacketSize];
+	memset(data, 0, sizeof(data));
+	run.sent = 0;
+	run.unique = 0;
+	run.copies = 0;
+	run.outOfOrder = 0;
+	run.bytes = 0;
+	run.firstArrival = 0;
+	run.lastArrival = 0;
+	run.hash = 2166136261u;
+	run.delays.clear();
+	Uint32 highest = 0;
+	for (Uint32 now = 0; (run.sent < packets) || (link.pending() > 0); ++now)
+	{
+		for (Uint32 i = 0; (i < perTick) && (run.sent < packets) && (now % spacing == 0); ++i)
+		{
+			memcpy(data, &run.sent, 4);
+			memcpy(data + 4, &now, 4);
+			link.send(data, PacketSize, address, now);
+			run.sent++;
+		}
+		int len;
+		while (link.receive(now, data, len, address))
+		{
+			Uint32 sequence;
+			Uint32 time;
+			memcpy(&sequence, data, 4);
+			memcpy(&time, data + 4, 4);
+			run.hash = ((run.hash ^ sequence) * 16777619u ^ now) * 16777619u;
+			run.copies++;
+			if (seen[sequence])
+				continue;
+			seen[sequence] = 1;
+			if (run.unique == 0)
+				run.firstArrival = now;
+			run.lastArrival = now;
+			run.unique++;
+			run.bytes += len;
+			if ((run.unique > 1) && (sequence < highest))
+				run.outOfOrder++;
+			else
+				highest = sequence;
+			run.delays.push_back(now - time);
+		}
+	}
+	run.dropped = link.stats().dropped;
+}
+
+static bool check(const char *what, double measured, double expected, double tolerance)
+{
+	bool ok = fabs(measured - expected) <= tolerance;
+	char buf[192];
+	SDL_snprintf(buf, sizeof(buf), "%s: %.4f, expected %.4f +- %.4f%s", what, measured, expected, tolerance,
+		ok ? "." : ": FAILED.");
+	if (ok)
+		g_log.logLog(buf);
+	else
+		g_log.logErr(buf);
+	return ok;
+}
+
+// Tolerance on a measured chance p over count draws: 4 standard deviations, times how much
+// longer runs of same outcome are than independent draws give.
+static double chanceTolerance(double p, Uint32 count, double runLength)
+{
+	if (count == 0)
+		return 1.0;
+	return 4.0 * sqrt(p * (1.0 - p) * runLength / count) + 0.002;
+}
+
+// Ms one way delays spread over, ignoring the long tail of exponential ones.
+static Uint32 jitterSpan(const NetConditions &conditions)
+{
+	switch (conditions.distribution)
+	{
+	case LatencyUniform:
+		return 2 * conditions.jitter;
+	case LatencyNormal:
+		return 6 * conditions.jitter;
+	case LatencyExponential:
+		return 8 * conditions.jitter;
+	}
+	return 0;
+}
+
+bool Ris::verifyLink(const NetConditions &conditions, Uint32 seed, Uint32 packets)
+{
+	g_log.logLog("Verifying " + conditions.describe() + ", seed " + String(seed) + ", " + String(packets) +
+		" packets.");
+	bool ok = true;
+	Uint32 span = jitterSpan(conditions);
+
+	// Loss, duplication and reordering, a packet per ms with no bandwidth cap to drop any.
+	NetConditions rates = conditions;
+	rates.bandwidth = 0;
+	LinkRun run;
+	runLink(rates, seed, packets, 1, 1, run);
+	// Gilbert-Elliott: link is bad burstStart / (burstStart + burstEnd) of the time.
+	double bad = (conditions.burstStart > 0.0f) ? conditions.burstStart / (conditions.burstStart + conditions.burstEnd) : 0.0;
+	double loss = (1.0 - bad) * conditions.loss + bad * conditions.burstLoss;
+	double burst = (conditions.burstStart > 0.0f) ? 1.0 + 2.0 / conditions.burstEnd : 1.0;
+	ok &= check("Loss", (double)(run.sent - run.unique) / run.sent, loss, chanceTolerance(loss, run.sent, burst));
+	ok &= check("Duplication", run.unique ? (double)(run.copies - run.unique) / run.unique : 0.0,
+		conditions.duplicate, chanceTolerance(conditions.duplicate, run.unique, 1.0));
+	// A packet held back is only seen overtaken if that is more than jitter alone moves packets.
+	if ((conditions.reorder <= 0.0f) || (conditions.reorderDelay > span + 1))
+		ok &= check("Reordering", run.unique ? (double)run.outOfOrder / run.unique : 0.0, conditions.reorder,
+			chanceTolerance(conditions.reorder, run.unique, 1.0));
+	else
+		g_log.logLog("Reordering not checked: reorder delay is within jitter.");
+	if (run.dropped > 0)
+	{
+		g_log.logErr(String(run.dropped) + " packets dropped with no bandwidth cap: FAILED.");
+		ok = false;
+	}
+
+	// Same seed, same packets at same times. Any other seed, not.
+	LinkRun again;
+	runLink(rates, seed, packets, 1, 1, again);
+	if (again.hash != run.hash)
+	{
+		g_log.logErr("Same seed gave different deliveries: FAILED.");
+		ok = false;
+	}
+	runLink(rates, seed + 1, packets, 1, 1, again);
+	if (!rates.isPerfect() && (again.hash == run.hash))
+	{
+		g_log.logErr("Another seed gave same deliveries: FAILED.");
+		ok = false;
+	}
+
+	// Latency, packets far enough apart that none waits behind an earlier one.
+	NetConditions delays = rates;
+	delays.reorder = 0.0f;
+	delays.duplicate = 0.0f;
+	runLink(delays, seed, packets, span + 1, 1, run);
+	double mean = conditions.latency + ((conditions.distribution == LatencyExponential) ? conditions.jitter : 0.0);
+	double deviation = (conditions.distribution == LatencyUniform) ? conditions.jitter / sqrt(3.0) : conditions.jitter;
+	// Delays are clamped at 0: only checked when that is too rare to move them.
+	if ((conditions.distribution == LatencyExponential) || (conditions.latency * 2 >= span))
+	{
+		double sum = 0.0;
+		for (size_t i = 0; i < run.delays.size(); ++i)
+			sum += run.delays[i];
+		double measured = run.delays.empty() ? 0.0 : sum / run.delays.size();
+		double squares = 0.0;
+		for (size_t i = 0; i < run.delays.size(); ++i)
+			squares += (run.delays[i] - measured) * (run.delays[i] - measured);
+		double spread = run.delays.empty() ? 0.0 : sqrt(squares / run.delays.size());
+		// Delays are rounded to ms.
+		ok &= check("Mean latency", measured, mean, 0.6 + 4.0 * deviation / sqrt((double)run.unique + 1.0));
+		ok &= check("Jitter deviation", spread, deviation, 0.5 + 0.1 * deviation);
+	}
+	else
+		g_log.logLog("Latency not checked: jitter goes below 0 ms.");
+
+	// Bandwidth, sending twice what it lets through.
+	if (conditions.bandwidth > 0)
+	{
+		NetConditions capped;
+		capped.bandwidth = conditions.bandwidth;
+		capped.queueLimit = conditions.queueLimit;
+		double perMs = 2.0 * conditions.bandwidth / 1000.0 / PacketSize;
+		Uint32 spacing = (perMs >= 1.0) ? 1 : (Uint32)(1.0 / perMs);
+		Uint32 perTick = (perMs >= 1.0) ? (Uint32)perMs : 1;
+		runLink(capped, seed, packets, spacing, perTick, run);
+		double elapsed = (run.lastArrival > run.firstArrival) ? (run.lastArrival - run.firstArrival) / 1000.0 : 1.0;
+		double rate = (run.bytes - PacketSize) / elapsed;
+		ok &= check("Bandwidth (bytes/s)", rate, conditions.bandwidth, 0.03 * conditions.bandwidth + PacketSize);
+		Uint32 longest = 0;
+		for (size_t i = 0; i < run.delays.size(); ++i)
+			longest = (run.delays[i] > longest) ? run.delays[i] : longest;
+		// Waits queueLimit at most, then its own time on the link.
+		Uint32 limit = conditions.queueLimit + PacketSize * 1000 / conditions.bandwidth + 1;
+		if ((longest > limit) || (run.dropped == 0))
+		{
+			g_log.logErr("Queue: " + String(longest) + " ms at most, limit " + String(limit) + " ms, " +
+				String(run.dropped) + " dropped: FAILED.");
+			ok = false;
+		}
+		else
+			g_log.logLog("Queue: " + String(longest) + " ms at most, limit " + String(limit) + " ms, " +
+				String(run.dropped) + " dropped.");
+	}
+	g_log.logLog(ok ? String("Link verified.") : String("Link verification FAILED."));
+	return ok;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "SDL_stdinc.h"
+
+#include "common/net_sim.h"
+
+namespace Ris
+{
+	// Checks a simulated link does what its conditions say, offline: numbered packets go through
+	// NetSimulator on a fake ms clock, and loss, duplication, reordering, latency, bandwidth and
+	// seeded determinism measured on what comes out are compared with what was asked.
+	// Each impairment is measured apart, with the others off where they would hide it.
+	// Results are logged. Returns false if any check failed.
+	bool verifyLink(const Net::NetConditions &conditions, Uint32 seed, Uint32 packets);
+}
@@ -0,0 +1,93 @@
+#include "SDL.h"
+#include "SDL_net.h"
+
+#include "common/string.h"
+#include "common/logging.h"
+#include "proxy.h"
+#include "link_check.h"
+
+#include <stdlib.h>
+
+using namespace Ris;
+
+// RissagaProxy --connect host[:port] [--listen port] [--link conditions] [--up conditions]
+//     [--down conditions] [--seed n] [--max-clients n] [--report seconds] [--verify packets]
+// Conditions are described on net_sim.h. --link sets both ways, --up and --down one of them.
+// --verify sends packets through both simulated links offline and checks what comes out
+// matches conditions, instead of proxying.
+int main(int argc, char *argv[])
+{
+	String host = "127.0.0.1";
+	Uint16 port = Net::DefaultPort;
+	ProxyConfig config;
+	Uint32 verifyPackets = 0;
+	for (int i = 1; i < argc - 1; ++i)
+	{
+		String arg(argv[i]);
+		bool parsed = true;
+		if (arg == "--connect")
+		{
+			// host[:port]
+			host = argv[++i];
+			size_t colon = host.find(':');
+			if (colon != String::npos)
+			{
+				port = (Uint16)atoi(host.c_str() + colon + 1);
+				host = host.substr(0, colon);
+			}
+		}
+		else if (arg == "--listen")
+			config.port = (Uint16)atoi(argv[++i]);
+		else if (arg == "--link")
+		{
+			parsed = config.up.parse(argv[++i]);
+			config.down = config.up;
+		}
+		else if (arg == "--up")
+			parsed = config.up.parse(argv[++i]);
+		else if (arg == "--down")
+			parsed = config.down.parse(argv[++i]);
+		else if (arg == "--seed")
+			config.seed = (Uint32)atoi(argv[++i]);
+		else if (arg == "--max-clients")
+			config.maxClients = atoi(argv[++i]);
+		else if (arg == "--report")
+			config.reportInterval = (Uint32)atoi(argv[++i]) * 1000;
+		else if (arg == "--verify")
+			verifyPackets = (Uint32)atoi(argv[++i]);
+		if (!parsed)
+			return EXIT_FAILURE;
+	}
+	if (verifyPackets > 0)
+	{
+		// Seeds of first client links.
+		Uint32 seed = config.seed * 7919;
+		bool up = verifyLink(config.up, seed, verifyPackets);
+		bool down = verifyLink(config.down, seed * 7919 + 1, verifyPackets);
+		return (up && down) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	if (SDL_Init(SDL_INIT_TIMER | SDL_INIT_EVENTS) < 0)
+	{
+		g_log.logErr("SDL could not initialize! SDL_Error: " + String(SDL_GetError()));
+		return EXIT_FAILURE;
+	}
+	if (SDLNet_Init() < 0)
+	{
+		g_log.logErr("SDL_net could not initialize! SDL_net Error: " + String(SDLNet_GetError()));
+		SDL_Quit();
+		return EXIT_FAILURE;
+	}
+	int result = EXIT_SUCCESS;
+	{
+		NetProxy proxy(config);
+		if (proxy.start(host, port))
+			proxy.run();
+		else
+			result = EXIT_FAILURE;
+		proxy.stop();
+	}
+	SDLNet_Quit();
+	SDL_Quit();
+	return result;
+}
@@ -0,0 +1,187 @@
+#include "proxy.h"
+
+#include "SDL_events.h"
+#include "SDL_timer.h"
+
+#include "common/logging.h"
+
+using namespace Ris;
+
+static String addressString(const IPaddress &address)
+{
+	const Uint8 *host = reinterpret_cast<const Uint8*>(&address.host);
+	char buf[32];
+	SDL_snprintf(buf, sizeof(buf), "%u.%u.%u.%u:%u", host[0], host[1], host[2], host[3],
+		SDLNet_Read16(&address.port));
+	return buf;
+}
+
+NetProxy::Session::Session(const ProxyConfig &config, Uint32 seed) :
+	socket(nullptr),
+	lastSeen(0),
+	up(config.up, seed),
+	down(config.down, seed * 7919 + 1)
+{ }
+
+NetProxy::NetProxy(const ProxyConfig &config) :
+	m_config(config),
+	m_socket(nullptr),
+	m_set(nullptr),
+	m_packet(nullptr),
+	m_opened(0)
+{
+	m_server.host = INADDR_NONE;
+	m_server.port = 0;
+}
+
+NetProxy::~NetProxy()
+{
+	stop();
+}
+
+bool NetProxy::start(const String &host, Uint16 port)
+{
+	if (SDLNet_ResolveHost(&m_server, host.c_str(), port) < 0)
+	{
+		g_log.logErr("Cannot resolve " + host + ": " + String(SDLNet_GetError()));
+		return false;
+	}
+	m_socket = SDLNet_UDP_Open(m_config.port);
+	m_set = SDLNet_AllocSocketSet(m_config.maxClients + 1);
+	m_packet = SDLNet_AllocPacket(Net::MaxPacketSize);
+	if ((m_socket == nullptr) || (m_set == nullptr) || (m_packet == nullptr))
+	{
+		g_log.logErr("Cannot open UDP port " + String(m_config.port) + ": " + String(SDLNet_GetError()));
+		stop();
+		return false;
+	}
+	SDLNet_UDP_AddSocket(m_set, m_socket);
+	g_log.logLog("Proxying port " + String(m_config.port) + " to " + host + ":" + String(port) + ".");
+	g_log.logLog("Up link: " + m_config.up.describe() + ".");
+	g_log.logLog("Down link: " + m_config.down.describe() + ".");
+	return true;
+}
+
+void NetProxy::run()
+{
+	Uint32 lastReport = SDL_GetTicks();
+	while (!SDL_QuitRequested())
+	{
+		Uint32 now = SDL_GetTicks();
+		if (!pump(now))
+			break;
+		if (now - lastReport >= m_config.reportInterval)
+		{
+			report();
+			lastReport = now;
+		}
+		// Packets come due on any ms.
+		SDLNet_CheckSockets(m_set, 1);
+	}
+}
+
+void NetProxy::stop()
+{
+	if (m_socket == nullptr)
+		return;
+	while (!m_sessions.empty())
+		close(m_sessions.size() - 1);
+	report();
+	SDLNet_FreePacket(m_packet);
+	SDLNet_FreeSocketSet(m_set);
+	SDLNet_UDP_Close(m_socket);
+	m_packet = nullptr;
+	m_set = nullptr;
+	m_socket = nullptr;
+}
+
+NetProxy::Session *NetProxy::session(const IPaddress &client, Uint32 now)
+{
+	for (size_t i = 0; i < m_sessions.size(); ++i)
+	{
+		Session &s = *m_sessions[i];
+		if ((s.client.host == client.host) && (s.client.port == client.port))
+			return &s;
+	}
+	if ((int)m_sessions.size() >= m_config.maxClients)
+		return nullptr;
+	SessionPtr s(new Session(m_config, m_config.seed * 7919 + m_opened));
+	s->client = client;
+	s->lastSeen = now;
+	s->socket = SDLNet_UDP_Open(0);
+	if (s->socket == nullptr)
+	{
+		g_log.logErr("Cannot open socket for " + addressString(client) + ": " + String(SDLNet_GetError()));
+		return nullptr;
+	}
+	SDLNet_UDP_AddSocket(m_set, s->socket);
+	m_opened++;
+	g_log.logLog("Client " + addressString(client) + " joined.");
+	m_sessions.push_back(std::move(s));
+	return m_sessions.back().get();
+}
+
+void NetProxy::close(size_t index)
+{
+	Session &s = *m_sessions[index];
+	m_upStats.add(s.up.stats());
+	m_downStats.add(s.down.stats());
+	SDLNet_UDP_DelSocket(m_set, s.socket);
+	SDLNet_UDP_Close(s.socket);
+	g_log.logLog("Client " + addressString(s.client) + " left.");
+	m_sessions.erase(m_sessions.begin() + index);
+}
+
+void NetProxy::forward(UDPsocket socket)
+{
+	if (SDLNet_UDP_Send(socket, -1, m_packet) == 0)
+		g_log.logErr("Cannot send packet: " + String(SDLNet_GetError()));
+}
+
+bool NetProxy::pump(Uint32 now)
+{
+	int got;
+	while ((got = SDLNet_UDP_Recv(m_socket, m_packet)) > 0)
+	{
+		Session *s = session(m_packet->address, now);
+		if (s == nullptr)
+			continue;
+		s->lastSeen = now;
+		s->up.send(m_packet->data, m_packet->len, m_server, now);
+	}
+	if (got < 0)
+	{
+		g_log.logErr("Cannot receive packet: " + String(SDLNet_GetError()));
+		return false;
+	}
+	for (size_t i = m_sessions.size(); i-- > 0;)
+	{
+		Session &s = *m_sessions[i];
+		while ((got = SDLNet_UDP_Recv(s.socket, m_packet)) > 0)
+		{
+			if ((m_packet->address.host == m_server.host) && (m_packet->address.port == m_server.port))
+				s.down.send(m_packet->data, m_packet->len, s.client, now);
+		}
+		while (s.up.receive(now, m_packet->data, m_packet->len, m_packet->address))
+			forward(s.socket);
+		while (s.down.receive(now, m_packet->data, m_packet->len, m_packet->address))
+			forward(m_socket);
+		// Quiet and nothing left on its way.
+		if ((now - s.lastSeen > m_config.timeout) && (s.up.pending() == 0) && (s.down.pending() == 0))
+			close(i);
+	}
+	return true;
+}
+
+void NetProxy::report()
+{
+	Net::NetSimStats up = m_upStats;
+	Net::NetSimStats down = m_downStats;
+	for (size_t i = 0; i < m_sessions.size(); ++i)
+	{
+		up.add(m_sessions[i]->up.stats());
+		down.add(m_sessions[i]->down.stats());
+	}
+	g_log.logLog(String((Uint32)m_sessions.size()) + " clients. Up: " + up.describe() + ".");
+	g_log.logLog("Down: " + down.describe() + ".");
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "SDL_net.h"
+
+#include "common/string.h"
+#include "common/net_sim.h"
+
+namespace Ris
+{
+	struct ProxyConfig
+	{
+		Uint16 port;
+		// Client to server, and back.
+		Net::NetConditions up;
+		Net::NetConditions down;
+		Uint32 seed;
+		int maxClients;
+		// Client forgotten after this long without packets, in ms.
+		Uint32 timeout;
+		Uint32 reportInterval;
+
+		ProxyConfig() : port(Net::DefaultPort + 1), seed(1), maxClients(64), timeout(10000), reportInterval(5000)
+		{ }
+	};
+
+	// Local UDP proxy with a simulated link per client: clients connect to it instead of
+	// to server. Each client gets its own socket towards server, so server still tells
+	// them apart by address. Link randomness is seeded from config seed and client order.
+	class NetProxy
+	{
+		struct Session
+		{
+			IPaddress client;
+			UDPsocket socket;
+			Uint32 lastSeen;
+			Net::NetSimulator up;
+			Net::NetSimulator down;
+
+			Session(const ProxyConfig &config, Uint32 seed);
+		};
+		typedef std::unique_ptr<Session> SessionPtr;
+
+		ProxyConfig m_config;
+		IPaddress m_server;
+		UDPsocket m_socket;
+		SDLNet_SocketSet m_set;
+		UDPpacket *m_packet;
+		std::vector<SessionPtr> m_sessions;
+		Uint32 m_opened;
+		// Of closed sessions.
+		Net::NetSimStats m_upStats;
+		Net::NetSimStats m_downStats;
+
+		Session *session(const IPaddress &client, Uint32 now);
+		void close(size_t index);
+		// Sends m_packet.
+		void forward(UDPsocket socket);
+		// Moves every pending and due packet along. Returns false on socket error.
+		bool pump(Uint32 now);
+		void report();
+
+	public:
+		NetProxy(const ProxyConfig &config);
+		~NetProxy();
+
+		bool start(const String &host, Uint16 port);
+		// Until quit is requested.
+		void run();
+		void stop();
+	};
+}
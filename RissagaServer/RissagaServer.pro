@@ -0,0 +1,72 @@
+#-------------------------------------------------
+#
+# Headless game server. Shares common/ and utils/ with RissagaClient.
+#
+#-------------------------------------------------
+
+QT       -= core gui
+
+CONFIG += c++11
+
+TARGET = RissagaServer
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+
+INCLUDEPATH += D:\Projects\Rissaga
+INCLUDEPATH += D:\Projects\Rissaga\GW_SDL2\include
+
+LIBS += -LD:\Projects\Rissaga\GW_SDL2\i686-w64-mingw32\lib -lmingw32 -lSDL2Main -lSDL2 -lSDL2_net
+
+SOURCES += \
+    source/main.cpp \
+    source/server.cpp \
+    source/world.cpp \
+    ../common/jobs.cpp \
+    ../common/snapshot_delta.cpp \
+    ../common/net_io.cpp \
+    source/interest.cpp \
+    ../common/walk_grid.cpp \
+    ../common/pathfinder.cpp \
+    ../common/cluster_path.cpp \
+    ../common/flow_field.cpp \
+    ../common/steering.cpp \
+    ../common/tile_collision.cpp \
+    source/benchmarks.cpp \
+    ../common/net_sim.cpp \
+    ../common/net_channel.cpp \
+    ../common/clock_sync.cpp
+
+HEADERS += \
+    source/server.h \
+    source/world.h \
+    ../common/game_obj.h \
+    ../common/histogram.h \
+    ../common/jobs.h \
+    ../common/movement_fsm.h \
+    ../common/net_protocol.h \
+    ../common/bitstream.h \
+    ../common/snapshot_delta.h \
+    ../common/state_machine.h \
+    ../common/string.h \
+    ../common/logging.h \
+    ../common/profiler.h \
+    ../utils/math.h \
+    ../utils/point.h \
+    ../common/net_io.h \
+    ../common/spsc_queue.h \
+    source/interest.h \
+    ../utils/fixed.h \
+    ../common/walk_grid.h \
+    ../common/pathfinder.h \
+    ../common/cluster_path.h \
+    ../common/flow_field.h \
+    ../common/steering.h \
+    ../common/tile_collision.h \
+    source/benchmarks.h \
+    ../common/net_sim.h \
+    ../common/net_channel.h \
+    ../common/clock_sync.h \
+    ../common/simd.h
@@ -0,0 +1,1618 @@
+#include "benchmarks.h"
+#include "world.h"
+#include "interest.h"
+
+#include "SDL.h"
+#include "SDL_net.h"
+
+#include "common/logging.h"
+#include "common/clock_sync.h"
+#include "common/cluster_path.h"
+#include "common/histogram.h"
+#include "common/jobs.h"
+#include "common/movement_fsm.h"
+#include "common/net_protocol.h"
+#include "common/net_channel.h"
+#include "common/net_io.h"
+#include "common/net_sim.h"
+#include "common/pathfinder.h"
+#include "common/snapshot_delta.h"
+#include "common/state_machine.h"
+#include "common/steering.h"
+#include "common/tile_collision.h"
+
+#include <functional>
+#include <math.h>
+#include <queue>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+using namespace Ris;
+
+namespace
+{
+	typedef bool (*BenchmarkFunction)(Uint32 size);
+
+	struct Benchmark
+	{
+		const char *name;
+		BenchmarkFunction function;
+		Uint32 defaultSize;
+		const char *description;
+	};
+
+	const Uint32 Ticks = 100;
+	const int Views = 64;
+	const float ViewSize = 1024.0f;
+
+	// Entity encodings compared by the serialization benchmark.
+	enum Schema
+	{
+		// SnapshotEntity, byte aligned, as full snapshots are sent.
+		SchemaBytes = 0,
+		// EntityState against a zero baseline.
+		SchemaFull,
+		// EntityState against last tick, every field.
+		SchemaDelta,
+		// ID and changed fields only, as delta snapshots are sent.
+		SchemaChanged,
+		SchemaCount
+	};
+	const char *schemaNames[SchemaCount] = { "bytes", "full", "delta", "changed" };
+}
+
+static inline Uint32 microsecondsSince(Uint64 start)
+{
+	return (Uint32)((SDL_GetPerformanceCounter() - start) * 1000000 / SDL_GetPerformanceFrequency());
+}
+
+static inline Uint32 nextRandom(Uint32 &seed)
+{
+	seed = seed * 1103515245 + 12345;
+	return seed >> 8;
+}
+
+static String formatFloat(const char *format, double v)
+{
+	char buffer[32];
+	SDL_snprintf(buffer, sizeof(buffer), format, v);
+	return String(buffer);
+}
+
+// Per entity state objects, as the local player had them before MovementFSM.
+struct VirtualMover
+{
+	StateStand stand;
+	StateWalking walk;
+	State *current;
+};
+
+static void applyVirtual(VirtualMover &mover, const SDL_KeyboardEvent &key)
+{
+	State::StateID next = mover.current->checkKeyboard(key);
+	if (next == State::NoState)
+		return;
+	mover.current->onExit();
+	mover.current = (next == State::Walking) ? static_cast<State*>(&mover.walk) : static_cast<State*>(&mover.stand);
+	mover.current->onEnter(key);
+}
+
+// One event per entity and tick, then a move, on MovementFSM tables and on virtual State objects.
+static bool movementBenchmark(Uint32 size)
+{
+	static const SDL_Keycode keys[4] = { SDLK_UP, SDLK_DOWN, SDLK_RIGHT, SDLK_LEFT };
+	std::vector<MoveInput> inputs(size);
+	MovementFSM fsm;
+	fsm.resize(size);
+	std::vector<VirtualMover> movers(size);
+	for (Uint32 i = 0; i < size; ++i)
+	{
+		movers[i].current = &movers[i].stand;
+		movers[i].walk.direction = StateWalking::NoDir;
+	}
+	std::vector<float> x(size, 0.0f);
+	std::vector<float> y(size, 0.0f);
+	std::vector<float> virtualX(size, 0.0f);
+	std::vector<float> virtualY(size, 0.0f);
+	Histogram tables;
+	Histogram virtuals;
+	Uint32 seed = 1;
+	for (Uint32 t = 0; t < Ticks; ++t)
+	{
+		for (Uint32 i = 0; i < size; ++i)
+		{
+			inputs[i].entity = i;
+			inputs[i].event = (Uint8)(MovePressNorth + nextRandom(seed) % (MoveEventCount - 1));
+		}
+
+		Uint64 start = SDL_GetPerformanceCounter();
+		fsm.updateAll(inputs);
+		fsm.integrate(x.data(), y.data(), 2.0f);
+		tables.record(microsecondsSince(start));
+
+		start = SDL_GetPerformanceCounter();
+		for (Uint32 i = 0; i < size; ++i)
+		{
+			SDL_KeyboardEvent key;
+			SDL_zero(key);
+			Uint8 event = inputs[i].event;
+			key.state = (event >= MoveReleaseNorth) ? SDL_RELEASED : SDL_PRESSED;
+			key.keysym.sym = keys[(event - MovePressNorth) & 3];
+			applyVirtual(movers[i], key);
+		}
+		for (Uint32 i = 0; i < size; ++i)
+		{
+			const VirtualMover &mover = movers[i];
+			if (mover.current->stateID() != State::Walking)
+				continue;
+			Uint8 d = (Uint8)mover.walk.direction & 0xF;
+			virtualX[i] += MoveTables::moveX[d] * 2.0f;
+			virtualY[i] += MoveTables::moveY[d] * 2.0f;
+		}
+		virtuals.record(microsecondsSince(start));
+	}
+	Uint32 walking = 0;
+	for (Uint32 i = 0; i < size; ++i)
+		walking += (fsm.state(i) == State::Walking) ? 1 : 0;
+	g_log.logLog("Movement benchmark: " + String(size) + " entities, " + String(Ticks) + " ticks, " + String(walking) +
+		" walking at end, tables " + formatFloat("%.2f", tables.average() ? (double)virtuals.average() / tables.average() : 0.0) +
+		"x faster than virtual states.");
+	g_log.logLog(tables.report("Tables"));
+	g_log.logLog(virtuals.report("Virtual"));
+	return true;
+}
+
+// Entities of the jobs benchmark, on a square area where 64 client views are.
+struct JobsWorld
+{
+	MovementFSM movement;
+	std::vector<float> x;
+	std::vector<float> y;
+	std::vector<Uint8> visible;
+	float viewX[Views];
+	float viewY[Views];
+	Steering steering;
+
+	void reset(Uint32 size);
+	static void integrateRange(void *context, Uint32 begin, Uint32 end);
+	static void cullRange(void *context, Uint32 begin, Uint32 end);
+};
+
+void JobsWorld::reset(Uint32 size)
+{
+	Uint32 seed = 7;
+	float side = sqrtf((float)size) * 40.0f;
+	movement.resize(size);
+	x.resize(size);
+	y.resize(size);
+	visible.assign(size, 0);
+	steering.resize(size);
+	for (Uint32 i = 0; i < size; ++i)
+	{
+		x[i] = (float)(nextRandom(seed) % 65536) * side / 65536.0f;
+		y[i] = (float)(nextRandom(seed) % 65536) * side / 65536.0f;
+		movement.set(i, State::Walking, (Uint8)(1 << (nextRandom(seed) & 3)));
+		steering.setPosition(i, x[i], y[i]);
+		steering.setVelocity(i, 0.0f, 0.0f);
+		Uint8 d = movement.moveDirection(i);
+		steering.setPreferred(i, MoveTables::moveX[d] * 2.0f, MoveTables::moveY[d] * 2.0f);
+		steering.setMode(i, (i & 1) ? Steering::Steered : Steering::Obstacle);
+	}
+	for (int v = 0; v < Views; ++v)
+	{
+		viewX[v] = (float)(nextRandom(seed) % 65536) * (side - ViewSize) / 65536.0f;
+		viewY[v] = (float)(nextRandom(seed) % 65536) * (side - ViewSize) / 65536.0f;
+	}
+}
+
+void JobsWorld::integrateRange(void *context, Uint32 begin, Uint32 end)
+{
+	JobsWorld *world = static_cast<JobsWorld*>(context);
+	world->movement.integrate(world->x.data(), world->y.data(), 2.0f, begin, end);
+}
+
+void JobsWorld::cullRange(void *context, Uint32 begin, Uint32 end)
+{
+	JobsWorld *world = static_cast<JobsWorld*>(context);
+	for (Uint32 i = begin; i < end; ++i)
+	{
+		Uint8 views = 0;
+		for (int v = 0; v < Views; ++v)
+		{
+			float dx = world->x[i] - world->viewX[v];
+			float dy = world->y[i] - world->viewY[v];
+			views += ((dx >= 0.0f) && (dx < ViewSize) && (dy >= 0.0f) && (dy < ViewSize)) ? 1 : 0;
+		}
+		world->visible[i] = views;
+	}
+}
+
+// Movement integration, culling against client views and steering of size entities, on the calling
+// thread alone and then on 2 to 32 threads. Speedups are against the calling thread alone.
+static bool jobsBenchmark(Uint32 size)
+{
+	JobSystem &jobs = JobSystem::instance();
+	JobsWorld world;
+	double single = 0.0;
+	for (int threads = 1; threads <= 32; threads *= 2)
+	{
+		// Calling thread runs jobs too.
+		if ((threads > 1) && !jobs.start(threads - 1))
+			return false;
+		world.reset(size);
+		Histogram integrate;
+		Histogram cull;
+		Histogram steer;
+		for (Uint32 t = 0; t < Ticks; ++t)
+		{
+			Uint64 start = SDL_GetPerformanceCounter();
+			jobs.parallelForWait(size, 4096, JobsWorld::integrateRange, &world);
+			integrate.record(microsecondsSince(start));
+			start = SDL_GetPerformanceCounter();
+			jobs.parallelForWait(size, 1024, JobsWorld::cullRange, &world);
+			cull.record(microsecondsSince(start));
+			start = SDL_GetPerformanceCounter();
+			world.steering.update();
+			steer.record(microsecondsSince(start));
+		}
+		jobs.stop();
+		double total = (double)integrate.average() + cull.average() + steer.average();
+		if (threads == 1)
+			single = total;
+		g_log.logLog("Jobs benchmark: " + String(size) + " entities, " + String(threads) + " threads: integrate " +
+			formatFloat("%.2f", integrate.average() / 1000.0) + " ms, cull " + formatFloat("%.2f", cull.average() / 1000.0) +
+			" ms, steer " + formatFloat("%.2f", steer.average() / 1000.0) + " ms, speedup " +
+			formatFloat("%.2f", total ? single / total : 0.0) + "x.");
+	}
+	g_log.logLog("Jobs benchmark: " + String(SDL_GetCPUCount()) + " cores.");
+	return true;
+}
+
+// Encodes every entity on schema. Returns bytes used, 0 on overflow.
+static int encodeEntities(int schema, std::vector<Net::EntityState> &states, const std::vector<Net::EntityState> &baselines,
+	Uint8 *data, int size)
+{
+	Uint32 count = (Uint32)states.size();
+	if (schema == SchemaBytes)
+	{
+		Net::ByteWriter w(data, size);
+		for (Uint32 i = 0; i < count; ++i)
+		{
+			const Net::EntityState &e = states[i];
+			Net::SnapshotEntity se = { e.id, e.position.x, e.position.y, e.state, e.dirs };
+			Net::writeSnapshotEntity(w, se);
+		}
+		return w.overflow() ? 0 : w.size();
+	}
+	Net::WriteStream s(data, size);
+	if (schema == SchemaFull)
+	{
+		for (Uint32 i = 0; i < count; ++i)
+			states[i].serialize(s);
+	}
+	else if (schema == SchemaDelta)
+	{
+		for (Uint32 i = 0; i < count; ++i)
+			states[i].serialize(s, baselines[i]);
+	}
+	else
+	{
+		for (Uint32 i = 0; i < count; ++i)
+		{
+			Uint8 mask = states[i].dirtyMask(baselines[i]);
+			Net::serializeVarint(s, states[i].id);
+			states[i].serializeChanged(s, baselines[i], mask);
+		}
+	}
+	int bytes = s.flush();
+	return s.error() ? 0 : bytes;
+}
+
+// Entities one tick after their baselines, most of them walking, on every schema.
+// Reports bytes per entity and encode rate on the calling thread, and checks delta encoded
+// entities are decoded as they were.
+static bool serializationBenchmark(Uint32 size)
+{
+	std::vector<Net::EntityState> baselines(size);
+	std::vector<Net::EntityState> states(size);
+	Uint32 seed = 3;
+	for (Uint32 i = 0; i < size; ++i)
+	{
+		Net::EntityState &b = baselines[i];
+		b.id = i * 3 + nextRandom(seed) % 3;
+		b.position.set((float)(nextRandom(seed) % 8192), (float)(nextRandom(seed) % 8192));
+		b.dirs = (nextRandom(seed) % 4) ? (Uint8)(1 << (nextRandom(seed) & 3)) : (Uint8)StateWalking::NoDir;
+		b.state = b.dirs ? (Uint8)State::Walking : (Uint8)State::Standing;
+		b.health = 100;
+		b.mana = 50;
+		b.quantize();
+		Net::EntityState &e = states[i];
+		e = b;
+		e.position.x += MoveTables::moveX[e.dirs] * 4.0f;
+		e.position.y += MoveTables::moveY[e.dirs] * 4.0f;
+		if (nextRandom(seed) % 16 == 0)
+			e.health -= (Sint32)(nextRandom(seed) % 20);
+		e.quantize();
+	}
+	std::vector<Uint8> buffer(size * 32 + 64);
+	for (int schema = 0; schema < SchemaCount; ++schema)
+	{
+		int bytes = 0;
+		Uint64 start = SDL_GetPerformanceCounter();
+		Uint32 passes = 0;
+		do
+		{
+			bytes = encodeEntities(schema, states, baselines, buffer.data(), (int)buffer.size());
+			passes++;
+		}
+		while (microsecondsSince(start) < 500000);
+		double seconds = (double)microsecondsSince(start) / 1000000.0;
+		if (bytes == 0)
+		{
+			g_log.logErr("Serialization benchmark: " + String(schemaNames[schema]) + " overflowed its buffer.");
+			return false;
+		}
+		g_log.logLog("Serialization benchmark: " + String(schemaNames[schema]) + ": " +
+			formatFloat("%.2f", (double)bytes / size) + " bytes/entity, " +
+			formatFloat("%.1f", (double)size * passes / seconds / 1000000.0) + " M entities/s, " +
+			formatFloat("%.0f", (double)bytes * passes / seconds / 1048576.0) + " MB/s on one core.");
+	}
+
+	// Round trip of what delta snapshots send.
+	int bytes = encodeEntities(SchemaChanged, states, baselines, buffer.data(), (int)buffer.size());
+	Net::ReadStream r(buffer.data(), bytes);
+	Uint32 mismatches = 0;
+	for (Uint32 i = 0; i < size; ++i)
+	{
+		Net::EntityState e;
+		Uint8 mask = 0;
+		Net::serializeVarint(r, e.id);
+		e.serializeChanged(r, baselines[i], mask);
+		const Net::EntityState &src = states[i];
+		if ((e.id != src.id) || (e.position.x != src.position.x) || (e.position.y != src.position.y) || (e.state != src.state) ||
+			(e.dirs != src.dirs) || (e.health != src.health) || (e.mana != src.mana))
+			mismatches++;
+	}
+	if (r.error() || mismatches)
+	{
+		g_log.logErr("Serialization benchmark: " + String(mismatches) + " entities decoded wrong.");
+		return false;
+	}
+	return true;
+}
+
+// One client of the snapshot loopback: both ends of its delta snapshots, and the links between them.
+struct LoopbackClient
+{
+	Net::SnapshotEncoder encoder;
+	Net::SnapshotDecoder decoder;
+	Net::NetSimulator down;
+	Net::NetSimulator up;
+	// What was encoded on each snapshot still on history, and whether it all fit the budget.
+	std::vector<Net::EntityState> sources[Net::SnapshotHistory];
+	bool complete[Net::SnapshotHistory];
+
+	LoopbackClient() : down(Net::NetConditions(), 1, 256), up(Net::NetConditions(), 1, 256)
+	{ }
+};
+
+static bool sameEntities(const std::vector<Net::EntityState> &a, const std::vector<Net::EntityState> &b)
+{
+	if (a.size() != b.size())
+		return false;
+	for (size_t i = 0; i < a.size(); ++i)
+	{
+		const Net::EntityState &x = a[i];
+		const Net::EntityState &y = b[i];
+		if ((x.id != y.id) || (x.position.x != y.position.x) || (x.position.y != y.position.y) || (x.state != y.state) ||
+			(x.dirs != y.dirs) || (x.health != y.health) || (x.mana != y.mana))
+			return false;
+	}
+	return true;
+}
+
+// Wandering entities seen by size clients, each following one of them. Delta snapshots go through
+// lossy links, acks come back through others, for a simulated minute. Every snapshot decoded as the
+// newest one must be what was encoded, unless part of it was left out for the budget.
+static bool snapshotLoopback(Uint32 size)
+{
+	const Uint32 entityCount = 2000;
+	const float area = 2048.0f;
+	const float viewRadius = 256.0f;
+	const Uint32 tickInterval = 50;
+	const Uint32 ticks = 1200;
+	Net::NetConditions conditions;
+	conditions.parse("latency=60,jitter=20,loss=10,dup=2,reorder=5");
+
+	std::vector<Net::EntityState> world(entityCount);
+	Uint32 seed = 11;
+	for (Uint32 i = 0; i < entityCount; ++i)
+	{
+		world[i].id = i;
+		world[i].position.set((float)(nextRandom(seed) % (Uint32)area), (float)(nextRandom(seed) % (Uint32)area));
+		world[i].state = State::Standing;
+		world[i].health = 100;
+		world[i].mana = 50;
+		world[i].quantize();
+	}
+	std::vector<LoopbackClient> clients(size);
+	for (Uint32 c = 0; c < size; ++c)
+	{
+		clients[c].down.setConditions(conditions);
+		clients[c].down.reset(c * 2 + 1);
+		clients[c].up.setConditions(conditions);
+		clients[c].up.reset(c * 2 + 2);
+		for (int h = 0; h < Net::SnapshotHistory; ++h)
+			clients[c].complete[h] = false;
+	}
+
+	Uint8 data[Net::MaxPacketSize];
+	IPaddress address;
+	SDL_zero(address);
+	Uint32 decoded = 0;
+	Uint32 matched = 0;
+	Uint32 partial = 0;
+	Uint32 mismatched = 0;
+	Uint32 failed = 0;
+	for (Uint32 t = 1; t <= ticks; ++t)
+	{
+		Uint32 now = t * tickInterval;
+		for (Uint32 i = 0; i < entityCount; ++i)
+		{
+			Net::EntityState &e = world[i];
+			if (nextRandom(seed) % 20 == 0)
+			{
+				e.dirs = (nextRandom(seed) % 4) ? (Uint8)(1 << (nextRandom(seed) & 3)) : (Uint8)StateWalking::NoDir;
+				e.state = e.dirs ? (Uint8)State::Walking : (Uint8)State::Standing;
+			}
+			if (nextRandom(seed) % 50 == 0)
+				e.health = 50 + (Sint32)(nextRandom(seed) % 51);
+			float x = e.position.x + MoveTables::moveX[e.dirs] * 4.0f;
+			float y = e.position.y + MoveTables::moveY[e.dirs] * 4.0f;
+			e.position.set((x < 0.0f) ? x + area : ((x >= area) ? x - area : x), (y < 0.0f) ? y + area : ((y >= area) ? y - area : y));
+			e.quantize();
+		}
+		for (Uint32 c = 0; c < size; ++c)
+		{
+			LoopbackClient &client = clients[c];
+			const Net::EntityState &self = world[c % entityCount];
+			// Sequences start at 0, one per tick.
+			int slot = (int)((t - 1) % Net::SnapshotHistory);
+			std::vector<Net::EntityState> &source = client.sources[slot];
+			source.clear();
+			for (Uint32 i = 0; i < entityCount; ++i)
+			{
+				if ((fabsf(world[i].position.x - self.position.x) <= viewRadius) && (fabsf(world[i].position.y - self.position.y) <= viewRadius))
+					source.push_back(world[i]);
+			}
+			Uint32 deferred = client.encoder.stats().deferred;
+			int bytes = client.encoder.encode(t, now, source.data(), nullptr, (int)source.size(), data, sizeof(data));
+			if (bytes == 0)
+			{
+				g_log.logErr("Snapshot loopback: client " + String(c) + " could not encode tick " + String(t) + ".");
+				return false;
+			}
+			client.complete[slot] = (client.encoder.stats().deferred == deferred);
+			client.down.send(data, bytes, address, now);
+
+			int len;
+			IPaddress from;
+			while (client.down.receive(now, data, len, from))
+			{
+				Uint16 sequence;
+				Net::SnapshotDecoder::Result result = client.decoder.decode(data, len, sequence);
+				if (result != Net::SnapshotDecoder::Decoded)
+				{
+					failed += (result == Net::SnapshotDecoder::Malformed) ? 1 : 0;
+					continue;
+				}
+				decoded++;
+				Uint8 ack[2] = { (Uint8)(sequence >> 8), (Uint8)sequence };
+				client.up.send(ack, sizeof(ack), address, now);
+				const Net::ClientView *view = client.decoder.latest();
+				if (view->sequence != sequence)
+					continue;
+				int h = sequence % Net::SnapshotHistory;
+				if (!client.complete[h])
+					partial++;
+				else if (sameEntities(view->entities, client.sources[h]))
+					matched++;
+				else
+					mismatched++;
+			}
+			while (client.up.receive(now, data, len, from))
+				client.encoder.ack((Uint16)((data[0] << 8) | data[1]));
+		}
+	}
+	Net::NetSimStats links;
+	Uint64 bytes = 0;
+	for (Uint32 c = 0; c < size; ++c)
+	{
+		links.add(clients[c].down.stats());
+		bytes += clients[c].encoder.stats().bytes;
+	}
+	g_log.logLog("Snapshot loopback: " + String(size) + " clients, " + String(ticks) + " ticks over " + conditions.describe() + ".");
+	g_log.logLog("Snapshot loopback: " + links.describe() + ", " + String(bytes / ((Uint64)size * ticks)) + " bytes per snapshot.");
+	g_log.logLog("Snapshot loopback: " + String(decoded) + " decoded, " + String(matched) + " same as source, " + String(partial) +
+		" left entities out for budget, " + String(mismatched) + " different from source, " + String(failed) + " malformed.");
+	return (mismatched == 0) && (failed == 0) && (matched > 0);
+}
+
+// Message n of the channel verification: its number, then bytes any receiver can check.
+// Every 97th is bigger than a fragment.
+static void channelMessage(Uint32 n, std::vector<Uint8> &message)
+{
+	size_t size = (n % 97 == 96) ? 2500 : 8 + (n % 64) * 5;
+	message.resize(size);
+	memcpy(message.data(), &n, sizeof(n));
+	for (size_t k = sizeof(n); k < size; ++k)
+		message[k] = (Uint8)(n * 31 + k);
+}
+
+static bool validChannelMessage(const std::vector<Uint8> &message, Uint32 &n)
+{
+	if (message.size() < sizeof(n))
+		return false;
+	memcpy(&n, message.data(), sizeof(n));
+	std::vector<Uint8> expected;
+	channelMessage(n, expected);
+	return message == expected;
+}
+
+// Both ends of a Connection test and what each one got so far.
+struct ChannelEnd
+{
+	Net::Connection connection;
+	Net::NetSimulator link;
+	Uint32 nextOrdered;
+	Uint32 nextUnordered;
+	Uint32 nextUnreliable;
+	Uint32 ordered;
+	std::vector<Uint8> unordered;
+	std::vector<Uint8> unreliable;
+	Uint32 errors;
+
+	ChannelEnd(const Net::ChannelType *types, int count, const Net::NetConditions &conditions, Uint32 seed, Uint32 messages) :
+		connection(types, count), link(conditions, seed, 1024), nextOrdered(0), nextUnordered(0), nextUnreliable(0),
+		ordered(0), unordered(messages, 0), unreliable(messages, 0), errors(0)
+	{ }
+	void receive(Uint32 messages);
+};
+
+enum
+{
+	ChannelTestUnreliable = 0,
+	ChannelTestUnordered,
+	ChannelTestOrdered,
+	ChannelTestCount
+};
+
+void ChannelEnd::receive(Uint32 messages)
+{
+	std::vector<Uint8> message;
+	Uint32 n;
+	while (connection.receive(ChannelTestOrdered, message))
+	{
+		if (!validChannelMessage(message, n) || (n != ordered))
+			errors++;
+		ordered++;
+	}
+	while (connection.receive(ChannelTestUnordered, message))
+	{
+		if (!validChannelMessage(message, n) || (n >= messages) || unordered[n])
+			errors++;
+		else
+			unordered[n] = 1;
+	}
+	while (connection.receive(ChannelTestUnreliable, message))
+	{
+		if (!validChannelMessage(message, n) || (n >= messages) || unreliable[n])
+			errors++;
+		else
+			unreliable[n] = 1;
+	}
+}
+
+// Two Connections sending size messages to each other on every kind of channel, through lossy
+// links. Reliable ones must all be delivered once, ordered ones in order, unreliable ones at most
+// once. Once done, idle ends must stop sending.
+static bool channelVerification(Uint32 size)
+{
+	const Net::ChannelType types[ChannelTestCount] = { Net::ChannelUnreliable, Net::ChannelReliableUnordered, Net::ChannelReliableOrdered };
+	const Uint32 tickInterval = 20;
+	const Uint32 perTick = 4;
+	const Uint32 maxTicks = size + 100000;
+	Net::NetConditions conditions;
+	conditions.parse("latency=50,jitter=15,loss=10,burst=1,dup=2,reorder=5");
+	ChannelEnd a(types, ChannelTestCount, conditions, 1, size);
+	ChannelEnd b(types, ChannelTestCount, conditions, 2, size);
+	ChannelEnd *ends[2] = { &a, &b };
+	Uint8 data[Net::MaxPacketSize];
+	IPaddress address;
+	SDL_zero(address);
+	std::vector<Uint8> message;
+	Uint32 now = 0;
+	Uint32 idleTicks = 0;
+	Uint32 idlePackets = 0;
+	Uint32 t = 0;
+	for (; (t < maxTicks) && (idleTicks < 500); ++t)
+	{
+		now += tickInterval;
+		bool done = true;
+		for (int e = 0; e < 2; ++e)
+		{
+			ChannelEnd &end = *ends[e];
+			ChannelEnd &peer = *ends[1 - e];
+			for (Uint32 i = 0; (i < perTick) && (end.nextOrdered < size); ++i)
+			{
+				channelMessage(end.nextOrdered++, message);
+				end.connection.send(ChannelTestOrdered, message.data(), (int)message.size());
+			}
+			for (Uint32 i = 0; (i < perTick) && (end.nextUnordered < size); ++i)
+			{
+				channelMessage(end.nextUnordered++, message);
+				end.connection.send(ChannelTestUnordered, message.data(), (int)message.size());
+			}
+			for (Uint32 i = 0; (i < perTick) && (end.nextUnreliable < size); ++i)
+			{
+				// Big ones are left out: unreliable messages are never split.
+				channelMessage(end.nextUnreliable++, message);
+				if (message.size() <= Net::FragmentSize)
+					end.connection.send(ChannelTestUnreliable, message.data(), (int)message.size());
+			}
+			int bytes = end.connection.writePacket(data, sizeof(data), now);
+			if (bytes > 0)
+			{
+				end.link.send(data, bytes, address, now);
+				idlePackets += idleTicks ? 1 : 0;
+			}
+			int len;
+			IPaddress from;
+			while (peer.link.receive(now, data, len, from))
+			{
+				if (!end.connection.readPacket(data, len, now))
+					end.errors++;
+			}
+			end.receive(size);
+			done = done && (peer.ordered == size) && (end.nextUnreliable == size) && (end.connection.pendingReliable() == 0);
+		}
+		for (Uint32 n = 0; done && (n < size); ++n)
+			done = a.unordered[n] && b.unordered[n];
+		// Idle on a perfect link: nothing lost would stop bare acks bouncing back and forth.
+		if (done && (idleTicks == 0))
+		{
+			a.link.setConditions(Net::NetConditions());
+			b.link.setConditions(Net::NetConditions());
+		}
+		idleTicks = done ? idleTicks + 1 : 0;
+	}
+
+	bool ok = (idleTicks > 0);
+	for (int e = 0; e < 2; ++e)
+	{
+		ChannelEnd &end = *ends[e];
+		Uint32 unordered = 0;
+		Uint32 unreliable = 0;
+		for (Uint32 n = 0; n < size; ++n)
+		{
+			unordered += end.unordered[n];
+			unreliable += end.unreliable[n];
+		}
+		const Net::Connection::Stats &cs = end.connection.stats();
+		g_log.logLog("Channel verification: end " + String(e) + " got " + String(end.ordered) + " ordered, " + String(unordered) +
+			" unordered and " + String(unreliable) + " unreliable of " + String(size) + ", " + String(end.errors) + " errors. " +
+			String(cs.packetsSent) + " packets sent, " + String(cs.resent) + " resends, rtt " + String(end.connection.rtt()) + " ms.");
+		g_log.logLog("Channel verification: link " + String(e) + ": " + end.link.stats().describe() + ".");
+		ok = ok && (end.ordered == size) && (unordered == size) && (end.errors == 0);
+	}
+	g_log.logLog("Channel verification: " + String(t) + " ticks, " + String(idlePackets) + " packets sent while idle.");
+	// A bare ack or two is fine, ends acking each other forever is not.
+	return ok && (idlePackets < 10);
+}
+
+// Blasts packets from a NetIo to another one over loopback for size seconds.
+// Reports packets per second and latency from sender game thread to receiver game thread.
+static bool ioBenchmark(Uint32 seconds)
+{
+	enum
+	{
+		// Bounded, or we would only measure our own queues filling up.
+		InFlight = 2048,
+		PacketSize = 64
+	};
+	Net::NetIo receiver;
+	Net::NetIo sender(1024, InFlight * 2);
+	IPaddress to;
+	if (!receiver.start(0) || !sender.start(0) || (SDLNet_ResolveHost(&to, "127.0.0.1", receiver.port()) < 0))
+		return false;
+	Histogram latency;
+	Uint64 frequency = SDL_GetPerformanceFrequency();
+	Uint32 next = 0;
+	Uint32 newest = 0;
+	Uint32 received = 0;
+	Uint32 start = SDL_GetTicks();
+	Uint32 lastReceived = start;
+	Uint32 now = start;
+	while (now - start < seconds * 1000)
+	{
+		for (int i = 0; (i < Net::NetIo::Batch) && (next - newest < InFlight); ++i)
+		{
+			Net::NetPacket *packet = sender.allocate();
+			if (packet == nullptr)
+				break;
+			Uint64 stamp = SDL_GetPerformanceCounter();
+			memset(packet->data, 0, PacketSize);
+			memcpy(packet->data, &next, sizeof(next));
+			memcpy(packet->data + sizeof(next), &stamp, sizeof(stamp));
+			packet->len = PacketSize;
+			packet->address = to;
+			sender.send(packet);
+			next++;
+		}
+		sender.flush();
+		Net::NetPacket *packet;
+		while ((packet = receiver.receive()) != nullptr)
+		{
+			Uint32 sequence;
+			Uint64 stamp;
+			memcpy(&sequence, packet->data, sizeof(sequence));
+			memcpy(&stamp, packet->data + sizeof(sequence), sizeof(stamp));
+			receiver.release(packet);
+			latency.record((Uint32)((SDL_GetPerformanceCounter() - stamp) * 1000000 / frequency));
+			if (sequence + 1 > newest)
+				newest = sequence + 1;
+			received++;
+			lastReceived = now;
+		}
+		now = SDL_GetTicks();
+		// Everything in flight was lost.
+		if (now - lastReceived > 100)
+		{
+			newest = next;
+			lastReceived = now;
+		}
+	}
+	Uint32 elapsed = (now - start) ? now - start : 1;
+	Net::NetIoStats in = receiver.stats();
+	Net::NetIoStats out = sender.stats();
+	g_log.logLog("I/O benchmark: " + String(next) + " sent, " + String(received) + " received, " +
+		String((Uint64)received * 1000 / elapsed) + " packets/s, " + String(out.sendCalls) + " send calls, " +
+		String(in.receiveCalls) + " receive calls, " + String(in.dropped + out.dropped) + " dropped.");
+	g_log.logLog(latency.report("Latency"));
+	receiver.stop();
+	sender.stop();
+	return true;
+}
+
+// Two crowds of size/2 agents walking into each other, steered for 20 seconds of ticks. Workers are
+// not started: a steering tick must fit on one core. Reports tick times, and how many agents
+// still overlap a neighbour at the end.
+static bool steeringBenchmark(Uint32 agents)
+{
+	const Uint32 ticks = 20 * 20;
+	Steering steering;
+	steering.resize(agents);
+	float spacing = steering.params().radius * 3.0f;
+	Uint32 side = (Uint32)sqrtf((float)agents / 2.0f) + 1;
+	for (Uint32 i = 0; i < agents; ++i)
+	{
+		Uint32 k = i / 2;
+		bool east = (i & 1) == 0;
+		float x = (float)(k % side) * spacing + (east ? 0.0f : (float)side * spacing + 300.0f);
+		steering.setPosition(i, x, (float)(k / side) * spacing);
+		steering.setPreferred(i, east ? steering.params().maxSpeed : -steering.params().maxSpeed, 0.0f);
+		steering.setMode(i, Steering::Steered);
+	}
+	Histogram times;
+	Uint64 frequency = SDL_GetPerformanceFrequency();
+	Uint32 worstContacts = 0;
+	for (Uint32 t = 0; t < ticks; ++t)
+	{
+		Uint64 start = SDL_GetPerformanceCounter();
+		steering.update();
+		times.record((Uint32)((SDL_GetPerformanceCounter() - start) * 1000000 / frequency));
+		if (steering.stats().contacts > worstContacts)
+			worstContacts = steering.stats().contacts;
+	}
+	float speed = 0.0f;
+	for (Uint32 i = 0; i < agents; ++i)
+		speed += (i & 1) ? -steering.vx(i) : steering.vx(i);
+	char buffer[64];
+	SDL_snprintf(buffer, sizeof(buffer), "%.2f", agents ? speed / (float)agents : 0.0f);
+	g_log.logLog("Steering benchmark: " + String(agents) + " agents, " + String(ticks) + " ticks, " +
+		String(steering.stats().pairs) + " pairs tested on last tick, " + String(worstContacts) + " contacts at worst, " +
+		String(steering.stats().contacts) + " at end, forward speed " + String(buffer) + " px/tick.");
+	g_log.logLog(times.report("Tick"));
+	return true;
+}
+
+// Server tick without sockets: world, views and snapshots of size clients, each one following
+// a wandering entity. Snapshots are acked right away, as on a perfect link.
+struct ServerTick
+{
+	World world;
+	InterestManager interest;
+	std::vector<Uint32> observers;
+	std::vector<Net::SnapshotEncoder> encoders;
+	std::vector<std::vector<Net::EntityState> > views;
+	std::vector<Uint8> packets;
+	std::vector<int> bytes;
+
+	ServerTick(Uint32 clients);
+	static void encodeRange(void *context, Uint32 begin, Uint32 end);
+};
+
+ServerTick::ServerTick(Uint32 clients) :
+	world(4.0f),
+	observers(clients),
+	encoders(clients),
+	views(clients),
+	packets((size_t)clients * Net::MaxPacketSize),
+	bytes(clients, 0)
+{
+	// Same layout than Server::start gives NPCs.
+	for (Uint32 i = 0; i < clients; ++i)
+		observers[i] = interest.addObserver(world.spawn((float)(i % 64) * 40.0f, (float)(i / 64) * 56.0f, "Client " + String(i), true));
+}
+
+void ServerTick::encodeRange(void *context, Uint32 begin, Uint32 end)
+{
+	ServerTick *server = static_cast<ServerTick*>(context);
+	for (Uint32 i = begin; i < end; ++i)
+	{
+		std::vector<Net::EntityState> &view = server->views[i];
+		view.clear();
+		for (Uint32 id : server->interest.visible(server->observers[i]))
+		{
+			const Net::EntityState *state = server->world.entityState(id);
+			if (state != nullptr)
+				view.push_back(*state);
+		}
+		Net::SnapshotEncoder &encoder = server->encoders[i];
+		Uint8 *data = &server->packets[(size_t)i * Net::MaxPacketSize];
+		server->bytes[i] = encoder.encode(server->world.currentTick(), 0, view.data(), nullptr, (int)view.size(),
+			data, Net::MaxPacketSize - Net::HeaderSize);
+		Uint16 sequence;
+		Uint32 tick;
+		if (server->bytes[i] && Net::peekSnapshot(data, server->bytes[i], sequence, tick))
+			encoder.ack(sequence);
+	}
+}
+
+// Simulation, interest and snapshot encoding of a server tick with size clients, on all cores.
+// Reports each phase, and ticks over the 50 ms a 20 ticks per second server has.
+static bool serverBenchmark(Uint32 size)
+{
+	// Two simulated seconds: ticks of thousands of clients take long on small machines.
+	const Uint32 ticks = 40;
+	JobSystem &jobs = JobSystem::instance();
+	if (!jobs.start())
+		return false;
+	int threads = jobs.workerCount() + 1;
+	ServerTick server(size);
+	Histogram simulate;
+	Histogram interest;
+	Histogram encode;
+	Histogram tick;
+	Uint32 late = 0;
+	Uint64 bytes = 0;
+	for (Uint32 t = 0; t < ticks; ++t)
+	{
+		Uint64 start = SDL_GetPerformanceCounter();
+		server.world.tick();
+		Uint64 simulated = SDL_GetPerformanceCounter();
+		server.interest.update(server.world);
+		Uint64 updated = SDL_GetPerformanceCounter();
+		jobs.parallelForWait(size, 32, ServerTick::encodeRange, &server);
+		Uint32 us = microsecondsSince(start);
+		simulate.record((Uint32)((simulated - start) * 1000000 / SDL_GetPerformanceFrequency()));
+		interest.record((Uint32)((updated - simulated) * 1000000 / SDL_GetPerformanceFrequency()));
+		encode.record(microsecondsSince(updated));
+		tick.record(us);
+		late += (us > 50000) ? 1 : 0;
+		for (Uint32 i = 0; i < size; ++i)
+			bytes += server.bytes[i];
+	}
+	jobs.stop();
+	g_log.logLog("Server benchmark: " + String(size) + " clients, " + String(ticks) + " ticks on " + String(threads) +
+		" threads, " + String(bytes / ((Uint64)size * ticks)) + " bytes per snapshot, " + String(late) + " ticks over 50 ms.");
+	g_log.logLog(simulate.report("Simulate"));
+	g_log.logLog(interest.report("Interest"));
+	g_log.logLog(encode.report("Encode"));
+	g_log.logLog(tick.report("Tick"));
+	return true;
+}
+
+// Server end of the clock sync verification: time requests answered and inputs taken on its ticks,
+// as Server does.
+struct ClockServer
+{
+	enum
+	{
+		InputBuffer = 64
+	};
+	Uint32 tick;
+	Uint16 nextInput;
+	Uint16 newestInput;
+	bool hasInputs;
+	bool valid[InputBuffer];
+	Uint16 sequences[InputBuffer];
+	float inputDepth;
+	Uint32 missed;
+	Uint32 applied;
+
+	ClockServer() : tick(0), nextInput(0), newestInput(0), hasInputs(false), inputDepth(0.0f), missed(0), applied(0)
+	{
+		for (int i = 0; i < InputBuffer; ++i)
+			valid[i] = false;
+	}
+	void receiveInputs(Net::ByteReader &r)
+	{
+		Uint16 newest = r.read16();
+		Uint8 count = r.read8();
+		if (r.overflow() || (count == 0))
+			return;
+		if (!hasInputs)
+		{
+			nextInput = newest - count + 1;
+			newestInput = newest;
+			hasInputs = true;
+		}
+		for (Uint8 i = 0; i < count; ++i)
+		{
+			Uint16 sequence = newest - i;
+			if (((Sint16)(sequence - nextInput) < 0) || ((Uint16)(sequence - nextInput) >= InputBuffer))
+				continue;
+			valid[sequence % InputBuffer] = true;
+			sequences[sequence % InputBuffer] = sequence;
+		}
+		if (Net::sequenceNewer(newest, newestInput))
+			newestInput = newest;
+	}
+	void applyInput()
+	{
+		if (!hasInputs)
+			return;
+		if ((Sint16)(newestInput - nextInput) >= InputBuffer)
+			nextInput = newestInput;
+		int slot = nextInput % InputBuffer;
+		float depth = -1.0f;
+		if (valid[slot] && (sequences[slot] == nextInput))
+		{
+			valid[slot] = false;
+			nextInput++;
+			applied++;
+			depth = (float)(Sint16)(newestInput - nextInput + 1);
+		}
+		else
+			missed++;
+		inputDepth += (depth - inputDepth) * 0.1f;
+	}
+};
+
+// Clocks of size clients, each some random offset away from server, synced through lossy links
+// for a simulated minute while sending inputs. Server answers and takes inputs on its ticks only.
+// Once converged, offset in use must stay within a few ms of the real one, and server must keep
+// about the target input depth waiting.
+static bool clockSyncConvergence(Uint32 size)
+{
+	const Uint32 tickInterval = 50;
+	const Uint32 duration = 60000;
+	const float targetDepth = 2.0f;
+	// On average once converged. Any one estimate can be off by half the difference between
+	// both ways of its round trip: up to jitter.
+	const double maxError = 2.5;
+	const Uint32 maxConvergence = 10000;
+	const Uint8 redundantInputs = 3;
+	enum
+	{
+		PacketTime,
+		PacketInput
+	};
+	Net::NetConditions conditions;
+	conditions.parse("latency=40,jitter=5,loss=5,dup=1,reorder=2");
+	const double bound = conditions.jitter;
+
+	Uint8 data[Net::MaxPacketSize];
+	IPaddress address;
+	SDL_zero(address);
+	Uint32 seed = 17;
+	Uint32 failed = 0;
+	double errorSum = 0.0;
+	double depthSum = 0.0;
+	Uint32 samples = 0;
+	Uint32 slowest = 0;
+	double worst = 0.0;
+	Uint32 missed = 0;
+	Uint32 applied = 0;
+	for (Uint32 c = 0; c < size; ++c)
+	{
+		// Server clock is that far ahead: any value, wrapping included.
+		Uint32 trueOffset = (nextRandom(seed) << 8) | (nextRandom(seed) & 0xFF);
+		Net::NetSimulator up(conditions, c * 2 + 1, 256);
+		Net::NetSimulator down(conditions, c * 2 + 2, 256);
+		// Starts on a wrong tick interval, as client does until server tells its own.
+		ClockSync clock(tickInterval * 2 / 3, targetDepth);
+		ClockServer server;
+		// Requests and inputs wait for next server tick, with when they came in server time.
+		std::vector<Uint32> arrivals;
+		std::vector<std::vector<Uint8> > waiting;
+		Uint32 nextTick = 0;
+		Uint32 nextInput = 0;
+		Uint16 inputSequence = 0;
+		Uint32 converged = 0;
+		double clientError = 0.0;
+		double clientDepth = 0.0;
+		Uint32 clientSamples = 0;
+		for (Uint32 now = 0; now < duration; ++now)
+		{
+			Uint32 serverNow = now + trueOffset;
+			clock.update(now);
+			if (clock.wantsRequest(now))
+			{
+				Net::ByteWriter w(data, sizeof(data));
+				w.write8(PacketTime);
+				clock.writeRequest(w, now);
+				up.send(data, w.size(), address, now);
+			}
+			// Inputs paced on clock sync, with at most two late ones caught up at once, as client does.
+			for (int catchUp = 0; (Sint32)(now - nextInput) >= 0; ++catchUp)
+			{
+				if (catchUp >= 2)
+				{
+					nextInput = now + clock.inputStep();
+					break;
+				}
+				inputSequence++;
+				Net::ByteWriter w(data, sizeof(data));
+				w.write8(PacketInput);
+				w.write16(inputSequence);
+				w.write8(redundantInputs);
+				for (Uint8 i = 0; i < redundantInputs; ++i)
+					w.write8(0);
+				up.send(data, w.size(), address, now);
+				nextInput += clock.inputStep();
+			}
+
+			int len;
+			IPaddress from;
+			while (up.receive(now, data, len, from))
+			{
+				arrivals.push_back(serverNow);
+				waiting.push_back(std::vector<Uint8>(data, data + len));
+			}
+			if ((Sint32)(now - nextTick) >= 0)
+			{
+				server.tick++;
+				for (size_t i = 0; i < waiting.size(); ++i)
+				{
+					Net::ByteReader r(waiting[i].data(), (int)waiting[i].size());
+					if (r.read8() == PacketInput)
+					{
+						server.receiveInputs(r);
+						continue;
+					}
+					// Held until this tick: that is server time, not network delay.
+					Net::TimeReply reply = { r.read32(), arrivals[i], serverNow, server.tick, serverNow,
+						(Uint16)tickInterval, server.inputDepth };
+					Net::ByteWriter w(data, sizeof(data));
+					Net::writeTimeReply(w, reply);
+					down.send(data, w.size(), address, now);
+				}
+				arrivals.clear();
+				waiting.clear();
+				server.applyInput();
+				nextTick += tickInterval;
+			}
+			while (down.receive(now, data, len, from))
+			{
+				Net::ByteReader r(data, len);
+				Net::TimeReply reply;
+				Net::readTimeReply(r, reply);
+				clock.addSample(reply, now);
+			}
+
+			if (!clock.synced())
+			{
+				converged = now + 1;
+				continue;
+			}
+			// Both offsets as server minus local clock, taken apart where that wraps.
+			double error = clock.offset() - (double)(Sint32)trueOffset;
+			if (error > 2147483648.0)
+				error -= 4294967296.0;
+			else if (error < -2147483648.0)
+				error += 4294967296.0;
+			if (fabs(error) > bound)
+				converged = now + 1;
+			// Second half of the run only: well past convergence.
+			if (now >= duration / 2)
+			{
+				clientError += fabs(error);
+				worst = (fabs(error) > worst) ? fabs(error) : worst;
+				if (now % tickInterval == 0)
+				{
+					clientDepth += server.inputDepth;
+					clientSamples++;
+				}
+			}
+		}
+		clientError /= duration - duration / 2;
+		clientDepth = clientSamples ? clientDepth / clientSamples : 0.0;
+		if ((converged > maxConvergence) || (clientError > maxError) || (fabs(clientDepth - targetDepth) > 0.5))
+		{
+			g_log.logErr("Clock sync: client " + String(c) + " converged after " + String(converged) + " ms, error " +
+				formatFloat("%.2f", clientError) + " ms, input depth " + formatFloat("%.2f", clientDepth) + ". " + clock.report());
+			failed++;
+		}
+		slowest = (converged > slowest) ? converged : slowest;
+		errorSum += clientError;
+		depthSum += clientDepth;
+		samples++;
+		missed += server.missed;
+		applied += server.applied;
+	}
+	g_log.logLog("Clock sync: " + String(size) + " clients over " + conditions.describe() + ", " + String(tickInterval) + " ms ticks.");
+	g_log.logLog("Clock sync: converged within " + formatFloat("%.1f", bound) + " ms after " + String(slowest) + " ms at most, then " +
+		formatFloat("%.2f", samples ? errorSum / samples : 0.0) + " ms off on average, " + formatFloat("%.2f", worst) + " ms at most.");
+	g_log.logLog("Clock sync: input depth " + formatFloat("%.2f", samples ? depthSum / samples : 0.0) + " for a target of " +
+		formatFloat("%.1f", targetDepth) + ", " + String(missed) + " ticks without input, " + String(applied) + " inputs applied, " +
+		String(failed) + " clients failed.");
+	return failed == 0;
+}
+
+// Plain A* on every tile, as PathFinder would be without jumps: same moves, same octile costs,
+// no corner cutting. dist is kept from call to call. Returns cost, 0xFFFFFFFF if unreachable.
+static Uint32 gridAStar(const WalkGrid &grid, const GridPoint &from, const GridPoint &to, std::vector<Uint32> &dist,
+	Uint32 &expanded)
+{
+	const Uint32 unreachable = 0xFFFFFFFF;
+	if (!grid.walkable(from.x, from.y) || !grid.walkable(to.x, to.y))
+		return unreachable;
+	int width = grid.width();
+	dist.assign((size_t)width * grid.height(), unreachable);
+	// f << 32 | tile: smallest f on top.
+	std::priority_queue<Uint64, std::vector<Uint64>, std::greater<Uint64> > open;
+	Uint32 start = (Uint32)(from.y * width + from.x);
+	dist[start] = 0;
+	open.push(((Uint64)PathFinder::distance(to.x - from.x, to.y - from.y) << 32) | start);
+	while (!open.empty())
+	{
+		Uint64 top = open.top();
+		open.pop();
+		Uint32 tile = (Uint32)top;
+		int x = (int)(tile % width);
+		int y = (int)(tile / width);
+		Uint32 g = dist[tile];
+		// Stale entry: tile was reached cheaper since.
+		if ((Uint32)(top >> 32) != g + PathFinder::distance(to.x - x, to.y - y))
+			continue;
+		if ((x == to.x) && (y == to.y))
+			return g;
+		expanded++;
+		for (int dy = -1; dy <= 1; ++dy)
+		{
+			for (int dx = -1; dx <= 1; ++dx)
+			{
+				if (((dx == 0) && (dy == 0)) || !grid.walkable(x + dx, y + dy))
+					continue;
+				if (dx && dy && (!grid.walkable(x + dx, y) || !grid.walkable(x, y + dy)))
+					continue;
+				Uint32 next = (Uint32)((y + dy) * width + x + dx);
+				Uint32 cost = g + ((dx && dy) ? (Uint32)PathFinder::DiagonalCost : (Uint32)PathFinder::StraightCost);
+				if (cost >= dist[next])
+					continue;
+				dist[next] = cost;
+				open.push(((Uint64)(cost + PathFinder::distance(to.x - x - dx, to.y - y - dy)) << 32) | next);
+			}
+		}
+	}
+	return unreachable;
+}
+
+// Jump points are on straight or diagonal lines from one to the next, over walkable tiles only,
+// never between two blocked corners.
+static bool walkablePath(const WalkGrid &grid, const std::vector<GridPoint> &path)
+{
+	for (size_t i = 1; i < path.size(); ++i)
+	{
+		int x = path[i - 1].x;
+		int y = path[i - 1].y;
+		int dx = (path[i].x > x) - (path[i].x < x);
+		int dy = (path[i].y > y) - (path[i].y < y);
+		if (dx && dy && (abs(path[i].x - x) != abs(path[i].y - y)))
+			return false;
+		while ((x != path[i].x) || (y != path[i].y))
+		{
+			if (dx && dy && (!grid.walkable(x + dx, y) || !grid.walkable(x, y + dy)))
+				return false;
+			x += dx;
+			y += dy;
+			if (!grid.walkable(x, y))
+				return false;
+		}
+	}
+	return true;
+}
+
+// Random grids, from scattered blocked tiles to rooms of rectangles, and size queries on each.
+// Jump point search must find paths of the same cost as plain A*, or none when it finds none,
+// whole or a few expansions per step. Then both are timed on a 512 x 512 map.
+static bool pathEquivalence(Uint32 size)
+{
+	const int maps = 40;
+	Uint32 seed = 12345;
+	std::vector<Uint32> dist;
+	Uint32 queries = 0;
+	Uint32 found = 0;
+	Uint32 different = 0;
+	Uint32 invalid = 0;
+	for (int m = 0; m < maps; ++m)
+	{
+		int width = 20 + (int)(nextRandom(seed) % 100);
+		int height = 20 + (int)(nextRandom(seed) % 100);
+		WalkGrid grid(width, height);
+		if (m & 1)
+		{
+			for (int i = 0; i < width * height / 60; ++i)
+				grid.fill((int)(nextRandom(seed) % width), (int)(nextRandom(seed) % height), 1 + (int)(nextRandom(seed) % 8),
+					1 + (int)(nextRandom(seed) % 8), false);
+		}
+		else
+		{
+			Uint32 density = 10 + nextRandom(seed) % 35;
+			for (int y = 0; y < height; ++y)
+			{
+				for (int x = 0; x < width; ++x)
+				{
+					if (nextRandom(seed) % 100 < density)
+						grid.set(x, y, false);
+				}
+			}
+		}
+		PathFinder finder(grid);
+		for (Uint32 q = 0; q < size; ++q)
+		{
+			GridPoint from = { (int)(nextRandom(seed) % width), (int)(nextRandom(seed) % height) };
+			GridPoint to = { (int)(nextRandom(seed) % width), (int)(nextRandom(seed) % height) };
+			Uint32 expanded = 0;
+			Uint32 expected = gridAStar(grid, from, to, dist, expanded);
+			PathFinder::Status status;
+			if (q & 1)
+				status = finder.find(from, to);
+			else
+			{
+				finder.start(from, to);
+				do
+				{
+					Uint32 budget = 3;
+					status = finder.step(budget);
+				} while (status == PathFinder::PathSearching);
+			}
+			Uint32 cost = (status == PathFinder::PathFound) ? finder.cost() : 0xFFFFFFFF;
+			queries++;
+			found += (status == PathFinder::PathFound) ? 1 : 0;
+			if (cost != expected)
+			{
+				if (different < 5)
+					g_log.logErr("Paths: map " + String(m) + ", " + String(from.x) + "," + String(from.y) + " to " + String(to.x) + "," +
+						String(to.y) + " cost " + String(cost) + " instead of " + String(expected) + ".");
+				different++;
+			}
+			else if ((status == PathFinder::PathFound) && !walkablePath(grid, finder.path()))
+				invalid++;
+		}
+	}
+	g_log.logLog("Paths: " + String(queries) + " queries on " + String(maps) + " maps, " + String(found) + " found, " + String(different) +
+		" with another cost than A*, " + String(invalid) + " going through blocked tiles.");
+
+	// Timing: rooms of rectangles on a 512 x 512 map.
+	const int side = 512;
+	WalkGrid grid(side, side);
+	for (int i = 0; i < 900; ++i)
+		grid.fill((int)(nextRandom(seed) % side), (int)(nextRandom(seed) % side), 2 + (int)(nextRandom(seed) % 20),
+			2 + (int)(nextRandom(seed) % 20), false);
+	PathFinder finder(grid);
+	Histogram jps;
+	Histogram astar;
+	Uint64 jpsExpanded = 0;
+	Uint64 astarExpanded = 0;
+	const Uint32 timed = 200;
+	for (Uint32 q = 0; q < timed;)
+	{
+		GridPoint from = { (int)(nextRandom(seed) % side), (int)(nextRandom(seed) % side) };
+		GridPoint to = { (int)(nextRandom(seed) % side), (int)(nextRandom(seed) % side) };
+		// Ends on blocked tiles fail at once on both.
+		if (!grid.walkable(from.x, from.y) || !grid.walkable(to.x, to.y))
+			continue;
+		q++;
+		Uint32 expanded = finder.stats().expanded;
+		Uint64 start = SDL_GetPerformanceCounter();
+		finder.find(from, to);
+		jps.record(microsecondsSince(start));
+		jpsExpanded += finder.stats().expanded - expanded;
+		Uint32 astarCount = 0;
+		start = SDL_GetPerformanceCounter();
+		gridAStar(grid, from, to, dist, astarCount);
+		astar.record(microsecondsSince(start));
+		astarExpanded += astarCount;
+	}
+	g_log.logLog("Paths: " + String(timed) + " queries on " + String(side) + " x " + String(side) + ", " +
+		formatFloat("%.0f", (double)jpsExpanded / timed) + " expansions each with jumps, " + formatFloat("%.0f", (double)astarExpanded / timed) +
+		" without, jumps " + formatFloat("%.1f", jps.average() ? (double)astar.average() / jps.average() : 0.0) + "x faster.");
+	g_log.logLog(jps.report("Jump point search"));
+	g_log.logLog(astar.report("A*"));
+	return (different == 0) && (invalid == 0);
+}
+
+// Long routes on a 1024 x 1024 map of rooms, searched with HPA* and with PathFinder alone. HPA* must
+// find a route whenever the flat search does, refined into walkable tiles, within a few percents of
+// the best one. Then tiles are edited: the graph updated around them must give what a fresh one does.
+static bool clusterPathLatency(Uint32 size)
+{
+	const int side = 1024;
+	const int clusterSize = 16;
+	const double maxDetour = 1.1;
+	Uint32 seed = 777;
+	WalkGrid grid(side, side);
+	for (int i = 0; i < side * side / 300; ++i)
+		grid.fill((int)(nextRandom(seed) % side), (int)(nextRandom(seed) % side), 2 + (int)(nextRandom(seed) % 20),
+			2 + (int)(nextRandom(seed) % 20), false);
+	Uint64 start = SDL_GetPerformanceCounter();
+	ClusterPathFinder clusters(grid, clusterSize);
+	clusters.build();
+	Uint32 build = microsecondsSince(start);
+	PathFinder flat(grid);
+
+	std::vector<GridPoint> from;
+	std::vector<GridPoint> to;
+	while (from.size() < size)
+	{
+		GridPoint a = { (int)(nextRandom(seed) % side), (int)(nextRandom(seed) % side) };
+		GridPoint b = { (int)(nextRandom(seed) % side), (int)(nextRandom(seed) % side) };
+		if (!grid.walkable(a.x, a.y) || !grid.walkable(b.x, b.y))
+			continue;
+		from.push_back(a);
+		to.push_back(b);
+	}
+	Histogram flatTime;
+	Histogram clusterTime;
+	Histogram refineTime;
+	std::vector<GridPoint> segment;
+	std::vector<GridPoint> tiles;
+	double detour = 0.0;
+	double worstDetour = 0.0;
+	Uint32 both = 0;
+	Uint32 mismatched = 0;
+	Uint32 invalid = 0;
+	for (Uint32 i = 0; i < size; ++i)
+	{
+		start = SDL_GetPerformanceCounter();
+		PathFinder::Status flatStatus = flat.find(from[i], to[i]);
+		flatTime.record(microsecondsSince(start));
+		start = SDL_GetPerformanceCounter();
+		PathFinder::Status clusterStatus = clusters.find(from[i], to[i]);
+		clusterTime.record(microsecondsSince(start));
+		if ((flatStatus == PathFinder::PathFound) != (clusterStatus == PathFinder::PathFound))
+		{
+			mismatched++;
+			continue;
+		}
+		if (flatStatus != PathFinder::PathFound)
+			continue;
+		// Whole route, as a walker would have it refined segment after segment.
+		start = SDL_GetPerformanceCounter();
+		tiles.clear();
+		bool refined = true;
+		for (size_t s = 0; refined && (s + 1 < clusters.path().size()); ++s)
+		{
+			refined = clusters.refine(s, segment);
+			tiles.insert(tiles.end(), segment.begin() + (tiles.empty() ? 0 : 1), segment.end());
+		}
+		refineTime.record(microsecondsSince(start));
+		Uint32 cost = 0;
+		for (size_t k = 1; k < tiles.size(); ++k)
+			cost += PathFinder::distance(tiles[k].x - tiles[k - 1].x, tiles[k].y - tiles[k - 1].y);
+		if (!refined || (cost > clusters.cost()) || !walkablePath(grid, tiles))
+		{
+			invalid++;
+			continue;
+		}
+		double ratio = flat.cost() ? (double)cost / flat.cost() : 1.0;
+		detour += ratio;
+		worstDetour = (ratio > worstDetour) ? ratio : worstDetour;
+		both++;
+	}
+	g_log.logLog("Cluster paths: " + String(side) + " x " + String(side) + " in " + String(clusterSize) + " tiles clusters, " +
+		String((Uint32)clusters.nodeCount()) + " nodes built in " + formatFloat("%.1f", build / 1000.0) + " ms.");
+	g_log.logLog("Cluster paths: " + String(size) + " queries, " + String(both) + " found by both, " + String(mismatched) +
+		" found by one only, " + String(invalid) + " not refined into a walkable route, routes " + formatFloat("%.3f", both ? detour / both : 0.0) +
+		"x the best on average, " + formatFloat("%.3f", worstDetour) + "x at most.");
+	g_log.logLog("Cluster paths: HPA* " + formatFloat("%.1f", clusterTime.average() ? (double)flatTime.average() / clusterTime.average() : 0.0) +
+		"x faster than flat search on average, " + formatFloat("%.1f", clusterTime.max() ? (double)flatTime.max() / clusterTime.max() : 0.0) +
+		"x on the slowest query.");
+	g_log.logLog(flatTime.report("Flat"));
+	g_log.logLog(clusterTime.report("HPA*"));
+	g_log.logLog(refineTime.report("Refine"));
+
+	// Edits, then the same queries on the graph updated and on a fresh one.
+	for (int i = 0; i < 200; ++i)
+	{
+		int x = (int)(nextRandom(seed) % side);
+		int y = (int)(nextRandom(seed) % side);
+		grid.fill(x, y, 3, 3, (nextRandom(seed) & 1) != 0);
+		for (int dy = 0; dy < 3; ++dy)
+		{
+			for (int dx = 0; dx < 3; ++dx)
+				clusters.tileChanged(x + dx, y + dy);
+		}
+	}
+	start = SDL_GetPerformanceCounter();
+	clusters.update();
+	Uint32 update = microsecondsSince(start);
+	ClusterPathFinder fresh(grid, clusterSize);
+	fresh.build();
+	Uint32 different = 0;
+	for (Uint32 i = 0; i < size; ++i)
+	{
+		PathFinder::Status updated = clusters.find(from[i], to[i]);
+		Uint32 cost = clusters.cost();
+		if ((updated != fresh.find(from[i], to[i])) || ((updated == PathFinder::PathFound) && (cost != fresh.cost())))
+			different++;
+	}
+	g_log.logLog("Cluster paths: 200 edits updated in " + formatFloat("%.2f", update / 1000.0) + " ms, " +
+		String(clusters.stats().clustersBuilt) + " clusters built in all, " + String(different) + " queries different from a fresh graph.");
+	return (mismatched == 0) && (invalid == 0) && (different == 0) && (both == 0 || detour / both <= maxDetour);
+}
+
+// Boxes moving through a tile map, as SoA arrays TileCollision::moveAll takes.
+struct CollisionMovers
+{
+	const TileCollision *collision;
+	std::vector<float> x;
+	std::vector<float> y;
+	std::vector<float> w;
+	std::vector<float> h;
+	std::vector<float> dx;
+	std::vector<float> dy;
+	std::vector<Uint8> hits;
+
+	static void moveRange(void *context, Uint32 begin, Uint32 end)
+	{
+		CollisionMovers *movers = static_cast<CollisionMovers*>(context);
+		movers->collision->moveAll(movers->x.data(), movers->y.data(), movers->w.data(), movers->h.data(), movers->dx.data(),
+			movers->dy.data(), movers->hits.data(), begin, end);
+	}
+};
+
+// size boxes through a 1024 x 1024 map of 32 px tiles and rooms, some of them up to 2 tiles a tick,
+// on all cores. After every tick, no box may be on a solid tile, and none may have gone through
+// one: its move along x, then along y, must be on free tiles all the way.
+static bool collisionBenchmark(Uint32 size)
+{
+	const int side = 1024;
+	const Uint32 ticks = 100;
+	Uint32 seed = 4242;
+	WalkGrid grid(side, side);
+	for (int i = 0; i < side * side / 300; ++i)
+		grid.fill((int)(nextRandom(seed) % side), (int)(nextRandom(seed) % side), 2 + (int)(nextRandom(seed) % 20),
+			2 + (int)(nextRandom(seed) % 20), false);
+	TileCollision collision;
+	collision.build(grid);
+	float tile = collision.tileSize();
+
+	CollisionMovers movers;
+	movers.collision = &collision;
+	movers.x.resize(size);
+	movers.y.resize(size);
+	movers.w.resize(size);
+	movers.h.resize(size);
+	movers.dx.resize(size);
+	movers.dy.resize(size);
+	movers.hits.resize(size);
+	for (Uint32 i = 0; i < size; ++i)
+	{
+		movers.w[i] = 8.0f + (float)(nextRandom(seed) % 48);
+		movers.h[i] = 8.0f + (float)(nextRandom(seed) % 48);
+		do
+		{
+			movers.x[i] = (float)(nextRandom(seed) % ((side - 2) * (Uint32)tile));
+			movers.y[i] = (float)(nextRandom(seed) % ((side - 2) * (Uint32)tile));
+		} while (collision.overlaps(movers.x[i], movers.y[i], movers.w[i], movers.h[i]));
+		// One in 8 is fast enough to jump over a tile, were moves not checked all the way.
+		float speed = (i % 8 == 0) ? 2.0f * tile : 4.0f;
+		movers.dx[i] = speed * ((float)(nextRandom(seed) % 2001) / 1000.0f - 1.0f);
+		movers.dy[i] = speed * ((float)(nextRandom(seed) % 2001) / 1000.0f - 1.0f);
+	}
+
+	JobSystem &jobs = JobSystem::instance();
+	if (!jobs.start())
+		return false;
+	int threads = jobs.workerCount() + 1;
+	std::vector<float> startX;
+	std::vector<float> startY;
+	Histogram times;
+	Uint64 hits = 0;
+	Uint32 overlapping = 0;
+	Uint32 tunnelled = 0;
+	double distance = 0.0;
+	for (Uint32 t = 0; t < ticks; ++t)
+	{
+		startX = movers.x;
+		startY = movers.y;
+		Uint64 start = SDL_GetPerformanceCounter();
+		jobs.parallelForWait(size, 1024, CollisionMovers::moveRange, &movers);
+		times.record(microsecondsSince(start));
+		for (Uint32 i = 0; i < size; ++i)
+		{
+			float x = movers.x[i];
+			float y = movers.y[i];
+			float w = movers.w[i];
+			float h = movers.h[i];
+			if (collision.overlaps(x, y, w, h))
+				overlapping++;
+			// Swept along x at start height, then along y at end column.
+			float left = (x < startX[i]) ? x : startX[i];
+			float top = (y < startY[i]) ? y : startY[i];
+			if (collision.overlaps(left, startY[i], fabsf(x - startX[i]) + w, h) ||
+				collision.overlaps(x, top, w, fabsf(y - startY[i]) + h))
+				tunnelled++;
+			distance += fabsf(x - startX[i]) + fabsf(y - startY[i]);
+			// Bounces back from what it hit.
+			if (movers.hits[i] & (TileCollision::HitLeft | TileCollision::HitRight))
+				movers.dx[i] = -movers.dx[i];
+			if (movers.hits[i] & (TileCollision::HitTop | TileCollision::HitBottom))
+				movers.dy[i] = -movers.dy[i];
+			hits += movers.hits[i] ? 1 : 0;
+		}
+	}
+	jobs.stop();
+	g_log.logLog("Collision benchmark: " + String(size) + " boxes, " + String(ticks) + " ticks on " + String(threads) +
+		" threads, " + formatFloat("%.3f", times.average() / 1000.0) + " ms per tick, " +
+		formatFloat("%.1f", (double)hits / ticks) + " hits per tick, " + formatFloat("%.2f", distance / ((double)size * ticks)) +
+		" px moved per box per tick.");
+	g_log.logLog("Collision benchmark: " + String(overlapping) + " boxes on solid tiles, " + String(tunnelled) +
+		" moves through solid tiles.");
+	g_log.logLog(times.report("Tick"));
+	return (overlapping == 0) && (tunnelled == 0);
+}
+
+namespace
+{
+	const Benchmark benchmarks[] =
+	{
+		{ "movement", movementBenchmark, 100000, "MovementFSM tables against virtual State objects, per tick." },
+		{ "jobs", jobsBenchmark, 100000, "Tick phases on JobSystem, from 1 to 32 threads." },
+		{ "serialization", serializationBenchmark, 100000, "Bytes per entity and encode rate of each entity schema." },
+		{ "snapshots", snapshotLoopback, 32, "Delta snapshots of clients through lossy links, checked against their source." },
+		{ "channels", channelVerification, 20000, "Connection messages both ways through lossy links, checked for order and loss." },
+		{ "io", ioBenchmark, 5, "NetIo packets one way over loopback for size seconds, for rate and latency." },
+		{ "server", serverBenchmark, 5000, "Server tick phases with clients following wandering entities, without sockets." },
+		{ "steering", steeringBenchmark, 10000, "Two crowds of agents steered into each other on one core, for tick time and overlaps." },
+		{ "clocksync", clockSyncConvergence, 16, "Client clocks synced through lossy links, checked for offset error and input depth." },
+		{ "paths", pathEquivalence, 50, "Jump point search against plain A* on random grids, for cost and speed." },
+		{ "hpa", clusterPathLatency, 500, "HPA* against flat jump point search on long routes, for latency and detour." },
+		{ "collision", collisionBenchmark, 50000, "Boxes moved through a tile map on all cores, checked for overlaps and tunnelling." }
+	};
+	const int BenchmarkCount = sizeof(benchmarks) / sizeof(benchmarks[0]);
+}
+
+bool Benchmarks::run(const String &name, Uint32 size)
+{
+	for (int i = 0; i < BenchmarkCount; ++i)
+	{
+		if (name != benchmarks[i].name)
+			continue;
+		return benchmarks[i].function(size ? size : benchmarks[i].defaultSize);
+	}
+	g_log.logErr("Unknown benchmark " + name);
+	list();
+	return false;
+}
+
+void Benchmarks::list()
+{
+	for (int i = 0; i < BenchmarkCount; ++i)
+		g_log.logLog(String(benchmarks[i].name) + ": " + benchmarks[i].description + " Default size " + String(benchmarks[i].defaultSize) + ".");
+}
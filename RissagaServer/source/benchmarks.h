@@ -0,0 +1,19 @@
+#pragma once
+
+#include "SDL_stdinc.h"
+
+#include "common/string.h"
+
+namespace Ris
+{
+	// Benchmarks and verification runs of server side systems, on synthetic data.
+	// Run with --bench <name> [--bench-size N] instead of serving. Results are logged.
+	namespace Benchmarks
+	{
+		// Runs benchmark name on size items (0 for its default). Returns false if it is unknown,
+		// or if what it verifies did not hold.
+		bool run(const String &name, Uint32 size);
+		// Logs every benchmark name with what it does.
+		void list();
+	}
+}
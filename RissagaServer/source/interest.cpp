@@ -0,0 +1,266 @@
+#include "interest.h"
+
+#include <algorithm>
+
+#include "world.h"
+
+using namespace Ris;
+
+InterestManager::InterestManager(float cellSize, float enterRadius, float leaveRadius) :
+	m_cellSize((cellSize >= 1.0f) ? cellSize : 1.0f)
+{
+	m_enter = (Sint32)ceilf(enterRadius / m_cellSize);
+	m_leave = (Sint32)ceilf(leaveRadius / m_cellSize);
+	if (m_leave <= m_enter)
+		m_leave = m_enter + 1;
+}
+
+Uint32 InterestManager::addObserver(Uint32 entity)
+{
+	Uint32 observer;
+	if (!m_freeObservers.empty())
+	{
+		observer = m_freeObservers.back();
+		m_freeObservers.pop_back();
+	}
+	else
+	{
+		observer = (Uint32)m_observers.size();
+		m_observers.push_back(Observer());
+	}
+	Observer &o = m_observers[observer];
+	o.entity = entity;
+	o.active = true;
+	o.placed = false;
+	o.cx = o.cy = 0;
+	o.visible.clear();
+	o.entered.clear();
+	o.left.clear();
+	return observer;
+}
+
+void InterestManager::removeObserver(Uint32 observer)
+{
+	Observer &o = m_observers[observer];
+	if (o.placed)
+	{
+		for (Sint32 y = o.cy - m_leave; y <= o.cy + m_leave; ++y)
+			for (Sint32 x = o.cx - m_leave; x <= o.cx + m_leave; ++x)
+				unwatch(observer, x, y);
+	}
+	o.active = false;
+	o.placed = false;
+	o.visible.clear();
+	o.entered.clear();
+	o.left.clear();
+	m_freeObservers.push_back(observer);
+}
+
+void InterestManager::watch(Uint32 observer, Sint32 cx, Sint32 cy)
+{
+	m_cells[key(cx, cy)].watchers.push_back(observer);
+}
+
+void InterestManager::unwatch(Uint32 observer, Sint32 cx, Sint32 cy)
+{
+	auto it = m_cells.find(key(cx, cy));
+	if (it == m_cells.end())
+		return;
+	std::vector<Uint32> &watchers = it->second.watchers;
+	for (size_t i = 0; i < watchers.size(); ++i)
+	{
+		if (watchers[i] == observer)
+		{
+			watchers[i] = watchers.back();
+			watchers.pop_back();
+			break;
+		}
+	}
+	if (watchers.empty() && it->second.entities.empty())
+		m_cells.erase(it);
+}
+
+void InterestManager::update(const World &world)
+{
+	m_stats.updates++;
+	for (Uint32 i : m_changed)
+	{
+		m_observers[i].entered.clear();
+		m_observers[i].left.clear();
+	}
+	m_changed.clear();
+
+	// Cells of this tick. Lists are only moved to them after observers are done, so these
+	// still find whatever was around them at the start of the tick.
+	if (m_entities.size() < world.capacity())
+	{
+		EntityCell none = { false, 0, 0, 0, false, 0, 0 };
+		m_entities.resize(world.capacity(), none);
+	}
+	for (Uint32 e = 0; e < m_entities.size(); ++e)
+	{
+		EntityCell &c = m_entities[e];
+		c.nextPlaced = world.active(e);
+		if (!c.nextPlaced)
+			continue;
+		const Point2D &p = world.object(e).position();
+		c.nextX = toCell(p.x);
+		c.nextY = toCell(p.y);
+	}
+
+	for (Uint32 i = 0; i < m_observers.size(); ++i)
+	{
+		Observer &o = m_observers[i];
+		if (!o.active)
+			continue;
+		const EntityCell *c = (o.entity < m_entities.size()) ? &m_entities[o.entity] : nullptr;
+		bool placed = (c != nullptr) && c->nextPlaced;
+		if ((placed != o.placed) || (placed && ((c->nextX != o.cx) || (c->nextY != o.cy))))
+			moveObserver(i, placed, placed ? c->nextX : 0, placed ? c->nextY : 0);
+	}
+
+	for (Uint32 e = 0; e < m_entities.size(); ++e)
+	{
+		const EntityCell &c = m_entities[e];
+		if ((c.placed != c.nextPlaced) || (c.placed && ((c.cx != c.nextX) || (c.cy != c.nextY))))
+			moveEntity(e);
+	}
+
+	for (Uint32 i : m_changed)
+		apply(m_observers[i]);
+}
+
+void InterestManager::moveObserver(Uint32 observer, bool placed, Sint32 cx, Sint32 cy)
+{
+	Observer &o = m_observers[observer];
+	bool wasPlaced = o.placed;
+	Sint32 oldX = o.cx;
+	Sint32 oldY = o.cy;
+	// Checks are made against where observer is now.
+	o.placed = placed;
+	o.cx = cx;
+	o.cy = cy;
+	m_stats.crossings++;
+
+	// Cells out of leave area: everything there leaves.
+	if (wasPlaced)
+	{
+		for (Sint32 y = oldY - m_leave; y <= oldY + m_leave; ++y)
+		{
+			for (Sint32 x = oldX - m_leave; x <= oldX + m_leave; ++x)
+			{
+				if (placed && (distance(cx, cy, x, y) <= m_leave))
+					continue;
+				auto it = m_cells.find(key(x, y));
+				if (it == m_cells.end())
+					continue;
+				for (Uint32 e : it->second.entities)
+					check(observer, e);
+				unwatch(observer, x, y);
+			}
+		}
+	}
+	if (!placed)
+		return;
+	// Cells new in enter area: everything there enters. The ones in between keep their state.
+	for (Sint32 y = cy - m_leave; y <= cy + m_leave; ++y)
+	{
+		for (Sint32 x = cx - m_leave; x <= cx + m_leave; ++x)
+		{
+			Sint32 before = wasPlaced ? distance(oldX, oldY, x, y) : m_leave + 1;
+			if (before > m_leave)
+				watch(observer, x, y);
+			if ((distance(cx, cy, x, y) > m_enter) || (before <= m_enter))
+				continue;
+			auto it = m_cells.find(key(x, y));
+			if (it == m_cells.end())
+				continue;
+			for (Uint32 e : it->second.entities)
+				check(observer, e);
+		}
+	}
+}
+
+void InterestManager::moveEntity(Uint32 entity)
+{
+	EntityCell &c = m_entities[entity];
+	m_stats.crossings++;
+	if (c.placed)
+	{
+		auto it = m_cells.find(key(c.cx, c.cy));
+		Cell &cell = it->second;
+		// Everyone that could see it there.
+		for (Uint32 w : cell.watchers)
+			check(w, entity);
+		Uint32 moved = cell.entities.back();
+		cell.entities[c.index] = moved;
+		m_entities[moved].index = c.index;
+		cell.entities.pop_back();
+		if (cell.entities.empty() && cell.watchers.empty())
+			m_cells.erase(it);
+	}
+	if (c.nextPlaced)
+	{
+		Cell &cell = m_cells[key(c.nextX, c.nextY)];
+		c.index = (Uint32)cell.entities.size();
+		cell.entities.push_back(entity);
+		for (Uint32 w : cell.watchers)
+			check(w, entity);
+	}
+	c.placed = c.nextPlaced;
+	c.cx = c.nextX;
+	c.cy = c.nextY;
+}
+
+void InterestManager::check(Uint32 observer, Uint32 entity)
+{
+	// Same answer however many times a pair is checked on an update: from final cells and
+	// from the view at the start of it.
+	m_stats.checks++;
+	Observer &o = m_observers[observer];
+	const EntityCell &c = m_entities[entity];
+	bool was = std::binary_search(o.visible.begin(), o.visible.end(), entity);
+	bool now = false;
+	if (o.placed && c.nextPlaced)
+	{
+		Sint32 d = distance(o.cx, o.cy, c.nextX, c.nextY);
+		now = (d <= m_enter) || ((d <= m_leave) && was);
+	}
+	if (now == was)
+		return;
+	if (o.entered.empty() && o.left.empty())
+		m_changed.push_back(observer);
+	if (now)
+		o.entered.push_back(entity);
+	else
+		o.left.push_back(entity);
+}
+
+void InterestManager::apply(Observer &o)
+{
+	std::sort(o.entered.begin(), o.entered.end());
+	o.entered.erase(std::unique(o.entered.begin(), o.entered.end()), o.entered.end());
+	std::sort(o.left.begin(), o.left.end());
+	o.left.erase(std::unique(o.left.begin(), o.left.end()), o.left.end());
+	m_stats.entered += (Uint32)o.entered.size();
+	m_stats.left += (Uint32)o.left.size();
+
+	// One pass: visible minus left plus entered, still sorted.
+	std::vector<Uint32> &visible = m_merged;
+	visible.clear();
+	size_t l = 0;
+	size_t n = 0;
+	for (Uint32 id : o.visible)
+	{
+		while ((n < o.entered.size()) && (o.entered[n] < id))
+			visible.push_back(o.entered[n++]);
+		while ((l < o.left.size()) && (o.left[l] < id))
+			l++;
+		if ((l < o.left.size()) && (o.left[l] == id))
+			continue;
+		visible.push_back(id);
+	}
+	while (n < o.entered.size())
+		visible.push_back(o.entered[n++]);
+	o.visible.swap(visible);
+}
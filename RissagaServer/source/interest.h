@@ -0,0 +1,110 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+#include <math.h>
+
+#include "SDL_stdinc.h"
+
+namespace Ris
+{
+	class World;
+
+	// Area of interest: which entities each client (observer) gets updates for.
+	// Entities are bucketed on a uniform grid by GameObj::position(). An entity enters an
+	// observer view when it is within enter radius, and only leaves it beyond leave radius,
+	// so one walking on the border does not flicker in and out.
+	// Radii are rounded up to whole cells and measured in cells (square areas). Views only
+	// change when something crosses a cell, and only pairs around crossings are checked:
+	// a tick costs the number of crossings, not observers x entities.
+	class InterestManager
+	{
+	public:
+		struct Stats
+		{
+			Uint32 updates;
+			Uint32 crossings;		// Entities and observers that changed cell.
+			Uint32 checks;			// Observer/entity pairs tested.
+			Uint32 entered;
+			Uint32 left;
+			Stats() : updates(0), crossings(0), checks(0), entered(0), left(0)
+			{ }
+		};
+
+	private:
+		struct Cell
+		{
+			std::vector<Uint32> entities;
+			// Observers with this cell within their leave area.
+			std::vector<Uint32> watchers;
+		};
+		struct Observer
+		{
+			Uint32 entity;
+			bool active;
+			bool placed;
+			Sint32 cx, cy;
+			// Sorted by ID.
+			std::vector<Uint32> visible;
+			// Changes of last update, sorted by ID.
+			std::vector<Uint32> entered;
+			std::vector<Uint32> left;
+		};
+		struct EntityCell
+		{
+			bool placed;
+			Sint32 cx, cy;
+			Uint32 index;		// In Cell::entities.
+			// Cell this tick. Not placed if despawned.
+			bool nextPlaced;
+			Sint32 nextX, nextY;
+		};
+
+		float m_cellSize;
+		Sint32 m_enter;
+		Sint32 m_leave;
+		std::unordered_map<Uint64, Cell> m_cells;
+		std::vector<EntityCell> m_entities;
+		std::vector<Observer> m_observers;
+		std::vector<Uint32> m_freeObservers;
+		// Observers with changes on current update.
+		std::vector<Uint32> m_changed;
+		// Merge buffer, swapped with views.
+		std::vector<Uint32> m_merged;
+		Stats m_stats;
+
+		static inline Uint64 key(Sint32 x, Sint32 y) { return ((Uint64)(Uint32)x << 32) | (Uint32)y; }
+		inline Sint32 toCell(float v) const { return (Sint32)floorf(v / m_cellSize); }
+		static inline Sint32 distance(Sint32 ax, Sint32 ay, Sint32 bx, Sint32 by)
+		{
+			Sint32 dx = (ax > bx) ? ax - bx : bx - ax;
+			Sint32 dy = (ay > by) ? ay - by : by - ay;
+			return (dx > dy) ? dx : dy;
+		}
+		void watch(Uint32 observer, Sint32 cx, Sint32 cy);
+		void unwatch(Uint32 observer, Sint32 cx, Sint32 cy);
+		void moveObserver(Uint32 observer, bool placed, Sint32 cx, Sint32 cy);
+		void moveEntity(Uint32 entity);
+		void check(Uint32 observer, Uint32 entity);
+		void apply(Observer &o);
+
+	public:
+		// Radii in pixels. leave is made at least one cell more than enter.
+		InterestManager(float cellSize = 128.0f, float enterRadius = 512.0f, float leaveRadius = 640.0f);
+
+		// Observer seeing around entity. Its view is filled on next update().
+		Uint32 addObserver(Uint32 entity);
+		void removeObserver(Uint32 observer);
+
+		// Moves every entity to its cell and updates views with it.
+		void update(const World &world);
+
+		// Entity IDs in view, sorted.
+		inline const std::vector<Uint32> &visible(Uint32 observer) const { return m_observers[observer].visible; }
+		// Views changes on last update, sorted.
+		inline const std::vector<Uint32> &entered(Uint32 observer) const { return m_observers[observer].entered; }
+		inline const std::vector<Uint32> &left(Uint32 observer) const { return m_observers[observer].left; }
+		inline const Stats &stats() const { return m_stats; }
+		inline void resetStats() { m_stats = Stats(); }
+	};
+}
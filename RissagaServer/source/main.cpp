@@ -0,0 +1,79 @@
+#include "SDL.h"
+#include "SDL_net.h"
+
+#include "common/string.h"
+#include "common/logging.h"
+#include "common/jobs.h"
+#include "server.h"
+#include "benchmarks.h"
+
+#include <stdlib.h>
+
+using namespace Ris;
+
+#define TICKS_PER_SECOND(t) (1000/t)
+
+int main(int argc, char *argv[])
+{
+	Uint16 port = Net::DefaultPort;
+	int tickRate = 20;
+	int maxClients = 5000;
+	int npcs = 0;
+	Uint32 reportInterval = 10000;
+	String benchName;
+	Uint32 benchSize = 0;
+	for (int i = 1; i < argc - 1; ++i)
+	{
+		String arg(argv[i]);
+		if (arg == "--port")
+			port = (Uint16)atoi(argv[++i]);
+		else if (arg == "--tick-rate")
+			tickRate = atoi(argv[++i]);
+		else if (arg == "--max-clients")
+			maxClients = atoi(argv[++i]);
+		else if (arg == "--npcs")
+			npcs = atoi(argv[++i]);
+		else if (arg == "--report")
+			reportInterval = (Uint32)atoi(argv[++i]) * 1000;
+		else if (arg == "--bench")
+			benchName = argv[++i];
+		else if (arg == "--bench-size")
+			benchSize = (Uint32)atoi(argv[++i]);
+	}
+	if (tickRate <= 0)
+		tickRate = 20;
+
+	// No video: timer for ticks, events to get Ctrl+C as a quit event.
+	if (SDL_Init(SDL_INIT_TIMER | SDL_INIT_EVENTS) < 0)
+	{
+		g_log.logErr("SDL could not initialize! SDL_Error: " + String(SDL_GetError()));
+		return EXIT_FAILURE;
+	}
+	if (SDLNet_Init() < 0)
+	{
+		g_log.logErr("SDL_net could not initialize! SDL_net Error: " + String(SDLNet_GetError()));
+		SDL_Quit();
+		return EXIT_FAILURE;
+	}
+	// Before workers start: benchmarks start as many as they need.
+	if (!benchName.empty())
+	{
+		bool ok = Benchmarks::run(benchName, benchSize);
+		SDLNet_Quit();
+		SDL_Quit();
+		return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+	JobSystem::instance().start();
+	int result = EXIT_SUCCESS;
+	Server server(TICKS_PER_SECOND(tickRate), maxClients);
+	server.setReportInterval(reportInterval);
+	if (server.start(port, npcs))
+		server.run();
+	else
+		result = EXIT_FAILURE;
+	server.stop();
+	JobSystem::instance().stop();
+	SDLNet_Quit();
+	SDL_Quit();
+	return result;
+}
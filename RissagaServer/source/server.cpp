@@ -0,0 +1,488 @@
+#include "server.h"
+
+#include "SDL_events.h"
+#include "SDL_timer.h"
+
+#include "common/logging.h"
+#include "common/jobs.h"
+
+using namespace Ris;
+
+namespace
+{
+	enum
+	{
+		// Bounds a tick under a flood: the rest waits for next one.
+		MaxReceivePerTick = 16384,
+		// Ms of ticks a MsgStatus tells about. Every requester gets the same last full window.
+		StatusWindow = 1000
+	};
+
+	inline Uint32 elapsedUs(Uint64 start, Uint64 end)
+	{
+		return (Uint32)((end - start) * 1000000 / SDL_GetPerformanceFrequency());
+	}
+}
+
+ServerClient::ServerClient() :
+	entity(0),
+	observer(0),
+	lastHeard(0),
+	outSequence(0),
+	hasInputs(false),
+	applied(false),
+	nextInput(0),
+	newestInput(0),
+	lastApplied(0),
+	dirs(StateWalking::NoDir),
+	inputDepth(0.0f),
+	statePacket(nullptr),
+	snapshotPacket(nullptr)
+{
+	address.host = INADDR_NONE;
+	address.port = 0;
+	for (int i = 0; i < InputBuffer; ++i)
+		inputValid[i] = false;
+}
+
+Server::Server(int tickInterval, int maxClients) :
+	m_world(4.0f),
+	m_tickInterval(tickInterval),
+	m_maxClients(maxClients),
+	m_timeout(10000),
+	m_clientCount(0),
+	m_now(0),
+	m_tickDue(0),
+	m_tickCounter(0),
+	m_reportInterval(10000),
+	m_lastReport(0),
+	m_statusStart(0)
+{ }
+
+Server::~Server()
+{
+	stop();
+}
+
+bool Server::start(Uint16 port, int npcs)
+{
+	if (!m_io.start(port))
+		return false;
+	for (int i = 0; i < npcs; ++i)
+		m_world.spawn((float)(i % 64) * 40.0f, (float)(i / 64) * 56.0f, "NPC " + String(i), true);
+	m_now = m_lastReport = m_statusStart = m_tickDue = SDL_GetTicks();
+	g_log.logLog("Server listening on port " + String(port) + ", " + String(1000 / m_tickInterval) + " ticks per second.");
+	return true;
+}
+
+void Server::stop()
+{
+	m_io.stop();
+}
+
+void Server::run()
+{
+	Uint32 nextTick = SDL_GetTicks();
+	// Ctrl+C comes as a quit event, even without any window.
+	while (!SDL_QuitRequested())
+	{
+		Uint32 now = SDL_GetTicks();
+		if ((Sint32)(nextTick - now) > 0)
+		{
+			SDL_Delay(nextTick - now);
+			continue;
+		}
+		// Tick skip!!!! :((
+		while ((Sint32)(nextTick - now) <= 0)
+		{
+			// Ticks are due on nextTick, skipped or not: clients map ticks to time from it.
+			m_tickDue = nextTick;
+			nextTick += m_tickInterval;
+		}
+		tick();
+		if (m_now - m_lastReport >= m_reportInterval)
+			report();
+	}
+}
+
+void Server::tick()
+{
+	m_now = SDL_GetTicks();
+	Uint64 start = SDL_GetPerformanceCounter();
+	m_tickCounter = start;
+	receive();
+	Uint64 received = SDL_GetPerformanceCounter();
+	applyInputs();
+	Uint64 inputs = SDL_GetPerformanceCounter();
+	m_world.tick();
+	Uint64 simulated = SDL_GetPerformanceCounter();
+	m_interest.update(m_world);
+	Uint64 interest = SDL_GetPerformanceCounter();
+	allocatePackets();
+	// Every client snapshot is independent: encoded on all cores, sent from here afterwards.
+	JobSystem::instance().parallelForWait((Uint32)m_clients.size(), 32, encodeRange, this);
+	Uint64 encoded = SDL_GetPerformanceCounter();
+	sendAll();
+	Uint64 sent = SDL_GetPerformanceCounter();
+
+	m_receiveTime.record(elapsedUs(start, received));
+	m_inputTime.record(elapsedUs(received, inputs));
+	m_simulateTime.record(elapsedUs(inputs, simulated));
+	m_interestTime.record(elapsedUs(simulated, interest));
+	m_encodeTime.record(elapsedUs(interest, encoded));
+	m_sendTime.record(elapsedUs(encoded, sent));
+	m_tickTime.record(elapsedUs(start, sent));
+	m_statusTime.record(elapsedUs(start, sent));
+	if (m_now - m_statusStart >= StatusWindow)
+	{
+		m_statusLast = m_statusTime;
+		m_statusTime.reset();
+		m_statusStart = m_now;
+	}
+}
+
+void Server::receive()
+{
+	Uint64 now = SDL_GetPerformanceCounter();
+	Net::NetPacket *packet;
+	for (int i = 0; (i < MaxReceivePerTick) && ((packet = m_io.receive()) != nullptr); ++i)
+	{
+		// Decoded from I/O buffer and given back.
+		m_queueTime.record((packet->time < now) ? elapsedUs(packet->time, now) : 0);
+		handle(*packet);
+		m_io.release(packet);
+	}
+}
+
+void Server::handle(const Net::NetPacket &packet)
+{
+	Net::ByteReader r(packet.data, packet.len);
+	Uint8 type = r.read8();
+	r.read16();
+	if (r.overflow())
+		return;
+	if (type == Net::MsgHello)
+	{
+		handleHello(packet.address);
+		return;
+	}
+	auto it = m_byAddress.find(addressKey(packet.address));
+	if (it == m_byAddress.end())
+		return;
+	ServerClient &client = *m_clients[it->second];
+	client.lastHeard = m_now;
+	switch (type)
+	{
+	case Net::MsgInput:
+		handleInput(client, r);
+		break;
+	case Net::MsgSnapshotAck:
+		{
+			Uint16 sequence = r.read16();
+			if (!r.overflow())
+				client.encoder.ack(sequence);
+		}
+		break;
+	case Net::MsgStatusRequest:
+		handleStatusRequest(client);
+		break;
+	case Net::MsgTimeRequest:
+		handleTimeRequest(client, r, packet.time);
+		break;
+	case Net::MsgBye:
+		removeClient(it->second);
+		break;
+	}
+}
+
+void Server::handleHello(const IPaddress &address)
+{
+	Uint32 slot;
+	auto it = m_byAddress.find(addressKey(address));
+	if (it != m_byAddress.end())
+		slot = it->second;	// Our welcome was lost.
+	else
+	{
+		if ((int)m_clientCount >= m_maxClients)
+			return;
+		if (!m_freeClients.empty())
+		{
+			slot = m_freeClients.back();
+			m_freeClients.pop_back();
+		}
+		else
+		{
+			slot = (Uint32)m_clients.size();
+			m_clients.push_back(ServerClientPtr());
+		}
+		m_clients[slot].reset(new ServerClient());
+		ServerClient &client = *m_clients[slot];
+		client.address = address;
+		client.lastHeard = m_now;
+		client.entity = m_world.spawn((float)(slot % 32) * 40.0f, (float)(slot / 32) * 56.0f, "Player " + String(slot));
+		client.observer = m_interest.addObserver(client.entity);
+		m_byAddress[addressKey(address)] = slot;
+		m_clientCount++;
+	}
+	ServerClient &client = *m_clients[slot];
+	Net::NetPacket *packet = m_io.allocate();
+	if (packet == nullptr)
+		return;	// Client says hello again.
+	Net::ByteWriter w(packet->data, Net::MaxPacketSize);
+	Net::writeHeader(w, Net::MsgWelcome, client.outSequence++);
+	w.write32(client.entity);
+	packet->len = w.size();
+	packet->address = address;
+	m_io.send(packet);
+}
+
+void Server::handleStatusRequest(ServerClient &client)
+{
+	Net::NetPacket *packet = m_io.allocate();
+	if (packet == nullptr)
+		return;
+	// Until first window is full, what there is so far.
+	const Histogram &times = m_statusLast.count() ? m_statusLast : m_statusTime;
+	Net::ServerStatus status = { m_world.currentTick(), (Uint16)m_clientCount, (Uint16)times.count(),
+		times.average(), times.percentile(0.5f), times.percentile(0.99f), times.max() };
+	Net::ByteWriter w(packet->data, Net::MaxPacketSize);
+	Net::writeHeader(w, Net::MsgStatus, client.outSequence++);
+	Net::writeServerStatus(w, status);
+	packet->len = w.size();
+	packet->address = client.address;
+	m_io.send(packet);
+}
+
+void Server::handleTimeRequest(ServerClient &client, Net::ByteReader &r, Uint64 received)
+{
+	Uint32 clientSend = r.read32();
+	if (r.overflow())
+		return;
+	Net::NetPacket *packet = m_io.allocate();
+	if (packet == nullptr)
+		return;
+	// Packet may have waited in queue since before this tick: that is server time too.
+	Uint32 waited = (received < m_tickCounter) ? elapsedUs(received, m_tickCounter) / 1000 : 0;
+	Net::TimeReply reply = { clientSend, m_now - waited, SDL_GetTicks(), m_world.currentTick() + 1, m_tickDue,
+		(Uint16)m_tickInterval, client.inputDepth };
+	Net::ByteWriter w(packet->data, Net::MaxPacketSize);
+	Net::writeHeader(w, Net::MsgTime, client.outSequence++);
+	Net::writeTimeReply(w, reply);
+	packet->len = w.size();
+	packet->address = client.address;
+	m_io.send(packet);
+	// Not held until end of tick: that would be taken as network delay.
+	m_io.flush();
+}
+
+void Server::handleInput(ServerClient &client, Net::ByteReader &r)
+{
+	Uint16 newest = r.read16();
+	Uint8 count = r.read8();
+	if (r.overflow() || (count == 0) || (count > Net::MaxRedundantInputs) || (r.left() < count))
+		return;
+	if (!client.hasInputs)
+	{
+		client.nextInput = newest - count + 1;
+		client.newestInput = newest;
+		client.hasInputs = true;
+	}
+	for (Uint8 i = 0; i < count; ++i)
+	{
+		Uint16 sequence = newest - i;
+		Uint8 dirs = r.read8();
+		// Already applied, or too far ahead to be kept.
+		if ((Sint16)(sequence - client.nextInput) < 0 || ((Uint16)(sequence - client.nextInput) >= ServerClient::InputBuffer))
+			continue;
+		int slot = sequence % ServerClient::InputBuffer;
+		client.inputs[slot] = dirs & 0xF;
+		client.inputSequences[slot] = sequence;
+		client.inputValid[slot] = true;
+	}
+	if (Net::sequenceNewer(newest, client.newestInput))
+		client.newestInput = newest;
+}
+
+void Server::applyInputs()
+{
+	for (Uint32 i = 0; i < m_clients.size(); ++i)
+	{
+		if (!m_clients[i])
+			continue;
+		ServerClient &client = *m_clients[i];
+		if (m_now - client.lastHeard > m_timeout)
+		{
+			g_log.logLog("Client " + String(i) + " timed out.");
+			removeClient(i);
+			continue;
+		}
+		if (!client.hasInputs)
+			continue;
+		// Client is too far ahead: inputs in between are lost, prediction will be corrected.
+		if ((Sint16)(client.newestInput - client.nextInput) >= ServerClient::InputBuffer)
+			client.nextInput = client.newestInput;
+		int slot = client.nextInput % ServerClient::InputBuffer;
+		// Missing input: last one is held, like a key still pressed.
+		float depth = -1.0f;
+		if (client.inputValid[slot] && (client.inputSequences[slot] == client.nextInput))
+		{
+			client.dirs = client.inputs[slot];
+			client.inputValid[slot] = false;
+			client.lastApplied = client.nextInput++;
+			client.applied = true;
+			depth = (float)(Sint16)(client.newestInput - client.nextInput + 1);
+		}
+		// Clients pace their inputs to keep it at their target (see clock_sync.h).
+		client.inputDepth += (depth - client.inputDepth) * 0.1f;
+		m_world.setDirection(client.entity, client.dirs);
+	}
+}
+
+void Server::removeClient(Uint32 slot)
+{
+	ServerClient &client = *m_clients[slot];
+	m_world.despawn(client.entity);
+	m_interest.removeObserver(client.observer);
+	m_byAddress.erase(addressKey(client.address));
+	m_clients[slot].reset();
+	m_freeClients.push_back(slot);
+	m_clientCount--;
+}
+
+void Server::encodeRange(void *context, Uint32 begin, Uint32 end)
+{
+	Server *server = static_cast<Server*>(context);
+	for (Uint32 i = begin; i < end; ++i)
+	{
+		if (server->m_clients[i])
+			server->encode(*server->m_clients[i]);
+	}
+}
+
+void Server::allocatePackets()
+{
+	// Send pool belongs to this thread: encoding jobs get their buffers from here.
+	for (const ServerClientPtr &client : m_clients)
+	{
+		if (!client)
+			continue;
+		client->statePacket = m_io.allocate();
+		client->snapshotPacket = m_io.allocate();
+	}
+}
+
+void Server::encode(ServerClient &client)
+{
+	// Out of send buffers: this client skips a tick.
+	if ((client.statePacket == nullptr) || (client.snapshotPacket == nullptr))
+		return;
+	if (client.applied)
+	{
+		const Point2D &p = m_world.object(client.entity).position();
+		Net::PlayerState state = { client.lastApplied, m_world.currentTick(), p.x, p.y,
+			(Uint8)m_world.state(client.entity), (Uint8)m_world.direction(client.entity) };
+		Net::ByteWriter w(client.statePacket->data, Net::MaxPacketSize);
+		Net::writeHeader(w, Net::MsgPlayerState, client.outSequence++);
+		Net::writePlayerState(w, state);
+		client.statePacket->len = w.size();
+	}
+
+	// Only what is in view. Entities leaving it are sent as removed by the encoder.
+	client.view.clear();
+	for (Uint32 id : m_interest.visible(client.observer))
+	{
+		const Net::EntityState *state = m_world.entityState(id);
+		if (state != nullptr)
+			client.view.push_back(*state);
+	}
+	Net::ByteWriter w(client.snapshotPacket->data, Net::HeaderSize);
+	Net::writeHeader(w, Net::MsgDeltaSnapshot, client.outSequence++);
+	int bytes = client.encoder.encode(m_world.currentTick(), m_now, client.view.data(), nullptr, (int)client.view.size(),
+		client.snapshotPacket->data + Net::HeaderSize, Net::MaxPacketSize - Net::HeaderSize);
+	client.snapshotPacket->len = bytes ? Net::HeaderSize + bytes : 0;
+}
+
+void Server::sendAll()
+{
+	for (const ServerClientPtr &client : m_clients)
+	{
+		if (!client)
+			continue;
+		send(*client, client->statePacket);
+		send(*client, client->snapshotPacket);
+	}
+	m_io.flush();
+}
+
+void Server::send(ServerClient &client, Net::NetPacket *&packet)
+{
+	if (packet == nullptr)
+		return;
+	if (packet->len > 0)
+	{
+		packet->address = client.address;
+		m_io.send(packet);
+	}
+	else
+		m_io.discard(packet);
+	packet = nullptr;
+}
+
+void Server::reportInterest()
+{
+	// Per client averages: cost of keeping views and what each snapshot carries.
+	const InterestManager::Stats &interest = m_interest.stats();
+	Uint64 visible = 0;
+	Uint32 snapshots = 0;
+	Uint32 sent = 0;
+	Uint32 bytes = 0;
+	for (const ServerClientPtr &client : m_clients)
+	{
+		if (!client)
+			continue;
+		visible += m_interest.visible(client->observer).size();
+		const Net::SnapshotEncoder::Stats &s = client->encoder.stats();
+		snapshots += s.snapshots;
+		sent += s.sent;
+		bytes += s.bytes;
+		client->encoder.resetStats();
+	}
+	float clients = m_clientCount ? (float)m_clientCount : 1.0f;
+	float updates = interest.updates ? (float)interest.updates : 1.0f;
+	float perSnapshot = snapshots ? 1.0f / snapshots : 0.0f;
+	char buf[256];
+	SDL_snprintf(buf, sizeof(buf), "Interest: %.1f visible, %.2f entered, %.2f left per client tick, %.0f crossings, "
+		"%.0f checks per tick. Snapshots: %.1f entities, %.0f bytes each.", visible / clients,
+		interest.entered / updates / clients, interest.left / updates / clients, interest.crossings / updates,
+		interest.checks / updates, sent * perSnapshot, bytes * perSnapshot);
+	g_log.logLog(buf);
+	m_interest.resetStats();
+}
+
+void Server::report()
+{
+	Uint32 elapsed = m_now - m_lastReport;
+	if (elapsed == 0)
+		elapsed = 1;
+	Net::NetIoStats io = m_io.takeStats();
+	g_log.logLog("Tick " + String(m_world.currentTick()) + ": " + String(m_clientCount) + " clients, " +
+		String(m_world.count()) + " entities, in " + String((Uint64)io.bytesIn * 1000 / elapsed / 1024) +
+		" KB/s, out " + String((Uint64)io.bytesOut * 1000 / elapsed / 1024) + " KB/s.");
+	g_log.logLog("Packets in " + String((Uint64)io.packetsIn * 1000 / elapsed) + "/s in " +
+		String(io.receiveCalls) + " calls, out " + String((Uint64)io.packetsOut * 1000 / elapsed) + "/s in " +
+		String(io.sendCalls) + " calls, " + String(io.dropped) + " dropped. " + m_queueTime.report("Queue"));
+	reportInterest();
+	// avg/p50/p90/p99/max per tick phase.
+	g_log.logLog(m_tickTime.report("Tick") + ", " + m_receiveTime.report("Receive") + ", " + m_inputTime.report("Input"));
+	g_log.logLog(m_simulateTime.report("Simulate") + ", " + m_interestTime.report("Interest") + ", " +
+		m_encodeTime.report("Encode") + ", " + m_sendTime.report("Send"));
+	m_queueTime.reset();
+	m_interestTime.reset();
+	m_tickTime.reset();
+	m_receiveTime.reset();
+	m_inputTime.reset();
+	m_simulateTime.reset();
+	m_encodeTime.reset();
+	m_sendTime.reset();
+	m_lastReport = m_now;
+}
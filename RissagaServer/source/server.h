@@ -0,0 +1,126 @@
+#pragma once
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "common/net_protocol.h"
+#include "common/net_io.h"
+#include "common/snapshot_delta.h"
+#include "common/histogram.h"
+#include "world.h"
+#include "interest.h"
+
+namespace Ris
+{
+	// One connected client.
+	struct ServerClient
+	{
+		enum
+		{
+			// Inputs received ahead of the one to be applied.
+			InputBuffer = 32
+		};
+		IPaddress address;
+		Uint32 entity;
+		Uint32 observer;
+		Uint32 lastHeard;
+		Uint16 outSequence;
+
+		// Inputs are applied one per tick, in sequence order, as client predicted them.
+		Uint8 inputs[InputBuffer];
+		Uint16 inputSequences[InputBuffer];
+		bool inputValid[InputBuffer];
+		bool hasInputs;
+		bool applied;
+		Uint16 nextInput;
+		Uint16 newestInput;
+		Uint16 lastApplied;
+		Uint8 dirs;
+		// Inputs waiting after each tick, smoothed. -1 on ticks its input was missing.
+		float inputDepth;
+
+		Net::SnapshotEncoder encoder;
+		// States of entities in view, sorted by ID. Filled by encoding job.
+		std::vector<Net::EntityState> view;
+		// Taken from send pool before encoding jobs fill them, sent afterwards. len 0 if unused.
+		Net::NetPacket *statePacket;
+		Net::NetPacket *snapshotPacket;
+
+		ServerClient();
+	};
+	typedef std::unique_ptr<ServerClient> ServerClientPtr;
+
+	// Headless authoritative server. No SDL video: timer, events (for quit) and net only.
+	// Every tick: receive all packets, apply one input per client, simulate, update views,
+	// send snapshots of what each client sees.
+	// Socket calls are done on NetIo thread: ticks only pay for decoding and encoding.
+	class Server
+	{
+		Net::NetIo m_io;
+		World m_world;
+		InterestManager m_interest;
+		int m_tickInterval;
+		int m_maxClients;
+		Uint32 m_timeout;
+
+		std::vector<ServerClientPtr> m_clients;
+		std::vector<Uint32> m_freeClients;
+		std::unordered_map<Uint64, Uint32> m_byAddress;
+		Uint32 m_clientCount;
+		Uint32 m_now;
+		// When current tick was due, and performance counter when it started.
+		Uint32 m_tickDue;
+		Uint64 m_tickCounter;
+
+		// Per tick timings, reported and reset every m_reportInterval ms.
+		Histogram m_receiveTime;
+		Histogram m_inputTime;
+		Histogram m_simulateTime;
+		Histogram m_interestTime;
+		Histogram m_encodeTime;
+		Histogram m_sendTime;
+		Histogram m_tickTime;
+		// Tick times of current status window, and of last full one, which MsgStatus reports.
+		// Reading it changes nothing: any number of clients can ask.
+		Histogram m_statusTime;
+		Histogram m_statusLast;
+		// From socket to game thread.
+		Histogram m_queueTime;
+		Uint32 m_reportInterval;
+		Uint32 m_lastReport;
+		Uint32 m_statusStart;
+
+		static inline Uint64 addressKey(const IPaddress &a) { return ((Uint64)a.host << 16) | a.port; }
+		void receive();
+		void handle(const Net::NetPacket &packet);
+		void handleHello(const IPaddress &address);
+		void handleInput(ServerClient &client, Net::ByteReader &r);
+		void handleStatusRequest(ServerClient &client);
+		void handleTimeRequest(ServerClient &client, Net::ByteReader &r, Uint64 received);
+		void removeClient(Uint32 slot);
+		void applyInputs();
+		static void encodeRange(void *context, Uint32 begin, Uint32 end);
+		void encode(ServerClient &client);
+		void allocatePackets();
+		void sendAll();
+		void send(ServerClient &client, Net::NetPacket *&packet);
+		void reportInterest();
+		void report();
+
+	public:
+		Server(int tickInterval, int maxClients);
+		~Server();
+
+		// Opens port and spawns npcs wandering NPCs.
+		bool start(Uint16 port, int npcs = 0);
+		// Runs ticks until quit is requested (Ctrl+C).
+		void run();
+		void stop();
+		void tick();
+
+		inline void setReportInterval(Uint32 ms) { m_reportInterval = ms; }
+		inline Uint32 clientCount() const { return m_clientCount; }
+		inline const World &world() const { return m_world; }
+	};
+}
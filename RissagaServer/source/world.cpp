@@ -0,0 +1,138 @@
+#include "world.h"
+
+#include "common/jobs.h"
+
+using namespace Ris;
+
+static Steering::Params steeringParams(float speed)
+{
+	Steering::Params params;
+	params.maxSpeed = speed;
+	return params;
+}
+
+World::World(float speed) :
+	m_seed(0x5EED),
+	m_speed(Fixed::fromFloat(speed)),
+	m_tick(0),
+	m_steering(steeringParams(speed))
+{ }
+
+Uint32 World::spawn(float x, float y, const String &name, bool ai)
+{
+	Uint32 entity;
+	if (!m_free.empty())
+	{
+		entity = m_free.back();
+		m_free.pop_back();
+		m_objects[entity] = AliveObj();
+	}
+	else
+	{
+		entity = m_movement.add();
+		m_x.push_back(Fixed());
+		m_y.push_back(Fixed());
+		m_objects.push_back(AliveObj());
+		m_active.push_back(0);
+		m_aiThink.push_back(0);
+		m_steering.resize(m_objects.size());
+	}
+	m_movement.set(entity, State::Standing, StateWalking::NoDir);
+	m_x[entity] = Fixed::fromFloat(x);
+	m_y[entity] = Fixed::fromFloat(y);
+	m_objects[entity].position().set(m_x[entity].toFloat(), m_y[entity].toFloat());
+	m_objects[entity].name() = name;
+	m_active[entity] = 1;
+	m_aiThink[entity] = ai ? m_tick + 1 : 0;
+	m_steering.setPosition(entity, m_x[entity].toFloat(), m_y[entity].toFloat());
+	m_steering.setVelocity(entity, 0.0f, 0.0f);
+	m_steering.setMode(entity, ai ? Steering::Steered : Steering::Obstacle);
+	return entity;
+}
+
+void World::despawn(Uint32 entity)
+{
+	if (!active(entity))
+		return;
+	// Slot is kept, still and out of replication, until reused.
+	m_movement.set(entity, State::Standing, StateWalking::NoDir);
+	m_active[entity] = 0;
+	m_aiThink[entity] = 0;
+	m_steering.setMode(entity, Steering::Ignored);
+	m_free.push_back(entity);
+}
+
+void World::think()
+{
+	static const Uint8 dirs[4] = { StateWalking::North, StateWalking::South, StateWalking::East, StateWalking::West };
+	for (Uint32 i = 0; i < m_aiThink.size(); ++i)
+	{
+		if ((m_aiThink[i] == 0) || (m_aiThink[i] > m_tick))
+			continue;
+		m_aiThink[i] = m_tick + 10 + random() % 20;
+		m_movement.setDirection(i, (random() & 0x100) ? dirs[(random() >> 8) & 3] : (Uint8)StateWalking::NoDir);
+	}
+}
+
+void World::steer()
+{
+	for (Uint32 i = 0; i < m_objects.size(); ++i)
+	{
+		if (!m_active[i])
+			continue;
+		Uint8 d = m_movement.moveDirection(i);
+		m_steering.setPreferred(i, MoveTables::moveX[d] * m_speed.toFloat(), MoveTables::moveY[d] * m_speed.toFloat());
+		// Players are where their inputs took them, NPCs where steering did.
+		if (m_steering.mode(i) == Steering::Obstacle)
+			m_steering.setPosition(i, m_x[i].toFloat(), m_y[i].toFloat());
+	}
+	m_steering.update();
+}
+
+void World::integrateRange(void *context, Uint32 begin, Uint32 end)
+{
+	World *world = static_cast<World*>(context);
+	// Steered entities were moved already: runs between them are moved by direction.
+	Uint32 run = begin;
+	for (Uint32 i = begin; i < end; ++i)
+	{
+		if (world->m_steering.mode(i) != Steering::Steered)
+			continue;
+		world->m_movement.integrate(world->m_x.data(), world->m_y.data(), world->m_speed, run, i);
+		world->m_x[i] = Fixed::fromFloat(world->m_steering.x(i));
+		world->m_y[i] = Fixed::fromFloat(world->m_steering.y(i));
+		run = i + 1;
+	}
+	world->m_movement.integrate(world->m_x.data(), world->m_y.data(), world->m_speed, run, end);
+	for (Uint32 i = begin; i < end; ++i)
+		world->m_objects[i].position().set(world->m_x[i].toFloat(), world->m_y[i].toFloat());
+}
+
+void World::tick()
+{
+	// Same steps than client prediction: inputs were applied already, then movement.
+	m_tick++;
+	think();
+	steer();
+	JobSystem::instance().parallelForWait((Uint32)m_movement.count(), 4096, integrateRange, this);
+
+	m_states.clear();
+	m_stateIndex.assign(m_objects.size(), -1);
+	const Uint8 *states = m_movement.states();
+	const Uint8 *dirs = m_movement.directions();
+	for (Uint32 i = 0; i < m_objects.size(); ++i)
+	{
+		if (!m_active[i])
+			continue;
+		m_stateIndex[i] = (int)m_states.size();
+		m_states.push_back(Net::EntityState());
+		Net::EntityState &e = m_states.back();
+		e.id = i;
+		e.position = m_objects[i].position();
+		e.state = states[i];
+		e.dirs = dirs[i];
+		e.health = m_objects[i].health();
+		e.mana = m_objects[i].mana();
+		e.quantize();
+	}
+}
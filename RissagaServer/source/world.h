@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+
+#include "utils/fixed.h"
+#include "common/game_obj.h"
+#include "common/movement_fsm.h"
+#include "common/net_protocol.h"
+#include "common/steering.h"
+
+namespace Ris
+{
+	// Authoritative world. Movement runs on MovementFSM arrays, like client simulation does,
+	// and positions are copied back to each AliveObj once per tick.
+	// Wandering NPCs are steered around each other, and around players, instead: their direction
+	// is only the way they would like to go.
+	class World
+	{
+		MovementFSM m_movement;
+		// Fixed point, as client prediction: players end up on the same bits on both ends.
+		std::vector<Fixed> m_x;
+		std::vector<Fixed> m_y;
+		std::vector<AliveObj> m_objects;
+		std::vector<Uint8> m_active;
+		std::vector<Uint32> m_free;
+		// Tick of next decision for wandering NPCs. 0 for players.
+		std::vector<Uint32> m_aiThink;
+		Uint32 m_seed;
+		Fixed m_speed;
+		Uint32 m_tick;
+		Steering m_steering;
+		// Replicated state of active entities, sorted by ID. Rebuilt every tick.
+		std::vector<Net::EntityState> m_states;
+		// Index in m_states by entity, -1 if not active.
+		std::vector<int> m_stateIndex;
+
+		static void integrateRange(void *context, Uint32 begin, Uint32 end);
+		void think();
+		void steer();
+		inline Uint32 random() { return m_seed = m_seed * 1103515245 + 12345; }
+
+	public:
+		// speed in pixels per tick. Must be the same clients predict with.
+		World(float speed);
+
+		Uint32 spawn(float x, float y, const String &name, bool ai = false);
+		void despawn(Uint32 entity);
+		inline void setDirection(Uint32 entity, Uint8 dirs) { m_movement.setDirection(entity, dirs); }
+		void tick();
+
+		inline Uint32 currentTick() const { return m_tick; }
+		inline size_t capacity() const { return m_objects.size(); }
+		inline size_t count() const { return m_objects.size() - m_free.size(); }
+		inline bool active(Uint32 entity) const { return (entity < m_active.size()) && m_active[entity]; }
+		inline AliveObj &object(Uint32 entity) { return m_objects[entity]; }
+		inline const AliveObj &object(Uint32 entity) const { return m_objects[entity]; }
+		inline State::StateID state(Uint32 entity) const { return m_movement.state(entity); }
+		inline StateWalking::Direction direction(Uint32 entity) const { return m_movement.direction(entity); }
+		inline const std::vector<Net::EntityState> &states() const { return m_states; }
+		// Replicated state of an entity on last tick, nullptr if it was not active.
+		inline const Net::EntityState *entityState(Uint32 entity) const
+		{
+			return ((entity < m_stateIndex.size()) && (m_stateIndex[entity] >= 0)) ? &m_states[m_stateIndex[entity]] : nullptr;
+		}
+	};
+}
@@ -0,0 +1,373 @@
+#pragma once
+
+#include <math.h>
+
+#include "SDL_stdinc.h"
+
+namespace Ris
+{
+	namespace Net
+	{
+		// Bits needed to store any value in [0, range].
+		inline int bitsRequired(Uint32 range)
+		{
+			int bits = 0;
+			while (range)
+			{
+				++bits;
+				range >>= 1;
+			}
+			return bits;
+		}
+
+		// Writes bit fields on a caller buffer. Nothing is allocated.
+		// Bits are packed from least significant first, so output does not depend on endianness.
+		class BitWriter
+		{
+			Uint8 *m_data;
+			int m_size;
+			int m_pos;
+			Uint64 m_scratch;
+			int m_scratchBits;
+			bool m_overflow;
+
+		public:
+			BitWriter(Uint8 *data, int size) :
+				m_data(data), m_size(size), m_pos(0), m_scratch(0), m_scratchBits(0), m_overflow(false)
+			{ }
+			// bits in [1, 32].
+			inline void writeBits(Uint32 value, int bits)
+			{
+				m_scratch |= (Uint64)(value & (Uint32)((((Uint64)1) << bits) - 1)) << m_scratchBits;
+				m_scratchBits += bits;
+				while (m_scratchBits >= 8)
+				{
+					if (m_pos < m_size)
+						m_data[m_pos++] = (Uint8)m_scratch;
+					else
+						m_overflow = true;
+					m_scratch >>= 8;
+					m_scratchBits -= 8;
+				}
+			}
+			// Pads with zeroes to next byte.
+			inline void align()
+			{
+				if (m_scratchBits)
+					writeBits(0, 8 - m_scratchBits);
+			}
+			// Must be called once everything is written. Returns bytes used.
+			inline int flush()
+			{
+				align();
+				return m_pos;
+			}
+			inline int bitsWritten() const { return m_pos * 8 + m_scratchBits; }
+			inline int bitsLeft() const { return (m_size - m_pos) * 8 - m_scratchBits; }
+			inline bool overflow() const { return m_overflow; }
+
+			// Position to go back to, undoing everything written after it, overflow included.
+			struct Mark
+			{
+				int pos;
+				Uint64 scratch;
+				int scratchBits;
+				bool overflow;
+			};
+			inline Mark mark() const
+			{
+				Mark m = { m_pos, m_scratch, m_scratchBits, m_overflow };
+				return m;
+			}
+			inline void rewind(const Mark &m)
+			{
+				m_pos = m.pos;
+				m_scratch = m.scratch;
+				m_scratchBits = m.scratchBits;
+				m_overflow = m.overflow;
+			}
+		};
+
+		// Reads bit fields written by BitWriter. Reading past the end gives zeroes and sets overflow.
+		class BitReader
+		{
+			const Uint8 *m_data;
+			int m_size;
+			int m_pos;
+			Uint64 m_scratch;
+			int m_scratchBits;
+			bool m_overflow;
+
+		public:
+			BitReader(const Uint8 *data, int size) :
+				m_data(data), m_size(size), m_pos(0), m_scratch(0), m_scratchBits(0), m_overflow(false)
+			{ }
+			// bits in [1, 32].
+			inline Uint32 readBits(int bits)
+			{
+				while (m_scratchBits < bits)
+				{
+					if (m_pos >= m_size)
+					{
+						m_overflow = true;
+						return 0;
+					}
+					m_scratch |= (Uint64)m_data[m_pos++] << m_scratchBits;
+					m_scratchBits += 8;
+				}
+				Uint32 value = (Uint32)(m_scratch & ((((Uint64)1) << bits) - 1));
+				m_scratch >>= bits;
+				m_scratchBits -= bits;
+				return value;
+			}
+			inline void align()
+			{
+				m_scratch = 0;
+				m_scratchBits = 0;
+			}
+			inline int bitsRead() const { return m_pos * 8 - m_scratchBits; }
+			inline int bitsLeft() const { return (m_size - m_pos) * 8 + m_scratchBits; }
+			inline bool overflow() const { return m_overflow; }
+		};
+
+		// Streams for message schemas.
+		// A message declares its fields once, on a template <typename Stream> void serialize(Stream &s)
+		// method, with the serialize*() functions below. Same code writes, reads and measures it,
+		// so encoding and decoding cannot diverge.
+		class WriteStream
+		{
+			BitWriter m_writer;
+			bool m_error;
+
+		public:
+			enum
+			{
+				IsWriting = 1,
+				IsReading = 0
+			};
+			WriteStream(Uint8 *data, int size) : m_writer(data, size), m_error(false)
+			{ }
+			inline void bits(Uint32 &value, int bits) { m_writer.writeBits(value, bits); }
+			inline void align() { m_writer.align(); }
+			inline int flush() { return m_writer.flush(); }
+			inline void setError() { m_error = true; }
+			inline bool error() const { return m_error || m_writer.overflow(); }
+			inline int bitsProcessed() const { return m_writer.bitsWritten(); }
+			inline BitWriter::Mark mark() const { return m_writer.mark(); }
+			inline void rewind(const BitWriter::Mark &m) { m_writer.rewind(m); }
+		};
+
+		class ReadStream
+		{
+			BitReader m_reader;
+			bool m_error;
+
+		public:
+			enum
+			{
+				IsWriting = 0,
+				IsReading = 1
+			};
+			ReadStream(const Uint8 *data, int size) : m_reader(data, size), m_error(false)
+			{ }
+			inline void bits(Uint32 &value, int bits) { value = m_reader.readBits(bits); }
+			inline void align() { m_reader.align(); }
+			inline void setError() { m_error = true; }
+			inline bool error() const { return m_error || m_reader.overflow(); }
+			inline int bitsProcessed() const { return m_reader.bitsRead(); }
+		};
+
+		// Counts bits a message would take, without writing anything.
+		class MeasureStream
+		{
+			int m_bits;
+			bool m_error;
+
+		public:
+			enum
+			{
+				IsWriting = 1,
+				IsReading = 0
+			};
+			MeasureStream() : m_bits(0), m_error(false)
+			{ }
+			inline void bits(Uint32 &, int bits) { m_bits += bits; }
+			inline void align() { m_bits = (m_bits + 7) & ~7; }
+			inline void setError() { m_error = true; }
+			inline bool error() const { return m_error; }
+			inline int bitsProcessed() const { return m_bits; }
+			inline int bytes() const { return (m_bits + 7) / 8; }
+		};
+
+		template <typename Stream, typename T>
+		inline void serializeBits(Stream &s, T &value, int bits)
+		{
+			Uint32 v = (Uint32)value;
+			s.bits(v, bits);
+			if (Stream::IsReading)
+				value = (T)v;
+		}
+
+		template <typename Stream>
+		inline void serializeBool(Stream &s, bool &value)
+		{
+			Uint32 v = value ? 1 : 0;
+			s.bits(v, 1);
+			if (Stream::IsReading)
+				value = (v != 0);
+		}
+
+		// Integer in [min, max]. Values out of range are an error on both ends.
+		template <typename Stream, typename T>
+		inline void serializeInt(Stream &s, T &value, Sint32 min, Sint32 max)
+		{
+			Uint32 range = (Uint32)(max - min);
+			Uint32 v = 0;
+			if (Stream::IsWriting)
+			{
+				if (((Sint32)value < min) || ((Sint32)value > max))
+					s.setError();
+				v = (Uint32)((Sint32)value - min);
+			}
+			s.bits(v, bitsRequired(range));
+			if (Stream::IsReading)
+			{
+				if (v > range)
+					s.setError();
+				value = (T)((Sint32)v + min);
+			}
+		}
+
+		// Small values take less: 7 bits per group and a continuation bit.
+		template <typename Stream>
+		inline void serializeVarint(Stream &s, Uint32 &value)
+		{
+			if (Stream::IsWriting)
+			{
+				Uint32 v = value;
+				do
+				{
+					Uint32 group = (v & 0x7F) | ((v > 0x7F) ? 0x80 : 0);
+					s.bits(group, 8);
+					v >>= 7;
+				} while (v);
+				return;
+			}
+			value = 0;
+			for (int shift = 0; shift < 35; shift += 7)
+			{
+				Uint32 group = 0;
+				s.bits(group, 8);
+				value |= (group & 0x7F) << shift;
+				if (!(group & 0x80))
+					return;
+			}
+			s.setError();
+		}
+
+		// Zigzag: small negative values are small too.
+		template <typename Stream>
+		inline void serializeSignedVarint(Stream &s, Sint32 &value)
+		{
+			Uint32 v = ((Uint32)value << 1) ^ (Uint32)(value >> 31);
+			serializeVarint(s, v);
+			if (Stream::IsReading)
+				value = (Sint32)(v >> 1) ^ -(Sint32)(v & 1);
+		}
+
+		// Float quantized to precision units within [min, max].
+		struct FloatRange
+		{
+			float min;
+			float max;
+			float precision;
+
+			inline Uint32 steps() const { return (Uint32)ceilf((max - min) / precision); }
+			inline Sint32 quantize(float v) const
+			{
+				if (v < min)
+					v = min;
+				else if (v > max)
+					v = max;
+				// Never below 0.5 once clamped: truncating is flooring, without a call to floorf.
+				return (Sint32)((v - min) / precision + 0.5f);
+			}
+			inline float dequantize(Sint32 q) const { return min + (float)q * precision; }
+			// Value as the other end will see it.
+			inline float round(float v) const { return dequantize(quantize(v)); }
+		};
+
+		template <typename Stream>
+		inline void serializeFloat(Stream &s, float &value, const FloatRange &range)
+		{
+			Uint32 steps = range.steps();
+			Uint32 q = Stream::IsWriting ? (Uint32)range.quantize(value) : 0;
+			s.bits(q, bitsRequired(steps));
+			if (Stream::IsReading)
+			{
+				if (q > steps)
+					s.setError();
+				value = range.dequantize((Sint32)q);
+			}
+		}
+
+		// Delta against a baseline both ends have: one bit if unchanged, else a signed varint difference.
+		template <typename Stream, typename T>
+		inline void serializeIntDelta(Stream &s, T &value, T baseline)
+		{
+			bool changed = (value != baseline);
+			serializeBool(s, changed);
+			if (!changed)
+			{
+				if (Stream::IsReading)
+					value = baseline;
+				return;
+			}
+			Sint32 diff = (Sint32)value - (Sint32)baseline;
+			serializeSignedVarint(s, diff);
+			if (Stream::IsReading)
+				value = (T)((Sint32)baseline + diff);
+		}
+
+		// Same, on quantized values. Baseline must be a value already quantized (see FloatRange::round).
+		template <typename Stream>
+		inline void serializeFloatDelta(Stream &s, float &value, float baseline, const FloatRange &range)
+		{
+			Sint32 base = range.quantize(baseline);
+			Sint32 q = Stream::IsWriting ? range.quantize(value) : base;
+			serializeIntDelta(s, q, base);
+			if (Stream::IsReading)
+			{
+				if ((q < 0) || ((Uint32)q > range.steps()))
+					s.setError();
+				value = range.dequantize(q);
+			}
+		}
+
+		// Writes a message on a buffer. Returns bytes used, 0 on error.
+		template <typename Message>
+		inline int writeMessage(Message &msg, Uint8 *data, int size)
+		{
+			WriteStream s(data, size);
+			msg.serialize(s);
+			int bytes = s.flush();
+			return s.error() ? 0 : bytes;
+		}
+
+		template <typename Message>
+		inline bool readMessage(Message &msg, const Uint8 *data, int size)
+		{
+			ReadStream s(data, size);
+			msg.serialize(s);
+			return !s.error();
+		}
+
+		template <typename Message>
+		inline int measureMessage(Message &msg)
+		{
+			MeasureStream s;
+			msg.serialize(s);
+			return s.bytes();
+		}
+	}
+}
@@ -0,0 +1,161 @@
+#include "clock_sync.h"
+
+#include <math.h>
+
+using namespace Ris;
+
+namespace
+{
+	// ms of correction per ms of local time. Clock in use runs 5% faster or slower at most.
+	const double SlewRate = 0.05;
+	// Part of tick interval per input of depth away from target, and most of it.
+	const float DriftGain = 0.02f;
+	const float MaxDrift = 0.05f;
+	// Weight of new samples on smoothed round trip and on input depth.
+	const float RttSmoothing = 0.125f;
+	const float DepthSmoothing = 0.25f;
+}
+
+ClockSync::ClockSync(Uint32 tickInterval, float targetDepth) :
+	m_tickInterval(tickInterval),
+	m_targetDepth(targetDepth)
+{
+	reset();
+}
+
+void ClockSync::reset()
+{
+	m_count = 0;
+	m_next = 0;
+	m_synced = false;
+	m_lastRequest = 0;
+	m_hasRequest = false;
+	m_rtt = 0.0f;
+	m_minRtt = 0;
+	m_target = 0.0;
+	m_offset = 0.0;
+	m_lastUpdate = 0;
+	m_tick = 0;
+	m_tickTime = 0;
+	m_inputDepth = m_targetDepth;
+	m_inputInterval = (float)m_tickInterval;
+	m_inputCarry = 0.0f;
+	m_stats = Stats();
+}
+
+bool ClockSync::wantsRequest(Uint32 now) const
+{
+	if (!m_hasRequest)
+		return true;
+	return now - m_lastRequest >= (Uint32)((m_count < Samples) ? FastInterval : SlowInterval);
+}
+
+void ClockSync::writeRequest(Net::ByteWriter &w, Uint32 now)
+{
+	w.write32(now);
+	m_lastRequest = now;
+	m_hasRequest = true;
+}
+
+void ClockSync::addSample(const Net::TimeReply &reply, Uint32 now)
+{
+	Sint32 elapsed = (Sint32)(now - reply.clientSend);
+	Sint32 held = (Sint32)(reply.serverSend - reply.serverReceive);
+	if ((elapsed < 0) || (held < 0))
+		return;
+	// Clocks are in whole ms: a fast enough round trip may look negative.
+	Sint32 rtt = (elapsed > held) ? elapsed - held : 0;
+	// Clocks are not related at all: differences are taken first, so they never overflow.
+	double offset = ((double)(Sint32)(reply.serverReceive - reply.clientSend) +
+		(double)(Sint32)(reply.serverSend - now)) * 0.5;
+	m_samples[m_next].rtt = rtt;
+	m_samples[m_next].offset = offset;
+	m_next = (m_next + 1) % Samples;
+	if (m_count < Samples)
+		m_count++;
+	m_stats.samples++;
+
+	// Clock filter: the least delayed sample is the least skewed by queues on either way.
+	int best = 0;
+	for (int i = 1; i < m_count; ++i)
+	{
+		if (m_samples[i].rtt < m_samples[best].rtt)
+			best = i;
+	}
+	m_target = m_samples[best].offset;
+	m_minRtt = m_samples[best].rtt;
+	m_rtt = m_synced ? m_rtt + ((float)rtt - m_rtt) * RttSmoothing : (float)rtt;
+
+	m_tick = reply.tick;
+	m_tickTime = reply.tickTime;
+	if (reply.tickInterval > 0)
+		m_tickInterval = reply.tickInterval;
+	m_inputDepth = m_synced ? m_inputDepth + (reply.inputDepth - m_inputDepth) * DepthSmoothing : reply.inputDepth;
+	float drift = DriftGain * (m_inputDepth - m_targetDepth);
+	if (drift > MaxDrift)
+		drift = MaxDrift;
+	else if (drift < -MaxDrift)
+		drift = -MaxDrift;
+	m_inputInterval = m_tickInterval * (1.0f + drift);
+
+	if (!m_synced)
+	{
+		// Nothing used the clock yet: it starts right on estimate.
+		m_offset = m_target;
+		m_lastUpdate = now;
+		m_synced = true;
+	}
+}
+
+void ClockSync::update(Uint32 now)
+{
+	if (!m_synced)
+		return;
+	double most = (double)(Uint32)(now - m_lastUpdate) * SlewRate;
+	m_lastUpdate = now;
+	double step = m_target - m_offset;
+	if (step > most)
+		step = most;
+	else if (step < -most)
+		step = -most;
+	m_offset += step;
+	m_stats.slewed += fabs(step);
+}
+
+Uint32 ClockSync::serverTime(Uint32 now) const
+{
+	return now + (Uint32)(Sint32)floor(m_offset + 0.5);
+}
+
+double ClockSync::serverTick(Uint32 now) const
+{
+	double whole = floor(m_offset);
+	Uint32 server = now + (Uint32)(Sint32)whole;
+	// Anchor is a recent tick: difference stays small even if a clock wrapped.
+	double since = (double)(Sint32)(server - m_tickTime) + (m_offset - whole);
+	return (double)m_tick + since / (double)m_tickInterval;
+}
+
+Uint32 ClockSync::tickTime(Uint32 tick) const
+{
+	Uint32 server = m_tickTime + (Uint32)((Sint32)(tick - m_tick) * (Sint32)m_tickInterval);
+	return server - (Uint32)(Sint32)floor(m_offset + 0.5);
+}
+
+Uint32 ClockSync::inputStep()
+{
+	m_inputCarry += m_inputInterval;
+	Uint32 step = (Uint32)m_inputCarry;
+	m_inputCarry -= (float)step;
+	return step;
+}
+
+String ClockSync::report() const
+{
+	if (!m_synced)
+		return "Clock: not synced.";
+	char buf[160];
+	SDL_snprintf(buf, sizeof(buf), "Clock: rtt %.1f ms (min %d), offset %+.1f ms (estimate %+.1f), input depth %.2f, "
+		"input tick %.2f ms.", m_rtt, m_minRtt, m_offset, m_target, m_inputDepth, m_inputInterval);
+	return buf;
+}
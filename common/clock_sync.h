@@ -0,0 +1,102 @@
+#pragma once
+
+#include "SDL_stdinc.h"
+
+#include "common/string.h"
+#include "common/net_protocol.h"
+
+namespace Ris
+{
+	// NTP style estimate of server clock and ticks, from time requests server echoes.
+	// A sample gives round trip = (clientReceive - clientSend) - (serverSend - serverReceive)
+	// and offset = ((serverReceive - clientSend) + (serverSend - clientReceive)) / 2.
+	// The offset kept is the one of the shortest round trip among last samples: queuing delays it
+	// least. Once synced, clock in use never jumps: it slews towards that estimate.
+	class ClockSync
+	{
+	public:
+		enum
+		{
+			Samples = 8,
+			// Requests every FastInterval ms until Samples are taken, every SlowInterval ms after.
+			FastInterval = 100,
+			SlowInterval = 500
+		};
+		struct Stats
+		{
+			Uint32 samples;
+			// Clock in use moved by slewing, in ms.
+			double slewed;
+			Stats() : samples(0), slewed(0.0)
+			{ }
+		};
+
+	private:
+		struct Sample
+		{
+			Sint32 rtt;
+			double offset;
+		};
+		Sample m_samples[Samples];
+		int m_count;
+		int m_next;
+		bool m_synced;
+		Uint32 m_lastRequest;
+		bool m_hasRequest;
+		// Smoothed round trip, ms.
+		float m_rtt;
+		Sint32 m_minRtt;
+		// Server clock minus local clock: estimate, and value in use.
+		double m_target;
+		double m_offset;
+		Uint32 m_lastUpdate;
+
+		// Server tick tick was due at server time tickTime.
+		Uint32 m_tick;
+		Uint32 m_tickTime;
+		Uint32 m_tickInterval;
+
+		float m_inputDepth;
+		float m_targetDepth;
+		float m_inputInterval;
+		float m_inputCarry;
+		Stats m_stats;
+
+	public:
+		// tickInterval is the expected one, until server tells its own.
+		ClockSync(Uint32 tickInterval, float targetDepth = 2.0f);
+		void reset();
+
+		// A time request should be sent now.
+		bool wantsRequest(Uint32 now) const;
+		// Writes a time request sent at local time now.
+		void writeRequest(Net::ByteWriter &w, Uint32 now);
+		// Server reply, received at local time now.
+		void addSample(const Net::TimeReply &reply, Uint32 now);
+		// Moves clock in use towards estimate. Called every frame.
+		void update(Uint32 now);
+
+		inline bool synced() const { return m_synced; }
+		inline float rtt() const { return m_rtt; }
+		inline Sint32 minRtt() const { return m_minRtt; }
+		// Server clock minus local clock, in use.
+		inline double offset() const { return m_offset; }
+		// Server clock at local time now.
+		Uint32 serverTime(Uint32 now) const;
+		// Server tick due at local time now, with fraction.
+		double serverTick(Uint32 now) const;
+		// Local time server tick is due.
+		Uint32 tickTime(Uint32 tick) const;
+		inline Uint32 tickInterval() const { return m_tickInterval; }
+
+		// Local input ticks, ms. Drifts around tick interval so that server keeps targetDepth
+		// inputs waiting: less, client runs faster; more, slower. Never by more than a few percents.
+		inline float inputInterval() const { return m_inputInterval; }
+		inline float inputDepth() const { return m_inputDepth; }
+		// Whole ms to next input tick. Fractions are carried to next ones.
+		Uint32 inputStep();
+
+		inline const Stats &stats() const { return m_stats; }
+		String report() const;
+	};
+}
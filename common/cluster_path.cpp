@@ -0,0 +1,419 @@
+#include "cluster_path.h"
+
+#include <algorithm>
+#include <functional>
+
+#include "utils/math.h"
+
+using namespace Ris;
+
+namespace
+{
+	const Uint32 Unreached = 0xFFFFFFFF;
+	// Runs of open tiles this long or more get a node at each end instead of one in the middle.
+	const int LongEntrance = 6;
+
+	// Heap items are cost << 32 | index, so a plain Uint64 compare orders them.
+	inline Uint64 heapItem(Uint32 cost, Uint32 index)
+	{
+		return ((Uint64)cost << 32) | index;
+	}
+}
+
+ClusterPathFinder::ClusterPathFinder(const WalkGrid &grid, int clusterSize) :
+	m_grid(grid),
+	m_clusterSize(clusterSize),
+	m_clustersX(0),
+	m_clustersY(0),
+	m_localX(0),
+	m_localY(0),
+	m_localW(0),
+	m_localH(0),
+	m_search(0),
+	m_cost(0),
+	m_refiner(grid)
+{ }
+
+void ClusterPathFinder::build()
+{
+	m_clustersX = (m_grid.width() + m_clusterSize - 1) / m_clusterSize;
+	m_clustersY = (m_grid.height() + m_clusterSize - 1) / m_clusterSize;
+	m_nodes.clear();
+	m_nodes.resize(2);
+	m_freeNodes.clear();
+	m_clusters.assign((size_t)m_clustersX * m_clustersY, Cluster());
+	m_borders.assign(m_clusters.size() * 2, std::vector<Uint32>());
+	m_borderDirty.assign(m_borders.size(), 0);
+	m_dirtyBorders.clear();
+	m_dirtyClusters.clear();
+	m_localDist.resize((size_t)m_clusterSize * m_clusterSize);
+	for (Uint32 b = 0; b < m_borders.size(); ++b)
+		markBorder(b);
+	for (Uint32 c = 0; c < m_clusters.size(); ++c)
+		markCluster(c);
+	update();
+}
+
+void ClusterPathFinder::markCluster(Uint32 cluster)
+{
+	if (m_clusters[cluster].dirty)
+		return;
+	m_clusters[cluster].dirty = true;
+	m_dirtyClusters.push_back(cluster);
+}
+
+void ClusterPathFinder::markBorder(Uint32 border)
+{
+	if (m_borderDirty[border])
+		return;
+	m_borderDirty[border] = 1;
+	m_dirtyBorders.push_back(border);
+}
+
+void ClusterPathFinder::tileChanged(int x, int y)
+{
+	if (!m_grid.inside(x, y) || m_clusters.empty())
+		return;
+	int cx = x / m_clusterSize;
+	int cy = y / m_clusterSize;
+	Uint32 c = clusterOf(x, y);
+	markCluster(c);
+	// Tiles on a cluster edge are part of the entrances there.
+	if ((x % m_clusterSize == m_clusterSize - 1) && (cx + 1 < m_clustersX))
+		markBorder(c * 2);
+	if ((x % m_clusterSize == 0) && (cx > 0))
+		markBorder((c - 1) * 2);
+	if ((y % m_clusterSize == m_clusterSize - 1) && (cy + 1 < m_clustersY))
+		markBorder(c * 2 + 1);
+	if ((y % m_clusterSize == 0) && (cy > 0))
+		markBorder((c - m_clustersX) * 2 + 1);
+}
+
+void ClusterPathFinder::update()
+{
+	// Borders first: they mark the clusters on both sides.
+	for (Uint32 b : m_dirtyBorders)
+	{
+		m_borderDirty[b] = 0;
+		buildBorder(b);
+	}
+	m_dirtyBorders.clear();
+	for (Uint32 c : m_dirtyClusters)
+	{
+		m_clusters[c].dirty = false;
+		buildCluster(c);
+	}
+	m_dirtyClusters.clear();
+}
+
+Uint32 ClusterPathFinder::newNode(int x, int y)
+{
+	Uint32 id;
+	if (!m_freeNodes.empty())
+	{
+		id = m_freeNodes.back();
+		m_freeNodes.pop_back();
+	}
+	else
+	{
+		id = (Uint32)m_nodes.size();
+		m_nodes.push_back(Node());
+	}
+	Node &n = m_nodes[id];
+	n.pos.x = x;
+	n.pos.y = y;
+	n.cluster = clusterOf(x, y);
+	n.partner = id;
+	n.edges.clear();
+	m_clusters[n.cluster].nodes.push_back(id);
+	return id;
+}
+
+void ClusterPathFinder::addEntrance(Uint32 border, int x, int y, int dx, int dy)
+{
+	Uint32 a = newNode(x, y);
+	Uint32 b = newNode(x + dx, y + dy);
+	m_nodes[a].partner = b;
+	m_nodes[b].partner = a;
+	m_borders[border].push_back(a);
+	m_borders[border].push_back(b);
+}
+
+void ClusterPathFinder::buildBorder(Uint32 border)
+{
+	std::vector<Uint32> &nodes = m_borders[border];
+	Uint32 c = border / 2;
+	bool east = (border % 2) == 0;
+	int cx = (int)(c % (Uint32)m_clustersX);
+	int cy = (int)(c / (Uint32)m_clustersX);
+	// Last column has no east border, last row no south one.
+	if ((east && (cx + 1 >= m_clustersX)) || (!east && (cy + 1 >= m_clustersY)))
+		return;
+	Uint32 other = east ? c + 1 : c + m_clustersX;
+	// Old nodes go, from both clusters.
+	for (Uint32 id : nodes)
+	{
+		std::vector<Uint32> &list = m_clusters[m_nodes[id].cluster].nodes;
+		list.erase(std::find(list.begin(), list.end(), id));
+		m_freeNodes.push_back(id);
+	}
+	nodes.clear();
+	markCluster(c);
+	markCluster(other);
+	m_stats.bordersBuilt++;
+
+	// Edge tiles on this cluster side, walked along the border.
+	int x0 = east ? (cx + 1) * m_clusterSize - 1 : cx * m_clusterSize;
+	int y0 = east ? cy * m_clusterSize : (cy + 1) * m_clusterSize - 1;
+	int dx = east ? 0 : 1;
+	int dy = east ? 1 : 0;
+	int ox = east ? 1 : 0;
+	int oy = east ? 0 : 1;
+	int length = east ? Math::min(m_clusterSize, m_grid.height() - y0) : Math::min(m_clusterSize, m_grid.width() - x0);
+	int run = 0;
+	for (int i = 0; i <= length; ++i)
+	{
+		int x = x0 + dx * i;
+		int y = y0 + dy * i;
+		if ((i < length) && m_grid.walkable(x, y) && m_grid.walkable(x + ox, y + oy))
+		{
+			run++;
+			continue;
+		}
+		if (run == 0)
+			continue;
+		int first = i - run;
+		if (run < LongEntrance)
+		{
+			int mid = first + run / 2;
+			addEntrance(border, x0 + dx * mid, y0 + dy * mid, ox, oy);
+		}
+		else
+		{
+			addEntrance(border, x0 + dx * first, y0 + dy * first, ox, oy);
+			addEntrance(border, x0 + dx * (i - 1), y0 + dy * (i - 1), ox, oy);
+		}
+		run = 0;
+	}
+}
+
+void ClusterPathFinder::localSearch(int sx, int sy)
+{
+	int cx = sx / m_clusterSize;
+	int cy = sy / m_clusterSize;
+	m_localX = cx * m_clusterSize;
+	m_localY = cy * m_clusterSize;
+	m_localW = Math::min(m_clusterSize, m_grid.width() - m_localX);
+	m_localH = Math::min(m_clusterSize, m_grid.height() - m_localY);
+	std::fill(m_localDist.begin(), m_localDist.begin() + m_localW * m_localH, Unreached);
+	m_localHeap.clear();
+	Uint32 s = (Uint32)((sy - m_localY) * m_localW + sx - m_localX);
+	m_localDist[s] = 0;
+	m_localHeap.push_back(heapItem(0, s));
+	while (!m_localHeap.empty())
+	{
+		std::pop_heap(m_localHeap.begin(), m_localHeap.end(), std::greater<Uint64>());
+		Uint64 item = m_localHeap.back();
+		m_localHeap.pop_back();
+		Uint32 cost = (Uint32)(item >> 32);
+		Uint32 cell = (Uint32)item;
+		if (cost != m_localDist[cell])
+			continue;
+		int lx = (int)(cell % (Uint32)m_localW);
+		int ly = (int)(cell / (Uint32)m_localW);
+		int x = m_localX + lx;
+		int y = m_localY + ly;
+		for (int dy = -1; dy <= 1; ++dy)
+		{
+			for (int dx = -1; dx <= 1; ++dx)
+			{
+				int nx = lx + dx;
+				int ny = ly + dy;
+				if (((dx == 0) && (dy == 0)) || (nx < 0) || (ny < 0) || (nx >= m_localW) || (ny >= m_localH))
+					continue;
+				if (!m_grid.walkable(x + dx, y + dy))
+					continue;
+				// Same moves as PathFinder: no corner cutting.
+				if ((dx != 0) && (dy != 0) && (!m_grid.walkable(x + dx, y) || !m_grid.walkable(x, y + dy)))
+					continue;
+				Uint32 next = cost + (((dx != 0) && (dy != 0)) ? PathFinder::DiagonalCost : PathFinder::StraightCost);
+				Uint32 n = (Uint32)(ny * m_localW + nx);
+				if (next < m_localDist[n])
+				{
+					m_localDist[n] = next;
+					m_localHeap.push_back(heapItem(next, n));
+					std::push_heap(m_localHeap.begin(), m_localHeap.end(), std::greater<Uint64>());
+				}
+			}
+		}
+	}
+}
+
+void ClusterPathFinder::buildCluster(Uint32 cluster)
+{
+	m_stats.clustersBuilt++;
+	const std::vector<Uint32> &nodes = m_clusters[cluster].nodes;
+	for (Uint32 id : nodes)
+		m_nodes[id].edges.clear();
+	// Paths are the same both ways: one search per node, for nodes after it.
+	for (size_t i = 0; i + 1 < nodes.size(); ++i)
+	{
+		Node &a = m_nodes[nodes[i]];
+		localSearch(a.pos.x, a.pos.y);
+		for (size_t j = i + 1; j < nodes.size(); ++j)
+		{
+			Node &b = m_nodes[nodes[j]];
+			Uint32 d = localDist(b.pos);
+			if (d == Unreached)
+				continue;
+			Edge ab = { nodes[j], d };
+			Edge ba = { nodes[i], d };
+			a.edges.push_back(ab);
+			b.edges.push_back(ba);
+		}
+	}
+}
+
+PathFinder::Status ClusterPathFinder::find(const GridPoint &from, const GridPoint &to)
+{
+	m_stats.queries++;
+	m_path.clear();
+	m_cost = 0;
+	if (m_clusters.empty())
+		build();
+	update();
+	if (!m_grid.walkable(from.x, from.y) || !m_grid.walkable(to.x, to.y))
+		return PathFinder::PathUnreachable;
+
+	Node &start = m_nodes[StartNode];
+	Node &goal = m_nodes[GoalNode];
+	start.pos = from;
+	goal.pos = to;
+	start.edges.clear();
+	goal.edges.clear();
+	// Same cluster, and a way inside it: no need for the graph.
+	Uint32 startCluster = clusterOf(from.x, from.y);
+	localSearch(from.x, from.y);
+	if ((clusterOf(to.x, to.y) == startCluster) && (localDist(to) != Unreached))
+	{
+		m_cost = localDist(to);
+		m_path.push_back(from);
+		if ((from.x != to.x) || (from.y != to.y))
+			m_path.push_back(to);
+		return PathFinder::PathFound;
+	}
+	for (Uint32 id : m_clusters[startCluster].nodes)
+	{
+		Uint32 d = localDist(m_nodes[id].pos);
+		if (d != Unreached)
+		{
+			Edge e = { id, d };
+			start.edges.push_back(e);
+		}
+	}
+	// Goal edges go on its cluster nodes for this query only.
+	localSearch(to.x, to.y);
+	m_goalLinks.clear();
+	for (Uint32 id : m_clusters[clusterOf(to.x, to.y)].nodes)
+	{
+		Uint32 d = localDist(m_nodes[id].pos);
+		if (d != Unreached)
+		{
+			Edge e = { GoalNode, d };
+			m_nodes[id].edges.push_back(e);
+			m_goalLinks.push_back(id);
+		}
+	}
+	bool found = search();
+	for (Uint32 id : m_goalLinks)
+		m_nodes[id].edges.pop_back();
+	return found ? PathFinder::PathFound : PathFinder::PathUnreachable;
+}
+
+bool ClusterPathFinder::search()
+{
+	if (m_visits.size() < m_nodes.size())
+	{
+		Visit blank = { 0, 0, 0, false };
+		m_visits.resize(m_nodes.size(), blank);
+	}
+	if (++m_search == 0)
+	{
+		for (Visit &v : m_visits)
+			v.stamp = 0;
+		m_search = 1;
+	}
+	const GridPoint &goal = m_nodes[GoalNode].pos;
+	m_heap.clear();
+	Visit &s = m_visits[StartNode];
+	s.stamp = m_search;
+	s.g = 0;
+	s.parent = StartNode;
+	s.closed = false;
+	m_heap.push_back(heapItem(0, StartNode));
+	while (!m_heap.empty())
+	{
+		std::pop_heap(m_heap.begin(), m_heap.end(), std::greater<Uint64>());
+		Uint32 id = (Uint32)m_heap.back();
+		m_heap.pop_back();
+		Visit &v = m_visits[id];
+		// Stale entry of a node reached cheaper since.
+		if (v.closed)
+			continue;
+		v.closed = true;
+		m_stats.expanded++;
+		if (id == GoalNode)
+		{
+			m_cost = v.g;
+			for (Uint32 i = GoalNode; ; i = m_visits[i].parent)
+			{
+				m_path.push_back(m_nodes[i].pos);
+				if (i == StartNode)
+					break;
+			}
+			std::reverse(m_path.begin(), m_path.end());
+			// Start or goal on an entrance node is there twice.
+			m_path.erase(std::unique(m_path.begin(), m_path.end(), [](const GridPoint &a, const GridPoint &b)
+			{
+				return (a.x == b.x) && (a.y == b.y);
+			}), m_path.end());
+			return true;
+		}
+		const Node &n = m_nodes[id];
+		Uint32 partnerCost = (n.partner != id) ? (Uint32)PathFinder::StraightCost : Unreached;
+		for (size_t e = 0; e <= n.edges.size(); ++e)
+		{
+			Uint32 to = (e < n.edges.size()) ? n.edges[e].to : n.partner;
+			Uint32 cost = (e < n.edges.size()) ? n.edges[e].cost : partnerCost;
+			if (cost == Unreached)
+				continue;
+			Visit &t = m_visits[to];
+			if (t.stamp != m_search)
+			{
+				t.stamp = m_search;
+				t.g = Unreached;
+				t.closed = false;
+			}
+			Uint32 g = v.g + cost;
+			if (t.closed || (g >= t.g))
+				continue;
+			t.g = g;
+			t.parent = id;
+			const GridPoint &p = m_nodes[to].pos;
+			m_heap.push_back(heapItem(g + PathFinder::distance(goal.x - p.x, goal.y - p.y), to));
+			std::push_heap(m_heap.begin(), m_heap.end(), std::greater<Uint64>());
+		}
+	}
+	return false;
+}
+
+bool ClusterPathFinder::refine(size_t segment, std::vector<GridPoint> &points)
+{
+	points.clear();
+	if (segment + 1 >= m_path.size())
+		return false;
+	if (m_refiner.find(m_path[segment], m_path[segment + 1]) != PathFinder::PathFound)
+		return false;
+	points = m_refiner.path();
+	return true;
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <vector>
+
+#include "SDL_stdinc.h"
+
+#include "common/walk_grid.h"
+#include "common/pathfinder.h"
+
+namespace Ris
+{
+	// Hierarchical pathfinding (HPA*) for routes too long for PathFinder alone.
+	// The map is split in square clusters. Where two clusters touch, each run of tiles open on both
+	// sides is an entrance, with a node on either side: one in the middle of short runs, one at each
+	// end of long ones. Nodes of a cluster are linked by the cost of the best path inside it.
+	// A query links start and goal to the nodes of their clusters and runs A* on that graph only.
+	// Waypoints it gives are refined into tiles one segment at a time, as the walker gets there.
+	// After tiles change, only clusters and borders around them are built again, on next query.
+	class ClusterPathFinder
+	{
+	public:
+		struct Stats
+		{
+			Uint32 queries;
+			Uint32 expanded;
+			Uint32 clustersBuilt;
+			Uint32 bordersBuilt;
+			Stats() : queries(0), expanded(0), clustersBuilt(0), bordersBuilt(0)
+			{ }
+		};
+
+	private:
+		struct Edge
+		{
+			Uint32 to;
+			Uint32 cost;
+		};
+		struct Node
+		{
+			GridPoint pos;
+			Uint32 cluster;
+			// Node on the other side of the entrance, one step away.
+			Uint32 partner;
+			// Nodes of same cluster it reaches.
+			std::vector<Edge> edges;
+		};
+		struct Cluster
+		{
+			std::vector<Uint32> nodes;
+			bool dirty;
+		};
+		// Search state of a node. Belongs to current query only if stamp is m_search.
+		struct Visit
+		{
+			Uint32 stamp;
+			Uint32 g;
+			Uint32 parent;
+			bool closed;
+		};
+		// Start and goal of a query have fixed node slots, never on any cluster.
+		enum
+		{
+			StartNode = 0,
+			GoalNode = 1
+		};
+
+		const WalkGrid &m_grid;
+		int m_clusterSize;
+		int m_clustersX;
+		int m_clustersY;
+		std::vector<Node> m_nodes;
+		std::vector<Uint32> m_freeNodes;
+		std::vector<Cluster> m_clusters;
+		std::vector<Uint32> m_dirtyClusters;
+		// Nodes of each border, two per cluster: east one, then south one.
+		std::vector<std::vector<Uint32>> m_borders;
+		std::vector<Uint8> m_borderDirty;
+		std::vector<Uint32> m_dirtyBorders;
+
+		// Dijkstra inside one cluster.
+		std::vector<Uint32> m_localDist;
+		std::vector<Uint64> m_localHeap;
+		int m_localX;
+		int m_localY;
+		int m_localW;
+		int m_localH;
+
+		std::vector<Visit> m_visits;
+		std::vector<Uint64> m_heap;
+		Uint32 m_search;
+		// Nodes given an edge to goal node on this query.
+		std::vector<Uint32> m_goalLinks;
+		std::vector<GridPoint> m_path;
+		Uint32 m_cost;
+		PathFinder m_refiner;
+		Stats m_stats;
+
+		inline Uint32 clusterOf(int x, int y) const { return (Uint32)((y / m_clusterSize) * m_clustersX + x / m_clusterSize); }
+		Uint32 newNode(int x, int y);
+		void markCluster(Uint32 cluster);
+		void markBorder(Uint32 border);
+		void buildBorder(Uint32 border);
+		void addEntrance(Uint32 border, int x, int y, int dx, int dy);
+		void buildCluster(Uint32 cluster);
+		// Costs from x, y to every tile of its cluster it reaches, on m_localDist.
+		void localSearch(int x, int y);
+		inline Uint32 localDist(const GridPoint &p) const { return m_localDist[(p.y - m_localY) * m_localW + p.x - m_localX]; }
+		bool search();
+
+	public:
+		ClusterPathFinder(const WalkGrid &grid, int clusterSize = 16);
+
+		// Builds the whole graph. Needed after grid is resized or loaded.
+		void build();
+		// Tile x, y of grid changed. Graph around it is built again on next update() or find().
+		void tileChanged(int x, int y);
+		void update();
+
+		// Waypoints from start to goal.
+		PathFinder::Status find(const GridPoint &from, const GridPoint &to);
+		// Start, entrances on the way, goal. Valid until next find().
+		inline const std::vector<GridPoint> &path() const { return m_path; }
+		inline Uint32 cost() const { return m_cost; }
+		// Jump points from waypoint segment to the next one, as PathFinder::path() gives them.
+		bool refine(size_t segment, std::vector<GridPoint> &points);
+
+		inline size_t nodeCount() const { return m_nodes.size() - m_freeNodes.size() - 2; }
+		inline int clusterSize() const { return m_clusterSize; }
+		inline const Stats &stats() const { return m_stats; }
+	};
+}
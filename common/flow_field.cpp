@@ -0,0 +1,464 @@
+#include "flow_field.h"
+
+#include "common/jobs.h"
+#include "common/pathfinder.h"
+
+using namespace Ris;
+
+const Uint32 FlowField::Unreached;
+const int FlowField::dirX[NoDirection + 1] = { 0, 0, 1, -1, 1, -1, 1, -1, 0 };
+const int FlowField::dirY[NoDirection + 1] = { -1, 1, 0, 0, -1, -1, 1, 1, 0 };
+
+namespace
+{
+	const int BlockTiles = FlowField::BlockSize * FlowField::BlockSize;
+
+	inline Uint32 moveCost(int d)
+	{
+		return (d < 4) ? PathFinder::StraightCost : PathFinder::DiagonalCost;
+	}
+
+	// Indexed binary heap of block tiles by cost. Lives on the stack of the job relaxing the block.
+	struct BlockHeap
+	{
+		Uint16 items[BlockTiles];
+		Uint16 pos[BlockTiles];
+		int count;
+		const Uint32 *cost;
+		const Uint32 *index;
+
+		inline Uint32 key(Uint16 item) const { return cost[index[item]]; }
+		void up(int i)
+		{
+			Uint16 item = items[i];
+			while (i > 0)
+			{
+				int parent = (i - 1) >> 1;
+				if (key(items[parent]) <= key(item))
+					break;
+				items[i] = items[parent];
+				pos[items[i]] = (Uint16)i;
+				i = parent;
+			}
+			items[i] = item;
+			pos[item] = (Uint16)i;
+		}
+		void down(int i)
+		{
+			Uint16 item = items[i];
+			for (;;)
+			{
+				int child = i * 2 + 1;
+				if (child >= count)
+					break;
+				if ((child + 1 < count) && (key(items[child + 1]) < key(items[child])))
+					child++;
+				if (key(item) <= key(items[child]))
+					break;
+				items[i] = items[child];
+				pos[items[i]] = (Uint16)i;
+				i = child;
+			}
+			items[i] = item;
+			pos[item] = (Uint16)i;
+		}
+	};
+	const Uint16 NotInHeap = 0xFFFF;
+}
+
+FlowField::FlowField(const WalkGrid &grid, const GridPoint &goal) :
+	m_grid(grid),
+	m_goal(goal),
+	m_blocksX(0),
+	m_blocksY(0)
+{ }
+
+void FlowField::build()
+{
+	m_stats.builds++;
+	m_blocksX = (m_grid.width() + BlockSize - 1) / BlockSize;
+	m_blocksY = (m_grid.height() + BlockSize - 1) / BlockSize;
+	size_t tiles = (size_t)m_grid.width() * m_grid.height();
+	size_t blocks = (size_t)m_blocksX * m_blocksY;
+	m_cost.assign(tiles, Unreached);
+	m_dir.assign(tiles, (Uint8)NoDirection);
+	m_active.assign(blocks, 0);
+	m_changed.assign(blocks, 0);
+	m_dirDirty.assign(blocks, 0);
+	m_edits.clear();
+	if (m_grid.walkable(m_goal.x, m_goal.y))
+		m_active[blockOf(m_goal.x, m_goal.y)] = 1;
+	relax();
+	// Unreached blocks have nothing to point to, but every block is written once.
+	m_dirDirty.assign(blocks, 1);
+	rebuildDirections();
+}
+
+void FlowField::tileChanged(int x, int y)
+{
+	if (m_grid.inside(x, y))
+	{
+		GridPoint p = { x, y };
+		m_edits.push_back(p);
+	}
+}
+
+bool FlowField::update()
+{
+	if (m_edits.empty())
+		return false;
+	m_stats.updates++;
+	// Grid changed size: nothing can be kept.
+	if (m_cost.size() != (size_t)m_grid.width() * m_grid.height())
+	{
+		build();
+		return true;
+	}
+	// Resets go first, while directions still tell which tile comes from which.
+	for (const GridPoint &p : m_edits)
+	{
+		if (!m_grid.walkable(p.x, p.y))
+			resetThrough(p.x, p.y);
+	}
+	for (const GridPoint &p : m_edits)
+	{
+		if (m_grid.walkable(p.x, p.y))
+			activateAround(blockOf(p.x, p.y));
+	}
+	m_edits.clear();
+	relax();
+	rebuildDirections();
+	return true;
+}
+
+void FlowField::activateAround(Uint32 block)
+{
+	int bx = (int)(block % (Uint32)m_blocksX);
+	int by = (int)(block / (Uint32)m_blocksX);
+	for (int y = by - 1; y <= by + 1; ++y)
+	{
+		for (int x = bx - 1; x <= bx + 1; ++x)
+		{
+			if ((x >= 0) && (y >= 0) && (x < m_blocksX) && (y < m_blocksY))
+				m_active[y * m_blocksX + x] = 1;
+		}
+	}
+}
+
+void FlowField::reset(int x, int y)
+{
+	Uint32 i = (Uint32)(y * m_grid.width() + x);
+	m_cost[i] = Unreached;
+	m_dir[i] = NoDirection;
+	Uint32 b = blockOf(x, y);
+	m_dirDirty[b] = 1;
+	// Neighbour blocks bring costs back in.
+	activateAround(b);
+	m_resetQueue.push_back(i);
+}
+
+void FlowField::resetThrough(int x, int y)
+{
+	int w = m_grid.width();
+	m_resetQueue.clear();
+	reset(x, y);
+	// Diagonal moves past this tile as a corner cannot be done any more either.
+	for (int d = 4; d < NoDirection; ++d)
+	{
+		int ax = x - dirX[d];
+		int ay = y;
+		int bx = x;
+		int by = y - dirY[d];
+		if (m_grid.inside(ax, ay) && (m_dir[ay * w + ax] == d) && (m_cost[ay * w + ax] != Unreached))
+			reset(ax, ay);
+		if (m_grid.inside(bx, by) && (m_dir[by * w + bx] == d) && (m_cost[by * w + bx] != Unreached))
+			reset(bx, by);
+	}
+	// Then every tile whose direction leads to a reset one, all the way up the tree.
+	for (size_t q = 0; q < m_resetQueue.size(); ++q)
+	{
+		int px = (int)(m_resetQueue[q] % (Uint32)w);
+		int py = (int)(m_resetQueue[q] / (Uint32)w);
+		for (int d = 0; d < NoDirection; ++d)
+		{
+			// Neighbour on d steps back to p along the opposite direction.
+			int nx = px - dirX[d];
+			int ny = py - dirY[d];
+			if (m_grid.inside(nx, ny) && (m_dir[ny * w + nx] == d))
+				reset(nx, ny);
+		}
+	}
+}
+
+void FlowField::relax()
+{
+	size_t blocks = m_active.size();
+	bool any = true;
+	while (any)
+	{
+		m_stats.rounds++;
+		any = false;
+		for (int color = 0; color < 4; ++color)
+		{
+			m_work.clear();
+			for (int by = color >> 1; by < m_blocksY; by += 2)
+			{
+				for (int bx = color & 1; bx < m_blocksX; bx += 2)
+				{
+					Uint32 b = (Uint32)(by * m_blocksX + bx);
+					if (m_active[b])
+					{
+						m_active[b] = 0;
+						m_work.push_back(b);
+					}
+				}
+			}
+			m_stats.blocksRelaxed += (Uint32)m_work.size();
+			JobSystem::instance().parallelForWait((Uint32)m_work.size(), 1, relaxRange, this);
+		}
+		// A block that changed may lower costs of any block around it on next round.
+		for (Uint32 b = 0; b < blocks; ++b)
+		{
+			if (m_changed[b])
+			{
+				m_changed[b] = 0;
+				activateAround(b);
+				any = true;
+			}
+		}
+	}
+}
+
+void FlowField::relaxRange(void *context, Uint32 begin, Uint32 end)
+{
+	FlowField *field = static_cast<FlowField*>(context);
+	for (Uint32 i = begin; i < end; ++i)
+		field->relaxBlock(field->m_work[i]);
+}
+
+void FlowField::relaxBlock(Uint32 block)
+{
+	int w = m_grid.width();
+	int x0 = (int)(block % (Uint32)m_blocksX) * BlockSize;
+	int y0 = (int)(block / (Uint32)m_blocksX) * BlockSize;
+	int bw = (x0 + BlockSize <= w) ? BlockSize : w - x0;
+	int bh = (y0 + BlockSize <= m_grid.height()) ? BlockSize : m_grid.height() - y0;
+	Uint32 *cost = m_cost.data();
+	Uint32 index[BlockTiles];
+	BlockHeap heap;
+	heap.count = 0;
+	heap.cost = cost;
+	heap.index = index;
+	bool changed = false;
+	bool borderChanged = false;
+
+	// Only this job writes tiles of the block, and no block it reads from runs on this colour.
+	// One pass over the block against every neighbour, the ones around it included. Tiles it
+	// lowers are the only ones with something to pass on: costs coming in from blocks around,
+	// goal, and tiles next to ones reset by a blocked tile.
+	for (int ly = 0; ly < bh; ++ly)
+	{
+		for (int lx = 0; lx < bw; ++lx)
+		{
+			int x = x0 + lx;
+			int y = y0 + ly;
+			Uint16 local = (Uint16)(ly * BlockSize + lx);
+			index[local] = (Uint32)(y * w + x);
+			heap.pos[local] = NotInHeap;
+			if (!m_grid.walkable(x, y))
+				continue;
+			Uint32 &c = cost[index[local]];
+			Uint32 best = ((x == m_goal.x) && (y == m_goal.y)) ? 0 : c;
+			for (int d = 0; d < NoDirection; ++d)
+			{
+				if (!canMove(x, y, dirX[d], dirY[d]))
+					continue;
+				Uint32 n = cost[(y + dirY[d]) * w + x + dirX[d]];
+				if ((n != Unreached) && (n + moveCost(d) < best))
+					best = n + moveCost(d);
+			}
+			if (best < c)
+			{
+				c = best;
+				changed = true;
+				if ((lx == 0) || (ly == 0) || (lx == bw - 1) || (ly == bh - 1))
+					borderChanged = true;
+				heap.items[heap.count] = local;
+				heap.pos[local] = (Uint16)heap.count;
+				heap.count++;
+			}
+		}
+	}
+	for (int i = heap.count / 2 - 1; i >= 0; --i)
+		heap.down(i);
+
+	// Dijkstra inside the block.
+	while (heap.count > 0)
+	{
+		Uint16 u = heap.items[0];
+		heap.pos[u] = NotInHeap;
+		heap.count--;
+		if (heap.count > 0)
+		{
+			heap.items[0] = heap.items[heap.count];
+			heap.down(0);
+		}
+		int lx = u % BlockSize;
+		int ly = u / BlockSize;
+		int x = x0 + lx;
+		int y = y0 + ly;
+		Uint32 cu = cost[index[u]];
+		for (int d = 0; d < NoDirection; ++d)
+		{
+			int nlx = lx + dirX[d];
+			int nly = ly + dirY[d];
+			if ((nlx < 0) || (nly < 0) || (nlx >= bw) || (nly >= bh) || !canMove(x, y, dirX[d], dirY[d]))
+				continue;
+			Uint16 v = (Uint16)(nly * BlockSize + nlx);
+			Uint32 nc = cu + moveCost(d);
+			Uint32 &cv = cost[index[v]];
+			if (nc >= cv)
+				continue;
+			cv = nc;
+			changed = true;
+			if ((nlx == 0) || (nly == 0) || (nlx == bw - 1) || (nly == bh - 1))
+				borderChanged = true;
+			if (heap.pos[v] == NotInHeap)
+			{
+				heap.items[heap.count] = v;
+				heap.count++;
+				heap.up(heap.count - 1);
+			}
+			else
+				heap.up(heap.pos[v]);
+		}
+	}
+	// Blocks around only read tiles on the edge of this one.
+	if (borderChanged)
+		m_changed[block] = 1;
+	if (changed)
+		m_dirDirty[block] = 1;
+}
+
+void FlowField::rebuildDirections()
+{
+	// Directions look at costs next door: blocks around a changed one are redone too.
+	size_t blocks = m_dirDirty.size();
+	for (Uint32 b = 0; b < blocks; ++b)
+	{
+		if (m_dirDirty[b] == 1)
+		{
+			int bx = (int)(b % (Uint32)m_blocksX);
+			int by = (int)(b / (Uint32)m_blocksX);
+			for (int y = by - 1; y <= by + 1; ++y)
+			{
+				for (int x = bx - 1; x <= bx + 1; ++x)
+				{
+					if ((x >= 0) && (y >= 0) && (x < m_blocksX) && (y < m_blocksY) && !m_dirDirty[y * m_blocksX + x])
+						m_dirDirty[y * m_blocksX + x] = 2;
+				}
+			}
+		}
+	}
+	m_work.clear();
+	for (Uint32 b = 0; b < blocks; ++b)
+	{
+		if (m_dirDirty[b])
+		{
+			m_dirDirty[b] = 0;
+			m_work.push_back(b);
+		}
+	}
+	JobSystem::instance().parallelForWait((Uint32)m_work.size(), 1, directRange, this);
+}
+
+void FlowField::directRange(void *context, Uint32 begin, Uint32 end)
+{
+	FlowField *field = static_cast<FlowField*>(context);
+	for (Uint32 i = begin; i < end; ++i)
+		field->directBlock(field->m_work[i]);
+}
+
+void FlowField::directBlock(Uint32 block)
+{
+	int w = m_grid.width();
+	int x0 = (int)(block % (Uint32)m_blocksX) * BlockSize;
+	int y0 = (int)(block / (Uint32)m_blocksX) * BlockSize;
+	int x1 = (x0 + BlockSize <= w) ? x0 + BlockSize : w;
+	int y1 = (y0 + BlockSize <= m_grid.height()) ? y0 + BlockSize : m_grid.height();
+	for (int y = y0; y < y1; ++y)
+	{
+		for (int x = x0; x < x1; ++x)
+		{
+			Uint32 i = (Uint32)(y * w + x);
+			Uint32 c = m_cost[i];
+			Uint8 best = NoDirection;
+			// Neighbour the best path goes through: its cost plus the move is this one.
+			if ((c != Unreached) && (c != 0))
+			{
+				Uint32 bestCost = c;
+				for (int d = 0; d < NoDirection; ++d)
+				{
+					if (!canMove(x, y, dirX[d], dirY[d]))
+						continue;
+					Uint32 n = m_cost[(y + dirY[d]) * w + x + dirX[d]];
+					if ((n != Unreached) && (n + moveCost(d) <= bestCost))
+					{
+						bestCost = n + moveCost(d);
+						best = (Uint8)d;
+					}
+				}
+			}
+			m_dir[i] = best;
+		}
+	}
+}
+
+FlowFieldCache::FlowFieldCache(const WalkGrid &grid, size_t capacity) :
+	m_grid(grid),
+	m_capacity(capacity),
+	m_clock(0)
+{ }
+
+const FlowField &FlowFieldCache::field(const GridPoint &goal)
+{
+	m_clock++;
+	for (size_t i = 0; i < m_fields.size(); ++i)
+	{
+		FlowField &field = *m_fields[i];
+		if ((field.goal().x == goal.x) && (field.goal().y == goal.y))
+		{
+			m_lastUsed[i] = m_clock;
+			field.update();
+			return field;
+		}
+	}
+	if ((m_fields.size() >= m_capacity) && !m_fields.empty())
+	{
+		size_t oldest = 0;
+		for (size_t i = 1; i < m_fields.size(); ++i)
+		{
+			if (m_lastUsed[i] < m_lastUsed[oldest])
+				oldest = i;
+		}
+		m_fields.erase(m_fields.begin() + oldest);
+		m_lastUsed.erase(m_lastUsed.begin() + oldest);
+	}
+	FlowFieldPtr field(new FlowField(m_grid, goal));
+	field->build();
+	m_fields.push_back(std::move(field));
+	m_lastUsed.push_back(m_clock);
+	return *m_fields.back();
+}
+
+void FlowFieldCache::tileChanged(int x, int y)
+{
+	for (FlowFieldPtr &field : m_fields)
+		field->tileChanged(x, y);
+}
+
+void FlowFieldCache::clear()
+{
+	m_fields.clear();
+	m_lastUsed.clear();
+}
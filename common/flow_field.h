@@ -0,0 +1,124 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "SDL_stdinc.h"
+
+#include "common/walk_grid.h"
+
+namespace Ris
+{
+	// Way to one goal from every tile of a WalkGrid, for crowds heading to the same place.
+	// Integration field: cost of best path to goal, with PathFinder moves and costs.
+	// Direction field: for each tile, the neighbour that path goes through. Agents read it in O(1).
+	// The map is split in blocks. Each block solves its tiles with Dijkstra from the costs around
+	// it, and blocks are relaxed in rounds until nothing changes. Blocks of one of four colours
+	// never touch, so all active blocks of a colour run at once on the JobSystem.
+	// Tile changes are applied on next update(): a newly open tile only relaxes costs around it,
+	// a newly blocked one first resets every tile whose path went through it.
+	class FlowField
+	{
+	public:
+		enum
+		{
+			BlockSize = 32,
+			// Direction of goal, unreachable and blocked tiles.
+			NoDirection = 8
+		};
+		static const Uint32 Unreached = 0xFFFFFFFF;
+		// Steps by direction: N, S, E, W, NE, NW, SE, SW.
+		static const int dirX[NoDirection + 1];
+		static const int dirY[NoDirection + 1];
+
+		struct Stats
+		{
+			Uint32 builds;
+			Uint32 updates;
+			Uint32 rounds;
+			Uint32 blocksRelaxed;
+			Stats() : builds(0), updates(0), rounds(0), blocksRelaxed(0)
+			{ }
+		};
+
+	private:
+		const WalkGrid &m_grid;
+		GridPoint m_goal;
+		int m_blocksX;
+		int m_blocksY;
+		std::vector<Uint32> m_cost;
+		std::vector<Uint8> m_dir;
+		// Per block: to relax on next round, changed on this one, directions to rebuild.
+		std::vector<Uint8> m_active;
+		std::vector<Uint8> m_changed;
+		std::vector<Uint8> m_dirDirty;
+		// Blocks run by current job.
+		std::vector<Uint32> m_work;
+		std::vector<GridPoint> m_edits;
+		std::vector<Uint32> m_resetQueue;
+		Stats m_stats;
+
+		inline Uint32 blockOf(int x, int y) const { return (Uint32)((y / BlockSize) * m_blocksX + x / BlockSize); }
+		// Both ends walkable and no corner cut.
+		inline bool canMove(int x, int y, int dx, int dy) const
+		{
+			return m_grid.walkable(x + dx, y + dy) && ((dx == 0) || (dy == 0) ||
+				(m_grid.walkable(x + dx, y) && m_grid.walkable(x, y + dy)));
+		}
+		void activateAround(Uint32 block);
+		void reset(int x, int y);
+		void resetThrough(int x, int y);
+		void relax();
+		void relaxBlock(Uint32 block);
+		void directBlock(Uint32 block);
+		void rebuildDirections();
+		static void relaxRange(void *context, Uint32 begin, Uint32 end);
+		static void directRange(void *context, Uint32 begin, Uint32 end);
+
+	public:
+		FlowField(const WalkGrid &grid, const GridPoint &goal);
+
+		// Whole field from scratch.
+		void build();
+		// Tile x, y of grid changed. Applied on next update().
+		void tileChanged(int x, int y);
+		// Applies tile changes. Returns false if there were none.
+		bool update();
+		inline bool pending() const { return !m_edits.empty(); }
+
+		inline const GridPoint &goal() const { return m_goal; }
+		inline Uint32 cost(int x, int y) const { return m_grid.inside(x, y) ? m_cost[y * m_grid.width() + x] : Unreached; }
+		inline Uint8 direction(int x, int y) const { return m_grid.inside(x, y) ? m_dir[y * m_grid.width() + x] : (Uint8)NoDirection; }
+		// Next tile from x, y. Returns false at goal and where goal cannot be reached.
+		inline bool next(int x, int y, int &dx, int &dy) const
+		{
+			Uint8 d = direction(x, y);
+			dx = dirX[d];
+			dy = dirY[d];
+			return d != NoDirection;
+		}
+		inline const Stats &stats() const { return m_stats; }
+	};
+	typedef std::unique_ptr<FlowField> FlowFieldPtr;
+
+	// Flow fields by goal, shared by every agent heading there. Least recently used goes first.
+	class FlowFieldCache
+	{
+		const WalkGrid &m_grid;
+		size_t m_capacity;
+		std::vector<FlowFieldPtr> m_fields;
+		// Clock of last use, by field.
+		std::vector<Uint32> m_lastUsed;
+		Uint32 m_clock;
+
+	public:
+		FlowFieldCache(const WalkGrid &grid, size_t capacity = 8);
+
+		// Field to goal, built or brought up to date if needed. Valid until a field is evicted.
+		const FlowField &field(const GridPoint &goal);
+		// Tile x, y of grid changed. Cached fields are fixed when next asked for.
+		void tileChanged(int x, int y);
+		void clear();
+		inline size_t size() const { return m_fields.size(); }
+	};
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "utils/point.h"
+#include "common/string.h"
+#include "common/state_machine.h"
+
+namespace Ris
+{
+	class GameObj
+	{
+		Point2D m_position;
+		String m_name;
+
+	public:
+		Point2D &position() { return m_position; }
+		const Point2D &position() const { return m_position; }
+		String &name() { return m_name; }
+		const String &name() const { return m_name; }
+	};
+
+	class AliveObj : public GameObj
+	{
+		int m_health;
+		int m_mana;
+
+		// Valid States;
+		struct MovementStates
+		{
+			StateStand stateStanding;
+			StateWalking stateWalking;
+		}movementStates;
+
+		State *moveState;
+		inline void newMovementState(State *state, const SDL_KeyboardEvent &key)
+		{
+			moveState->onExit();
+			moveState = state;
+			moveState->onEnter(key);
+		}
+	public:
+		AliveObj() : m_health(100), m_mana(100), moveState(&movementStates.stateStanding)
+		{ }
+		// moveState points inside the object, so it must be moved to the copy states.
+		AliveObj(const AliveObj &o) : GameObj(o), m_health(o.m_health), m_mana(o.m_mana), movementStates(o.movementStates)
+		{
+			moveState = (o.moveState == &o.movementStates.stateWalking) ? (State*)&movementStates.stateWalking : &movementStates.stateStanding;
+		}
+		AliveObj &operator=(const AliveObj &o)
+		{
+			GameObj::operator=(o);
+			m_health = o.m_health;
+			m_mana = o.m_mana;
+			movementStates = o.movementStates;
+			moveState = (o.moveState == &o.movementStates.stateWalking) ? (State*)&movementStates.stateWalking : &movementStates.stateStanding;
+			return *this;
+		}
+		inline int health() const { return m_health; }
+		inline void setHealth(int health) { m_health = health; }
+		inline int mana() const { return m_mana; }
+		inline void setMana(int mana) { m_mana = mana; }
+		inline State::StateID movementState() const { return moveState->stateID(); }
+		inline StateWalking::Direction walkDirection() const
+		{
+			return (moveState == &movementStates.stateWalking) ? movementStates.stateWalking.direction : StateWalking::NoDir;
+		}
+		void checkKeyboard(const SDL_KeyboardEvent &key)
+		{
+			switch (moveState->checkKeyboard(key))
+			{
+			case State::NoState:
+				break;
+			case State::Walking:
+				newMovementState(&movementStates.stateWalking, key);
+				break;
+			case State::Standing:
+				newMovementState(&movementStates.stateStanding, key);
+				break;
+			}
+		}
+	};
+}
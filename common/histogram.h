@@ -0,0 +1,108 @@
+#pragma once
+
+#include <string.h>
+
+#include "SDL_stdinc.h"
+
+#include "common/string.h"
+
+namespace Ris
+{
+	// Distribution of timings in microseconds, for percentiles.
+	// Buckets are a quarter of an octave wide: 19% error at most, on a fixed 500 bytes.
+	// Not thread safe: keep one per thread and merge() them.
+	class Histogram
+	{
+	public:
+		enum
+		{
+			Buckets = 124
+		};
+
+	private:
+		Uint32 m_counts[Buckets];
+		Uint32 m_count;
+		Uint64 m_sum;
+		Uint32 m_max;
+
+	public:
+		Histogram()
+		{
+			reset();
+		}
+		inline void reset()
+		{
+			memset(m_counts, 0, sizeof(m_counts));
+			m_count = 0;
+			m_sum = 0;
+			m_max = 0;
+		}
+
+		static inline int bucket(Uint32 us)
+		{
+			if (us < 4)
+				return (int)us;
+			int msb = 31;
+			while (!(us & (1u << msb)))
+				--msb;
+			return (msb - 1) * 4 + (int)((us >> (msb - 2)) & 3);
+		}
+		// Biggest value that falls on a bucket.
+		static inline Uint32 bucketTop(int b)
+		{
+			if (b < 4)
+				return (Uint32)b;
+			int msb = b / 4 + 1;
+			Uint32 low = (Uint32)(4 + b % 4) << (msb - 2);
+			return low + ((1u << (msb - 2)) - 1);
+		}
+
+		inline void record(Uint32 us)
+		{
+			m_counts[bucket(us)]++;
+			m_count++;
+			m_sum += us;
+			if (us > m_max)
+				m_max = us;
+		}
+		void merge(const Histogram &h)
+		{
+			for (int i = 0; i < Buckets; ++i)
+				m_counts[i] += h.m_counts[i];
+			m_count += h.m_count;
+			m_sum += h.m_sum;
+			if (h.m_max > m_max)
+				m_max = h.m_max;
+		}
+
+		inline Uint32 count() const { return m_count; }
+		inline Uint32 max() const { return m_max; }
+		inline Uint32 average() const { return m_count ? (Uint32)(m_sum / m_count) : 0; }
+		// Value below which p (in [0, 1]) of the samples are.
+		Uint32 percentile(float p) const
+		{
+			if (m_count == 0)
+				return 0;
+			Uint32 target = (Uint32)(p * m_count);
+			if (target >= m_count)
+				target = m_count - 1;
+			Uint32 seen = 0;
+			for (int i = 0; i < Buckets; ++i)
+			{
+				seen += m_counts[i];
+				if (seen > target)
+					return (bucketTop(i) < m_max) ? bucketTop(i) : m_max;
+			}
+			return m_max;
+		}
+		// "name: avg/p50/p90/p99/max ms (count)"
+		String report(const String &name) const
+		{
+			char buf[160];
+			SDL_snprintf(buf, sizeof(buf), "%s: %.2f/%.2f/%.2f/%.2f/%.2f ms (%u)", name.c_str(),
+				average() / 1000.0f, percentile(0.5f) / 1000.0f, percentile(0.9f) / 1000.0f,
+				percentile(0.99f) / 1000.0f, m_max / 1000.0f, m_count);
+			return buf;
+		}
+	};
+}
@@ -0,0 +1,313 @@
+#include "input_record.h"
+
+#include <iterator>
+#include <string.h>
+
+#include "common/logging.h"
+
+using namespace Ris;
+
+namespace
+{
+	const char Magic[4] = { 'R', 'I', 'S', 'R' };
+	// 2: positions and speed are Fixed.
+	// 3: Fixed is 24.8 instead of 16.16.
+	const Uint8 Version = 3;
+	// Written to disk once this much is buffered.
+	const size_t FlushSize = 4096;
+
+	enum RecordType
+	{
+		RecordInputs = 1,
+		RecordHash,
+		RecordEnd
+	};
+
+	// Reads the same encoding InputRecorder writes. Any read past the end fails for good.
+	class RecordReader
+	{
+		const Uint8 *m_data;
+		size_t m_size;
+		size_t m_pos;
+		bool m_ok;
+
+	public:
+		RecordReader(const Uint8 *data, size_t size) : m_data(data), m_size(size), m_pos(0), m_ok(true)
+		{ }
+		inline bool ok() const { return m_ok; }
+		inline bool atEnd() const { return m_pos >= m_size; }
+		Uint8 read8()
+		{
+			if (m_pos + 1 > m_size)
+			{
+				m_ok = false;
+				return 0;
+			}
+			return m_data[m_pos++];
+		}
+		Uint32 read32()
+		{
+			Uint32 v = read8();
+			v |= (Uint32)read8() << 8;
+			v |= (Uint32)read8() << 16;
+			v |= (Uint32)read8() << 24;
+			return v;
+		}
+		inline Fixed readFixed() { return Fixed::fromRaw((Sint32)read32()); }
+		Uint32 readVarint()
+		{
+			Uint32 v = 0;
+			for (int shift = 0; shift < 35; shift += 7)
+			{
+				Uint8 b = read8();
+				v |= (Uint32)(b & 0x7F) << shift;
+				if (!(b & 0x80))
+					return v;
+			}
+			m_ok = false;
+			return 0;
+		}
+	};
+}
+
+InputRecorder::InputRecorder() :
+	m_lastTick(0),
+	m_bytes(0)
+{ }
+
+InputRecorder::~InputRecorder()
+{
+	if (isOpen())
+		close(m_lastTick);
+}
+
+void InputRecorder::writeVarint(Uint32 v)
+{
+	while (v >= 0x80)
+	{
+		m_buffer.push_back((Uint8)(v | 0x80));
+		v >>= 7;
+	}
+	m_buffer.push_back((Uint8)v);
+}
+
+void InputRecorder::write32(Uint32 v)
+{
+	m_buffer.push_back((Uint8)v);
+	m_buffer.push_back((Uint8)(v >> 8));
+	m_buffer.push_back((Uint8)(v >> 16));
+	m_buffer.push_back((Uint8)(v >> 24));
+}
+
+void InputRecorder::writeRecord(Uint8 type, Uint32 tick)
+{
+	m_buffer.push_back(type);
+	writeVarint(tick - m_lastTick);
+	m_lastTick = tick;
+}
+
+void InputRecorder::flush()
+{
+	if (m_buffer.empty())
+		return;
+	m_file.write(reinterpret_cast<const char*>(m_buffer.data()), m_buffer.size());
+	m_bytes += (Uint32)m_buffer.size();
+	m_buffer.clear();
+}
+
+bool InputRecorder::open(const String &path, const ReplayHeader &header)
+{
+	m_file.open(path.c_str(), std::ios::binary | std::ios::trunc);
+	if (!m_file.is_open())
+	{
+		g_log.logErr("Unable to open input recording " + path);
+		return false;
+	}
+	m_lastTick = 0;
+	m_bytes = 0;
+	m_buffer.clear();
+	m_buffer.insert(m_buffer.end(), Magic, Magic + sizeof(Magic));
+	m_buffer.push_back(Version);
+	m_buffer.push_back((Uint8)header.tickInterval);
+	m_buffer.push_back((Uint8)(header.tickInterval >> 8));
+	write32((Uint32)header.speed.raw());
+	write32(header.seed);
+	writeVarint((Uint32)header.entities.size());
+	for (const ReplayEntity &e : header.entities)
+	{
+		write32((Uint32)e.x.raw());
+		write32((Uint32)e.y.raw());
+		m_buffer.push_back(e.ai ? 1 : 0);
+	}
+	flush();
+	return true;
+}
+
+void InputRecorder::inputs(Uint32 tick, const MoveInput *inputs, size_t count)
+{
+	if ((count == 0) || !isOpen())
+		return;
+	writeRecord(RecordInputs, tick);
+	writeVarint((Uint32)count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		writeVarint(inputs[i].entity);
+		m_buffer.push_back(inputs[i].event);
+	}
+	if (m_buffer.size() >= FlushSize)
+		flush();
+}
+
+void InputRecorder::hash(Uint32 tick, Uint32 hash)
+{
+	if (!isOpen())
+		return;
+	writeRecord(RecordHash, tick);
+	write32(hash);
+	if (m_buffer.size() >= FlushSize)
+		flush();
+}
+
+void InputRecorder::close(Uint32 tick)
+{
+	if (!isOpen())
+		return;
+	writeRecord(RecordEnd, tick);
+	flush();
+	m_file.close();
+}
+
+InputReplay::InputReplay() :
+	m_endTick(0),
+	m_nextInput(0),
+	m_nextHash(0)
+{
+	m_header.tickInterval = 0;
+	m_header.seed = 0;
+}
+
+bool InputReplay::load(const String &path)
+{
+	std::ifstream file(path.c_str(), std::ios::binary);
+	if (!file.is_open())
+	{
+		g_log.logErr("Unable to open input recording " + path);
+		return false;
+	}
+	std::vector<Uint8> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	RecordReader r(data.data(), data.size());
+	if ((data.size() < sizeof(Magic) + 1) || (memcmp(data.data(), Magic, sizeof(Magic)) != 0))
+	{
+		g_log.logErr(path + " is not an input recording.");
+		return false;
+	}
+	for (size_t i = 0; i < sizeof(Magic); ++i)
+		r.read8();
+	Uint8 version = r.read8();
+	if (version != Version)
+	{
+		g_log.logErr(path + " is an input recording of version " + String((Uint32)version) + ", expected " +
+			String((Uint32)Version) + ".");
+		return false;
+	}
+	m_header.tickInterval = r.read8();
+	m_header.tickInterval |= (Uint16)(r.read8() << 8);
+	m_header.speed = r.readFixed();
+	m_header.seed = r.read32();
+	Uint32 count = r.readVarint();
+	// Each entity takes 9 bytes: a huge count is a broken file, not an allocation to try.
+	if (count > data.size() / 9)
+	{
+		g_log.logErr(path + " is broken: " + String(count) + " entities.");
+		return false;
+	}
+	m_header.entities.resize(count);
+	for (ReplayEntity &e : m_header.entities)
+	{
+		e.x = r.readFixed();
+		e.y = r.readFixed();
+		e.ai = (r.read8() != 0);
+	}
+
+	m_inputs.clear();
+	m_hashes.clear();
+	Uint32 tick = 0;
+	bool ended = false;
+	while (r.ok() && !ended && !r.atEnd())
+	{
+		Uint8 type = r.read8();
+		tick += r.readVarint();
+		switch (type)
+		{
+		case RecordInputs:
+			{
+				Uint32 n = r.readVarint();
+				for (Uint32 i = 0; (i < n) && r.ok(); ++i)
+				{
+					TickInput in;
+					in.tick = tick;
+					in.input.entity = r.readVarint();
+					in.input.event = r.read8();
+					if ((in.input.entity >= count) || (in.input.event >= MoveEventCount))
+					{
+						g_log.logErr(path + " is broken: bad input on tick " + String(tick) + ".");
+						return false;
+					}
+					m_inputs.push_back(in);
+				}
+			}
+			break;
+		case RecordHash:
+			{
+				TickHash h;
+				h.tick = tick;
+				h.hash = r.read32();
+				m_hashes.push_back(h);
+			}
+			break;
+		case RecordEnd:
+			ended = true;
+			break;
+		default:
+			g_log.logErr(path + " is broken: unknown record " + String((Uint32)type) + ".");
+			return false;
+		}
+	}
+	if (!r.ok())
+	{
+		g_log.logErr(path + " is broken: it ends halfway through a record.");
+		return false;
+	}
+	// Recording cut short by a crash still replays up to its last record.
+	if (!ended)
+		g_log.logWar(path + " has no end record. Replaying up to tick " + String(tick) + ".");
+	m_endTick = tick;
+	rewind();
+	return true;
+}
+
+void InputReplay::rewind()
+{
+	m_nextInput = 0;
+	m_nextHash = 0;
+}
+
+void InputReplay::inputs(Uint32 tick, std::vector<MoveInput> &out)
+{
+	while ((m_nextInput < m_inputs.size()) && (m_inputs[m_nextInput].tick <= tick))
+	{
+		if (m_inputs[m_nextInput].tick == tick)
+			out.push_back(m_inputs[m_nextInput].input);
+		m_nextInput++;
+	}
+}
+
+bool InputReplay::hash(Uint32 tick, Uint32 &out)
+{
+	while ((m_nextHash < m_hashes.size()) && (m_hashes[m_nextHash].tick < tick))
+		m_nextHash++;
+	if ((m_nextHash >= m_hashes.size()) || (m_hashes[m_nextHash].tick != tick))
+		return false;
+	out = m_hashes[m_nextHash].hash;
+	return true;
+}
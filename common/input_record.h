@@ -0,0 +1,103 @@
+#pragma once
+
+#include <fstream>
+#include <vector>
+
+#include "SDL_stdinc.h"
+
+#include "utils/fixed.h"
+#include "common/string.h"
+#include "common/movement_fsm.h"
+
+namespace Ris
+{
+	// Input recording file: a header with the world to start from, then records of inputs,
+	// state hashes and end, each tagged with its tick as a delta from previous record.
+	// Numbers are LEB128 varints, Fixed values and hashes 4 bytes little endian.
+	struct ReplayEntity
+	{
+		Fixed x;
+		Fixed y;
+		bool ai;
+	};
+	struct ReplayHeader
+	{
+		Uint16 tickInterval;
+		Fixed speed;
+		Uint32 seed;
+		std::vector<ReplayEntity> entities;
+	};
+
+	// Writes a recording as ticks go. Written to disk every few KB, so a crash loses little.
+	class InputRecorder
+	{
+		std::ofstream m_file;
+		std::vector<Uint8> m_buffer;
+		Uint32 m_lastTick;
+		Uint32 m_bytes;
+
+		void writeVarint(Uint32 v);
+		void write32(Uint32 v);
+		void writeRecord(Uint8 type, Uint32 tick);
+		void flush();
+
+	public:
+		InputRecorder();
+		~InputRecorder();
+
+		bool open(const String &path, const ReplayHeader &header);
+		// Inputs applied on tick. Nothing is written if there is none.
+		void inputs(Uint32 tick, const MoveInput *inputs, size_t count);
+		// State hash at the end of tick.
+		void hash(Uint32 tick, Uint32 hash);
+		// Writes end record on last tick and closes file.
+		void close(Uint32 tick);
+		inline bool isOpen() const { return m_file.is_open(); }
+		inline Uint32 bytes() const { return m_bytes; }
+	};
+
+	// A whole recording, checked and decoded on load.
+	class InputReplay
+	{
+		struct TickInput
+		{
+			Uint32 tick;
+			MoveInput input;
+		};
+		struct TickHash
+		{
+			Uint32 tick;
+			Uint32 hash;
+		};
+		ReplayHeader m_header;
+		std::vector<TickInput> m_inputs;
+		std::vector<TickHash> m_hashes;
+		Uint32 m_endTick;
+		size_t m_nextInput;
+		size_t m_nextHash;
+
+	public:
+		InputReplay();
+
+		bool load(const String &path);
+		// Back to tick 0.
+		void rewind();
+		// Appends inputs of tick to out. Ticks must be asked in order.
+		void inputs(Uint32 tick, std::vector<MoveInput> &out);
+		// Hash recorded for tick. Returns false if there is none. Ticks must be asked in order.
+		bool hash(Uint32 tick, Uint32 &out);
+
+		inline const ReplayHeader &header() const { return m_header; }
+		inline Uint32 endTick() const { return m_endTick; }
+		inline size_t inputCount() const { return m_inputs.size(); }
+	};
+
+	// FNV-1a, for state hashes.
+	inline Uint32 hashBytes(const void *data, size_t size, Uint32 hash = 2166136261u)
+	{
+		const Uint8 *bytes = static_cast<const Uint8*>(data);
+		for (size_t i = 0; i < size; ++i)
+			hash = (hash ^ bytes[i]) * 16777619u;
+		return hash;
+	}
+}
@@ -0,0 +1,384 @@
+#include "jobs.h"
+
+#include "SDL_cpuinfo.h"
+#include "SDL_timer.h"
+
+#include "common/logging.h"
+
+using namespace Ris;
+
+bool JobDeque::push(Job *job)
+{
+	int b = SDL_AtomicGet(&m_bottom);
+	int t = SDL_AtomicGet(&m_top);
+	if (b - t >= Capacity)
+		return false;
+	m_jobs[b & Mask] = job;
+	// SDL atomics are full barriers: job is visible before bottom moves.
+	SDL_AtomicSet(&m_bottom, b + 1);
+	return true;
+}
+
+Job *JobDeque::pop()
+{
+	int b = SDL_AtomicGet(&m_bottom) - 1;
+	SDL_AtomicSet(&m_bottom, b);
+	int t = SDL_AtomicGet(&m_top);
+	if (t > b)
+	{
+		// Was empty.
+		SDL_AtomicSet(&m_bottom, t);
+		return nullptr;
+	}
+	Job *job = m_jobs[b & Mask];
+	if (t != b)
+		return job;
+	// Last job. Stealers may be after it too.
+	if (!SDL_AtomicCAS(&m_top, t, t + 1))
+		job = nullptr;
+	SDL_AtomicSet(&m_bottom, t + 1);
+	return job;
+}
+
+Job *JobDeque::steal()
+{
+	int t = SDL_AtomicGet(&m_top);
+	int b = SDL_AtomicGet(&m_bottom);
+	if (t >= b)
+		return nullptr;
+	Job *job = m_jobs[t & Mask];
+	if (!SDL_AtomicCAS(&m_top, t, t + 1))
+		return nullptr;
+	return job;
+}
+
+JobSystem::JobSystem() :
+	m_workers(0),
+	m_tls(SDL_TLSCreate()),
+	m_wake(SDL_CreateSemaphore(0)),
+	m_attachLock(SDL_CreateMutex())
+{
+	SDL_AtomicSet(&m_threadCount, 0);
+	SDL_AtomicSet(&m_quit, 0);
+	SDL_AtomicSet(&m_sleeping, 0);
+}
+
+JobSystem::~JobSystem()
+{
+	stop();
+	for (int i = 0; i < SDL_AtomicGet(&m_threadCount); ++i)
+	{
+		delete[] m_threads[i]->pool;
+		delete m_threads[i];
+	}
+	SDL_DestroySemaphore(m_wake);
+	SDL_DestroyMutex(m_attachLock);
+}
+
+JobSystem &JobSystem::instance()
+{
+	static JobSystem jobs;
+	return jobs;
+}
+
+JobSystem::ThreadData *JobSystem::threadData() const
+{
+	return static_cast<ThreadData*>(SDL_TLSGet(m_tls));
+}
+
+JobSystem::ThreadData *JobSystem::newThreadData()
+{
+	SDL_LockMutex(m_attachLock);
+	int count = SDL_AtomicGet(&m_threadCount);
+	ThreadData *td = nullptr;
+	if (count < MaxThreads)
+	{
+		td = new ThreadData();
+		td->system = this;
+		td->index = count;
+		td->thread = nullptr;
+		td->worker = false;
+		td->pool = new Job[PoolSize];
+		// Finished jobs are free slots.
+		for (int i = 0; i < PoolSize; ++i)
+			SDL_AtomicSet(&td->pool[i].unfinished, 0);
+		td->allocated = 0;
+		td->seed = 0x9E3779B9 * (count + 1);
+		m_threads[count] = td;
+		// Stealers only look up to m_threadCount, so it grows after the slot is filled.
+		SDL_AtomicSet(&m_threadCount, count + 1);
+	}
+	else
+		g_log.logErr("Too many threads on job system.");
+	SDL_UnlockMutex(m_attachLock);
+	return td;
+}
+
+JobSystem::ThreadData *JobSystem::stoppedWorker() const
+{
+	for (int i = 0; i < SDL_AtomicGet(const_cast<SDL_atomic_t*>(&m_threadCount)); ++i)
+	{
+		if (m_threads[i]->worker && (m_threads[i]->thread == nullptr))
+			return m_threads[i];
+	}
+	return nullptr;
+}
+
+bool JobSystem::attachThread()
+{
+	if (threadData() != nullptr)
+		return true;
+	ThreadData *td = newThreadData();
+	if (td == nullptr)
+		return false;
+	SDL_TLSSet(m_tls, td, NULL);
+	return true;
+}
+
+bool JobSystem::start(int workers)
+{
+	if (isRunning())
+		return true;
+	if (workers < 0)
+		workers = SDL_GetCPUCount() - 1;
+	if (workers < 1)
+		workers = 1;
+	if (!attachThread())
+		return false;
+	SDL_AtomicSet(&m_quit, 0);
+	for (int i = 0; i < workers; ++i)
+	{
+		ThreadData *td = stoppedWorker();
+		if (td == nullptr)
+			td = newThreadData();
+		if (td == nullptr)
+			break;
+		td->worker = true;
+		td->thread = SDL_CreateThread(workerMain, "Job worker", td);
+		if (td->thread == nullptr)
+		{
+			g_log.logErr("Cannot create job worker: " + String(SDL_GetError()));
+			break;
+		}
+		m_workers++;
+	}
+	return m_workers > 0;
+}
+
+void JobSystem::stop()
+{
+	if (!isRunning())
+		return;
+	SDL_AtomicSet(&m_quit, 1);
+	for (int i = 0; i < SDL_AtomicGet(&m_threadCount); ++i)
+	{
+		if (m_threads[i]->thread != nullptr)
+		{
+			SDL_SemPost(m_wake);
+			SDL_WaitThread(m_threads[i]->thread, NULL);
+			m_threads[i]->thread = nullptr;
+		}
+	}
+	m_workers = 0;
+}
+
+int JobSystem::workerMain(void *data)
+{
+	ThreadData *td = static_cast<ThreadData*>(data);
+	JobSystem *js = td->system;
+	SDL_TLSSet(js->m_tls, td, NULL);
+	while (!SDL_AtomicGet(&js->m_quit))
+	{
+		Job *job = js->findJob(td);
+		if (job != nullptr)
+			js->execute(job);
+		else
+		{
+			SDL_AtomicIncRef(&js->m_sleeping);
+			SDL_SemWaitTimeout(js->m_wake, 1);
+			SDL_AtomicDecRef(&js->m_sleeping);
+		}
+	}
+	return 0;
+}
+
+Job *JobSystem::findJob(ThreadData *td)
+{
+	Job *job = td->deque.pop();
+	if (job != nullptr)
+		return job;
+	// Own deque is empty. Steal starting from a random victim.
+	int count = SDL_AtomicGet(&m_threadCount);
+	td->seed ^= td->seed << 13;
+	td->seed ^= td->seed >> 17;
+	td->seed ^= td->seed << 5;
+	int start = (int)(td->seed % (Uint32)count);
+	for (int i = 0; i < count; ++i)
+	{
+		int victim = (start + i) % count;
+		if (victim == td->index)
+			continue;
+		job = m_threads[victim]->deque.steal();
+		if (job != nullptr)
+			return job;
+	}
+	return nullptr;
+}
+
+Job *JobSystem::create(JobFunction function, const void *data, size_t size, Job *parent)
+{
+	ThreadData *td = threadData();
+	if ((td == nullptr) && attachThread())
+		td = threadData();
+	if (td == nullptr)
+		return nullptr;
+	if (size > Job::DataSize)
+	{
+		g_log.logErr("Job data too big: " + String((int)size) + " bytes.");
+		return nullptr;
+	}
+	// Pool is a ring: next slot is the oldest one. Still alive, pool is full.
+	Job *job = &td->pool[td->allocated & (PoolSize - 1)];
+	if (SDL_AtomicGet(&job->unfinished) != 0)
+		return nullptr;
+	td->allocated++;
+	job->function = function;
+	job->parent = parent;
+	SDL_AtomicSet(&job->unfinished, 1);
+	SDL_AtomicSet(&job->pending, 1);
+	job->continuationCount = 0;
+	if (size)
+		memcpy(job->data, data, size);
+	if (parent != nullptr)
+		SDL_AtomicIncRef(&parent->unfinished);
+	return job;
+}
+
+bool JobSystem::addDependency(Job *job, Job *dependency)
+{
+	if (dependency->continuationCount >= Job::MaxContinuations)
+	{
+		g_log.logErr("Too many jobs depending on the same job.");
+		return false;
+	}
+	SDL_AtomicIncRef(&job->pending);
+	dependency->continuations[dependency->continuationCount++] = job;
+	return true;
+}
+
+void JobSystem::run(Job *job)
+{
+	if (SDL_AtomicDecRef(&job->pending))
+		submit(job);
+}
+
+void JobSystem::submit(Job *job)
+{
+	ThreadData *td = threadData();
+	// Full deque or unknown thread: just do it here.
+	if ((td == nullptr) || !td->deque.push(job))
+	{
+		execute(job);
+		return;
+	}
+	if (SDL_AtomicGet(&m_sleeping) > 0)
+		SDL_SemPost(m_wake);
+}
+
+void JobSystem::execute(Job *job)
+{
+	job->function(job, job->data);
+	finish(job);
+}
+
+void JobSystem::finish(Job *job)
+{
+	// Once finished, its slot can be taken again at any time: everything needed is read before.
+	Job *parent = job->parent;
+	int continuationCount = job->continuationCount;
+	Job *continuations[Job::MaxContinuations];
+	for (int i = 0; i < continuationCount; ++i)
+		continuations[i] = job->continuations[i];
+	if (!SDL_AtomicDecRef(&job->unfinished))
+		return;
+	if (parent != nullptr)
+		finish(parent);
+	for (int i = 0; i < continuationCount; ++i)
+		run(continuations[i]);
+}
+
+void JobSystem::wait(Job *job)
+{
+	ThreadData *td = threadData();
+	while (!isFinished(job))
+	{
+		Job *other = (td != nullptr) ? findJob(td) : nullptr;
+		if (other != nullptr)
+			execute(other);
+		else
+			SDL_Delay(0);
+	}
+}
+
+struct ParallelForData
+{
+	RangeFunction function;
+	void *context;
+	Uint32 begin;
+	Uint32 end;
+	Uint32 minBatch;
+};
+
+void JobSystem::parallelForJob(Job *job, void *data)
+{
+	ParallelForData *pf = static_cast<ParallelForData*>(data);
+	Uint32 count = pf->end - pf->begin;
+	if (count <= pf->minBatch)
+	{
+		pf->function(pf->context, pf->begin, pf->end);
+		return;
+	}
+	// Split in halves. Idle workers steal the biggest ones, from the top.
+	JobSystem &js = instance();
+	ParallelForData left = *pf;
+	ParallelForData right = *pf;
+	left.end = right.begin = pf->begin + count / 2;
+	ParallelForData *halves[2] = { &left, &right };
+	for (int i = 0; i < 2; ++i)
+	{
+		Job *half = js.create(parallelForJob, *halves[i], job);
+		// Pool is full: that half is done here, unsplit.
+		if (half != nullptr)
+			js.run(half);
+		else
+			halves[i]->function(halves[i]->context, halves[i]->begin, halves[i]->end);
+	}
+}
+
+Job *JobSystem::parallelFor(Uint32 count, Uint32 minBatch, RangeFunction function, void *context, Job *parent)
+{
+	// Splitting makes about 4 * count / minBatch jobs, alive until all of theirs are done.
+	// Batches are made big enough for them to fit an eighth of a pool.
+	Uint32 fewest = count / (PoolSize / 32) + 1;
+	if (minBatch < fewest)
+		minBatch = fewest;
+	ParallelForData pf = { function, context, 0, count, minBatch };
+	return create(parallelForJob, pf, parent);
+}
+
+void JobSystem::parallelForWait(Uint32 count, Uint32 minBatch, RangeFunction function, void *context)
+{
+	if (!isRunning() || (count <= minBatch))
+	{
+		function(context, 0, count);
+		return;
+	}
+	Job *job = parallelFor(count, minBatch, function, context);
+	if (job == nullptr)
+	{
+		function(context, 0, count);
+		return;
+	}
+	run(job);
+	wait(job);
+}
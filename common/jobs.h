@@ -0,0 +1,146 @@
+#pragma once
+
+#include <string.h>
+
+#include "SDL_atomic.h"
+#include "SDL_thread.h"
+#include "SDL_mutex.h"
+
+namespace Ris
+{
+	struct Job;
+	typedef void (*JobFunction)(Job *job, void *data);
+	// Function for parallelFor. Called with [begin, end) ranges.
+	typedef void (*RangeFunction)(void *context, Uint32 begin, Uint32 end);
+
+	// Jobs come from fixed per thread pools. Nothing is allocated once the system is running.
+	struct Job
+	{
+		enum
+		{
+			MaxContinuations = 4,
+			DataSize = 48
+		};
+		JobFunction function;
+		Job *parent;
+		// This job plus its unfinished children.
+		SDL_atomic_t unfinished;
+		// Dependencies not done yet, plus one held until run() is called.
+		SDL_atomic_t pending;
+		// Jobs depending on this one. Graphs are built before running their jobs.
+		int continuationCount;
+		Job *continuations[MaxContinuations];
+		// Job parameters are copied here.
+		Uint8 data[DataSize];
+	};
+
+	// Chase-Lev work stealing deque with fixed capacity.
+	// Owner thread pushes and pops on bottom. Any other thread steals from top.
+	class JobDeque
+	{
+		enum
+		{
+			Capacity = 4096,
+			Mask = Capacity - 1
+		};
+		Job *volatile m_jobs[Capacity];
+		SDL_atomic_t m_top;
+		SDL_atomic_t m_bottom;
+
+	public:
+		JobDeque()
+		{
+			SDL_AtomicSet(&m_top, 0);
+			SDL_AtomicSet(&m_bottom, 0);
+		}
+		// Owner only. Returns false if full.
+		bool push(Job *job);
+		// Owner only.
+		Job *pop();
+		// Any thread.
+		Job *steal();
+	};
+
+	// Work stealing job system.
+	// Every worker and every attached thread owns a deque and a job pool.
+	// Idle threads steal from random victims.
+	class JobSystem
+	{
+	public:
+		enum
+		{
+			MaxThreads = 64,
+			PoolSize = 4096		// Jobs alive at once per thread.
+		};
+
+	private:
+		struct ThreadData
+		{
+			JobSystem *system;
+			int index;
+			SDL_Thread *thread;
+			// Worker slots are kept when stopped, and reused by next start().
+			bool worker;
+			JobDeque deque;
+			Job *pool;
+			Uint32 allocated;
+			Uint32 seed;
+		};
+		// Slots are filled before m_threadCount grows, so stealers can read them without locking.
+		ThreadData *m_threads[MaxThreads];
+		SDL_atomic_t m_threadCount;
+		int m_workers;
+		SDL_TLSID m_tls;
+		SDL_atomic_t m_quit;
+		SDL_atomic_t m_sleeping;
+		SDL_sem *m_wake;
+		SDL_mutex *m_attachLock;
+
+		JobSystem();
+		JobSystem(const JobSystem &);
+
+		static int workerMain(void *data);
+		ThreadData *threadData() const;
+		ThreadData *newThreadData();
+		ThreadData *stoppedWorker() const;
+		Job *findJob(ThreadData *td);
+		void execute(Job *job);
+		void finish(Job *job);
+		void submit(Job *job);
+		static void parallelForJob(Job *job, void *data);
+
+	public:
+		~JobSystem();
+		static JobSystem &instance();
+
+		// Starts workers. Calling thread is attached. workers < 0 means one per core but one.
+		bool start(int workers = -1);
+		void stop();
+		inline bool isRunning() const { return m_workers > 0; }
+		inline int workerCount() const { return m_workers; }
+		// Lets calling thread create, run and wait jobs.
+		bool attachThread();
+
+		// Creates a job. Data is copied into the job (up to Job::DataSize bytes).
+		// parent waits for this job too. Returns nullptr if PoolSize jobs of this thread are alive.
+		Job *create(JobFunction function, const void *data = nullptr, size_t size = 0, Job *parent = nullptr);
+		template <typename T>
+		inline Job *create(JobFunction function, const T &data, Job *parent = nullptr)
+		{
+			return create(function, &data, sizeof(T), parent);
+		}
+		// job won't run until dependency is finished. Must be called before running any of them.
+		bool addDependency(Job *job, Job *dependency);
+		// Queues job. It will run as soon as its dependencies are done.
+		void run(Job *job);
+		// Runs other jobs until job is finished.
+		void wait(Job *job);
+		inline bool isFinished(const Job *job) const { return SDL_AtomicGet(const_cast<SDL_atomic_t*>(&job->unfinished)) == 0; }
+
+		// Job calling function over [0, count) split on ranges of minBatch items at least, or
+		// more so that jobs always fit the pool.
+		Job *parallelFor(Uint32 count, Uint32 minBatch, RangeFunction function, void *context, Job *parent = nullptr);
+		// Creates, runs and waits a parallelFor. Runs in place if system is not started.
+		void parallelForWait(Uint32 count, Uint32 minBatch, RangeFunction function, void *context);
+	};
+}
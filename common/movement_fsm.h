@@ -0,0 +1,195 @@
+#pragma once
+
+#include <vector>
+
+#include "utils/fixed.h"
+#include "common/state_machine.h"
+
+namespace Ris
+{
+	// Movement input events, not tied to any input device.
+	enum MoveEvent
+	{
+		MoveNoEvent = 0,
+		MovePressNorth,
+		MovePressSouth,
+		MovePressEast,
+		MovePressWest,
+		MoveReleaseNorth,
+		MoveReleaseSouth,
+		MoveReleaseEast,
+		MoveReleaseWest,
+		MoveEventCount
+	};
+
+	// Event for one entity.
+	struct MoveInput
+	{
+		Uint32 entity;
+		Uint8 event;
+	};
+
+	namespace MoveTables
+	{
+		enum
+		{
+			StateCount = State::Laying + 1
+		};
+		// Direction flags (StateWalking::Direction) set and cleared by each event.
+		static const Uint8 pressBits[MoveEventCount] = { 0, StateWalking::North, StateWalking::South, StateWalking::East, StateWalking::West, 0, 0, 0, 0 };
+		static const Uint8 releaseBits[MoveEventCount] = { 0, 0, 0, 0, 0, StateWalking::North, StateWalking::South, StateWalking::East, StateWalking::West };
+
+		// Next state by [current state][event][any direction held]. NoState means no change.
+		// VS2013 has no constexpr, but const aggregates are laid out at compile time all the same.
+		static const Uint8 transitions[StateCount][MoveEventCount][2] =
+		{
+			// NoState
+			{ { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 } },
+			// Standing: any press starts walking.
+			{ { 0, 0 }, { 0, State::Walking }, { 0, State::Walking }, { 0, State::Walking }, { 0, State::Walking }, { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 } },
+			// Ducking
+			{ { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 } },
+			// Walking: stands when last direction is released.
+			{ { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 }, { State::Standing, 0 }, { State::Standing, 0 }, { State::Standing, 0 }, { State::Standing, 0 } },
+			// Laying
+			{ { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 } }
+		};
+
+		// Direction flags that move an entity, by state. Ducking and laying entities keep their
+		// directions held, but stay where they are.
+		static const Uint8 moveMask[StateCount] = { 0, 0, 0, 0xF, 0 };
+
+		// Unit move vector by direction flags. Opposite directions cancel out.
+		static const float diagonal = 0.70710678f;
+		static const float moveX[16] = { 0, 0, 0, 0, 1, diagonal, diagonal, 1, -1, -diagonal, -diagonal, -1, 0, 0, 0, 0 };
+		static const float moveY[16] = { 0, -1, 1, 0, 0, -diagonal, diagonal, 0, 0, -diagonal, diagonal, 0, 0, -1, 1, 0 };
+		// Same vectors as raw Fixed values, for deterministic simulation.
+		static const Sint32 fixedOne = Fixed::One;
+		static const Sint32 fixedDiagonal = 181;
+		static const Sint32 fixedMoveX[16] = { 0, 0, 0, 0, fixedOne, fixedDiagonal, fixedDiagonal, fixedOne,
+			-fixedOne, -fixedDiagonal, -fixedDiagonal, -fixedOne, 0, 0, 0, 0 };
+		static const Sint32 fixedMoveY[16] = { 0, -fixedOne, fixedOne, 0, 0, -fixedDiagonal, fixedDiagonal, 0,
+			0, -fixedDiagonal, fixedDiagonal, 0, 0, -fixedOne, fixedOne, 0 };
+	}
+
+	// Movement state machine for many entities at once.
+	// Every entity is just a state byte and a direction flags byte on contiguous arrays.
+	// Transitions are looked up on MoveTables, so there is no virtual dispatch at all.
+	class MovementFSM
+	{
+		std::vector<Uint8> m_state;
+		std::vector<Uint8> m_dirs;
+		// Entities whose state changed on last updateAll().
+		std::vector<Uint32> m_changed;
+
+	public:
+		inline Uint32 add(State::StateID state = State::Standing)
+		{
+			m_state.push_back((Uint8)state);
+			m_dirs.push_back(StateWalking::NoDir);
+			return (Uint32)(m_state.size() - 1);
+		}
+		inline void resize(size_t count)
+		{
+			m_state.resize(count, State::Standing);
+			m_dirs.resize(count, StateWalking::NoDir);
+		}
+		inline size_t count() const { return m_state.size(); }
+		inline State::StateID state(Uint32 entity) const { return (State::StateID)m_state[entity]; }
+		inline StateWalking::Direction direction(Uint32 entity) const { return (StateWalking::Direction)m_dirs[entity]; }
+		inline const std::vector<Uint32> &changed() const { return m_changed; }
+		inline const Uint8 *states() const { return m_state.data(); }
+		inline const Uint8 *directions() const { return m_dirs.data(); }
+		// Directions the entity actually moves to in its state.
+		inline Uint8 moveDirection(Uint32 entity) const { return m_dirs[entity] & MoveTables::moveMask[m_state[entity]]; }
+
+		// Applies one event. Returns true if state changed.
+		inline bool apply(Uint32 entity, Uint8 event)
+		{
+			Uint8 &st = m_state[entity];
+			Uint8 &dirs = m_dirs[entity];
+			dirs = (dirs | MoveTables::pressBits[event]) & ~MoveTables::releaseBits[event];
+			Uint8 next = MoveTables::transitions[st][event][dirs != 0];
+			if (next == State::NoState)
+				return false;
+			st = next;
+			return true;
+		}
+		// Sets held directions at once, as given by a network input command.
+		// Standing and walking entities change state accordingly, any other state is kept.
+		inline bool setDirection(Uint32 entity, Uint8 dirs)
+		{
+			Uint8 &st = m_state[entity];
+			m_dirs[entity] = dirs & 0xF;
+			if ((st != State::Standing) && (st != State::Walking))
+				return false;
+			Uint8 next = m_dirs[entity] ? State::Walking : State::Standing;
+			if (next == st)
+				return false;
+			st = next;
+			return true;
+		}
+		inline void set(Uint32 entity, State::StateID state, Uint8 dirs)
+		{
+			m_state[entity] = (Uint8)state;
+			m_dirs[entity] = dirs & 0xF;
+		}
+		// Applies a whole tick of events.
+		void updateAll(const MoveInput *inputs, size_t count)
+		{
+			m_changed.clear();
+			for (size_t i = 0; i < count; ++i)
+			{
+				if (apply(inputs[i].entity, inputs[i].event))
+					m_changed.push_back(inputs[i].entity);
+			}
+		}
+		inline void updateAll(const std::vector<MoveInput> &inputs) { updateAll(inputs.data(), inputs.size()); }
+
+		// Moves entities step units along their direction, if their state moves at all.
+		// x and y are arrays with one position per entity.
+		inline void integrate(float *x, float *y, float step) const { integrate(x, y, step, 0, (Uint32)m_state.size()); }
+		// Same, for entities in [begin, end) only. Ranges can be done in parallel.
+		void integrate(float *x, float *y, float step, Uint32 begin, Uint32 end) const
+		{
+			for (Uint32 i = begin; i < end; ++i)
+			{
+				// Entities in states that do not move get a null vector.
+				Uint8 d = moveDirection(i);
+				x[i] += MoveTables::moveX[d] * step;
+				y[i] += MoveTables::moveY[d] * step;
+			}
+		}
+		// Fixed point versions: same bits on every machine.
+		inline void integrate(Fixed *x, Fixed *y, Fixed step) const { integrate(x, y, step, 0, (Uint32)m_state.size()); }
+		void integrate(Fixed *x, Fixed *y, Fixed step, Uint32 begin, Uint32 end) const
+		{
+			for (Uint32 i = begin; i < end; ++i)
+			{
+				Uint8 d = moveDirection(i);
+				x[i] += Fixed::fromRaw(MoveTables::fixedMoveX[d]) * step;
+				y[i] += Fixed::fromRaw(MoveTables::fixedMoveY[d]) * step;
+			}
+		}
+
+		// Translates an SDL keyboard event. Returns MoveNoEvent for non movement keys.
+		static MoveEvent fromKeyboard(const SDL_KeyboardEvent &key)
+		{
+			if (key.repeat)
+				return MoveNoEvent;
+			int release = (key.state == SDL_RELEASED) ? (MoveReleaseNorth - MovePressNorth) : 0;
+			switch (key.keysym.sym)
+			{
+			case SDLK_UP:
+				return (MoveEvent)(MovePressNorth + release);
+			case SDLK_DOWN:
+				return (MoveEvent)(MovePressSouth + release);
+			case SDLK_RIGHT:
+				return (MoveEvent)(MovePressEast + release);
+			case SDLK_LEFT:
+				return (MoveEvent)(MovePressWest + release);
+			}
+			return MoveNoEvent;
+		}
+	};
+}
@@ -0,0 +1,424 @@
+#include "net_channel.h"
+
+#include <math.h>
+
+#include "common/logging.h"
+
+using namespace Ris;
+using namespace Ris::Net;
+
+Connection::Connection(const ChannelType *types, int count) :
+	m_channels(count),
+	m_sequence(0),
+	m_ack(0),
+	m_ackBits(0),
+	m_hasReceived(false),
+	m_ackPending(false),
+	m_hasRtt(false),
+	m_srtt(0.0f),
+	m_rttvar(0.0f),
+	m_rto(1000),
+	m_backoff(1)
+{
+	for (int i = 0; i < count; ++i)
+	{
+		Channel &c = m_channels[i];
+		c.type = types[i];
+		c.nextId = 0;
+		c.base = 0;
+		for (int s = 0; s < ReliableWindow; ++s)
+		{
+			c.window[s].received = false;
+			c.window[s].delivered = false;
+		}
+	}
+	for (int i = 0; i < ReliableWindow; ++i)
+		m_sent[i].valid = false;
+}
+
+bool Connection::queue(Channel &c, Uint8 index, Uint8 count, const Uint8 *data, int size)
+{
+	c.out.push_back(OutMessage());
+	OutMessage &m = c.out.back();
+	m.id = c.nextId++;
+	m.index = index;
+	m.count = count;
+	m.acked = false;
+	m.lastSent = 0;
+	m.timesSent = 0;
+	m.data.assign(data, data + size);
+	return true;
+}
+
+bool Connection::send(int channel, const Uint8 *data, int size)
+{
+	if ((channel < 0) || (channel >= (int)m_channels.size()))
+		return false;
+	Channel &c = m_channels[channel];
+	if (c.type == ChannelUnreliable)
+	{
+		// Not split: a lost fragment would lose whole message anyway.
+		if (size > MaxPacketSize - ConnectionHeaderSize - 3)
+		{
+			g_log.logErr("Unreliable message too big: " + String(size) + " bytes.");
+			return false;
+		}
+		m_stats.messagesSent++;
+		return queue(c, 0, 0, data, size);
+	}
+	int fragments = (size + FragmentSize - 1) / FragmentSize;
+	if (fragments > MaxFragments)
+	{
+		g_log.logErr("Reliable message too big: " + String(size) + " bytes.");
+		return false;
+	}
+	m_stats.messagesSent++;
+	if (fragments <= 1)
+		return queue(c, 0, 0, data, size);
+	for (int i = 0; i < fragments; ++i)
+	{
+		int bytes = (i == fragments - 1) ? size - i * FragmentSize : FragmentSize;
+		queue(c, (Uint8)i, (Uint8)fragments, data + i * FragmentSize, bytes);
+		m_stats.fragments++;
+	}
+	return true;
+}
+
+bool Connection::receive(int channel, std::vector<Uint8> &message)
+{
+	if ((channel < 0) || (channel >= (int)m_channels.size()))
+		return false;
+	Channel &c = m_channels[channel];
+	if (c.delivered.empty())
+		return false;
+	message.swap(c.delivered.front());
+	c.delivered.pop_front();
+	return true;
+}
+
+int Connection::writePacket(Uint8 *data, int size, Uint32 now)
+{
+	ByteWriter w(data, size);
+	Uint16 sequence = m_sequence;
+	writeHeader(w, MsgConnection, sequence);
+	w.write16(m_ack);
+	w.write32(m_ackBits);
+
+	SentPacket &sp = m_sent[sequence % ReliableWindow];
+	// Its slot is reused, so it will never be acked now.
+	if (sp.valid && !sp.acked)
+		m_stats.packetsLost++;
+	sp.sequence = sequence;
+	sp.valid = true;
+	sp.acked = false;
+	sp.time = now;
+	sp.messages = 0;
+
+	bool any = false;
+	bool timedOut = false;
+	Uint32 timeout = m_rto * m_backoff;
+	if (timeout > MaxRto)
+		timeout = MaxRto;
+	for (size_t ch = 0; ch < m_channels.size(); ++ch)
+	{
+		Channel &c = m_channels[ch];
+		if (c.type == ChannelUnreliable)
+		{
+			// Coalesced while they fit. Old movement is useless next tick, so the rest is dropped.
+			for (const OutMessage &m : c.out)
+			{
+				if (!w.fits(3 + (int)m.data.size()))
+				{
+					m_stats.dropped++;
+					continue;
+				}
+				w.write8((Uint8)ch);
+				w.write16((Uint16)m.data.size());
+				w.writeBytes(m.data.data(), (int)m.data.size());
+				any = true;
+			}
+			c.out.clear();
+			continue;
+		}
+		// Everything before oldest message not acked was received, and all of it was delivered
+		// but the fragments of its own message. So receiver window starts there at least.
+		Uint16 windowStart = c.out.empty() ? 0 : (Uint16)(c.out.front().id - c.out.front().index);
+		for (OutMessage &m : c.out)
+		{
+			if (sp.messages == MaxPacketMessages)
+				break;
+			// Receiver cannot take messages beyond its window.
+			if ((Uint16)(m.id - windowStart) >= ReliableWindow)
+				break;
+			if (m.acked || (m.timesSent && (now - m.lastSent < timeout)))
+				continue;
+			int header = m.count ? 7 : 5;
+			if (!w.fits(header + (int)m.data.size()))
+				continue;
+			w.write8((Uint8)ch | (m.count ? 0x80 : 0));
+			w.write16(m.id);
+			if (m.count)
+			{
+				w.write8(m.index);
+				w.write8(m.count);
+			}
+			w.write16((Uint16)m.data.size());
+			w.writeBytes(m.data.data(), (int)m.data.size());
+			if (m.timesSent)
+			{
+				m_stats.resent++;
+				timedOut = true;
+			}
+			m.timesSent++;
+			m.lastSent = now;
+			MessageRef ref = { (Uint8)ch, m.id };
+			sp.refs[sp.messages++] = ref;
+			any = true;
+		}
+	}
+	// Exponential backoff until a new RTT sample comes, as RFC 6298 says.
+	if (timedOut && (m_backoff < 64))
+		m_backoff *= 2;
+	if (!any && !m_ackPending)
+	{
+		sp.valid = false;
+		return 0;
+	}
+	m_sequence++;
+	m_ackPending = false;
+	m_stats.packetsSent++;
+	return w.size();
+}
+
+bool Connection::flush(UDPsocket socket, const IPaddress &address, Uint32 now)
+{
+	Uint8 data[MaxPacketSize];
+	int size = writePacket(data, sizeof(data), now);
+	if (size == 0)
+		return true;
+	UDPpacket p;
+	p.channel = -1;
+	p.data = data;
+	p.len = size;
+	p.maxlen = size;
+	p.address = address;
+	if (SDLNet_UDP_Send(socket, -1, &p) == 0)
+	{
+		g_log.logErr("Cannot send packet: " + String(SDLNet_GetError()));
+		return false;
+	}
+	return true;
+}
+
+bool Connection::readPacket(const Uint8 *data, int size, Uint32 now)
+{
+	ByteReader r(data, size);
+	Uint8 type = r.read8();
+	Uint16 sequence = r.read16();
+	Uint16 ack = r.read16();
+	Uint32 ackBits = r.read32();
+	if (r.overflow() || (type != MsgConnection))
+		return false;
+
+	onAck(ack, now);
+	for (int i = 0; i < 32; ++i)
+	{
+		if (ackBits & (1u << i))
+			onAck((Uint16)(ack - 1 - i), now);
+	}
+
+	// Duplicated packets are dropped, so unreliable messages are not delivered twice either.
+	if (!m_hasReceived)
+	{
+		m_ack = sequence;
+		m_ackBits = 0;
+		m_hasReceived = true;
+	}
+	else if (sequenceNewer(sequence, m_ack))
+	{
+		Uint16 diff = sequence - m_ack;
+		m_ackBits = (diff > 32) ? 0 : (Uint32)((((Uint64)m_ackBits << 1) | 1) << (diff - 1));
+		m_ack = sequence;
+	}
+	else
+	{
+		Uint16 diff = m_ack - sequence;
+		if ((diff == 0) || (diff > 32) || (m_ackBits & (1u << (diff - 1))))
+		{
+			m_stats.duplicates++;
+			return true;
+		}
+		m_ackBits |= 1u << (diff - 1);
+	}
+	m_stats.packetsReceived++;
+
+	while (r.left() > 0)
+	{
+		Uint8 ch = r.read8();
+		bool fragment = (ch & 0x80) != 0;
+		ch &= 0x7F;
+		if (ch >= m_channels.size())
+			return false;
+		bool reliable = (m_channels[ch].type != ChannelUnreliable);
+		Uint16 id = reliable ? r.read16() : 0;
+		Uint8 index = 0;
+		Uint8 count = 0;
+		if (fragment)
+		{
+			index = r.read8();
+			count = r.read8();
+			if (!reliable || (count == 0) || (index >= count))
+				return false;
+		}
+		Uint16 bytes = r.read16();
+		const Uint8 *payload = r.current();
+		r.skip(bytes);
+		if (r.overflow())
+			return false;
+		receiveMessage(ch, id, index, count, payload, bytes);
+		// Only packets with messages are acked on their own. Acking bare acks too would keep
+		// both ends sending them to each other forever.
+		m_ackPending = true;
+	}
+	return true;
+}
+
+void Connection::onAck(Uint16 sequence, Uint32 now)
+{
+	SentPacket &sp = m_sent[sequence % ReliableWindow];
+	if (!sp.valid || sp.acked || (sp.sequence != sequence))
+		return;
+	sp.acked = true;
+	m_stats.packetsAcked++;
+	// Every packet is sent once, resends go on new ones, so samples are never ambiguous (Karn).
+	rttSample(now - sp.time);
+	for (int i = 0; i < sp.messages; ++i)
+	{
+		Channel &c = m_channels[sp.refs[i].channel];
+		if (c.out.empty())
+			continue;
+		Uint16 offset = sp.refs[i].id - c.out.front().id;
+		if ((offset < c.out.size()) && (c.out[offset].id == sp.refs[i].id))
+			c.out[offset].acked = true;
+	}
+	for (int i = 0; i < sp.messages; ++i)
+	{
+		Channel &c = m_channels[sp.refs[i].channel];
+		while (!c.out.empty() && c.out.front().acked)
+			c.out.pop_front();
+	}
+}
+
+void Connection::rttSample(Uint32 rtt)
+{
+	float r = (float)rtt;
+	if (!m_hasRtt)
+	{
+		m_srtt = r;
+		m_rttvar = r / 2.0f;
+		m_hasRtt = true;
+	}
+	else
+	{
+		m_rttvar = 0.75f * m_rttvar + 0.25f * fabsf(m_srtt - r);
+		m_srtt = 0.875f * m_srtt + 0.125f * r;
+	}
+	// Clock granularity is a millisecond. RFC minimum of 1 second is far too much for a game.
+	float variance = 4.0f * m_rttvar;
+	m_rto = (Uint32)(m_srtt + ((variance > 1.0f) ? variance : 1.0f));
+	if (m_rto < MinRto)
+		m_rto = MinRto;
+	else if (m_rto > MaxRto)
+		m_rto = MaxRto;
+	m_backoff = 1;
+}
+
+void Connection::receiveMessage(int channel, Uint16 id, Uint8 index, Uint8 count, const Uint8 *data, int size)
+{
+	Channel &c = m_channels[channel];
+	if (c.type == ChannelUnreliable)
+	{
+		c.delivered.push_back(std::vector<Uint8>(data, data + size));
+		m_stats.messagesReceived++;
+		return;
+	}
+	// Already delivered, or too far ahead to be kept.
+	if ((Uint16)(id - c.base) >= ReliableWindow)
+		return;
+	InSlot &s = c.window[id % ReliableWindow];
+	if (s.received && (s.id == id))
+		return;
+	s.received = true;
+	s.delivered = false;
+	s.id = id;
+	s.index = index;
+	s.count = count;
+	s.data.assign(data, data + size);
+
+	if (c.type == ChannelReliableUnordered)
+	{
+		Uint16 first = id - index;
+		if ((Uint16)(first - c.base) < ReliableWindow)
+			tryDeliver(c, first, count ? count : 1);
+	}
+	deliverReady(c);
+}
+
+bool Connection::tryDeliver(Channel &c, Uint16 first, Uint8 count)
+{
+	for (Uint8 i = 0; i < count; ++i)
+	{
+		const InSlot &s = c.window[(Uint16)(first + i) % ReliableWindow];
+		if (!s.received || s.delivered || (s.id != (Uint16)(first + i)))
+			return false;
+	}
+	InSlot &head = c.window[first % ReliableWindow];
+	c.delivered.push_back(std::vector<Uint8>());
+	std::vector<Uint8> &message = c.delivered.back();
+	if (count == 1)
+		message.swap(head.data);
+	for (Uint8 i = 0; i < count; ++i)
+	{
+		InSlot &s = c.window[(Uint16)(first + i) % ReliableWindow];
+		if (count > 1)
+			message.insert(message.end(), s.data.begin(), s.data.end());
+		s.delivered = true;
+	}
+	m_stats.messagesReceived++;
+	return true;
+}
+
+void Connection::deliverReady(Channel &c)
+{
+	for (;;)
+	{
+		InSlot &s = c.window[c.base % ReliableWindow];
+		if (!s.received || (s.id != c.base))
+			return;
+		if (!s.delivered)
+		{
+			// Ordered: messages go out only once all before them did.
+			if ((c.type != ChannelReliableOrdered) || (s.index != 0) || !tryDeliver(c, c.base, s.count ? s.count : 1))
+				return;
+		}
+		s.received = false;
+		s.data.clear();
+		c.base++;
+	}
+}
+
+int Connection::pendingReliable() const
+{
+	int pending = 0;
+	for (const Channel &c : m_channels)
+	{
+		if (c.type == ChannelUnreliable)
+			continue;
+		for (const OutMessage &m : c.out)
+		{
+			if (!m.acked)
+				pending++;
+		}
+	}
+	return pending;
+}
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+
+#include "common/net_protocol.h"
+
+namespace Ris
+{
+	namespace Net
+	{
+		enum ChannelType
+		{
+			ChannelUnreliable = 0,		// Movement: only newest matters, nothing is resent.
+			ChannelReliableUnordered,	// Delivered once, as soon as it arrives.
+			ChannelReliableOrdered		// Delivered once, in the order sent. Chat, inventory, login...
+		};
+
+		// Packet: [MsgConnection u8][sequence u16][ack u16][ack bits u32] and messages, each
+		// [channel u8, 0x80 if fragment][id u16 if reliable][index u8][count u8 if fragment][size u16][data].
+		// Ack bits tell which of the 32 packets before ack were received too, so every packet
+		// acks the last 33 and a lost ack is not a problem.
+		enum
+		{
+			ConnectionHeaderSize = HeaderSize + 6,
+			MaxChannels = 16,
+			// Reliable messages bigger than this are split and rebuilt on the other end.
+			FragmentSize = 1024,
+			MaxFragments = 255,
+			// Reliable messages in flight per channel. Also the receive window.
+			ReliableWindow = 256,
+			// Reliable messages referenced by one packet, at most.
+			MaxPacketMessages = 64
+		};
+
+		// Message channels over one UDP peer.
+		// Socket agnostic: packets are built by writePacket() and given back by readPacket(),
+		// so it works the same with any socket, thread or a network simulator in between.
+		class Connection
+		{
+		public:
+			struct Stats
+			{
+				Uint32 packetsSent;
+				Uint32 packetsReceived;
+				Uint32 packetsAcked;
+				Uint32 packetsLost;
+				Uint32 duplicates;
+				Uint32 messagesSent;
+				Uint32 messagesReceived;
+				Uint32 resent;
+				Uint32 fragments;
+				Uint32 dropped;		// Unreliable messages that did not fit on their tick.
+				Stats() : packetsSent(0), packetsReceived(0), packetsAcked(0), packetsLost(0), duplicates(0),
+					messagesSent(0), messagesReceived(0), resent(0), fragments(0), dropped(0)
+				{ }
+			};
+
+		private:
+			struct OutMessage
+			{
+				Uint16 id;
+				Uint8 index;
+				Uint8 count;	// 0 if not a fragment.
+				bool acked;
+				Uint32 lastSent;
+				Uint32 timesSent;
+				std::vector<Uint8> data;
+			};
+			struct InSlot
+			{
+				bool received;
+				bool delivered;
+				Uint16 id;
+				Uint8 index;
+				Uint8 count;
+				std::vector<Uint8> data;
+			};
+			struct Channel
+			{
+				ChannelType type;
+				// Send side.
+				Uint16 nextId;
+				std::deque<OutMessage> out;		// Reliable: oldest not acked first. Unreliable: this tick ones.
+				// Receive side.
+				Uint16 base;		// Oldest message id not delivered yet.
+				InSlot window[ReliableWindow];
+				std::deque<std::vector<Uint8> > delivered;
+			};
+			struct MessageRef
+			{
+				Uint8 channel;
+				Uint16 id;
+			};
+			struct SentPacket
+			{
+				Uint16 sequence;
+				bool valid;
+				bool acked;
+				Uint32 time;
+				int messages;
+				MessageRef refs[MaxPacketMessages];
+			};
+
+			std::vector<Channel> m_channels;
+			Uint16 m_sequence;
+			SentPacket m_sent[ReliableWindow];
+			// Receive side packet acks.
+			Uint16 m_ack;
+			Uint32 m_ackBits;
+			bool m_hasReceived;
+			bool m_ackPending;
+
+			// RFC 6298 retransmission timer, milliseconds.
+			bool m_hasRtt;
+			float m_srtt;
+			float m_rttvar;
+			Uint32 m_rto;
+			Uint32 m_backoff;
+
+			Stats m_stats;
+
+			bool queue(Channel &c, Uint8 index, Uint8 count, const Uint8 *data, int size);
+			void onAck(Uint16 sequence, Uint32 now);
+			void rttSample(Uint32 rtt);
+			void receiveMessage(int channel, Uint16 id, Uint8 index, Uint8 count, const Uint8 *data, int size);
+			void deliverReady(Channel &c);
+			bool tryDeliver(Channel &c, Uint16 first, Uint8 count);
+
+		public:
+			static const Uint32 MinRto = 100;
+			static const Uint32 MaxRto = 3000;
+
+			// Channels are numbered by position on types. Both ends must use same ones.
+			Connection(const ChannelType *types, int count);
+
+			// Queues a message. Reliable ones are split if too big. Returns false if it cannot be sent.
+			bool send(int channel, const Uint8 *data, int size);
+			// Next message delivered on a channel, if any.
+			bool receive(int channel, std::vector<Uint8> &message);
+
+			// Builds this tick datagram: acks, resends due, and as many queued messages as fit.
+			// Returns bytes used. 0 if there is nothing worth sending.
+			int writePacket(Uint8 *data, int size, Uint32 now);
+			// Takes a datagram from peer. Returns false if it is malformed.
+			bool readPacket(const Uint8 *data, int size, Uint32 now);
+			// Builds and sends this tick datagram on a socket.
+			bool flush(UDPsocket socket, const IPaddress &address, Uint32 now);
+
+			inline Uint32 rtt() const { return (Uint32)m_srtt; }
+			inline Uint32 rto() const { return m_rto; }
+			// Reliable messages sent and not acknowledged yet.
+			int pendingReliable() const;
+			inline const Stats &stats() const { return m_stats; }
+		};
+	}
+}
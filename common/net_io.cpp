@@ -0,0 +1,534 @@
+#include "net_io.h"
+
+#include "SDL_timer.h"
+
+#include "common/logging.h"
+
+#ifdef RIS_NET_MMSG
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#endif
+
+using namespace Ris;
+using namespace Ris::Net;
+
+namespace
+{
+	enum
+	{
+#ifdef RIS_NET_MMSG
+		// send() wakes thread up, so this only bounds how late quit is seen.
+		WaitTimeout = 10,
+		// Kernel buffers. SDL_net leaves them at system default.
+		SocketBuffer = 4 << 20
+#else
+		// No way to wake SDLNet_CheckSockets up: packets queued wait this at most.
+		WaitTimeout = 1
+#endif
+	};
+}
+
+NetIo::NetIo(int receivePackets, int sendPackets) :
+	m_receivePackets(receivePackets),
+	m_sendPackets(sendPackets),
+	m_incoming(receivePackets),
+	m_released(receivePackets),
+	m_outgoing(sendPackets),
+	m_sent(sendPackets),
+	m_thread(nullptr),
+	m_port(0),
+#ifdef RIS_NET_MMSG
+	m_socket(-1),
+	m_wake(-1)
+#else
+	m_socket(nullptr),
+	m_set(nullptr)
+#endif
+{
+	SDL_AtomicSet(&m_quit, 0);
+	SDL_AtomicSet(&m_starved, 0);
+	takeStats();
+}
+
+NetIo::~NetIo()
+{
+	stop();
+}
+
+bool NetIo::start(Uint16 port)
+{
+	if (isRunning())
+		return true;
+	if (m_buffers.empty())
+		m_buffers.resize(m_receivePackets + m_sendPackets);
+	// Every buffer back to its pool, in case we were stopped with packets queued.
+	NetPacket *packet;
+	while (m_incoming.pop(packet) || m_released.pop(packet) || m_outgoing.pop(packet) || m_sent.pop(packet));
+	m_receivePool.clear();
+	m_sendPool.clear();
+	for (int i = 0; i < m_receivePackets; ++i)
+		m_receivePool.push_back(&m_buffers[i]);
+	for (int i = 0; i < m_sendPackets; ++i)
+		m_sendPool.push_back(&m_buffers[m_receivePackets + i]);
+
+	if (!openSocket(port))
+		return false;
+	SDL_AtomicSet(&m_quit, 0);
+	m_thread = SDL_CreateThread(threadMain, "Net I/O", this);
+	if (m_thread == nullptr)
+	{
+		g_log.logErr("Cannot create net I/O thread: " + String(SDL_GetError()));
+		closeSocket();
+		return false;
+	}
+	return true;
+}
+
+void NetIo::stop()
+{
+	if (m_thread != nullptr)
+	{
+		SDL_AtomicSet(&m_quit, 1);
+		flush();
+		SDL_WaitThread(m_thread, nullptr);
+		m_thread = nullptr;
+	}
+	closeSocket();
+}
+
+int NetIo::threadMain(void *data)
+{
+	SDL_SetThreadPriority(SDL_THREAD_PRIORITY_HIGH);
+	static_cast<NetIo*>(data)->run();
+	return 0;
+}
+
+void NetIo::run()
+{
+	while (!SDL_AtomicGet(&m_quit))
+	{
+		reclaim();
+		// A full batch means there may be more right now.
+		while (sendBatch() && (m_outgoing.size() > 0));
+		wait(WaitTimeout);
+		reclaim();
+		for (int i = 0; (i < m_receivePackets / Batch) && receiveBatch(); ++i);
+	}
+}
+
+void NetIo::reclaim()
+{
+	NetPacket *packet;
+	while (m_released.pop(packet))
+		m_receivePool.push_back(packet);
+}
+
+NetPacket *NetIo::receive()
+{
+	NetPacket *packet;
+	return m_incoming.pop(packet) ? packet : nullptr;
+}
+
+void NetIo::release(NetPacket *packet)
+{
+	// Never full: it holds every receive buffer.
+	m_released.push(packet);
+	// I/O thread stopped reading when it had no buffer left: tell it there is one.
+	if (SDL_AtomicGet(&m_starved) && SDL_AtomicCAS(&m_starved, 1, 0))
+		flush();
+}
+
+bool NetIo::starved()
+{
+	if (!m_receivePool.empty())
+		return false;
+	// Set before looking again, so a buffer released meanwhile is either seen here or wakes us.
+	SDL_AtomicSet(&m_starved, 1);
+	reclaim();
+	if (m_receivePool.empty())
+		return true;
+	SDL_AtomicSet(&m_starved, 0);
+	return false;
+}
+
+NetPacket *NetIo::allocate()
+{
+	if (m_sendPool.empty())
+	{
+		NetPacket *packet;
+		while (m_sent.pop(packet))
+			m_sendPool.push_back(packet);
+		if (m_sendPool.empty())
+			return nullptr;
+	}
+	NetPacket *packet = m_sendPool.back();
+	m_sendPool.pop_back();
+	packet->len = 0;
+	return packet;
+}
+
+void NetIo::send(NetPacket *packet)
+{
+	m_outgoing.push(packet);
+}
+
+void NetIo::discard(NetPacket *packet)
+{
+	m_sendPool.push_back(packet);
+}
+
+NetIoStats NetIo::stats() const
+{
+	NetIo *self = const_cast<NetIo*>(this);
+	NetIoStats s;
+	s.packetsIn = (Uint32)SDL_AtomicGet(&self->m_packetsIn);
+	s.packetsOut = (Uint32)SDL_AtomicGet(&self->m_packetsOut);
+	s.bytesIn = (Uint32)SDL_AtomicGet(&self->m_bytesIn);
+	s.bytesOut = (Uint32)SDL_AtomicGet(&self->m_bytesOut);
+	s.dropped = (Uint32)SDL_AtomicGet(&self->m_dropped);
+	s.receiveCalls = (Uint32)SDL_AtomicGet(&self->m_receiveCalls);
+	s.sendCalls = (Uint32)SDL_AtomicGet(&self->m_sendCalls);
+	return s;
+}
+
+NetIoStats NetIo::takeStats()
+{
+	NetIoStats s;
+	s.packetsIn = (Uint32)SDL_AtomicSet(&m_packetsIn, 0);
+	s.packetsOut = (Uint32)SDL_AtomicSet(&m_packetsOut, 0);
+	s.bytesIn = (Uint32)SDL_AtomicSet(&m_bytesIn, 0);
+	s.bytesOut = (Uint32)SDL_AtomicSet(&m_bytesOut, 0);
+	s.dropped = (Uint32)SDL_AtomicSet(&m_dropped, 0);
+	s.receiveCalls = (Uint32)SDL_AtomicSet(&m_receiveCalls, 0);
+	s.sendCalls = (Uint32)SDL_AtomicSet(&m_sendCalls, 0);
+	return s;
+}
+
+#ifdef RIS_NET_MMSG
+
+bool NetIo::openSocket(Uint16 port)
+{
+	m_socket = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (m_socket < 0)
+	{
+		g_log.logErr("Cannot create UDP socket: " + String(strerror(errno)));
+		return false;
+	}
+	int size = SocketBuffer;
+	setsockopt(m_socket, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+	setsockopt(m_socket, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons(port);
+	socklen_t length = sizeof(address);
+	if ((bind(m_socket, (sockaddr*)&address, sizeof(address)) < 0) ||
+		(getsockname(m_socket, (sockaddr*)&address, &length) < 0))
+	{
+		g_log.logErr("Cannot open UDP port " + String(port) + ": " + String(strerror(errno)));
+		closeSocket();
+		return false;
+	}
+	m_port = ntohs(address.sin_port);
+	m_wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (m_wake < 0)
+	{
+		g_log.logErr("Cannot create eventfd: " + String(strerror(errno)));
+		closeSocket();
+		return false;
+	}
+	return true;
+}
+
+void NetIo::closeSocket()
+{
+	if (m_socket >= 0)
+		close(m_socket);
+	if (m_wake >= 0)
+		close(m_wake);
+	m_socket = -1;
+	m_wake = -1;
+}
+
+void NetIo::flush()
+{
+	if (m_wake < 0)
+		return;
+	uint64_t one = 1;
+	if (write(m_wake, &one, sizeof(one)) < 0)
+		return;	// Counter is full: thread is going to wake up anyway.
+}
+
+void NetIo::wait(Uint32 timeout)
+{
+	if (m_outgoing.size() > 0)
+		return;
+	pollfd fds[2];
+	fds[0].fd = m_socket;
+	// A readable socket would wake poll() up at once while there is nowhere to read it to.
+	fds[0].events = starved() ? 0 : POLLIN;
+	fds[1].fd = m_wake;
+	fds[1].events = POLLIN;
+	if (poll(fds, 2, (int)timeout) <= 0)
+		return;
+	if (fds[1].revents & POLLIN)
+	{
+		uint64_t count;
+		if (read(m_wake, &count, sizeof(count)) < 0)
+			return;
+	}
+}
+
+bool NetIo::receiveBatch()
+{
+	int count = (int)m_receivePool.size();
+	if (count > Batch)
+		count = Batch;
+	// Game thread holds every buffer. Packets wait on socket buffer meanwhile.
+	if (count == 0)
+		return false;
+	NetPacket *packets[Batch];
+	mmsghdr messages[Batch];
+	iovec vectors[Batch];
+	sockaddr_in from[Batch];
+	for (int i = 0; i < count; ++i)
+	{
+		packets[i] = m_receivePool.back();
+		m_receivePool.pop_back();
+		vectors[i].iov_base = packets[i]->data;
+		vectors[i].iov_len = MaxPacketSize;
+		memset(&messages[i].msg_hdr, 0, sizeof(msghdr));
+		messages[i].msg_hdr.msg_name = &from[i];
+		messages[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+		messages[i].msg_hdr.msg_iov = &vectors[i];
+		messages[i].msg_hdr.msg_iovlen = 1;
+	}
+	int received = recvmmsg(m_socket, messages, count, MSG_DONTWAIT, nullptr);
+	SDL_AtomicAdd(&m_receiveCalls, 1);
+	if ((received < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))
+		g_log.logErr("Cannot receive packets: " + String(strerror(errno)));
+	Uint64 now = SDL_GetPerformanceCounter();
+	int bytes = 0;
+	int dropped = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		NetPacket *packet = packets[i];
+		if ((i >= received) || (messages[i].msg_hdr.msg_flags & MSG_TRUNC))
+		{
+			dropped += (i < received);
+			m_receivePool.push_back(packet);
+			continue;
+		}
+		packet->len = (int)messages[i].msg_len;
+		packet->address.host = from[i].sin_addr.s_addr;
+		packet->address.port = from[i].sin_port;
+		packet->time = now;
+		bytes += packet->len;
+		// Never full: it holds every receive buffer.
+		m_incoming.push(packet);
+	}
+	if (received > 0)
+	{
+		SDL_AtomicAdd(&m_packetsIn, received - dropped);
+		SDL_AtomicAdd(&m_bytesIn, bytes);
+		SDL_AtomicAdd(&m_dropped, dropped);
+	}
+	return received == Batch;
+}
+
+bool NetIo::sendBatch()
+{
+	NetPacket *packets[Batch];
+	int count = 0;
+	while ((count < Batch) && m_outgoing.pop(packets[count]))
+		count++;
+	if (count == 0)
+		return false;
+	mmsghdr messages[Batch];
+	iovec vectors[Batch];
+	sockaddr_in to[Batch];
+	for (int i = 0; i < count; ++i)
+	{
+		memset(&to[i], 0, sizeof(sockaddr_in));
+		to[i].sin_family = AF_INET;
+		// IPaddress is in network order already.
+		to[i].sin_addr.s_addr = packets[i]->address.host;
+		to[i].sin_port = packets[i]->address.port;
+		vectors[i].iov_base = packets[i]->data;
+		vectors[i].iov_len = packets[i]->len;
+		memset(&messages[i].msg_hdr, 0, sizeof(msghdr));
+		messages[i].msg_hdr.msg_name = &to[i];
+		messages[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+		messages[i].msg_hdr.msg_iov = &vectors[i];
+		messages[i].msg_hdr.msg_iovlen = 1;
+	}
+	int done = 0;
+	int bytes = 0;
+	while (done < count)
+	{
+		int sent = sendmmsg(m_socket, messages + done, count - done, 0);
+		SDL_AtomicAdd(&m_sendCalls, 1);
+		if (sent < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+			{
+				// Kernel buffer is full: give it a moment, then drop the rest.
+				pollfd fd;
+				fd.fd = m_socket;
+				fd.events = POLLOUT;
+				if (poll(&fd, 1, 10) > 0)
+					continue;
+			}
+			else
+				g_log.logErr("Cannot send packets: " + String(strerror(errno)));
+			SDL_AtomicAdd(&m_dropped, count - done);
+			break;
+		}
+		for (int i = done; i < done + sent; ++i)
+			bytes += packets[i]->len;
+		done += sent;
+	}
+	SDL_AtomicAdd(&m_packetsOut, done);
+	SDL_AtomicAdd(&m_bytesOut, bytes);
+	// Never full: it holds every send buffer.
+	for (int i = 0; i < count; ++i)
+		m_sent.push(packets[i]);
+	return count == Batch;
+}
+
+#else
+
+bool NetIo::openSocket(Uint16 port)
+{
+	m_socket = SDLNet_UDP_Open(port);
+	if (m_socket == nullptr)
+	{
+		g_log.logErr("Cannot open UDP port " + String(port) + ": " + String(SDLNet_GetError()));
+		return false;
+	}
+	m_port = SDLNet_Read16(&SDLNet_UDP_GetPeerAddress(m_socket, -1)->port);
+	m_set = SDLNet_AllocSocketSet(1);
+	if ((m_set == nullptr) || (SDLNet_UDP_AddSocket(m_set, m_socket) < 0))
+	{
+		g_log.logErr("Cannot create socket set: " + String(SDLNet_GetError()));
+		closeSocket();
+		return false;
+	}
+	for (int i = 0; i < Batch; ++i)
+	{
+		m_udp[i].channel = -1;
+		m_udp[i].maxlen = MaxPacketSize;
+	}
+	return true;
+}
+
+void NetIo::closeSocket()
+{
+	if (m_set != nullptr)
+		SDLNet_FreeSocketSet(m_set);
+	if (m_socket != nullptr)
+		SDLNet_UDP_Close(m_socket);
+	m_set = nullptr;
+	m_socket = nullptr;
+}
+
+void NetIo::flush()
+{ }
+
+void NetIo::wait(Uint32 timeout)
+{
+	if (m_outgoing.size() > 0)
+		return;
+	// Socket stays readable while there is nowhere to read it to: just sleep.
+	if (starved())
+		SDL_Delay(timeout);
+	else
+		SDLNet_CheckSockets(m_set, timeout);
+}
+
+bool NetIo::receiveBatch()
+{
+	int count = (int)m_receivePool.size();
+	if (count > Batch)
+		count = Batch;
+	if (count == 0)
+		return false;
+	NetPacket *packets[Batch];
+	for (int i = 0; i < count; ++i)
+	{
+		packets[i] = m_receivePool.back();
+		m_receivePool.pop_back();
+		// SDL_net reads straight into our buffers.
+		m_udp[i].data = packets[i]->data;
+		m_udpV[i] = &m_udp[i];
+	}
+	m_udpV[count] = nullptr;
+	int received = SDLNet_UDP_RecvV(m_socket, m_udpV);
+	SDL_AtomicAdd(&m_receiveCalls, 1);
+	if (received < 0)
+		g_log.logErr("Cannot receive packets: " + String(SDLNet_GetError()));
+	Uint64 now = SDL_GetPerformanceCounter();
+	int bytes = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		NetPacket *packet = packets[i];
+		if (i >= received)
+		{
+			m_receivePool.push_back(packet);
+			continue;
+		}
+		packet->len = m_udp[i].len;
+		packet->address = m_udp[i].address;
+		packet->time = now;
+		bytes += packet->len;
+		m_incoming.push(packet);
+	}
+	if (received > 0)
+	{
+		SDL_AtomicAdd(&m_packetsIn, received);
+		SDL_AtomicAdd(&m_bytesIn, bytes);
+	}
+	return received == Batch;
+}
+
+bool NetIo::sendBatch()
+{
+	NetPacket *packets[Batch];
+	int count = 0;
+	while ((count < Batch) && m_outgoing.pop(packets[count]))
+		count++;
+	if (count == 0)
+		return false;
+	int bytes = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		m_udp[i].data = packets[i]->data;
+		m_udp[i].len = packets[i]->len;
+		m_udp[i].address = packets[i]->address;
+		m_udpV[i] = &m_udp[i];
+	}
+	int sent = SDLNet_UDP_SendV(m_socket, m_udpV, count);
+	SDL_AtomicAdd(&m_sendCalls, 1);
+	if (sent < 0)
+		sent = 0;
+	// Status of each packet is what was sent of it, or -1.
+	for (int i = 0; i < count; ++i)
+		bytes += (m_udp[i].status > 0) ? m_udp[i].status : 0;
+	SDL_AtomicAdd(&m_packetsOut, sent);
+	SDL_AtomicAdd(&m_bytesOut, bytes);
+	if (sent < count)
+		SDL_AtomicAdd(&m_dropped, count - sent);
+	for (int i = 0; i < count; ++i)
+		m_sent.push(packets[i]);
+	return count == Batch;
+}
+
+#endif
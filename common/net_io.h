@@ -0,0 +1,138 @@
+#pragma once
+
+#include <vector>
+
+#include "SDL_atomic.h"
+#include "SDL_thread.h"
+#include "SDL_net.h"
+
+#include "common/net_protocol.h"
+#include "common/spsc_queue.h"
+
+// Linux receives and sends whole batches with one syscall. Elsewhere SDL_net is used.
+#if defined(__linux__)
+#define RIS_NET_MMSG
+#endif
+
+namespace Ris
+{
+	namespace Net
+	{
+		// Datagram buffer. Sockets read and write data in place: it is never copied
+		// between socket and game code.
+		struct NetPacket
+		{
+			IPaddress address;
+			int len;
+			// SDL_GetPerformanceCounter() when it was taken from socket.
+			Uint64 time;
+			Uint8 data[MaxPacketSize];
+		};
+
+		struct NetIoStats
+		{
+			Uint32 packetsIn;
+			Uint32 packetsOut;
+			Uint32 bytesIn;
+			Uint32 bytesOut;
+			// Received while game thread was too far behind to get them.
+			Uint32 dropped;
+			Uint32 receiveCalls;
+			Uint32 sendCalls;
+		};
+
+		// UDP socket served by its own thread.
+		// Received packets come to game thread through a lock-free queue, are decoded from
+		// their buffer and given back with release(). Packets to send are taken with allocate(),
+		// filled in place and queued with send(). All buffers are allocated on start().
+		// Every queue has one producer and one consumer: game thread and I/O thread.
+		class NetIo
+		{
+		public:
+			enum
+			{
+				// Packets taken from or given to the socket on each call.
+				Batch = 64
+			};
+
+		private:
+			std::vector<NetPacket> m_buffers;
+			int m_receivePackets;
+			int m_sendPackets;
+			std::vector<NetPacket*> m_receivePool;	// Owned by I/O thread.
+			std::vector<NetPacket*> m_sendPool;		// Owned by game thread.
+			SpscQueue<NetPacket*> m_incoming;		// I/O -> game.
+			SpscQueue<NetPacket*> m_released;		// game -> I/O, back to m_receivePool.
+			SpscQueue<NetPacket*> m_outgoing;		// game -> I/O.
+			SpscQueue<NetPacket*> m_sent;			// I/O -> game, back to m_sendPool.
+
+			SDL_Thread *m_thread;
+			SDL_atomic_t m_quit;
+			// Set by I/O thread when it has no receive buffer left and stops reading.
+			SDL_atomic_t m_starved;
+			SDL_atomic_t m_packetsIn;
+			SDL_atomic_t m_packetsOut;
+			SDL_atomic_t m_bytesIn;
+			SDL_atomic_t m_bytesOut;
+			SDL_atomic_t m_dropped;
+			SDL_atomic_t m_receiveCalls;
+			SDL_atomic_t m_sendCalls;
+			Uint16 m_port;
+
+#ifdef RIS_NET_MMSG
+			int m_socket;
+			// eventfd waking I/O thread up when there is something to send.
+			int m_wake;
+#else
+			UDPsocket m_socket;
+			SDLNet_SocketSet m_set;
+			UDPpacket m_udp[Batch];
+			UDPpacket *m_udpV[Batch + 1];
+#endif
+
+			NetIo(const NetIo &);
+			NetIo &operator=(const NetIo &);
+
+			static int threadMain(void *data);
+			void run();
+			bool openSocket(Uint16 port);
+			void closeSocket();
+			// Waits up to timeout ms for packets or for send().
+			void wait(Uint32 timeout);
+			// Returns false on socket error.
+			bool receiveBatch();
+			bool sendBatch();
+			void reclaim();
+			// True if there is no receive buffer, even after taking back released ones.
+			bool starved();
+
+		public:
+			NetIo(int receivePackets = 4096, int sendPackets = 16384);
+			~NetIo();
+
+			// Opens port (0 for any) and starts I/O thread.
+			bool start(Uint16 port);
+			// Stops thread and closes socket. Packets still queued are lost.
+			void stop();
+			inline bool isRunning() const { return m_thread != nullptr; }
+			inline Uint16 port() const { return m_port; }
+
+			// Game thread only.
+			// Next received packet, or nullptr.
+			NetPacket *receive();
+			void release(NetPacket *packet);
+			// Empty packet to fill, or nullptr if all of them are waiting to be sent.
+			NetPacket *allocate();
+			// Queues packet for address. len must be set. Packet is owned by NetIo again.
+			void send(NetPacket *packet);
+			// Gives back an allocated packet without sending it.
+			void discard(NetPacket *packet);
+			// Wakes I/O thread up for packets queued with send().
+			void flush();
+
+			NetIoStats stats() const;
+			// Returns stats and sets them to 0.
+			NetIoStats takeStats();
+		};
+	}
+}
@@ -0,0 +1,446 @@
+#pragma once
+
+#include <string.h>
+
+#include "SDL_net.h"
+
+#include "utils/point.h"
+#include "common/state_machine.h"
+#include "common/bitstream.h"
+
+namespace Ris
+{
+	namespace Net
+	{
+		enum
+		{
+			DefaultPort = 7777,
+			// Below any usual path MTU, so packets are never fragmented by IP.
+			MaxPacketSize = 1200
+		};
+
+		enum MessageType
+		{
+			MsgNone = 0,
+			MsgHello,		// Client wants to join.
+			MsgWelcome,		// Server accepted client: entity ID of its player.
+			MsgSnapshot,	// World state at a server tick.
+			MsgInput,		// Client movement inputs.
+			MsgPlayerState,	// Authoritative state of client player and last input applied.
+			MsgDeltaSnapshot,	// Changed entities since a snapshot client acknowledged.
+			MsgSnapshotAck,	// Client got a delta snapshot: it can be used as baseline.
+			MsgConnection,	// Channel messages and acks (see net_channel.h).
+			MsgBye,
+			MsgStatusRequest,	// Client wants server load figures.
+			MsgStatus,		// Server tick timings since last request.
+			MsgTimeRequest,	// Client clock, to be echoed with server clock (see clock_sync.h).
+			MsgTime			// Echo of a time request.
+		};
+
+		// Every packet starts with [type u8][sequence u16].
+		enum
+		{
+			HeaderSize = 3
+		};
+
+		// Writes network order (big endian) values on a caller buffer.
+		class ByteWriter
+		{
+			Uint8 *m_data;
+			int m_size;
+			int m_pos;
+			bool m_overflow;
+
+		public:
+			ByteWriter(Uint8 *data, int size) : m_data(data), m_size(size), m_pos(0), m_overflow(false)
+			{ }
+			inline int size() const { return m_pos; }
+			inline int left() const { return m_size - m_pos; }
+			inline bool overflow() const { return m_overflow; }
+			inline bool fits(int bytes) const { return m_pos + bytes <= m_size; }
+
+			inline void write8(Uint8 v)
+			{
+				if (!fits(1))
+				{
+					m_overflow = true;
+					return;
+				}
+				m_data[m_pos++] = v;
+			}
+			inline void write16(Uint16 v)
+			{
+				if (!fits(2))
+				{
+					m_overflow = true;
+					return;
+				}
+				SDLNet_Write16(v, m_data + m_pos);
+				m_pos += 2;
+			}
+			inline void write32(Uint32 v)
+			{
+				if (!fits(4))
+				{
+					m_overflow = true;
+					return;
+				}
+				SDLNet_Write32(v, m_data + m_pos);
+				m_pos += 4;
+			}
+			inline void writeBytes(const Uint8 *data, int bytes)
+			{
+				if (!fits(bytes))
+				{
+					m_overflow = true;
+					return;
+				}
+				memcpy(m_data + m_pos, data, bytes);
+				m_pos += bytes;
+			}
+			inline void writeFloat(float f)
+			{
+				Uint32 v;
+				memcpy(&v, &f, 4);
+				write32(v);
+			}
+		};
+
+		// Reads values written by ByteWriter. Reading past the end gives zeroes and sets overflow.
+		class ByteReader
+		{
+			const Uint8 *m_data;
+			int m_size;
+			int m_pos;
+			bool m_overflow;
+
+		public:
+			ByteReader(const Uint8 *data, int size) : m_data(data), m_size(size), m_pos(0), m_overflow(false)
+			{ }
+			inline int position() const { return m_pos; }
+			inline const Uint8 *current() const { return m_data + m_pos; }
+			inline int left() const { return m_size - m_pos; }
+			inline bool overflow() const { return m_overflow; }
+			inline bool fits(int bytes) const { return m_pos + bytes <= m_size; }
+
+			inline void skip(int bytes)
+			{
+				if (!fits(bytes))
+				{
+					m_overflow = true;
+					m_pos = m_size;
+					return;
+				}
+				m_pos += bytes;
+			}
+			inline Uint8 read8()
+			{
+				if (!fits(1))
+				{
+					m_overflow = true;
+					return 0;
+				}
+				return m_data[m_pos++];
+			}
+			inline Uint16 read16()
+			{
+				if (!fits(2))
+				{
+					m_overflow = true;
+					return 0;
+				}
+				Uint16 v = SDLNet_Read16(m_data + m_pos);
+				m_pos += 2;
+				return v;
+			}
+			inline Uint32 read32()
+			{
+				if (!fits(4))
+				{
+					m_overflow = true;
+					return 0;
+				}
+				Uint32 v = SDLNet_Read32(m_data + m_pos);
+				m_pos += 4;
+				return v;
+			}
+			inline float readFloat()
+			{
+				Uint32 v = read32();
+				float f;
+				memcpy(&f, &v, 4);
+				return f;
+			}
+		};
+
+		inline void writeHeader(ByteWriter &w, MessageType type, Uint16 sequence)
+		{
+			w.write8((Uint8)type);
+			w.write16(sequence);
+		}
+
+		// Snapshot: [tick u32][server time u32][count u16] and count entities.
+		struct SnapshotEntity
+		{
+			Uint32 id;
+			float x;
+			float y;
+			Uint8 state;
+			Uint8 dirs;
+		};
+		enum
+		{
+			SnapshotHeaderSize = 10,
+			SnapshotEntitySize = 14
+		};
+		inline void writeSnapshotEntity(ByteWriter &w, const SnapshotEntity &e)
+		{
+			w.write32(e.id);
+			w.writeFloat(e.x);
+			w.writeFloat(e.y);
+			w.write8(e.state);
+			w.write8(e.dirs);
+		}
+		inline void readSnapshotEntity(ByteReader &r, SnapshotEntity &e)
+		{
+			e.id = r.read32();
+			e.x = r.readFloat();
+			e.y = r.readFloat();
+			e.state = r.read8();
+			e.dirs = r.read8();
+		}
+
+		// Input: [newest sequence u16][count u8] and count direction flags, newest first.
+		// Every packet repeats last inputs, so a lost packet does not lose any.
+		enum
+		{
+			MaxRedundantInputs = 16
+		};
+		inline void writeInputs(ByteWriter &w, Uint16 newest, const Uint8 *dirs, int count)
+		{
+			w.write16(newest);
+			w.write8((Uint8)count);
+			for (int i = 0; i < count; ++i)
+				w.write8(dirs[i]);
+		}
+
+		// Player state: [last input sequence u16][tick u32][x f32][y f32][state u8][dirs u8].
+		struct PlayerState
+		{
+			Uint16 inputSequence;
+			Uint32 tick;
+			float x;
+			float y;
+			Uint8 state;
+			Uint8 dirs;
+		};
+		inline void writePlayerState(ByteWriter &w, const PlayerState &p)
+		{
+			w.write16(p.inputSequence);
+			w.write32(p.tick);
+			w.writeFloat(p.x);
+			w.writeFloat(p.y);
+			w.write8(p.state);
+			w.write8(p.dirs);
+		}
+		inline void readPlayerState(ByteReader &r, PlayerState &p)
+		{
+			p.inputSequence = r.read16();
+			p.tick = r.read32();
+			p.x = r.readFloat();
+			p.y = r.readFloat();
+			p.state = r.read8();
+			p.dirs = r.read8();
+		}
+
+		// Server status: [tick u32][clients u16][ticks u16][tick time avg, p50, p99, max u32],
+		// times in microseconds, over ticks since last status sent.
+		struct ServerStatus
+		{
+			Uint32 tick;
+			Uint16 clients;
+			Uint16 ticks;
+			Uint32 averageUs;
+			Uint32 p50Us;
+			Uint32 p99Us;
+			Uint32 maxUs;
+		};
+		inline void writeServerStatus(ByteWriter &w, const ServerStatus &s)
+		{
+			w.write32(s.tick);
+			w.write16(s.clients);
+			w.write16(s.ticks);
+			w.write32(s.averageUs);
+			w.write32(s.p50Us);
+			w.write32(s.p99Us);
+			w.write32(s.maxUs);
+		}
+		inline void readServerStatus(ByteReader &r, ServerStatus &s)
+		{
+			s.tick = r.read32();
+			s.clients = r.read16();
+			s.ticks = r.read16();
+			s.averageUs = r.read32();
+			s.p50Us = r.read32();
+			s.p99Us = r.read32();
+			s.maxUs = r.read32();
+		}
+
+		// Time reply: [client send u32][server receive u32][server send u32][tick u32][tick time u32]
+		// [tick interval u16][input depth f32]. Times in ms of each side clock. Tick time is when
+		// tick was due on server. Input depth is how many inputs of this client wait to be applied.
+		struct TimeReply
+		{
+			Uint32 clientSend;
+			Uint32 serverReceive;
+			Uint32 serverSend;
+			Uint32 tick;
+			Uint32 tickTime;
+			Uint16 tickInterval;
+			float inputDepth;
+		};
+		inline void writeTimeReply(ByteWriter &w, const TimeReply &t)
+		{
+			w.write32(t.clientSend);
+			w.write32(t.serverReceive);
+			w.write32(t.serverSend);
+			w.write32(t.tick);
+			w.write32(t.tickTime);
+			w.write16(t.tickInterval);
+			w.writeFloat(t.inputDepth);
+		}
+		inline void readTimeReply(ByteReader &r, TimeReply &t)
+		{
+			t.clientSend = r.read32();
+			t.serverReceive = r.read32();
+			t.serverSend = r.read32();
+			t.tick = r.read32();
+			t.tickTime = r.read32();
+			t.tickInterval = r.read16();
+			t.inputDepth = r.readFloat();
+		}
+
+		// World positions: a quarter of a pixel is enough for any sprite to be placed right.
+		static const FloatRange PositionRange = { -32768.0f, 32767.0f, 0.25f };
+
+		// Fields of EntityState, as dirty mask bits.
+		enum EntityField
+		{
+			FieldX = 1,
+			FieldY = 2,
+			FieldState = 4,
+			FieldDirs = 8,
+			FieldHealth = 16,
+			FieldMana = 32,
+			FieldAll = 63,
+			FieldBits = 6
+		};
+
+		// Replicated state of a living entity. Everything but the ID is delta encoded
+		// against a baseline the receiver already has, so unchanged fields take one bit.
+		struct EntityState
+		{
+			Uint32 id;
+			Point2D position;
+			Uint8 state;
+			Uint8 dirs;
+			Sint32 health;
+			Sint32 mana;
+
+			EntityState() : id(0), state(0), dirs(0), health(0), mana(0)
+			{ }
+
+			template <typename Stream>
+			void serialize(Stream &s, const EntityState &baseline)
+			{
+				serializeVarint(s, id);
+				serializeFloatDelta(s, position.x, baseline.position.x, PositionRange);
+				serializeFloatDelta(s, position.y, baseline.position.y, PositionRange);
+				serializeInt(s, state, 0, State::Laying);
+				serializeBits(s, dirs, 4);
+				serializeIntDelta(s, health, baseline.health);
+				serializeIntDelta(s, mana, baseline.mana);
+			}
+			// Fields different from baseline. Positions are compared once quantized.
+			inline Uint8 dirtyMask(const EntityState &baseline) const
+			{
+				Uint8 mask = 0;
+				if (PositionRange.quantize(position.x) != PositionRange.quantize(baseline.position.x))
+					mask |= FieldX;
+				if (PositionRange.quantize(position.y) != PositionRange.quantize(baseline.position.y))
+					mask |= FieldY;
+				if (state != baseline.state)
+					mask |= FieldState;
+				if (dirs != baseline.dirs)
+					mask |= FieldDirs;
+				if (health != baseline.health)
+					mask |= FieldHealth;
+				if (mana != baseline.mana)
+					mask |= FieldMana;
+				return mask;
+			}
+			// Dirty mask first, then changed fields only. Fields not on mask are taken from baseline.
+			// ID is not included, it is the key baseline was found by.
+			template <typename Stream>
+			void serializeChanged(Stream &s, const EntityState &baseline, Uint8 &mask)
+			{
+				serializeBits(s, mask, FieldBits);
+				if (Stream::IsReading)
+				{
+					Uint32 keep = id;
+					*this = baseline;
+					id = keep;
+				}
+				if (mask & FieldX)
+					serializeQuantizedDelta(s, position.x, baseline.position.x);
+				if (mask & FieldY)
+					serializeQuantizedDelta(s, position.y, baseline.position.y);
+				if (mask & FieldState)
+					serializeInt(s, state, 0, State::Laying);
+				if (mask & FieldDirs)
+					serializeBits(s, dirs, 4);
+				if (mask & FieldHealth)
+					serializeIntDiff(s, health, baseline.health);
+				if (mask & FieldMana)
+					serializeIntDiff(s, mana, baseline.mana);
+			}
+			// Full state, against an all zero baseline.
+			template <typename Stream>
+			inline void serialize(Stream &s)
+			{
+				serialize(s, EntityState());
+			}
+			// Same values the receiver will get.
+			inline void quantize()
+			{
+				position.x = PositionRange.round(position.x);
+				position.y = PositionRange.round(position.y);
+			}
+
+		private:
+			template <typename Stream>
+			static void serializeQuantizedDelta(Stream &s, float &value, float baseline)
+			{
+				Sint32 base = PositionRange.quantize(baseline);
+				Sint32 diff = Stream::IsWriting ? PositionRange.quantize(value) - base : 0;
+				serializeSignedVarint(s, diff);
+				if (Stream::IsReading)
+					value = PositionRange.dequantize(base + diff);
+			}
+			template <typename Stream>
+			static void serializeIntDiff(Stream &s, Sint32 &value, Sint32 baseline)
+			{
+				Sint32 diff = value - baseline;
+				serializeSignedVarint(s, diff);
+				if (Stream::IsReading)
+					value = baseline + diff;
+			}
+		};
+
+		// True if sequence a is newer than b, with wrap around.
+		inline bool sequenceNewer(Uint16 a, Uint16 b)
+		{
+			return (Sint16)(a - b) > 0;
+		}
+	}
+}
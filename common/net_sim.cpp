@@ -0,0 +1,282 @@
+#include "net_sim.h"
+
+#include <algorithm>
+#include <math.h>
+#include <stdlib.h>
+
+#include "common/logging.h"
+
+using namespace Ris;
+using namespace Ris::Net;
+
+NetConditions::NetConditions() :
+	latency(0),
+	jitter(0),
+	distribution(LatencyUniform),
+	reorder(0.0f),
+	reorderDelay(20),
+	duplicate(0.0f),
+	loss(0.0f),
+	burstLoss(0.5f),
+	burstStart(0.0f),
+	burstEnd(0.2f),
+	bandwidth(0),
+	queueLimit(250)
+{ }
+
+bool NetConditions::parse(const String &text)
+{
+	size_t start = 0;
+	while (start < text.size())
+	{
+		size_t end = text.find(',', start);
+		if (end == String::npos)
+			end = text.size();
+		String item = text.substr(start, end - start);
+		start = end + 1;
+		if (item.empty())
+			continue;
+		size_t equal = item.find('=');
+		if (equal == String::npos)
+		{
+			g_log.logErr("Net conditions: no value for " + item + ".");
+			return false;
+		}
+		String key = item.substr(0, equal);
+		String value = item.substr(equal + 1);
+		float number = (float)atof(value.c_str());
+		if (number < 0.0f)
+			number = 0.0f;
+		float percent = (number > 100.0f) ? 1.0f : number / 100.0f;
+		if (key == "latency")
+			latency = (Uint32)number;
+		else if (key == "jitter")
+			jitter = (Uint32)number;
+		else if (key == "dist")
+		{
+			if (value == "uniform")
+				distribution = LatencyUniform;
+			else if (value == "normal")
+				distribution = LatencyNormal;
+			else if (value == "exp")
+				distribution = LatencyExponential;
+			else
+			{
+				g_log.logErr("Net conditions: unknown distribution " + value + ".");
+				return false;
+			}
+		}
+		else if (key == "reorder")
+			reorder = percent;
+		else if (key == "reorder-delay")
+			reorderDelay = (Uint32)number;
+		else if (key == "dup")
+			duplicate = percent;
+		else if (key == "loss")
+			loss = percent;
+		else if (key == "burst")
+			burstStart = percent;
+		else if (key == "burst-len")
+			burstEnd = (number >= 1.0f) ? 1.0f / number : 1.0f;
+		else if (key == "burst-loss")
+			burstLoss = percent;
+		else if (key == "rate")
+			bandwidth = (Uint32)(number * 1000.0f / 8.0f);
+		else if (key == "queue")
+			queueLimit = (Uint32)number;
+		else
+		{
+			g_log.logErr("Net conditions: unknown key " + key + ".");
+			return false;
+		}
+	}
+	return true;
+}
+
+String NetConditions::describe() const
+{
+	static const char *distributions[] = { "uniform", "normal", "exp" };
+	char buf[256];
+	SDL_snprintf(buf, sizeof(buf), "latency %u ms, jitter %u ms %s, reorder %.1f%% +%u ms, dup %.1f%%, "
+		"loss %.1f%%, bursts %.1f%% of %.1f packets at %.0f%% loss, rate %u kbit/s, queue %u ms",
+		latency, jitter, distributions[distribution], reorder * 100.0f, reorderDelay, duplicate * 100.0f,
+		loss * 100.0f, burstStart * 100.0f, (burstEnd > 0.0f) ? 1.0f / burstEnd : 0.0f, burstLoss * 100.0f,
+		bandwidth * 8 / 1000, queueLimit);
+	return buf;
+}
+
+bool NetConditions::isPerfect() const
+{
+	return (latency == 0) && (jitter == 0) && (reorder <= 0.0f) && (duplicate <= 0.0f) && (loss <= 0.0f) &&
+		((burstStart <= 0.0f) || (burstLoss <= 0.0f)) && (bandwidth == 0);
+}
+
+void NetSimStats::add(const NetSimStats &s)
+{
+	sent += s.sent;
+	delivered += s.delivered;
+	lost += s.lost;
+	dropped += s.dropped;
+	duplicated += s.duplicated;
+	reordered += s.reordered;
+}
+
+String NetSimStats::describe() const
+{
+	char buf[160];
+	SDL_snprintf(buf, sizeof(buf), "%u sent, %u delivered, %u lost, %u dropped, %u duplicated, %u reordered",
+		sent, delivered, lost, dropped, duplicated, reordered);
+	return buf;
+}
+
+NetSimulator::NetSimulator(const NetConditions &conditions, Uint32 seed, int capacity) :
+	m_conditions(conditions),
+	m_capacity(capacity)
+{
+	reset(seed);
+}
+
+void NetSimulator::setConditions(const NetConditions &conditions)
+{
+	m_conditions = conditions;
+}
+
+void NetSimulator::reset(Uint32 seed)
+{
+	m_seed = seed;
+	m_bad = false;
+	m_linkFree = 0;
+	m_lastDue = 0;
+	m_order = 0;
+	m_free.clear();
+	for (size_t i = 0; i < m_packets.size(); ++i)
+		m_free.push_back((int)i);
+	m_queue.clear();
+	m_stats = NetSimStats();
+}
+
+Uint32 NetSimulator::delay()
+{
+	float latency = (float)m_conditions.latency;
+	float jitter = (float)m_conditions.jitter;
+	float d = latency;
+	switch (m_conditions.distribution)
+	{
+	case LatencyUniform:
+		d += (chance() * 2.0f - 1.0f) * jitter;
+		break;
+	case LatencyNormal:
+		{
+			// Irwin-Hall: sum of 12 uniforms is close enough to normal, with no transcendental.
+			float sum = 0.0f;
+			for (int i = 0; i < 12; ++i)
+				sum += chance();
+			d += (sum - 6.0f) * jitter;
+		}
+		break;
+	case LatencyExponential:
+		d += -logf(1.0f - chance()) * jitter;
+		break;
+	}
+	return (d > 0.0f) ? (Uint32)(d + 0.5f) : 0;
+}
+
+bool NetSimulator::Later::operator()(int a, int b) const
+{
+	const Packet &pa = packets[a];
+	const Packet &pb = packets[b];
+	if (pa.due != pb.due)
+		return (Sint32)(pa.due - pb.due) > 0;
+	return (Sint32)(pa.order - pb.order) > 0;
+}
+
+void NetSimulator::send(const Uint8 *data, int len, const IPaddress &address, Uint32 now)
+{
+	m_stats.sent++;
+	// Loss state moves on every packet, lost or not.
+	if (m_bad ? (chance() < m_conditions.burstEnd) : (chance() < m_conditions.burstStart))
+		m_bad = !m_bad;
+	if (chance() < (m_bad ? m_conditions.burstLoss : m_conditions.loss))
+	{
+		m_stats.lost++;
+		return;
+	}
+
+	Uint32 departs = now;
+	if (m_conditions.bandwidth)
+	{
+		// Packets leave one after the other at link rate, waiting their turn.
+		Uint64 nowUs = (Uint64)now * 1000;
+		Uint64 start = (m_linkFree > nowUs) ? m_linkFree : nowUs;
+		if (start - nowUs > (Uint64)m_conditions.queueLimit * 1000)
+		{
+			m_stats.dropped++;
+			return;
+		}
+		m_linkFree = start + (Uint64)len * 1000000 / m_conditions.bandwidth;
+		departs = (Uint32)(m_linkFree / 1000);
+	}
+
+	Uint32 due = departs + delay();
+	if (chance() < m_conditions.reorder)
+	{
+		due += m_conditions.reorderDelay;
+		m_stats.reordered++;
+	}
+	else
+	{
+		if ((Sint32)(m_lastDue - due) > 0)
+			due = m_lastDue;
+		m_lastDue = due;
+	}
+	schedule(data, len, address, due);
+	if (chance() < m_conditions.duplicate)
+	{
+		m_stats.duplicated++;
+		schedule(data, len, address, due + random() % (m_conditions.jitter + 1));
+	}
+}
+
+void NetSimulator::schedule(const Uint8 *data, int len, const IPaddress &address, Uint32 due)
+{
+	int index;
+	if (!m_free.empty())
+	{
+		index = m_free.back();
+		m_free.pop_back();
+	}
+	else if ((int)m_packets.size() < m_capacity)
+	{
+		index = (int)m_packets.size();
+		m_packets.push_back(Packet());
+	}
+	else
+	{
+		m_stats.dropped++;
+		return;
+	}
+	Packet &p = m_packets[index];
+	p.due = due;
+	p.order = m_order++;
+	p.address = address;
+	p.len = (len < (int)MaxPacketSize) ? len : (int)MaxPacketSize;
+	memcpy(p.data, data, p.len);
+	m_queue.push_back(index);
+	std::push_heap(m_queue.begin(), m_queue.end(), Later(m_packets));
+}
+
+bool NetSimulator::receive(Uint32 now, Uint8 *data, int &len, IPaddress &address)
+{
+	if (m_queue.empty() || ((Sint32)(m_packets[m_queue.front()].due - now) > 0))
+		return false;
+	std::pop_heap(m_queue.begin(), m_queue.end(), Later(m_packets));
+	int index = m_queue.back();
+	m_queue.pop_back();
+	const Packet &p = m_packets[index];
+	memcpy(data, p.data, p.len);
+	len = p.len;
+	address = p.address;
+	m_free.push_back(index);
+	m_stats.delivered++;
+	return true;
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <vector>
+
+#include "SDL_net.h"
+
+#include "common/string.h"
+#include "common/net_protocol.h"
+
+namespace Ris
+{
+	namespace Net
+	{
+		enum LatencyDistribution
+		{
+			LatencyUniform,		// latency +- jitter.
+			LatencyNormal,		// jitter is standard deviation.
+			LatencyExponential	// Long tail: jitter is mean delay over latency.
+		};
+
+		// Conditions of one direction of a link. Times in ms, chances from 0 to 1.
+		struct NetConditions
+		{
+			Uint32 latency;
+			Uint32 jitter;
+			LatencyDistribution distribution;
+			// Held back reorderDelay ms more, so packets after it overtake it.
+			// Jitter alone never reorders, as on most real paths.
+			float reorder;
+			Uint32 reorderDelay;
+			float duplicate;
+			// Gilbert-Elliott loss: link is good or bad, and goes bad with burstStart chance
+			// on every packet. Bursts last 1 / burstEnd packets on average.
+			float loss;
+			float burstLoss;
+			float burstStart;
+			float burstEnd;
+			// Bytes per second, 0 for no cap. Packets waiting more than queueLimit ms are dropped.
+			Uint32 bandwidth;
+			Uint32 queueLimit;
+
+			NetConditions();
+			// Comma separated key=value: latency, jitter, dist (uniform, normal, exp), reorder,
+			// reorder-delay, dup, loss, burst, burst-len (packets), burst-loss, rate (kbit/s), queue.
+			// Chances are given in percents. Unset keys keep their value.
+			bool parse(const String &text);
+			String describe() const;
+			bool isPerfect() const;
+		};
+
+		struct NetSimStats
+		{
+			Uint32 sent;
+			Uint32 delivered;
+			Uint32 lost;
+			// Over bandwidth queue limit or simulator capacity.
+			Uint32 dropped;
+			Uint32 duplicated;
+			Uint32 reordered;
+
+			NetSimStats() : sent(0), delivered(0), lost(0), dropped(0), duplicated(0), reordered(0)
+			{ }
+			void add(const NetSimStats &s);
+			String describe() const;
+		};
+
+		// One direction of a simulated link. Packets given to send() come back from receive()
+		// once due, or never. Every decision is drawn from a seeded generator in send order:
+		// same seed, same packets sent at same times, same packets received at same times.
+		// Time is whatever ms clock caller uses, so it can run as fast as it wants.
+		class NetSimulator
+		{
+			struct Packet
+			{
+				Uint32 due;
+				// Send order, breaking ties between packets due at same time.
+				Uint32 order;
+				IPaddress address;
+				int len;
+				Uint8 data[MaxPacketSize];
+			};
+
+			// Heap order: earliest due on top.
+			struct Later
+			{
+				const std::vector<Packet> &packets;
+				Later(const std::vector<Packet> &p) : packets(p) { }
+				bool operator()(int a, int b) const;
+			};
+
+			NetConditions m_conditions;
+			Uint32 m_seed;
+			bool m_bad;
+			// When link is done with packets queued so far, in us.
+			Uint64 m_linkFree;
+			Uint32 m_lastDue;
+			Uint32 m_order;
+			int m_capacity;
+			// Grows up to capacity, slots are reused.
+			std::vector<Packet> m_packets;
+			std::vector<int> m_free;
+			// Min heap of m_packets indices by due time.
+			std::vector<int> m_queue;
+			NetSimStats m_stats;
+
+			inline Uint32 random() { return (m_seed = m_seed * 1103515245 + 12345) >> 8; }
+			inline float chance() { return random() * (1.0f / 16777216.0f); }
+			Uint32 delay();
+			void schedule(const Uint8 *data, int len, const IPaddress &address, Uint32 due);
+
+		public:
+			NetSimulator(const NetConditions &conditions = NetConditions(), Uint32 seed = 1, int capacity = 4096);
+
+			// Packets on their way are kept.
+			void setConditions(const NetConditions &conditions);
+			// Drops every packet on its way and starts over from seed.
+			void reset(Uint32 seed);
+
+			void send(const Uint8 *data, int len, const IPaddress &address, Uint32 now);
+			// Next packet due at now, copied on data (MaxPacketSize). Returns false if there is none.
+			bool receive(Uint32 now, Uint8 *data, int &len, IPaddress &address);
+
+			inline const NetConditions &conditions() const { return m_conditions; }
+			inline size_t pending() const { return m_queue.size(); }
+			inline const NetSimStats &stats() const { return m_stats; }
+		};
+	}
+}
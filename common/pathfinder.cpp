@@ -0,0 +1,402 @@
+#include "pathfinder.h"
+
+using namespace Ris;
+
+static inline int sign(int v)
+{
+	return (v > 0) - (v < 0);
+}
+
+PathFinder::PathFinder(const WalkGrid &grid) :
+	m_grid(grid),
+	m_search(0),
+	m_status(PathIdle),
+	m_goalX(0),
+	m_goalY(0)
+{ }
+
+inline bool PathFinder::better(Uint32 a, Uint32 b) const
+{
+	const Node &na = m_nodes[a];
+	const Node &nb = m_nodes[b];
+	// On ties, deeper nodes first: they are closer to goal.
+	return (na.f < nb.f) || ((na.f == nb.f) && (na.g > nb.g));
+}
+
+void PathFinder::heapUp(Uint32 pos)
+{
+	Uint32 item = m_heap[pos];
+	while (pos > 0)
+	{
+		Uint32 parent = (pos - 1) >> 1;
+		if (!better(item, m_heap[parent]))
+			break;
+		m_heap[pos] = m_heap[parent];
+		m_nodes[m_heap[pos]].heapIndex = pos;
+		pos = parent;
+	}
+	m_heap[pos] = item;
+	m_nodes[item].heapIndex = pos;
+}
+
+void PathFinder::heapDown(Uint32 pos)
+{
+	Uint32 item = m_heap[pos];
+	Uint32 count = (Uint32)m_heap.size();
+	for (;;)
+	{
+		Uint32 child = pos * 2 + 1;
+		if (child >= count)
+			break;
+		if ((child + 1 < count) && better(m_heap[child + 1], m_heap[child]))
+			child++;
+		if (!better(m_heap[child], item))
+			break;
+		m_heap[pos] = m_heap[child];
+		m_nodes[m_heap[pos]].heapIndex = pos;
+		pos = child;
+	}
+	m_heap[pos] = item;
+	m_nodes[item].heapIndex = pos;
+}
+
+Uint32 PathFinder::heapPop()
+{
+	Uint32 top = m_heap[0];
+	m_heap[0] = m_heap.back();
+	m_heap.pop_back();
+	if (!m_heap.empty())
+		heapDown(0);
+	m_nodes[top].heapIndex = Closed;
+	return top;
+}
+
+PathFinder::Node &PathFinder::node(Uint32 i)
+{
+	Node &n = m_nodes[i];
+	if (n.stamp != m_search)
+	{
+		n.stamp = m_search;
+		n.g = 0xFFFFFFFF;
+		n.f = 0xFFFFFFFF;
+		n.parent = i;
+		n.heapIndex = Unvisited;
+	}
+	return n;
+}
+
+Uint32 PathFinder::heuristic(int x, int y) const
+{
+	return distance(m_goalX - x, m_goalY - y);
+}
+
+PathFinder::Status PathFinder::start(const GridPoint &from, const GridPoint &to)
+{
+	m_stats.searches++;
+	m_path.clear();
+	m_heap.clear();
+	size_t cells = (size_t)m_grid.width() * m_grid.height();
+	if (m_nodes.size() != cells)
+	{
+		Node blank = { 0, 0, 0, 0, 0 };
+		m_nodes.assign(cells, blank);
+		m_search = 0;
+	}
+	// Stamps wrapped: old ones could be taken for this search.
+	if (++m_search == 0)
+	{
+		for (Node &n : m_nodes)
+			n.stamp = 0;
+		m_search = 1;
+	}
+	m_goalX = to.x;
+	m_goalY = to.y;
+	if (!m_grid.walkable(from.x, from.y) || !m_grid.walkable(to.x, to.y))
+		return m_status = PathUnreachable;
+	Uint32 s = index(from.x, from.y);
+	Node &n = node(s);
+	n.g = 0;
+	n.f = heuristic(from.x, from.y);
+	m_heap.push_back(s);
+	n.heapIndex = 0;
+	return m_status = PathSearching;
+}
+
+PathFinder::Status PathFinder::step(Uint32 &budget)
+{
+	if (m_status != PathSearching)
+		return m_status;
+	Uint32 goal = index(m_goalX, m_goalY);
+	while (budget > 0)
+	{
+		if (m_heap.empty())
+			return m_status = PathUnreachable;
+		budget--;
+		m_stats.expanded++;
+		Uint32 current = heapPop();
+		if (current == goal)
+		{
+			buildPath(goal);
+			m_stats.found++;
+			return m_status = PathFound;
+		}
+		expand(current);
+	}
+	return m_status;
+}
+
+PathFinder::Status PathFinder::find(const GridPoint &from, const GridPoint &to)
+{
+	Uint32 budget = 0xFFFFFFFF;
+	if (start(from, to) == PathSearching)
+		step(budget);
+	return m_status;
+}
+
+bool PathFinder::jump(int x, int y, int dx, int dy, int &jx, int &jy) const
+{
+	const WalkGrid &g = m_grid;
+	for (;;)
+	{
+		x += dx;
+		y += dy;
+		if (!g.walkable(x, y))
+			return false;
+		if ((x == m_goalX) && (y == m_goalY))
+			break;
+		if ((dx != 0) && (dy != 0))
+		{
+			// A diagonal stops where any of its straight parts would find a jump point.
+			int sx, sy;
+			if (jump(x, y, dx, 0, sx, sy) || jump(x, y, 0, dy, sx, sy))
+				break;
+			// Corners are never cut: both sides must be open to go on.
+			if (!g.walkable(x + dx, y) || !g.walkable(x, y + dy))
+				return false;
+		}
+		else if (dx != 0)
+		{
+			// Forced neighbour: a side opens that was blocked behind.
+			if ((g.walkable(x, y - 1) && !g.walkable(x - dx, y - 1)) || (g.walkable(x, y + 1) && !g.walkable(x - dx, y + 1)))
+				break;
+		}
+		else
+		{
+			if ((g.walkable(x - 1, y) && !g.walkable(x - 1, y - dy)) || (g.walkable(x + 1, y) && !g.walkable(x + 1, y - dy)))
+				break;
+		}
+	}
+	jx = x;
+	jy = y;
+	return true;
+}
+
+void PathFinder::visit(Uint32 current, int x, int y, int dx, int dy)
+{
+	int jx, jy;
+	if (!jump(x, y, dx, dy, jx, jy))
+		return;
+	Uint32 j = index(jx, jy);
+	Node &n = node(j);
+	if (n.heapIndex == Closed)
+		return;
+	Uint32 g = m_nodes[current].g + distance(jx - x, jy - y);
+	if (g >= n.g)
+		return;
+	n.g = g;
+	n.f = g + heuristic(jx, jy);
+	n.parent = current;
+	if (n.heapIndex == Unvisited)
+	{
+		m_heap.push_back(j);
+		n.heapIndex = (Uint32)m_heap.size() - 1;
+	}
+	heapUp(n.heapIndex);
+}
+
+void PathFinder::expand(Uint32 current)
+{
+	const WalkGrid &g = m_grid;
+	int w = g.width();
+	int x = (int)(current % (Uint32)w);
+	int y = (int)(current / (Uint32)w);
+	Uint32 parent = m_nodes[current].parent;
+	if (parent == current)
+	{
+		// Start: every way.
+		bool n = g.walkable(x, y - 1);
+		bool s = g.walkable(x, y + 1);
+		bool e = g.walkable(x + 1, y);
+		bool o = g.walkable(x - 1, y);
+		if (n)
+			visit(current, x, y, 0, -1);
+		if (s)
+			visit(current, x, y, 0, 1);
+		if (e)
+			visit(current, x, y, 1, 0);
+		if (o)
+			visit(current, x, y, -1, 0);
+		if (n && e)
+			visit(current, x, y, 1, -1);
+		if (n && o)
+			visit(current, x, y, -1, -1);
+		if (s && e)
+			visit(current, x, y, 1, 1);
+		if (s && o)
+			visit(current, x, y, -1, 1);
+		return;
+	}
+	// Pruned neighbours: only the ones a path coming from parent could not reach as short another way.
+	int dx = sign(x - (int)(parent % (Uint32)w));
+	int dy = sign(y - (int)(parent / (Uint32)w));
+	if ((dx != 0) && (dy != 0))
+	{
+		bool walkX = g.walkable(x + dx, y);
+		bool walkY = g.walkable(x, y + dy);
+		if (walkY)
+			visit(current, x, y, 0, dy);
+		if (walkX)
+			visit(current, x, y, dx, 0);
+		if (walkX && walkY)
+			visit(current, x, y, dx, dy);
+	}
+	else if (dx != 0)
+	{
+		bool next = g.walkable(x + dx, y);
+		bool up = g.walkable(x, y - 1);
+		bool down = g.walkable(x, y + 1);
+		if (next)
+		{
+			visit(current, x, y, dx, 0);
+			if (up)
+				visit(current, x, y, dx, -1);
+			if (down)
+				visit(current, x, y, dx, 1);
+		}
+		if (up)
+			visit(current, x, y, 0, -1);
+		if (down)
+			visit(current, x, y, 0, 1);
+	}
+	else
+	{
+		bool next = g.walkable(x, y + dy);
+		bool left = g.walkable(x - 1, y);
+		bool right = g.walkable(x + 1, y);
+		if (next)
+		{
+			visit(current, x, y, 0, dy);
+			if (left)
+				visit(current, x, y, -1, dy);
+			if (right)
+				visit(current, x, y, 1, dy);
+		}
+		if (left)
+			visit(current, x, y, -1, 0);
+		if (right)
+			visit(current, x, y, 1, 0);
+	}
+}
+
+void PathFinder::buildPath(Uint32 goal)
+{
+	Uint32 w = (Uint32)m_grid.width();
+	Uint32 i = goal;
+	for (;;)
+	{
+		GridPoint p = { (int)(i % w), (int)(i / w) };
+		m_path.push_back(p);
+		Uint32 parent = m_nodes[i].parent;
+		if (parent == i)
+			break;
+		i = parent;
+	}
+	for (size_t a = 0, b = m_path.size() - 1; a < b; ++a, --b)
+	{
+		GridPoint t = m_path[a];
+		m_path[a] = m_path[b];
+		m_path[b] = t;
+	}
+}
+
+Uint32 PathFinder::cost() const
+{
+	Uint32 total = 0;
+	for (size_t i = 1; i < m_path.size(); ++i)
+		total += distance(m_path[i].x - m_path[i - 1].x, m_path[i].y - m_path[i - 1].y);
+	return total;
+}
+
+PathQueue::PathQueue(const WalkGrid &grid) :
+	m_finder(grid),
+	m_busy(false)
+{ }
+
+void PathQueue::request(Uint32 id, const GridPoint &from, const GridPoint &to)
+{
+	cancel(id);
+	Request r = { id, from, to };
+	m_pending.push_back(r);
+}
+
+void PathQueue::cancel(Uint32 id)
+{
+	if (m_busy && (m_current.id == id))
+		m_busy = false;
+	for (size_t i = 0; i < m_pending.size(); ++i)
+	{
+		if (m_pending[i].id == id)
+		{
+			m_pending.erase(m_pending.begin() + i);
+			return;
+		}
+	}
+}
+
+void PathQueue::run(Uint32 budget)
+{
+	while (budget > 0)
+	{
+		if (!m_busy)
+		{
+			if (m_pending.empty())
+				return;
+			m_current = m_pending.front();
+			m_pending.pop_front();
+			m_busy = true;
+			// Unwalkable ends fail right away, for no budget.
+			if (m_finder.start(m_current.from, m_current.to) != PathFinder::PathSearching)
+			{
+				finish(m_finder.status());
+				continue;
+			}
+		}
+		PathFinder::Status status = m_finder.step(budget);
+		if (status != PathFinder::PathSearching)
+			finish(status);
+	}
+}
+
+void PathQueue::finish(PathFinder::Status status)
+{
+	m_busy = false;
+	if (!m_spare.empty())
+	{
+		m_results.push_back(std::move(m_spare.back()));
+		m_spare.pop_back();
+	}
+	else
+		m_results.push_back(PathResult());
+	PathResult &r = m_results.back();
+	r.id = m_current.id;
+	r.status = status;
+	r.path.assign(m_finder.path().begin(), m_finder.path().end());
+}
+
+void PathQueue::takeResults(std::vector<PathResult> &results)
+{
+	for (PathResult &r : results)
+		m_spare.push_back(std::move(r));
+	results.clear();
+	results.swap(m_results);
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+
+#include "SDL_stdinc.h"
+
+#include "common/string.h"
+#include "common/walk_grid.h"
+
+namespace Ris
+{
+	// A* with jump point search on a WalkGrid, 8 directions, never cutting corners of blocked tiles.
+	// Straight runs with nothing around are jumped over instead of being pushed on the open list,
+	// so only tiles where the path may turn are expanded.
+	// Nodes for every tile and the heap are kept from search to search: a search only bumps a
+	// stamp, and nothing is allocated once the grid has been seen at its size.
+	// A search can be run a budget of expansions at a time, over as many ticks as it takes.
+	class PathFinder
+	{
+	public:
+		enum Status
+		{
+			PathIdle,
+			PathSearching,
+			PathFound,
+			PathUnreachable
+		};
+		enum
+		{
+			// Move costs: straight and diagonal, octile distance in integers.
+			StraightCost = 100,
+			DiagonalCost = 141
+		};
+		struct Stats
+		{
+			Uint32 searches;
+			Uint32 found;
+			Uint32 expanded;
+			Stats() : searches(0), found(0), expanded(0)
+			{ }
+		};
+
+	private:
+		struct Node
+		{
+			// Node belongs to current search only if stamp is m_search.
+			Uint32 stamp;
+			Uint32 g;
+			Uint32 f;
+			Uint32 parent;
+			// Position on heap, Unvisited or Closed.
+			Uint32 heapIndex;
+		};
+		static const Uint32 Closed = 0xFFFFFFFF;
+		static const Uint32 Unvisited = 0xFFFFFFFE;
+
+		const WalkGrid &m_grid;
+		std::vector<Node> m_nodes;
+		std::vector<Uint32> m_heap;
+		Uint32 m_search;
+		Status m_status;
+		int m_goalX;
+		int m_goalY;
+		std::vector<GridPoint> m_path;
+		Stats m_stats;
+
+		inline Uint32 index(int x, int y) const { return (Uint32)y * (Uint32)m_grid.width() + (Uint32)x; }
+		inline bool better(Uint32 a, Uint32 b) const;
+		void heapUp(Uint32 pos);
+		void heapDown(Uint32 pos);
+		Uint32 heapPop();
+		// Node of x, y on this search. It is set up on first touch.
+		Node &node(Uint32 i);
+		Uint32 heuristic(int x, int y) const;
+		// Walks from x, y along dx, dy up to the next jump point. Returns false if there is none.
+		bool jump(int x, int y, int dx, int dy, int &jx, int &jy) const;
+		void expand(Uint32 current);
+		void visit(Uint32 current, int x, int y, int dx, int dy);
+		void buildPath(Uint32 goal);
+
+	public:
+		PathFinder(const WalkGrid &grid);
+
+		// Starts a search. Any search going on is dropped.
+		Status start(const GridPoint &from, const GridPoint &to);
+		// Expands up to budget nodes, less the ones used. Returns status once done.
+		Status step(Uint32 &budget);
+		// Whole search at once.
+		Status find(const GridPoint &from, const GridPoint &to);
+
+		// Octile distance: diagonal steps as long as both ways go, straight ones after.
+		inline static Uint32 distance(int dx, int dy)
+		{
+			dx = (dx < 0) ? -dx : dx;
+			dy = (dy < 0) ? -dy : dy;
+			return (dx < dy) ? (Uint32)(dx * DiagonalCost + (dy - dx) * StraightCost) :
+				(Uint32)(dy * DiagonalCost + (dx - dy) * StraightCost);
+		}
+
+		inline Status status() const { return m_status; }
+		// Jump points from start to goal, both included. Tiles between two of them are on a straight
+		// or diagonal line. Valid until next start().
+		inline const std::vector<GridPoint> &path() const { return m_path; }
+		// Cost of path found, in StraightCost per tile.
+		Uint32 cost() const;
+		inline const Stats &stats() const { return m_stats; }
+	};
+
+	struct PathResult
+	{
+		Uint32 id;
+		PathFinder::Status status;
+		std::vector<GridPoint> path;
+	};
+
+	// Path requests of many entities, searched first come first served a budget of expansions
+	// per tick, so no tick ever pays for all of them.
+	class PathQueue
+	{
+		struct Request
+		{
+			Uint32 id;
+			GridPoint from;
+			GridPoint to;
+		};
+		PathFinder m_finder;
+		std::deque<Request> m_pending;
+		bool m_busy;
+		Request m_current;
+		std::vector<PathResult> m_results;
+		// Result vectors handed back by takeResults(), reused for new results.
+		std::vector<PathResult> m_spare;
+
+		void finish(PathFinder::Status status);
+
+	public:
+		PathQueue(const WalkGrid &grid);
+
+		// A new request of an id replaces any one of it still pending.
+		void request(Uint32 id, const GridPoint &from, const GridPoint &to);
+		void cancel(Uint32 id);
+		// Searches for up to budget node expansions.
+		void run(Uint32 budget);
+		// Moves results found since last call into results. Results given back on next call are reused.
+		void takeResults(std::vector<PathResult> &results);
+
+		inline size_t pending() const { return m_pending.size() + (m_busy ? 1 : 0); }
+		inline const PathFinder::Stats &stats() const { return m_finder.stats(); }
+	};
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+
+#include "SDL_atomic.h"
+#include "SDL_mutex.h"
+#include "SDL_timer.h"
+
+#include "common/string.h"
+
+namespace Ris
+{
+	// Timings of one code section. Can be fed from any thread.
+	class ProfileCounter
+	{
+		String m_name;
+		SDL_atomic_t m_lastUs;
+		SDL_atomic_t m_maxUs;
+		SDL_atomic_t m_sumUs;
+		SDL_atomic_t m_count;
+
+	public:
+		struct Sample
+		{
+			int count;
+			float avgMs;
+			float maxMs;
+			float lastMs;
+		};
+		ProfileCounter(const String &name) : m_name(name)
+		{
+			SDL_AtomicSet(&m_lastUs, 0);
+			SDL_AtomicSet(&m_maxUs, 0);
+			SDL_AtomicSet(&m_sumUs, 0);
+			SDL_AtomicSet(&m_count, 0);
+		}
+		inline const String &name() const { return m_name; }
+
+		void add(int us)
+		{
+			SDL_AtomicSet(&m_lastUs, us);
+			SDL_AtomicAdd(&m_sumUs, us);
+			SDL_AtomicAdd(&m_count, 1);
+			int max;
+			do
+			{
+				max = SDL_AtomicGet(&m_maxUs);
+			} while ((us > max) && !SDL_AtomicCAS(&m_maxUs, max, us));
+		}
+		// Returns timings since last call.
+		Sample take()
+		{
+			Sample s;
+			int sum = SDL_AtomicSet(&m_sumUs, 0);
+			s.count = SDL_AtomicSet(&m_count, 0);
+			s.maxMs = SDL_AtomicSet(&m_maxUs, 0) / 1000.0f;
+			s.lastMs = SDL_AtomicGet(&m_lastUs) / 1000.0f;
+			s.avgMs = s.count ? (sum / 1000.0f) / s.count : 0.0f;
+			return s;
+		}
+	};
+
+	// Adds the time spent in a scope to a counter.
+	class ProfileScope
+	{
+		ProfileCounter *m_counter;
+		Uint64 m_start;
+
+	public:
+		ProfileScope(ProfileCounter *counter) : m_counter(counter), m_start(SDL_GetPerformanceCounter())
+		{ }
+		~ProfileScope()
+		{
+			Uint64 elapsed = SDL_GetPerformanceCounter() - m_start;
+			m_counter->add((int)(elapsed * 1000000 / SDL_GetPerformanceFrequency()));
+		}
+	};
+
+	class Profiler
+	{
+		std::vector<std::unique_ptr<ProfileCounter> > m_counters;
+		SDL_mutex *m_lock;
+
+		Profiler() : m_lock(SDL_CreateMutex())
+		{ }
+		Profiler(const Profiler &);
+
+	public:
+		~Profiler()
+		{
+			SDL_DestroyMutex(m_lock);
+		}
+		static Profiler &instance()
+		{
+			static Profiler profiler;
+			return profiler;
+		}
+		// Gets counter by name, creating it if needed.
+		// Counters are never deleted, so callers can keep the pointer.
+		ProfileCounter *counter(const String &name)
+		{
+			SDL_LockMutex(m_lock);
+			ProfileCounter *c = nullptr;
+			for (auto &it : m_counters)
+			{
+				if (it->name() == name)
+					c = it.get();
+			}
+			if (c == nullptr)
+			{
+				m_counters.push_back(std::unique_ptr<ProfileCounter>(new ProfileCounter(name)));
+				c = m_counters.back().get();
+			}
+			SDL_UnlockMutex(m_lock);
+			return c;
+		}
+		// One line summary of all counters since last report: "name avg/max ms (count)"
+		String report()
+		{
+			String s;
+			SDL_LockMutex(m_lock);
+			for (auto &it : m_counters)
+			{
+				ProfileCounter::Sample sample = it->take();
+				char buf[128];
+				SDL_snprintf(buf, sizeof(buf), "%s%s %.2f/%.2f ms (%d)", s.empty() ? "" : ", ", it->name().c_str(), sample.avgMs, sample.maxMs, sample.count);
+				s += buf;
+			}
+			SDL_UnlockMutex(m_lock);
+			return s;
+		}
+	};
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+// Instruction sets kernels can count on at build time. Code using them keeps a plain C++ path.
+
+// SSE2 is always there on x64 and is VS2012+ default for x86.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define RIS_SSE2
+#endif
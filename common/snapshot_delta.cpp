@@ -0,0 +1,332 @@
+#include "snapshot_delta.h"
+
+#include <algorithm>
+
+using namespace Ris;
+using namespace Ris::Net;
+
+namespace
+{
+	struct ByID
+	{
+		inline bool operator()(const EntityState &a, const EntityState &b) const { return a.id < b.id; }
+		inline bool operator()(const EntityState &a, Uint32 id) const { return a.id < id; }
+	};
+
+	struct ByPriority
+	{
+		template <typename Candidate>
+		inline bool operator()(const Candidate &a, const Candidate &b) const { return a.priority < b.priority; }
+	};
+
+	enum
+	{
+		// Smallest entity update: more bit, 1 byte ID and changed fields mask with one field.
+		MinEntityBits = 1 + 8 + FieldBits + 1,
+		// Entities in a row that did not fit, after which snapshot is taken as full.
+		MaxMisses = 8
+	};
+
+	inline int varintBits(Uint32 value)
+	{
+		int bits = 8;
+		for (; value > 0x7F; value >>= 7)
+			bits += 8;
+		return bits;
+	}
+
+	// Snapshot header, same for both ends.
+	template <typename Stream>
+	void serializeHeader(Stream &s, Uint16 &sequence, bool &hasBaseline, Uint16 &baseline, Uint32 &tick, Uint32 &time)
+	{
+		serializeBits(s, sequence, 16);
+		serializeBool(s, hasBaseline);
+		if (hasBaseline)
+			serializeBits(s, baseline, 16);
+		serializeBits(s, tick, 32);
+		serializeBits(s, time, 32);
+	}
+}
+
+bool Net::peekSnapshot(const Uint8 *data, int size, Uint16 &sequence, Uint32 &tick)
+{
+	ReadStream s(data, size);
+	bool hasBaseline = false;
+	Uint16 baseline = 0;
+	Uint32 time = 0;
+	serializeHeader(s, sequence, hasBaseline, baseline, tick, time);
+	return !s.error();
+}
+
+const EntityState *ClientView::find(Uint32 id) const
+{
+	auto it = std::lower_bound(entities.begin(), entities.end(), id, ByID());
+	if ((it == entities.end()) || (it->id != id))
+		return nullptr;
+	return &*it;
+}
+
+SnapshotEncoder::SnapshotEncoder(int budget) :
+	m_nextSequence(0),
+	m_acked(0),
+	m_hasAck(false),
+	m_budget(budget)
+{ }
+
+void SnapshotEncoder::ack(Uint16 sequence)
+{
+	// Only sequences sent are valid, anything else is a broken or malicious client.
+	if (!sequenceNewer(m_nextSequence, sequence) || ((Uint16)(m_nextSequence - sequence) > SnapshotHistory))
+		return;
+	if (m_hasAck && !sequenceNewer(sequence, m_acked))
+		return;
+	m_acked = sequence;
+	m_hasAck = true;
+}
+
+int SnapshotEncoder::encode(Uint32 tick, Uint32 time, const EntityState *entities, const float *weights, int count, Uint8 *data, int size)
+{
+	if (size > m_budget)
+		size = m_budget;
+	Uint16 sequence = m_nextSequence++;
+	ClientView &view = m_views[sequence % SnapshotHistory];
+	view.valid = false;
+	// Baseline is the newest snapshot client has, if it is still on history.
+	const ClientView *base = nullptr;
+	if (m_hasAck && ((Uint16)(sequence - m_acked) < SnapshotHistory))
+	{
+		const ClientView &acked = m_views[m_acked % SnapshotHistory];
+		if (acked.valid && (acked.sequence == m_acked))
+			base = &acked;
+	}
+	const EntityState none;
+	int baseCount = base ? (int)base->entities.size() : 0;
+
+	// Entities, baseline and priorities are all sorted by ID: one pass matches every entity
+	// with its baseline and what it was left with.
+	m_baseIndex.resize(count);
+	m_mask.resize(count);
+	m_sent.assign(count, 0);
+	m_priority.resize(count);
+	m_candidates.clear();
+	m_removed.clear();
+	int b = 0;
+	size_t p = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		const EntityState &e = entities[i];
+		while ((b < baseCount) && (base->entities[b].id < e.id))
+			m_removed.push_back(base->entities[b++].id);
+		while ((p < m_priorityIDs.size()) && (m_priorityIDs[p] < e.id))
+			++p;
+		float left = ((p < m_priorityIDs.size()) && (m_priorityIDs[p] == e.id)) ? m_priorities[p] : 0.0f;
+		if ((b < baseCount) && (base->entities[b].id == e.id))
+		{
+			m_baseIndex[i] = b;
+			m_mask[i] = e.dirtyMask(base->entities[b++]);
+			if (m_mask[i] == 0)
+			{
+				m_stats.unchanged++;
+				continue;
+			}
+		}
+		else
+		{
+			// New to client: sent whole, even if every field is zero.
+			m_baseIndex[i] = -1;
+			m_mask[i] = e.dirtyMask(none);
+		}
+		m_priority[i] = left + (weights ? weights[i] : 1.0f);
+		Candidate c = { i, m_priority[i] };
+		m_candidates.push_back(c);
+	}
+	while (b < baseCount)
+		m_removed.push_back(base->entities[b++].id);
+
+	WriteStream s(data, size);
+	bool hasBaseline = (base != nullptr);
+	Uint16 baseline = m_acked;
+	serializeHeader(s, sequence, hasBaseline, baseline, tick, time);
+
+	// Removals take half the budget at most. Those left out are sent on next snapshots.
+	int bits = size * 8;
+	Uint32 removed = 0;
+	for (int removalBits = 0; removed < m_removed.size(); ++removed)
+	{
+		removalBits += varintBits(m_removed[removed]);
+		if (removalBits > bits / 2)
+			break;
+	}
+	serializeVarint(s, removed);
+	for (Uint32 i = 0; i < removed; ++i)
+		serializeVarint(s, m_removed[i]);
+
+	// Highest priority first, while they fit. One bit is kept for the end mark. Entities are
+	// written straight away and taken back if they went over. Only those tried are taken off the
+	// heap, the rest are never sorted.
+	bool more = true;
+	std::make_heap(m_candidates.begin(), m_candidates.end(), ByPriority());
+	int misses = 0;
+	size_t remaining = m_candidates.size();
+	while ((remaining > 0) && (misses < MaxMisses) && (bits - s.bitsProcessed() - 1 >= MinEntityBits))
+	{
+		std::pop_heap(m_candidates.begin(), m_candidates.begin() + remaining, ByPriority());
+		int index = m_candidates[--remaining].index;
+		EntityState e = entities[index];
+		const EntityState &eb = (m_baseIndex[index] >= 0) ? base->entities[m_baseIndex[index]] : none;
+		Uint8 mask = m_mask[index];
+		BitWriter::Mark mark = s.mark();
+		serializeBool(s, more);
+		serializeVarint(s, e.id);
+		e.serializeChanged(s, eb, mask);
+		if (s.error() || (s.bitsProcessed() + 1 > bits))
+		{
+			s.rewind(mark);
+			m_stats.deferred++;
+			misses++;
+			continue;
+		}
+		m_sent[index] = 1;
+		m_stats.sent++;
+		misses = 0;
+	}
+	m_stats.deferred += (Uint32)remaining;
+	more = false;
+	serializeBool(s, more);
+	int bytes = s.flush();
+	if (s.error())
+		return 0;
+
+	// What client will have once it gets this one, and priorities of those left out.
+	// Entities not in view anymore, sent once or never, lose theirs.
+	view.entities.clear();
+	view.entities.reserve(count + m_removed.size() - removed);
+	m_nextPriorityIDs.clear();
+	m_nextPriorities.clear();
+	b = 0;
+	Uint32 r = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		const EntityState &e = entities[i];
+		for (; (b < baseCount) && (base->entities[b].id < e.id); ++b)
+		{
+			// Removals not sent are still there.
+			if ((r < m_removed.size()) && (m_removed[r] == base->entities[b].id))
+			{
+				if (r++ >= removed)
+					view.entities.push_back(base->entities[b]);
+			}
+		}
+		if ((b < baseCount) && (base->entities[b].id == e.id))
+			++b;
+		if (m_sent[i])
+			view.entities.push_back(e);
+		else
+		{
+			if (m_baseIndex[i] >= 0)
+				view.entities.push_back(base->entities[m_baseIndex[i]]);
+			if (m_mask[i] != 0)
+			{
+				m_nextPriorityIDs.push_back(e.id);
+				m_nextPriorities.push_back(m_priority[i]);
+			}
+		}
+	}
+	for (; b < baseCount; ++b)
+	{
+		if (r++ >= removed)
+			view.entities.push_back(base->entities[b]);
+	}
+	m_priorityIDs.swap(m_nextPriorityIDs);
+	m_priorities.swap(m_nextPriorities);
+	view.sequence = sequence;
+	view.tick = tick;
+	view.time = time;
+	view.valid = true;
+
+	m_stats.snapshots++;
+	m_stats.bytes += bytes;
+	return bytes;
+}
+
+SnapshotDecoder::Result SnapshotDecoder::decode(const Uint8 *data, int size, Uint16 &sequence)
+{
+	ReadStream s(data, size);
+	Uint16 seq = 0;
+	bool hasBaseline = false;
+	Uint16 baseline = 0;
+	Uint32 tick = 0;
+	Uint32 time = 0;
+	serializeHeader(s, seq, hasBaseline, baseline, tick, time);
+	if (s.error())
+		return Malformed;
+	if ((m_latest >= 0) && ((Sint16)(m_views[m_latest].sequence - seq) >= SnapshotHistory))
+		return TooOld;
+	const ClientView *base = nullptr;
+	if (hasBaseline)
+	{
+		const ClientView &v = m_views[baseline % SnapshotHistory];
+		if (!v.valid || (v.sequence != baseline) || (baseline % SnapshotHistory == seq % SnapshotHistory))
+			return NoBaseline;
+		base = &v;
+	}
+	const EntityState none;
+	int baseCount = base ? (int)base->entities.size() : 0;
+
+	Uint32 removed = 0;
+	serializeVarint(s, removed);
+	if (removed > (Uint32)baseCount)
+		return Malformed;
+	m_removed.resize(removed);
+	for (Uint32 i = 0; i < removed; ++i)
+		serializeVarint(s, m_removed[i]);
+	std::sort(m_removed.begin(), m_removed.end());
+
+	m_updates.clear();
+	for (;;)
+	{
+		bool more = false;
+		serializeBool(s, more);
+		if (!more || s.error())
+			break;
+		EntityState e;
+		serializeVarint(s, e.id);
+		const EntityState *eb = base ? base->find(e.id) : nullptr;
+		Uint8 mask = 0;
+		e.serializeChanged(s, eb ? *eb : none, mask);
+		m_updates.push_back(e);
+	}
+	if (s.error())
+		return Malformed;
+	std::sort(m_updates.begin(), m_updates.end(), ByID());
+
+	ClientView &view = m_views[seq % SnapshotHistory];
+	view.valid = false;
+	view.entities.clear();
+	int b = 0;
+	size_t u = 0;
+	size_t r = 0;
+	while ((b < baseCount) || (u < m_updates.size()))
+	{
+		if ((u == m_updates.size()) || ((b < baseCount) && (base->entities[b].id < m_updates[u].id)))
+		{
+			const EntityState &e = base->entities[b++];
+			while ((r < m_removed.size()) && (m_removed[r] < e.id))
+				++r;
+			if ((r == m_removed.size()) || (m_removed[r] != e.id))
+				view.entities.push_back(e);
+			continue;
+		}
+		if ((b < baseCount) && (base->entities[b].id == m_updates[u].id))
+			++b;
+		view.entities.push_back(m_updates[u++]);
+	}
+	view.sequence = seq;
+	view.tick = tick;
+	view.time = time;
+	view.valid = true;
+	if ((m_latest < 0) || sequenceNewer(seq, m_views[m_latest].sequence))
+		m_latest = seq % SnapshotHistory;
+	sequence = seq;
+	return Decoded;
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <vector>
+
+#include "common/net_protocol.h"
+
+namespace Ris
+{
+	namespace Net
+	{
+		// Delta snapshot: [sequence u16][has baseline 1][baseline u16][tick u32][server time u32]
+		// [removed count varint][removed IDs varint]... then [1][entity ID varint][changed fields]
+		// per entity, and [0] at the end.
+		//
+		// Both ends keep what the client world looks like after each of the last snapshots.
+		// Server encodes against the newest one the client acknowledged, so client can always
+		// rebuild exactly the same world, whatever packets were lost.
+		enum
+		{
+			SnapshotHistory = 32
+		};
+
+		// World as seen by a client after a snapshot. Entities sorted by ID.
+		struct ClientView
+		{
+			Uint16 sequence;
+			bool valid;
+			Uint32 tick;
+			Uint32 time;
+			std::vector<EntityState> entities;
+
+			ClientView() : sequence(0), valid(false), tick(0), time(0)
+			{ }
+			// Entity by ID, nullptr if not there.
+			const EntityState *find(Uint32 id) const;
+		};
+
+		// Server side, one per client.
+		class SnapshotEncoder
+		{
+		public:
+			struct Stats
+			{
+				Uint32 snapshots;
+				Uint32 sent;		// Entities written.
+				Uint32 unchanged;	// Entities client is up to date with.
+				Uint32 deferred;	// Entities changed that did not fit the budget.
+				Uint32 bytes;
+				Stats() : snapshots(0), sent(0), unchanged(0), deferred(0), bytes(0)
+				{ }
+			};
+
+		private:
+			struct Candidate
+			{
+				int index;
+				float priority;
+			};
+			ClientView m_views[SnapshotHistory];
+			Uint16 m_nextSequence;
+			Uint16 m_acked;
+			bool m_hasAck;
+			int m_budget;
+			// Priority accumulators of entities left out of last snapshot, sorted by ID like entities are,
+			// so one pass matches them. They grow every snapshot an entity is left out, and are dropped
+			// once it is sent or out of view. Next ones are built while encoding, then swapped.
+			std::vector<Uint32> m_priorityIDs;
+			std::vector<float> m_priorities;
+			std::vector<Uint32> m_nextPriorityIDs;
+			std::vector<float> m_nextPriorities;
+			// Scratch arrays by entity index, kept to avoid allocating on every snapshot.
+			std::vector<int> m_baseIndex;
+			std::vector<Uint8> m_mask;
+			std::vector<Uint8> m_sent;
+			std::vector<float> m_priority;
+			std::vector<Candidate> m_candidates;
+			std::vector<Uint32> m_removed;
+			Stats m_stats;
+
+		public:
+			// budget: most bytes a snapshot can take.
+			SnapshotEncoder(int budget = MaxPacketSize - HeaderSize);
+
+			inline void setBudget(int bytes) { m_budget = bytes; }
+			inline int budget() const { return m_budget; }
+			// Client got this snapshot. Older acks are ignored.
+			void ack(Uint16 sequence);
+			// Writes a snapshot of entities visible to this client, sorted by ID and already quantized.
+			// weights are added to priority accumulators of changed entities, higher are sent first.
+			// Returns bytes written, 0 on error.
+			int encode(Uint32 tick, Uint32 time, const EntityState *entities, const float *weights, int count, Uint8 *data, int size);
+			inline const Stats &stats() const { return m_stats; }
+			inline void resetStats() { m_stats = Stats(); }
+		};
+
+		// Reads sequence and tick of a delta snapshot without decoding it.
+		bool peekSnapshot(const Uint8 *data, int size, Uint16 &sequence, Uint32 &tick);
+
+		// Client side.
+		class SnapshotDecoder
+		{
+		public:
+			enum Result
+			{
+				Decoded = 0,
+				Malformed,
+				// Baseline is not on history anymore: server will use a newer one once it gets an ack.
+				NoBaseline,
+				// Its place on history is taken by a newer one.
+				TooOld
+			};
+
+		private:
+			ClientView m_views[SnapshotHistory];
+			int m_latest;
+			std::vector<EntityState> m_updates;
+			std::vector<Uint32> m_removed;
+
+		public:
+			SnapshotDecoder() : m_latest(-1)
+			{ }
+			// Rebuilds world from a snapshot. sequence is set to the one to acknowledge if decoded.
+			Result decode(const Uint8 *data, int size, Uint16 &sequence);
+			// Newest world rebuilt, nullptr before the first one.
+			inline const ClientView *latest() const { return (m_latest < 0) ? nullptr : &m_views[m_latest]; }
+		};
+	}
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <vector>
+
+#include "SDL_atomic.h"
+
+namespace Ris
+{
+	// Lock-free bounded queue between exactly one producer thread and one consumer thread.
+	// Capacity is rounded up to a power of two and allocated once.
+	// Each side caches the other one's index and only reads it when it looks full or empty.
+	template <typename T>
+	class SpscQueue
+	{
+		std::vector<T> m_items;
+		Uint32 m_mask;
+		// Kept on separate cache lines: written by different threads.
+		char m_pad0[64];
+		SDL_atomic_t m_head;	// Next to pop. Written by consumer.
+		Uint32 m_cachedTail;	// Consumer copy of m_tail.
+		char m_pad1[64];
+		SDL_atomic_t m_tail;	// Next to push. Written by producer.
+		Uint32 m_cachedHead;	// Producer copy of m_head.
+		char m_pad2[64];
+
+		SpscQueue(const SpscQueue &);
+		SpscQueue &operator=(const SpscQueue &);
+
+	public:
+		explicit SpscQueue(Uint32 capacity) :
+			m_cachedTail(0),
+			m_cachedHead(0)
+		{
+			Uint32 size = 2;
+			while (size < capacity)
+				size <<= 1;
+			m_items.resize(size);
+			m_mask = size - 1;
+			SDL_AtomicSet(&m_head, 0);
+			SDL_AtomicSet(&m_tail, 0);
+		}
+
+		inline Uint32 capacity() const { return m_mask + 1; }
+
+		// Producer side. Returns false if full.
+		inline bool push(const T &item)
+		{
+			Uint32 tail = (Uint32)SDL_AtomicGet(&m_tail);
+			if (tail - m_cachedHead > m_mask)
+			{
+				m_cachedHead = (Uint32)SDL_AtomicGet(&m_head);
+				if (tail - m_cachedHead > m_mask)
+					return false;
+			}
+			m_items[tail & m_mask] = item;
+			SDL_AtomicSet(&m_tail, (int)(tail + 1));
+			return true;
+		}
+
+		// Consumer side. Returns false if empty.
+		inline bool pop(T &item)
+		{
+			Uint32 head = (Uint32)SDL_AtomicGet(&m_head);
+			if (head == m_cachedTail)
+			{
+				m_cachedTail = (Uint32)SDL_AtomicGet(&m_tail);
+				if (head == m_cachedTail)
+					return false;
+			}
+			item = m_items[head & m_mask];
+			SDL_AtomicSet(&m_head, (int)(head + 1));
+			return true;
+		}
+
+		// Either side. Only a hint while the other side is running.
+		inline Uint32 size() const
+		{
+			return (Uint32)SDL_AtomicGet(const_cast<SDL_atomic_t*>(&m_tail)) - (Uint32)SDL_AtomicGet(const_cast<SDL_atomic_t*>(&m_head));
+		}
+	};
+}
@@ -1,3 +1,5 @@
+#pragma once
+
 #include "utils/math.h"
 
 #include "SDL_events.h"
@@ -61,13 +63,14 @@ namespace Ris
 	};
 	struct StateWalking : public StateOnGround
 	{
+		// Flags, as more than one direction can be held at once.
 		enum Direction
 		{
 			NoDir = 0,
-			North,
-			South,
-			East,
-			West
+			North = 0x1,
+			South = 0x2,
+			East = 0x4,
+			West = 0x8
 		};
 		Direction direction;
 		void checkKeyboardDown(const SDL_Keycode &key)
@@ -0,0 +1,400 @@
+#include "steering.h"
+
+#ifdef RIS_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "common/jobs.h"
+
+#include <math.h>
+
+using namespace Ris;
+
+namespace
+{
+	// Squared distances below this are agents on the same spot. They are pushed apart along x,
+	// lower slot to the left, so a stack always breaks the same way.
+	const float Tiny = 1e-6f;
+	const float Nudge = 0.01f;
+	// Closest approach nearer than this is head on: agents turn to their right instead.
+	const float HeadOn = 0.25f;
+	const float HeadOnOffset = 0.5f;
+
+	struct Agent
+	{
+		Uint32 slot;
+		float x, y, vx, vy;
+		float neighbour2;
+		float contact;
+		float contact2;
+		float invContact2;
+		float horizon;
+		float invHorizon;
+	};
+
+	struct Forces
+	{
+		float sepX, sepY;
+		float alignX, alignY, count;
+		float avoidX, avoidY;
+		float pushX, pushY;
+		Uint32 contacts;
+	};
+}
+
+// Effect of agent on slot j over a. Same maths as the SSE2 version, one neighbour at a time.
+static inline void neighbour(const Agent &a, Uint32 j, float jx, float jy, float jvx, float jvy, Forces &f)
+{
+	if (j == a.slot)
+		return;
+	float dx = jx - a.x;
+	float dy = jy - a.y;
+	float d2 = dx * dx + dy * dy;
+	if (d2 >= a.neighbour2)
+		return;
+	if (d2 < Tiny)
+	{
+		dx = (j > a.slot) ? Nudge : -Nudge;
+		dy = 0.0f;
+		d2 = Nudge * Nudge;
+	}
+	if (d2 < a.contact2)
+	{
+		// Zero at contact distance, stronger the closer.
+		float w = 1.0f / d2 - a.invContact2;
+		f.sepX -= dx * w;
+		f.sepY -= dy * w;
+		// Half the overlap, the other agent does the other half.
+		float push = (a.contact / sqrtf(d2) - 1.0f) * 0.5f;
+		f.pushX -= dx * push;
+		f.pushY -= dy * push;
+		f.contacts++;
+	}
+	f.alignX += jvx;
+	f.alignY += jvy;
+	f.count += 1.0f;
+
+	// Closest approach, if getting closer at all.
+	float rvx = jvx - a.vx;
+	float rvy = jvy - a.vy;
+	float vv = rvx * rvx + rvy * rvy;
+	float pv = dx * rvx + dy * rvy;
+	if ((pv >= 0.0f) || (vv < Tiny))
+		return;
+	float t = -pv / vv;
+	if (t >= a.horizon)
+		return;
+	float cx = dx + rvx * t;
+	float cy = dy + rvy * t;
+	float cd2 = cx * cx + cy * cy;
+	if (cd2 >= a.contact2)
+		return;
+	if (cd2 < HeadOn)
+	{
+		float s = HeadOnOffset / sqrtf(vv);
+		cx = rvy * s;
+		cy = -rvx * s;
+		cd2 = HeadOnOffset * HeadOnOffset;
+	}
+	// Away from where it will be, harder the sooner.
+	float w = (1.0f - t * a.invHorizon) / sqrtf(cd2);
+	f.avoidX -= cx * w;
+	f.avoidY -= cy * w;
+}
+
+#ifdef RIS_SSE2
+static inline float sum(__m128 v)
+{
+	float lanes[4];
+	_mm_storeu_ps(lanes, v);
+	return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+#endif
+
+static inline void neighbours(const Agent &a, const float *sx, const float *sy, const float *svx, const float *svy,
+	Uint32 begin, Uint32 end, Forces &f)
+{
+	Uint32 j = begin;
+#ifdef RIS_SSE2
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 tiny = _mm_set1_ps(Tiny);
+	const __m128 ax = _mm_set1_ps(a.x);
+	const __m128 ay = _mm_set1_ps(a.y);
+	const __m128 avx = _mm_set1_ps(a.vx);
+	const __m128 avy = _mm_set1_ps(a.vy);
+	const __m128 neighbour2 = _mm_set1_ps(a.neighbour2);
+	const __m128 contact2 = _mm_set1_ps(a.contact2);
+	const __m128i slot = _mm_set1_epi32((int)a.slot);
+	const __m128i lanes = _mm_set_epi32(3, 2, 1, 0);
+	__m128 sepX = zero, sepY = zero, alignX = zero, alignY = zero, count = zero, avoidX = zero, avoidY = zero;
+	__m128 pushX = zero, pushY = zero;
+	for (; j + 4 <= end; j += 4)
+	{
+		__m128 dx = _mm_sub_ps(_mm_loadu_ps(sx + j), ax);
+		__m128 dy = _mm_sub_ps(_mm_loadu_ps(sy + j), ay);
+		__m128 d2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+		__m128i index = _mm_add_epi32(_mm_set1_epi32((int)j), lanes);
+		__m128 self = _mm_castsi128_ps(_mm_cmpeq_epi32(index, slot));
+		__m128 near = _mm_andnot_ps(self, _mm_cmplt_ps(d2, neighbour2));
+		if (_mm_movemask_ps(near) == 0)
+			continue;
+
+		__m128 stacked = _mm_cmplt_ps(d2, tiny);
+		__m128 after = _mm_castsi128_ps(_mm_cmpgt_epi32(index, slot));
+		__m128 nudge = _mm_or_ps(_mm_and_ps(after, _mm_set1_ps(Nudge)), _mm_andnot_ps(after, _mm_set1_ps(-Nudge)));
+		dx = _mm_or_ps(_mm_and_ps(stacked, nudge), _mm_andnot_ps(stacked, dx));
+		dy = _mm_andnot_ps(stacked, dy);
+		d2 = _mm_or_ps(_mm_and_ps(stacked, _mm_set1_ps(Nudge * Nudge)), _mm_andnot_ps(stacked, d2));
+
+		__m128 contact = _mm_and_ps(near, _mm_cmplt_ps(d2, contact2));
+		__m128 w = _mm_and_ps(contact, _mm_sub_ps(_mm_div_ps(one, d2), _mm_set1_ps(a.invContact2)));
+		sepX = _mm_sub_ps(sepX, _mm_mul_ps(dx, w));
+		sepY = _mm_sub_ps(sepY, _mm_mul_ps(dy, w));
+		__m128 push = _mm_mul_ps(_mm_sub_ps(_mm_div_ps(_mm_set1_ps(a.contact), _mm_sqrt_ps(d2)), one), _mm_set1_ps(0.5f));
+		push = _mm_and_ps(contact, push);
+		pushX = _mm_sub_ps(pushX, _mm_mul_ps(dx, push));
+		pushY = _mm_sub_ps(pushY, _mm_mul_ps(dy, push));
+		int contacts = _mm_movemask_ps(contact);
+		f.contacts += (contacts & 1) + ((contacts >> 1) & 1) + ((contacts >> 2) & 1) + (contacts >> 3);
+
+		__m128 jvx = _mm_loadu_ps(svx + j);
+		__m128 jvy = _mm_loadu_ps(svy + j);
+		alignX = _mm_add_ps(alignX, _mm_and_ps(near, jvx));
+		alignY = _mm_add_ps(alignY, _mm_and_ps(near, jvy));
+		count = _mm_add_ps(count, _mm_and_ps(near, one));
+
+		__m128 rvx = _mm_sub_ps(jvx, avx);
+		__m128 rvy = _mm_sub_ps(jvy, avy);
+		__m128 vv = _mm_add_ps(_mm_mul_ps(rvx, rvx), _mm_mul_ps(rvy, rvy));
+		__m128 pv = _mm_add_ps(_mm_mul_ps(dx, rvx), _mm_mul_ps(dy, rvy));
+		__m128 closing = _mm_and_ps(near, _mm_and_ps(_mm_cmplt_ps(pv, zero), _mm_cmpge_ps(vv, tiny)));
+		__m128 t = _mm_div_ps(_mm_sub_ps(zero, pv), _mm_max_ps(vv, tiny));
+		closing = _mm_and_ps(closing, _mm_cmplt_ps(t, _mm_set1_ps(a.horizon)));
+		if (_mm_movemask_ps(closing) == 0)
+			continue;
+		__m128 cx = _mm_add_ps(dx, _mm_mul_ps(rvx, t));
+		__m128 cy = _mm_add_ps(dy, _mm_mul_ps(rvy, t));
+		__m128 cd2 = _mm_add_ps(_mm_mul_ps(cx, cx), _mm_mul_ps(cy, cy));
+		__m128 hit = _mm_and_ps(closing, _mm_cmplt_ps(cd2, contact2));
+		__m128 headOn = _mm_cmplt_ps(cd2, _mm_set1_ps(HeadOn));
+		__m128 s = _mm_div_ps(_mm_set1_ps(HeadOnOffset), _mm_sqrt_ps(_mm_max_ps(vv, tiny)));
+		cx = _mm_or_ps(_mm_and_ps(headOn, _mm_mul_ps(rvy, s)), _mm_andnot_ps(headOn, cx));
+		cy = _mm_or_ps(_mm_and_ps(headOn, _mm_sub_ps(zero, _mm_mul_ps(rvx, s))), _mm_andnot_ps(headOn, cy));
+		cd2 = _mm_or_ps(_mm_and_ps(headOn, _mm_set1_ps(HeadOnOffset * HeadOnOffset)), _mm_andnot_ps(headOn, cd2));
+		w = _mm_div_ps(_mm_sub_ps(one, _mm_mul_ps(t, _mm_set1_ps(a.invHorizon))), _mm_sqrt_ps(cd2));
+		w = _mm_and_ps(hit, w);
+		avoidX = _mm_sub_ps(avoidX, _mm_mul_ps(cx, w));
+		avoidY = _mm_sub_ps(avoidY, _mm_mul_ps(cy, w));
+	}
+	f.sepX += sum(sepX);
+	f.sepY += sum(sepY);
+	f.alignX += sum(alignX);
+	f.alignY += sum(alignY);
+	f.count += sum(count);
+	f.avoidX += sum(avoidX);
+	f.avoidY += sum(avoidY);
+	f.pushX += sum(pushX);
+	f.pushY += sum(pushY);
+#endif
+	for (; j < end; ++j)
+		neighbour(a, j, sx[j], sy[j], svx[j], svy[j], f);
+}
+
+Steering::Steering(const Params &params) :
+	m_params(params),
+	m_cellSize(params.neighbourRadius),
+	m_originX(0.0f),
+	m_originY(0.0f),
+	m_cellsX(0),
+	m_cellsY(0)
+{
+	SDL_AtomicSet(&m_pairs, 0);
+	SDL_AtomicSet(&m_contacts, 0);
+}
+
+void Steering::resize(size_t count)
+{
+	m_x.resize(count, 0.0f);
+	m_y.resize(count, 0.0f);
+	m_vx.resize(count, 0.0f);
+	m_vy.resize(count, 0.0f);
+	m_prefX.resize(count, 0.0f);
+	m_prefY.resize(count, 0.0f);
+	m_mode.resize(count, (Uint8)Ignored);
+}
+
+void Steering::buildGrid()
+{
+	Uint32 n = (Uint32)m_x.size();
+	Uint32 present = 0;
+	float minX = 0.0f, minY = 0.0f, maxX = 0.0f, maxY = 0.0f;
+	for (Uint32 i = 0; i < n; ++i)
+	{
+		if (m_mode[i] == Ignored)
+			continue;
+		if ((present == 0) || (m_x[i] < minX))
+			minX = m_x[i];
+		if ((present == 0) || (m_x[i] > maxX))
+			maxX = m_x[i];
+		if ((present == 0) || (m_y[i] < minY))
+			minY = m_y[i];
+		if ((present == 0) || (m_y[i] > maxY))
+			maxY = m_y[i];
+		present++;
+	}
+	// Cells of neighbour radius, so neighbours are on the 3x3 cells around. A crowd spread over
+	// a big map gets bigger cells instead, so the grid stays about the size of the crowd.
+	m_cellSize = (m_params.neighbourRadius >= 1.0f) ? m_params.neighbourRadius : 1.0f;
+	for (;;)
+	{
+		m_cellsX = (int)((maxX - minX) / m_cellSize) + 1;
+		m_cellsY = (int)((maxY - minY) / m_cellSize) + 1;
+		if ((Uint64)m_cellsX * (Uint64)m_cellsY <= (Uint64)present * 4 + 64)
+			break;
+		m_cellSize *= 2.0f;
+	}
+	m_originX = minX;
+	m_originY = minY;
+	Uint32 cells = (Uint32)(m_cellsX * m_cellsY);
+	float inv = 1.0f / m_cellSize;
+
+	// Counting sort by cell. Counts become cell ends, then placing backwards leaves cell starts.
+	m_cellStart.assign(cells + 1, 0);
+	m_cell.resize(n);
+	for (Uint32 i = 0; i < n; ++i)
+	{
+		if (m_mode[i] == Ignored)
+			continue;
+		int cx = (int)((m_x[i] - m_originX) * inv);
+		int cy = (int)((m_y[i] - m_originY) * inv);
+		cx = (cx < m_cellsX) ? cx : m_cellsX - 1;
+		cy = (cy < m_cellsY) ? cy : m_cellsY - 1;
+		m_cell[i] = (Uint32)(cy * m_cellsX + cx);
+		m_cellStart[m_cell[i]]++;
+	}
+	Uint32 sum = 0;
+	for (Uint32 c = 0; c < cells; ++c)
+	{
+		sum += m_cellStart[c];
+		m_cellStart[c] = sum;
+	}
+	m_cellStart[cells] = present;
+	m_order.resize(present);
+	m_sx.resize(present);
+	m_sy.resize(present);
+	m_svx.resize(present);
+	m_svy.resize(present);
+	m_outX.resize(present);
+	m_outY.resize(present);
+	m_pushX.resize(present);
+	m_pushY.resize(present);
+	for (Uint32 i = n; i-- > 0;)
+	{
+		if (m_mode[i] == Ignored)
+			continue;
+		Uint32 slot = --m_cellStart[m_cell[i]];
+		m_order[slot] = i;
+		m_sx[slot] = m_x[i];
+		m_sy[slot] = m_y[i];
+		// Obstacles go where their owner sends them.
+		bool steered = (m_mode[i] == Steered);
+		m_svx[slot] = steered ? m_vx[i] : m_prefX[i];
+		m_svy[slot] = steered ? m_vy[i] : m_prefY[i];
+	}
+}
+
+void Steering::steer(Uint32 slot, Uint32 &pairs, Uint32 &contacts)
+{
+	const Params &p = m_params;
+	Agent a;
+	a.slot = slot;
+	a.x = m_sx[slot];
+	a.y = m_sy[slot];
+	a.vx = m_svx[slot];
+	a.vy = m_svy[slot];
+	a.neighbour2 = p.neighbourRadius * p.neighbourRadius;
+	a.contact = 2.0f * p.radius;
+	a.contact2 = a.contact * a.contact;
+	a.invContact2 = 1.0f / a.contact2;
+	a.horizon = p.horizon;
+	a.invHorizon = 1.0f / p.horizon;
+	Forces f = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0 };
+
+	Uint32 agent = m_order[slot];
+	int cx = (int)(m_cell[agent] % (Uint32)m_cellsX);
+	int cy = (int)(m_cell[agent] / (Uint32)m_cellsX);
+	int x0 = (cx > 0) ? cx - 1 : 0;
+	int x1 = (cx + 1 < m_cellsX) ? cx + 1 : m_cellsX - 1;
+	for (int y = cy - 1; y <= cy + 1; ++y)
+	{
+		if ((y < 0) || (y >= m_cellsY))
+			continue;
+		// Cells of a row are next to each other on slots.
+		Uint32 begin = m_cellStart[y * m_cellsX + x0];
+		Uint32 end = m_cellStart[y * m_cellsX + x1 + 1];
+		pairs += end - begin;
+		neighbours(a, m_sx.data(), m_sy.data(), m_svx.data(), m_svy.data(), begin, end, f);
+	}
+	contacts += f.contacts;
+
+	float desiredX = m_prefX[agent] + f.sepX * (p.separation * p.radius * p.maxSpeed) + f.avoidX * (p.avoidance * p.maxSpeed);
+	float desiredY = m_prefY[agent] + f.sepY * (p.separation * p.radius * p.maxSpeed) + f.avoidY * (p.avoidance * p.maxSpeed);
+	if (f.count > 0.0f)
+	{
+		desiredX += (f.alignX / f.count - a.vx) * p.alignment;
+		desiredY += (f.alignY / f.count - a.vy) * p.alignment;
+	}
+	float vx = a.vx + (desiredX - a.vx) * p.response;
+	float vy = a.vy + (desiredY - a.vy) * p.response;
+	float speed2 = vx * vx + vy * vy;
+	if (speed2 > p.maxSpeed * p.maxSpeed)
+	{
+		float s = p.maxSpeed / sqrtf(speed2);
+		vx *= s;
+		vy *= s;
+	}
+	m_outX[slot] = vx;
+	m_outY[slot] = vy;
+	// Pushes of many overlaps at once overshoot: they are averaged.
+	float share = (f.contacts > 1) ? 1.0f / (float)f.contacts : 1.0f;
+	m_pushX[slot] = f.pushX * share;
+	m_pushY[slot] = f.pushY * share;
+}
+
+void Steering::steerRange(void *context, Uint32 begin, Uint32 end)
+{
+	Steering *steering = static_cast<Steering*>(context);
+	Uint32 pairs = 0;
+	Uint32 contacts = 0;
+	for (Uint32 slot = begin; slot < end; ++slot)
+	{
+		if (steering->m_mode[steering->m_order[slot]] == Steered)
+			steering->steer(slot, pairs, contacts);
+	}
+	SDL_AtomicAdd(&steering->m_pairs, (int)pairs);
+	SDL_AtomicAdd(&steering->m_contacts, (int)contacts);
+}
+
+void Steering::update()
+{
+	m_stats.updates++;
+	buildGrid();
+	SDL_AtomicSet(&m_pairs, 0);
+	SDL_AtomicSet(&m_contacts, 0);
+	JobSystem::instance().parallelForWait((Uint32)m_order.size(), 512, steerRange, this);
+	m_stats.pairs = (Uint32)SDL_AtomicGet(&m_pairs);
+	m_stats.contacts = (Uint32)SDL_AtomicGet(&m_contacts);
+	m_stats.steered = 0;
+	for (Uint32 slot = 0; slot < m_order.size(); ++slot)
+	{
+		Uint32 i = m_order[slot];
+		if (m_mode[i] != Steered)
+			continue;
+		m_stats.steered++;
+		m_vx[i] = m_outX[slot];
+		m_vy[i] = m_outY[slot];
+		m_x[i] += m_vx[i] + m_pushX[slot];
+		m_y[i] += m_vy[i] + m_pushY[slot];
+	}
+}
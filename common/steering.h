@@ -0,0 +1,131 @@
+#pragma once
+
+#include <vector>
+
+#include "SDL_stdinc.h"
+#include "SDL_atomic.h"
+
+#include "common/simd.h"
+
+namespace Ris
+{
+	// Local avoidance for crowds: agents follow their preferred velocity, but keep apart from
+	// neighbours (separation), match their heading (alignment) and turn away from the ones they
+	// would get too close to before long (avoidance, on closest approach of relative velocities).
+	// Agents are on SoA arrays. Every update sorts them on a uniform grid of neighbour radius
+	// cells, so neighbours of an agent are three runs of contiguous slots, tested 4 at a time.
+	// Units are pixels and ticks: velocities are pixels per tick, as World speed is.
+	class Steering
+	{
+	public:
+		enum Mode
+		{
+			// Not there at all.
+			Ignored = 0,
+			// Avoided by others, but moved by its owner: its velocity is its preferred one.
+			Obstacle,
+			Steered
+		};
+		struct Params
+		{
+			float radius;
+			float neighbourRadius;
+			float maxSpeed;
+			// Weights of each behaviour.
+			float separation;
+			float alignment;
+			float avoidance;
+			// Ticks ahead avoidance looks for collisions.
+			float horizon;
+			// Part of the way to new velocity done each tick, in (0, 1].
+			float response;
+			Params() : radius(12.0f), neighbourRadius(48.0f), maxSpeed(4.0f), separation(1.0f), alignment(0.2f),
+				avoidance(1.0f), horizon(16.0f), response(0.5f)
+			{ }
+		};
+		struct Stats
+		{
+			Uint32 updates;
+			Uint32 steered;
+			// On last update: neighbours tested, and ones closer than two radii, seen from each steered agent.
+			Uint64 pairs;
+			Uint32 contacts;
+			Stats() : updates(0), steered(0), pairs(0), contacts(0)
+			{ }
+		};
+
+	private:
+		Params m_params;
+		std::vector<float> m_x;
+		std::vector<float> m_y;
+		std::vector<float> m_vx;
+		std::vector<float> m_vy;
+		std::vector<float> m_prefX;
+		std::vector<float> m_prefY;
+		std::vector<Uint8> m_mode;
+
+		// Grid of last update, rebuilt every time over the area agents are on.
+		float m_cellSize;
+		float m_originX;
+		float m_originY;
+		int m_cellsX;
+		int m_cellsY;
+		// First slot of each cell, plus one past the last.
+		std::vector<Uint32> m_cellStart;
+		std::vector<Uint32> m_cell;
+		// Agent on each slot, and its copies sorted by cell.
+		std::vector<Uint32> m_order;
+		std::vector<float> m_sx;
+		std::vector<float> m_sy;
+		std::vector<float> m_svx;
+		std::vector<float> m_svy;
+		// New velocities by slot, and moves out of overlaps on top of them.
+		std::vector<float> m_outX;
+		std::vector<float> m_outY;
+		std::vector<float> m_pushX;
+		std::vector<float> m_pushY;
+		// Per job totals, summed after.
+		SDL_atomic_t m_pairs;
+		SDL_atomic_t m_contacts;
+		Stats m_stats;
+
+		void buildGrid();
+		static void steerRange(void *context, Uint32 begin, Uint32 end);
+		void steer(Uint32 slot, Uint32 &pairs, Uint32 &contacts);
+
+	public:
+		Steering(const Params &params = Params());
+
+		void resize(size_t count);
+		inline size_t count() const { return m_x.size(); }
+		inline const Params &params() const { return m_params; }
+		inline void setParams(const Params &params) { m_params = params; }
+
+		inline void setMode(Uint32 agent, Mode mode) { m_mode[agent] = (Uint8)mode; }
+		inline Mode mode(Uint32 agent) const { return (Mode)m_mode[agent]; }
+		inline void setPosition(Uint32 agent, float x, float y)
+		{
+			m_x[agent] = x;
+			m_y[agent] = y;
+		}
+		inline void setVelocity(Uint32 agent, float vx, float vy)
+		{
+			m_vx[agent] = vx;
+			m_vy[agent] = vy;
+		}
+		inline void setPreferred(Uint32 agent, float vx, float vy)
+		{
+			m_prefX[agent] = vx;
+			m_prefY[agent] = vy;
+		}
+		inline float x(Uint32 agent) const { return m_x[agent]; }
+		inline float y(Uint32 agent) const { return m_y[agent]; }
+		inline float vx(Uint32 agent) const { return m_vx[agent]; }
+		inline float vy(Uint32 agent) const { return m_vy[agent]; }
+
+		// One tick: new velocities of steered agents, which are then moved by them.
+		void update();
+
+		inline const Stats &stats() const { return m_stats; }
+	};
+}
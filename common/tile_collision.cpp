@@ -0,0 +1,350 @@
+#include "tile_collision.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+using namespace Ris;
+
+// Lowest and highest set bit of a word that is not zero. Two 32 bits scans on MSVC, which has
+// no 64 bits ones on x86.
+static inline int lowestBit(Uint64 v)
+{
+#ifdef _MSC_VER
+	unsigned long i;
+	if (_BitScanForward(&i, (unsigned long)v))
+		return (int)i;
+	_BitScanForward(&i, (unsigned long)(v >> 32));
+	return (int)i + 32;
+#else
+	return __builtin_ctzll(v);
+#endif
+}
+
+static inline int highestBit(Uint64 v)
+{
+#ifdef _MSC_VER
+	unsigned long i;
+	if (_BitScanReverse(&i, (unsigned long)(v >> 32)))
+		return (int)i + 32;
+	_BitScanReverse(&i, (unsigned long)v);
+	return (int)i;
+#else
+	return 63 - __builtin_clzll(v);
+#endif
+}
+
+// First set bit in [from, to] of a line of length bits, to + 1 if none. Past both ends of the
+// line every bit is set.
+static int firstSet(const Uint64 *line, int length, int from, int to)
+{
+	if (from < 0)
+		return from;
+	int last = (to < length) ? to : length - 1;
+	if (from <= last)
+	{
+		int w0 = from >> 6;
+		int w1 = last >> 6;
+		for (int w = w0; w <= w1; ++w)
+		{
+			Uint64 word = line[w];
+			if (w == w0)
+				word &= ~(Uint64)0 << (from & 63);
+			if (w == w1)
+				word &= ~(Uint64)0 >> (63 - (last & 63));
+			if (word)
+				return (w << 6) + lowestBit(word);
+		}
+	}
+	if (to >= length)
+		return (from > length) ? from : length;
+	return to + 1;
+}
+
+// Last set bit in [from, to], from - 1 if none.
+static int lastSet(const Uint64 *line, int length, int from, int to)
+{
+	if (to >= length)
+		return to;
+	int first = (from > 0) ? from : 0;
+	if (first <= to)
+	{
+		int w0 = first >> 6;
+		int w1 = to >> 6;
+		for (int w = w1; w >= w0; --w)
+		{
+			Uint64 word = line[w];
+			if (w == w0)
+				word &= ~(Uint64)0 << (first & 63);
+			if (w == w1)
+				word &= ~(Uint64)0 >> (63 - (to & 63));
+			if (word)
+				return (w << 6) + highestBit(word);
+		}
+	}
+	if (from < 0)
+		return (to < -1) ? to : -1;
+	return from - 1;
+}
+
+TileCollision::TileCollision(float tileSize) :
+	m_width(0),
+	m_height(0),
+	m_rowStride(0),
+	m_colStride(0),
+	m_tileSize((tileSize > 0.0f) ? tileSize : 1.0f)
+{
+	m_invTileSize = 1.0f / m_tileSize;
+}
+
+void TileCollision::build(const WalkGrid &grid)
+{
+	m_width = grid.width();
+	m_height = grid.height();
+	m_rowStride = (m_width + 63) >> 6;
+	m_colStride = (m_height + 63) >> 6;
+	m_rows.assign((size_t)m_rowStride * m_height, 0);
+	m_cols.assign((size_t)m_colStride * m_width, 0);
+	for (int y = 0; y < m_height; ++y)
+	{
+		const Uint64 *walkable = grid.row(y);
+		for (int w = 0; w < m_rowStride; ++w)
+		{
+			Uint64 solid = ~walkable[w];
+			// Bits past the last column stay clear, as on WalkGrid.
+			if ((w == m_rowStride - 1) && (m_width & 63))
+				solid &= ((Uint64)1 << (m_width & 63)) - 1;
+			m_rows[y * m_rowStride + w] = solid;
+			while (solid)
+			{
+				int x = (w << 6) + lowestBit(solid);
+				solid &= solid - 1;
+				m_cols[x * m_colStride + (y >> 6)] |= (Uint64)1 << (y & 63);
+			}
+		}
+	}
+}
+
+void TileCollision::setSolid(int x, int y, bool solid)
+{
+	if (((unsigned)x >= (unsigned)m_width) || ((unsigned)y >= (unsigned)m_height))
+		return;
+	Uint64 &row = m_rows[y * m_rowStride + (x >> 6)];
+	Uint64 &col = m_cols[x * m_colStride + (y >> 6)];
+	Uint64 rowBit = (Uint64)1 << (x & 63);
+	Uint64 colBit = (Uint64)1 << (y & 63);
+	row = solid ? (row | rowBit) : (row & ~rowBit);
+	col = solid ? (col | colBit) : (col & ~colBit);
+}
+
+int TileCollision::firstSolidColumn(int r0, int r1, int from, int to) const
+{
+	if ((r0 < 0) || (r1 >= m_height))
+		return from;
+	int best = to + 1;
+	for (int r = r0; (r <= r1) && (best > from); ++r)
+	{
+		int c = firstSet(&m_rows[r * m_rowStride], m_width, from, (best <= to) ? best - 1 : to);
+		best = (c < best) ? c : best;
+	}
+	return best;
+}
+
+int TileCollision::lastSolidColumn(int r0, int r1, int from, int to) const
+{
+	if ((r0 < 0) || (r1 >= m_height))
+		return to;
+	int best = from - 1;
+	for (int r = r0; (r <= r1) && (best < to); ++r)
+	{
+		int c = lastSet(&m_rows[r * m_rowStride], m_width, (best >= from) ? best + 1 : from, to);
+		best = (c > best) ? c : best;
+	}
+	return best;
+}
+
+int TileCollision::firstSolidRow(int c0, int c1, int from, int to) const
+{
+	if ((c0 < 0) || (c1 >= m_width))
+		return from;
+	int best = to + 1;
+	for (int c = c0; (c <= c1) && (best > from); ++c)
+	{
+		int r = firstSet(&m_cols[c * m_colStride], m_height, from, (best <= to) ? best - 1 : to);
+		best = (r < best) ? r : best;
+	}
+	return best;
+}
+
+int TileCollision::lastSolidRow(int c0, int c1, int from, int to) const
+{
+	if ((c0 < 0) || (c1 >= m_width))
+		return to;
+	int best = from - 1;
+	for (int c = c0; (c <= c1) && (best < to); ++c)
+	{
+		int r = lastSet(&m_cols[c * m_colStride], m_height, (best >= from) ? best + 1 : from, to);
+		best = (r > best) ? r : best;
+	}
+	return best;
+}
+
+bool TileCollision::overlaps(float x, float y, float w, float h) const
+{
+	int c0 = firstTile(x);
+	int c1 = lastTile(x + w);
+	int r0 = firstTile(y);
+	int r1 = lastTile(y + h);
+	return (c0 <= c1) && (r0 <= r1) && (firstSolidColumn(r0, r1, c0, c1) <= c1);
+}
+
+Uint8 TileCollision::move(float &x, float &y, float w, float h, float dx, float dy) const
+{
+	Uint8 hits = HitNone;
+	// Columns between leading edge and where it goes, on the rows the box is on.
+	if (dx != 0.0f)
+	{
+		int r0 = firstTile(y);
+		int r1 = lastTile(y + h);
+		if (dx > 0.0f)
+		{
+			int from = lastTile(x + w) + 1;
+			int to = lastTile(x + w + dx);
+			int c = ((from <= to) && (r0 <= r1)) ? firstSolidColumn(r0, r1, from, to) : to + 1;
+			if (c <= to)
+			{
+				float stop = (float)c * m_tileSize - w;
+				x = (stop > x) ? stop : x;
+				hits |= HitRight;
+			}
+			else
+				x += dx;
+		}
+		else
+		{
+			int from = firstTile(x + dx);
+			int to = firstTile(x) - 1;
+			int c = ((from <= to) && (r0 <= r1)) ? lastSolidColumn(r0, r1, from, to) : from - 1;
+			if (c >= from)
+			{
+				float stop = (float)(c + 1) * m_tileSize;
+				x = (stop < x) ? stop : x;
+				hits |= HitLeft;
+			}
+			else
+				x += dx;
+		}
+	}
+	// Then rows, on the columns the box ended on.
+	if (dy != 0.0f)
+	{
+		int c0 = firstTile(x);
+		int c1 = lastTile(x + w);
+		if (dy > 0.0f)
+		{
+			int from = lastTile(y + h) + 1;
+			int to = lastTile(y + h + dy);
+			int r = ((from <= to) && (c0 <= c1)) ? firstSolidRow(c0, c1, from, to) : to + 1;
+			if (r <= to)
+			{
+				float stop = (float)r * m_tileSize - h;
+				y = (stop > y) ? stop : y;
+				hits |= HitBottom;
+			}
+			else
+				y += dy;
+		}
+		else
+		{
+			int from = firstTile(y + dy);
+			int to = firstTile(y) - 1;
+			int r = ((from <= to) && (c0 <= c1)) ? lastSolidRow(c0, c1, from, to) : from - 1;
+			if (r >= from)
+			{
+				float stop = (float)(r + 1) * m_tileSize;
+				y = (stop < y) ? stop : y;
+				hits |= HitTop;
+			}
+			else
+				y += dy;
+		}
+	}
+	return hits;
+}
+
+void TileCollision::moveAll(float *x, float *y, const float *w, const float *h, const float *dx, const float *dy, Uint8 *hits,
+	Uint32 begin, Uint32 end) const
+{
+	for (Uint32 i = begin; i < end; ++i)
+	{
+		Uint8 hit = move(x[i], y[i], w[i], h[i], dx[i], dy[i]);
+		if (hits != nullptr)
+			hits[i] = hit;
+	}
+}
+
+bool TileCollision::sweep(float x, float y, float w, float h, float dx, float dy, SweepHit &hit) const
+{
+	int stepX = (dx > 0.0f) ? 1 : ((dx < 0.0f) ? -1 : 0);
+	int stepY = (dy > 0.0f) ? 1 : ((dy < 0.0f) ? -1 : 0);
+	// Tiles of leading edges, and times they get to the next ones. Moves that never do are past 1.
+	int col = (stepX > 0) ? lastTile(x + w) : firstTile(x);
+	int row = (stepY > 0) ? lastTile(y + h) : firstTile(y);
+	float nextX = 2.0f;
+	float nextY = 2.0f;
+	float deltaX = 0.0f;
+	float deltaY = 0.0f;
+	if (stepX != 0)
+	{
+		float border = (stepX > 0) ? (float)(col + 1) * m_tileSize - (x + w) : (float)col * m_tileSize - x;
+		nextX = (border / dx > 0.0f) ? border / dx : 0.0f;
+		deltaX = m_tileSize / fabsf(dx);
+	}
+	if (stepY != 0)
+	{
+		float border = (stepY > 0) ? (float)(row + 1) * m_tileSize - (y + h) : (float)row * m_tileSize - y;
+		nextY = (border / dy > 0.0f) ? border / dy : 0.0f;
+		deltaY = m_tileSize / fabsf(dy);
+	}
+	// Borders crossed in time order. Each new column is checked on the rows the box spans then,
+	// each new row on the columns. Leading tiles are the ones crossed so far, not rounded from
+	// position: a corner crossed on both ways at about the same time is not missed.
+	while ((nextX <= 1.0f) || (nextY <= 1.0f))
+	{
+		if (nextX <= nextY)
+		{
+			col += stepX;
+			int r0 = (stepY < 0) ? row : firstTile(y + dy * nextX);
+			int r1 = (stepY > 0) ? row : lastTile(y + h + dy * nextX);
+			int r = (r0 <= r1) ? firstSolidRow(col, col, r0, r1) : r1 + 1;
+			if (r <= r1)
+			{
+				hit.time = nextX;
+				hit.normalX = -stepX;
+				hit.normalY = 0;
+				hit.tileX = col;
+				hit.tileY = r;
+				return true;
+			}
+			nextX += deltaX;
+		}
+		else
+		{
+			row += stepY;
+			int c0 = (stepX < 0) ? col : firstTile(x + dx * nextY);
+			int c1 = (stepX > 0) ? col : lastTile(x + w + dx * nextY);
+			int c = (c0 <= c1) ? firstSolidColumn(row, row, c0, c1) : c1 + 1;
+			if (c <= c1)
+			{
+				hit.time = nextY;
+				hit.normalX = 0;
+				hit.normalY = -stepY;
+				hit.tileX = c;
+				hit.tileY = row;
+				return true;
+			}
+			nextY += deltaY;
+		}
+	}
+	return false;
+}
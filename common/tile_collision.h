@@ -0,0 +1,88 @@
+#pragma once
+
+#include <vector>
+#include <math.h>
+
+#include "SDL_stdinc.h"
+
+#include "common/walk_grid.h"
+
+namespace Ris
+{
+	// Solid tiles of a map as packed bits, for moving boxes (AABBs) in pixels against them.
+	// Bits are kept twice: by row (bit x of row y) and by column (bit y of column x), so a box
+	// moving either way only scans the rows or columns it spans, a 64 tiles word at a time.
+	// Anything outside the map is solid. Nothing is allocated once built.
+	class TileCollision
+	{
+	public:
+		// Sides of the box that hit something.
+		enum Hit
+		{
+			HitNone = 0,
+			HitLeft = 1,
+			HitRight = 2,
+			HitTop = 4,
+			HitBottom = 8
+		};
+		struct SweepHit
+		{
+			// Part of the move done before touching, in [0, 1].
+			float time;
+			// Side of the tile that was hit, facing the box.
+			int normalX;
+			int normalY;
+			int tileX;
+			int tileY;
+		};
+
+	private:
+		int m_width;
+		int m_height;
+		// Words per row, and per column.
+		int m_rowStride;
+		int m_colStride;
+		std::vector<Uint64> m_rows;
+		std::vector<Uint64> m_cols;
+		float m_tileSize;
+		float m_invTileSize;
+
+		// Tiles under box edges. An edge right on a tile border, give or take rounding, is not on
+		// the tile past it: a box stopped against a wall is not on the wall.
+		inline int firstTile(float v) const { return (int)floorf(v * m_invTileSize + 0.001f); }
+		inline int lastTile(float v) const { return (int)floorf(v * m_invTileSize - 0.001f); }
+		// First (or last) solid column in [from, to] on rows r0 to r1, to + 1 (or from - 1) if none.
+		// Rows versions are the same on columns c0 to c1.
+		int firstSolidColumn(int r0, int r1, int from, int to) const;
+		int lastSolidColumn(int r0, int r1, int from, int to) const;
+		int firstSolidRow(int c0, int c1, int from, int to) const;
+		int lastSolidRow(int c0, int c1, int from, int to) const;
+
+	public:
+		TileCollision(float tileSize = 32.0f);
+
+		// Blocked tiles of grid are solid.
+		void build(const WalkGrid &grid);
+		void setSolid(int x, int y, bool solid);
+		inline bool solid(int x, int y) const
+		{
+			return ((unsigned)x >= (unsigned)m_width) || ((unsigned)y >= (unsigned)m_height) ||
+				((m_rows[y * m_rowStride + (x >> 6)] >> (x & 63)) & 1);
+		}
+		inline int width() const { return m_width; }
+		inline int height() const { return m_height; }
+		inline float tileSize() const { return m_tileSize; }
+
+		// True if box x, y, w, h is on any solid tile.
+		bool overlaps(float x, float y, float w, float h) const;
+		// Moves box by dx, then by dy, stopping against solid tiles and sliding along them.
+		// Every tile between start and end is checked, however fast the box goes. Returns Hit flags.
+		Uint8 move(float &x, float &y, float w, float h, float dx, float dy) const;
+		// Same for boxes [begin, end) of SoA arrays. hits can be nullptr. Ranges can be done in parallel.
+		void moveAll(float *x, float *y, const float *w, const float *h, const float *dx, const float *dy, Uint8 *hits,
+			Uint32 begin, Uint32 end) const;
+		// First solid tile box touches moving along dx, dy at once, for projectiles.
+		// Returns false if the whole move is free.
+		bool sweep(float x, float y, float w, float h, float dx, float dy, SweepHit &hit) const;
+	};
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "SDL_atomic.h"
+
+namespace Ris
+{
+	// Lock-free single writer, single reader triple buffer.
+	// Writer fills writeBuffer() and publishes it. Reader takes the last published one
+	// with update() and reads it while writer keeps going with the other two.
+	// Neither side ever waits for the other one.
+	template <typename T>
+	class TripleBuffer
+	{
+		enum
+		{
+			IndexMask = 0x3,
+			NewData = 0x4
+		};
+		T m_buffers[3];
+		int m_write;			// Owned by writer.
+		int m_read;				// Owned by reader.
+		SDL_atomic_t m_middle;	// Buffer index exchanged between both, plus NewData flag.
+
+	public:
+		TripleBuffer() : m_write(0), m_read(1)
+		{
+			SDL_AtomicSet(&m_middle, 2);
+		}
+
+		// Writer side.
+		inline T &writeBuffer() { return m_buffers[m_write]; }
+		inline void publish()
+		{
+			m_write = SDL_AtomicSet(&m_middle, m_write | NewData) & IndexMask;
+		}
+
+		// Reader side. Returns true if a newly published buffer was taken.
+		inline bool update()
+		{
+			if (!(SDL_AtomicGet(&m_middle) & NewData))
+				return false;
+			m_read = SDL_AtomicSet(&m_middle, m_read) & IndexMask;
+			return true;
+		}
+		inline const T &readBuffer() const { return m_buffers[m_read]; }
+	};
+}
@@ -0,0 +1,82 @@
+#include "walk_grid.h"
+
+#include <fstream>
+
+#include "common/logging.h"
+
+using namespace Ris;
+
+WalkGrid::WalkGrid() :
+	m_width(0),
+	m_height(0),
+	m_stride(0)
+{ }
+
+WalkGrid::WalkGrid(int width, int height, bool walkable) :
+	m_width(0),
+	m_height(0),
+	m_stride(0)
+{
+	resize(width, height, walkable);
+}
+
+void WalkGrid::resize(int width, int height, bool walkable)
+{
+	m_width = width;
+	m_height = height;
+	m_stride = (width + 63) >> 6;
+	m_bits.assign((size_t)m_stride * height, walkable ? ~(Uint64)0 : 0);
+	// Bits past the last column stay clear, so rows can be scanned word by word.
+	if (walkable && (width & 63))
+	{
+		Uint64 mask = ((Uint64)1 << (width & 63)) - 1;
+		for (int y = 0; y < height; ++y)
+			m_bits[y * m_stride + m_stride - 1] &= mask;
+	}
+}
+
+bool WalkGrid::load(const String &fname)
+{
+	std::ifstream file(fname.c_str());
+	if (!file.is_open())
+	{
+		g_log.logErr("Unable to open walk map " + fname);
+		return false;
+	}
+	std::vector<std::string> lines;
+	std::string line;
+	size_t width = 0;
+	while (std::getline(file, line))
+	{
+		if (!line.empty() && (line[line.size() - 1] == '\r'))
+			line.resize(line.size() - 1);
+		width = (line.size() > width) ? line.size() : width;
+		lines.push_back(line);
+	}
+	if ((width == 0) || lines.empty())
+	{
+		g_log.logErr("Walk map " + fname + " is empty.");
+		return false;
+	}
+	resize((int)width, (int)lines.size(), false);
+	for (int y = 0; y < m_height; ++y)
+	{
+		const std::string &l = lines[y];
+		for (int x = 0; x < (int)l.size(); ++x)
+			set(x, y, (l[x] == '.') || (l[x] == ' '));
+	}
+	return true;
+}
+
+void WalkGrid::fill(int x, int y, int w, int h, bool walkable)
+{
+	int x0 = (x > 0) ? x : 0;
+	int y0 = (y > 0) ? y : 0;
+	int x1 = (x + w < m_width) ? x + w : m_width;
+	int y1 = (y + h < m_height) ? y + h : m_height;
+	for (int ty = y0; ty < y1; ++ty)
+	{
+		for (int tx = x0; tx < x1; ++tx)
+			set(tx, ty, walkable);
+	}
+}
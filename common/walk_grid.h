@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vector>
+
+#include "SDL_stdinc.h"
+
+#include "common/string.h"
+
+namespace Ris
+{
+	struct GridPoint
+	{
+		int x;
+		int y;
+	};
+
+	// Which tiles of a map can be walked, one bit per tile. Rows start on a word, so a row
+	// of 64 tiles is one Uint64 and a 1024 x 1024 map takes 128 KB.
+	// Anything outside the map is blocked.
+	class WalkGrid
+	{
+		int m_width;
+		int m_height;
+		// Words per row.
+		int m_stride;
+		std::vector<Uint64> m_bits;
+
+	public:
+		WalkGrid();
+		WalkGrid(int width, int height, bool walkable = true);
+
+		void resize(int width, int height, bool walkable = true);
+		// Text map: one line per row, '.' and ' ' are walkable, anything else is blocked.
+		// Short lines are blocked up to the widest one.
+		bool load(const String &fname);
+
+		inline int width() const { return m_width; }
+		inline int height() const { return m_height; }
+		inline bool inside(int x, int y) const { return ((unsigned)x < (unsigned)m_width) && ((unsigned)y < (unsigned)m_height); }
+		inline bool walkable(int x, int y) const
+		{
+			return inside(x, y) && ((m_bits[y * m_stride + (x >> 6)] >> (x & 63)) & 1);
+		}
+		inline void set(int x, int y, bool walkable)
+		{
+			if (!inside(x, y))
+				return;
+			Uint64 &word = m_bits[y * m_stride + (x >> 6)];
+			Uint64 bit = (Uint64)1 << (x & 63);
+			word = walkable ? (word | bit) : (word & ~bit);
+		}
+		// Sets a whole rectangle, clipped to the map.
+		void fill(int x, int y, int w, int h, bool walkable);
+		inline const Uint64 *row(int y) const { return &m_bits[y * m_stride]; }
+		inline int stride() const { return m_stride; }
+	};
+}
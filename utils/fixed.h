@@ -0,0 +1,276 @@
+#pragma once
+
+#include <SDL_stdinc.h>
+
+#include "point.h"
+#include "rect.h"
+
+namespace Ris
+{
+	// 24.8 fixed point number. Range is +-8388608 with steps of 1/256: a map of 262144 tiles of
+	// 32 px each way, far more than any map has, while 16.16 ended at 1024 such tiles.
+	// Every operation is integer math, so results are the same bits on any compiler and CPU:
+	// a simulation on Fixed can be checked against another one by hashing its state.
+	// Floats only come in and out at the boundary, with fromFloat() and toFloat().
+	class Fixed
+	{
+		Sint32 m_raw;
+
+	public:
+		enum
+		{
+			FracBits = 8,
+			One = 1 << FracBits
+		};
+
+		inline Fixed() : m_raw(0)
+		{ }
+		inline Fixed(int v) : m_raw(v * One)
+		{ }
+		// Floats must come through fromFloat(), never by accident.
+		Fixed(float) = delete;
+		Fixed(double) = delete;
+		inline static Fixed fromRaw(Sint32 raw) { Fixed f; f.m_raw = raw; return f; }
+		// Nearest value. Exact for any float with no more than 8 fraction bits.
+		inline static Fixed fromFloat(float v) { return fromRaw((Sint32)floor((double)v * One + 0.5)); }
+		inline static Fixed fromDouble(double v) { return fromRaw((Sint32)floor(v * One + 0.5)); }
+		// a / b, as exact as it gets.
+		inline static Fixed fromRatio(int a, int b) { return fromRaw((Sint32)((Sint64)a * One / b)); }
+
+		inline Sint32 raw() const { return m_raw; }
+		inline float toFloat() const { return (float)m_raw / (float)One; }
+		inline double toDouble() const { return (double)m_raw / (double)One; }
+		// Rounded down, also for negative values.
+		inline int toInt() const { return m_raw >> FracBits; }
+
+		inline Fixed operator-() const { return fromRaw(-m_raw); }
+		inline Fixed operator+(Fixed o) const { return fromRaw(m_raw + o.m_raw); }
+		inline Fixed operator-(Fixed o) const { return fromRaw(m_raw - o.m_raw); }
+		// Rounded down. Shift of negative values is arithmetic on every compiler we build with.
+		inline Fixed operator*(Fixed o) const { return fromRaw((Sint32)(((Sint64)m_raw * o.m_raw) >> FracBits)); }
+		// Rounded towards zero. Dividing by zero is the caller's bug, as with ints.
+		inline Fixed operator/(Fixed o) const { return fromRaw((Sint32)((Sint64)m_raw * One / o.m_raw)); }
+		// By ints there is nothing to round on products.
+		inline Fixed operator*(int v) const { return fromRaw(m_raw * v); }
+		inline Fixed operator/(int v) const { return fromRaw(m_raw / v); }
+		Fixed operator*(float) const = delete;
+		Fixed operator/(float) const = delete;
+
+		inline Fixed &operator+=(Fixed o) { m_raw += o.m_raw; return *this; }
+		inline Fixed &operator-=(Fixed o) { m_raw -= o.m_raw; return *this; }
+		inline Fixed &operator*=(Fixed o) { return *this = *this * o; }
+		inline Fixed &operator/=(Fixed o) { return *this = *this / o; }
+		inline Fixed &operator*=(int v) { m_raw *= v; return *this; }
+		inline Fixed &operator/=(int v) { m_raw /= v; return *this; }
+
+		inline bool operator==(Fixed o) const { return m_raw == o.m_raw; }
+		inline bool operator!=(Fixed o) const { return m_raw != o.m_raw; }
+		inline bool operator<(Fixed o) const { return m_raw < o.m_raw; }
+		inline bool operator>(Fixed o) const { return m_raw > o.m_raw; }
+		inline bool operator<=(Fixed o) const { return m_raw <= o.m_raw; }
+		inline bool operator>=(Fixed o) const { return m_raw >= o.m_raw; }
+	};
+	// Arrays of Fixed are hashed and sent as arrays of Sint32.
+	static_assert(sizeof(Fixed) == sizeof(Sint32), "Fixed must be a bare Sint32");
+
+	// Deterministic counterparts of the Math and <cmath> functions used on simulation.
+	// Math::min, max and limit work on Fixed as they are.
+	class FixedMath
+	{
+		// Angles on sin() polynomial have 30 fraction bits, so rounding never reaches the result.
+		enum
+		{
+			PolyBits = 30
+		};
+
+	public:
+		enum
+		{
+			// Raw values of pi, pi / 2 and 2 pi.
+			RawPi = 804,
+			RawHalfPi = 402,
+			RawTwoPi = 1608
+		};
+		inline static Fixed pi() { return Fixed::fromRaw(RawPi); }
+
+		inline static Fixed abs(Fixed v) { return (v.raw() < 0) ? -v : v; }
+		inline static Fixed floor(Fixed v) { return Fixed::fromRaw(v.raw() & ~(Sint32)(Fixed::One - 1)); }
+		inline static Fixed ceil(Fixed v) { return floor(v + Fixed::fromRaw(Fixed::One - 1)); }
+
+		// Integer square root, rounded down.
+		inline static Uint32 isqrt(Uint64 v)
+		{
+			Uint64 result = 0;
+			Uint64 bit = (Uint64)1 << 62;
+			while (bit > v)
+				bit >>= 2;
+			while (bit != 0)
+			{
+				if (v >= result + bit)
+				{
+					v -= result + bit;
+					result = (result >> 1) + bit;
+				}
+				else
+					result >>= 1;
+				bit >>= 2;
+			}
+			return (Uint32)result;
+		}
+		// 0 for negative values.
+		inline static Fixed sqrt(Fixed v)
+		{
+			if (v.raw() <= 0)
+				return Fixed();
+			return Fixed::fromRaw((Sint32)isqrt((Uint64)v.raw() << Fixed::FracBits));
+		}
+		// sqrt(x * x + y * y), on 64 bits so that it does not overflow where squares would.
+		inline static Fixed hypot(Fixed x, Fixed y)
+		{
+			Uint64 sum = (Uint64)((Sint64)x.raw() * x.raw()) + (Uint64)((Sint64)y.raw() * y.raw());
+			return Fixed::fromRaw((Sint32)isqrt(sum));
+		}
+
+		// Radians. Error is below one step on [-pi, pi], and grows a little with each turn
+		// farther, as 2 pi is rounded to 8 fraction bits too.
+		static Fixed sin(Fixed angle)
+		{
+			// Down to [-pi / 2, pi / 2], where sin is odd and the series converges fast.
+			Sint32 a = angle.raw() % RawTwoPi;
+			if (a < -RawPi)
+				a += RawTwoPi;
+			else if (a > RawPi)
+				a -= RawTwoPi;
+			if (a > RawHalfPi)
+				a = RawPi - a;
+			else if (a < -RawHalfPi)
+				a = -RawPi - a;
+			// Taylor series to the 13th power on Horner form: x (1 - x^2/6 (1 - x^2/20 (1 - ...))).
+			static const int divisors[6] = { 156, 110, 72, 42, 20, 6 };
+			const Sint64 one = (Sint64)1 << PolyBits;
+			Sint64 x = (Sint64)a << (PolyBits - Fixed::FracBits);
+			Sint64 x2 = (x * x) >> PolyBits;
+			Sint64 t = one;
+			for (int i = 0; i < 6; ++i)
+				t = one - ((x2 * t) >> PolyBits) / divisors[i];
+			Sint64 s = (x * t) >> PolyBits;
+			const int shift = PolyBits - Fixed::FracBits;
+			return Fixed::fromRaw((Sint32)((s + ((Sint64)1 << (shift - 1))) >> shift));
+		}
+		inline static Fixed cos(Fixed angle) { return sin(angle + Fixed::fromRaw(RawHalfPi)); }
+
+		inline static Fixed toRadians(Fixed degrees) { return degrees * pi() / 180; }
+		inline static Fixed toDegrees(Fixed radians) { return radians * 180 / pi(); }
+	};
+
+	// Point2D on Fixed, for simulation. toPoint2D() gives the float one to render.
+	class FixedPoint2D
+	{
+	public:
+		Fixed x;
+		Fixed y;
+
+		inline FixedPoint2D()
+		{ }
+		inline FixedPoint2D(Fixed X, Fixed Y) : x(X), y(Y)
+		{ }
+		inline FixedPoint2D(int X, int Y) : x(X), y(Y)
+		{ }
+		inline static FixedPoint2D fromPoint2D(const Point2D &p) { return FixedPoint2D(Fixed::fromFloat(p.x), Fixed::fromFloat(p.y)); }
+		inline Point2D toPoint2D() const { return Point2D(x.toFloat(), y.toFloat()); }
+
+		inline FixedPoint2D &set(Fixed X, Fixed Y) { x = X; y = Y; return *this; }
+
+		inline FixedPoint2D &operator+=(const FixedPoint2D &p) { x += p.x; y += p.y; return *this; }
+		inline FixedPoint2D &operator-=(const FixedPoint2D &p) { x -= p.x; y -= p.y; return *this; }
+		inline FixedPoint2D operator+(const FixedPoint2D &p) const { return FixedPoint2D(x + p.x, y + p.y); }
+		inline FixedPoint2D operator-(const FixedPoint2D &p) const { return FixedPoint2D(x - p.x, y - p.y); }
+		inline FixedPoint2D operator-() const { return FixedPoint2D(-x, -y); }
+
+		// operators with scalars, Fixed or int
+		template <typename T>
+		inline FixedPoint2D &operator*=(const T &scalar) { x *= scalar; y *= scalar; return *this; }
+		template <typename T>
+		inline FixedPoint2D &operator/=(const T &scalar) { x /= scalar; y /= scalar; return *this; }
+		template <typename T>
+		inline FixedPoint2D operator*(const T &scalar) const { return FixedPoint2D(x * scalar, y * scalar); }
+		template <typename T>
+		inline FixedPoint2D operator/(const T &scalar) const { return FixedPoint2D(x / scalar, y / scalar); }
+
+		inline bool operator==(const FixedPoint2D &p) const { return (x == p.x && y == p.y); }
+		inline bool operator!=(const FixedPoint2D &p) const { return !(*this == p); }
+
+		inline FixedPoint2D &limit(const FixedPoint2D &min, const FixedPoint2D &max)
+		{
+			x = Math::limit(min.x, max.x, x);
+			y = Math::limit(min.y, max.y, y);
+			return *this;
+		}
+		inline Fixed getLength() const { return FixedMath::hypot(x, y); }
+		inline Fixed getDistance(const FixedPoint2D &p) const { return FixedMath::hypot(x - p.x, y - p.y); }
+		inline FixedPoint2D &fromRadians(Fixed radians, Fixed length = Fixed(1))
+		{
+			x = FixedMath::cos(radians) * length;
+			y = FixedMath::sin(radians) * length;
+			return *this;
+		}
+		inline FixedPoint2D &fromDegrees(Fixed angle, Fixed length = Fixed(1))
+		{
+			return fromRadians(FixedMath::toRadians(angle), length);
+		}
+	};
+
+	// Rect on Fixed: origin and size. Right and bottom edges are outside.
+	class FixedRect
+	{
+		FixedPoint2D m_point;
+		Fixed m_w;
+		Fixed m_h;
+
+	public:
+		inline FixedRect()
+		{ }
+		inline FixedRect(Fixed x, Fixed y, Fixed w, Fixed h) : m_point(x, y), m_w(w), m_h(h)
+		{ }
+		inline FixedRect(const FixedPoint2D &p, Fixed w, Fixed h) : m_point(p), m_w(w), m_h(h)
+		{ }
+		inline Rect toRect() const { return Rect(m_point.x.toFloat(), m_point.y.toFloat(), m_w.toFloat(), m_h.toFloat()); }
+
+		inline FixedPoint2D &origin() { return m_point; }
+		inline const FixedPoint2D &origin() const { return m_point; }
+		inline Fixed width() const { return m_w; }
+		inline Fixed height() const { return m_h; }
+		inline Fixed left() const { return m_point.x; }
+		inline Fixed top() const { return m_point.y; }
+		inline Fixed right() const { return m_point.x + m_w; }
+		inline Fixed bottom() const { return m_point.y + m_h; }
+		inline void set(Fixed x, Fixed y, Fixed w, Fixed h) { m_point.set(x, y); m_w = w; m_h = h; }
+
+		inline bool isEmpty() const { return (m_w <= Fixed()) || (m_h <= Fixed()); }
+		inline bool contains(const FixedPoint2D &p) const
+		{
+			return (p.x >= left()) && (p.x < right()) && (p.y >= top()) && (p.y < bottom());
+		}
+		inline bool intersects(const FixedRect &o) const
+		{
+			return !isEmpty() && !o.isEmpty() && (o.left() < right()) && (left() < o.right()) &&
+				(o.top() < bottom()) && (top() < o.bottom());
+		}
+		// Returns false, and leaves result alone, if they do not intersect.
+		inline bool intersect(const FixedRect &o, FixedRect &result) const
+		{
+			if (!intersects(o))
+				return false;
+			Fixed l = Math::max(left(), o.left());
+			Fixed t = Math::max(top(), o.top());
+			result.set(l, t, Math::min(right(), o.right()) - l, Math::min(bottom(), o.bottom()) - t);
+			return true;
+		}
+		inline FixedRect unionRect(const FixedRect &o) const
+		{
+			Fixed l = Math::min(left(), o.left());
+			Fixed t = Math::min(top(), o.top());
+			return FixedRect(l, t, Math::max(right(), o.right()) - l, Math::max(bottom(), o.bottom()) - t);
+		}
+	};
+}